@@ -26,15 +26,478 @@
 #include <calf/giface.h>
 #include <calf/analyzer.h>
 #include <calf/modules_dev.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <calf/utils.h>
+#include <pthread.h>
+#include <semaphore.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 using namespace dsp;
 using namespace calf_plugins;
 
-#define sinc(x) (!x) ? 1 : sin(M_PI * x)/(M_PI * x);
 #define RGBAtoINT(r, g, b, a) ((uint32_t)(r * 255) << 24) + ((uint32_t)(g * 255) << 16) + ((uint32_t)(b * 255) << 8) + (uint32_t)(a * 255)
 
+/// FFTW plans shared by all the analyzers in the process.
+/// Each size is planned the first time an analyzer worker thread needs it, and
+/// the plan is then reused by all the analyzers, so switching accuracy back or
+/// opening another analyzer doesn't need to run the FFTW planner. The plans are
+/// measured rather than estimated, and the measurements are stored as FFTW
+/// wisdom in the user's cache directory, so they're only done once per machine.
+class analyzer_fft_plans
+{
+public:
+    enum { min_order = 7, max_order = 15 };
+    
+    static analyzer_fft_plans &get();
+    /// Return the plan for a real to halfcomplex transform of a given size (NULL if not supported),
+    /// creating it if necessary. Plans can be executed from any thread, on any buffers allocated
+    /// with fftwf_malloc. Not real-time safe (may run the planner).
+    fftwf_plan get_plan(int size);
+private:
+    fftwf_plan plans[max_order - min_order + 1];
+    std::string wisdom_path;
+    /// The FFTW planner is not thread-safe
+    calf_utils::ptmutex mutex;
+    
+    analyzer_fft_plans();
+    bool save_wisdom();
+};
+
+analyzer_fft_plans &analyzer_fft_plans::get()
+{
+    // never destroyed, as the analyzers may outlive static destructors
+    static analyzer_fft_plans *instance = new analyzer_fft_plans;
+    return *instance;
+}
+
+analyzer_fft_plans::analyzer_fft_plans()
+{
+    for (int i = min_order; i <= max_order; i++)
+        plans[i - min_order] = NULL;
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && *xdg)
+        wisdom_path = std::string(xdg) + "/calf/fftwf-wisdom";
+    else if (home && *home)
+        wisdom_path = std::string(home) + "/.cache/calf/fftwf-wisdom";
+    if (!wisdom_path.empty())
+        fftwf_import_wisdom_from_filename(wisdom_path.c_str());
+}
+
+fftwf_plan analyzer_fft_plans::get_plan(int size)
+{
+    int order = min_order;
+    while(order <= max_order && size != (1 << order))
+        order++;
+    if (order > max_order)
+        return NULL;
+    calf_utils::ptlock lock(mutex);
+    fftwf_plan &plan = plans[order - min_order];
+    if (plan)
+        return plan;
+    // aligned the same way as the buffers passed to fftwf_execute_r2r later;
+    // measuring overwrites the arrays, so they're only used for planning
+    float *in = (float *)fftwf_malloc(size * sizeof(float));
+    float *out = (float *)fftwf_malloc(size * sizeof(float));
+    // sizes in the wisdom are planned right away, the others are measured
+    plan = fftwf_plan_r2r_1d(size, in, out, FFTW_R2HC, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    if (!plan)
+    {
+        plan = fftwf_plan_r2r_1d(size, in, out, FFTW_R2HC, FFTW_MEASURE);
+        if (plan && !wisdom_path.empty() && !save_wisdom())
+            fprintf(stderr, "Cannot save FFTW wisdom to %s\n", wisdom_path.c_str());
+    }
+    fftwf_free(out);
+    fftwf_free(in);
+    return plan;
+}
+
+bool analyzer_fft_plans::save_wisdom()
+{
+    std::string dir = wisdom_path.substr(0, wisdom_path.rfind('/'));
+    std::string parent = dir.substr(0, dir.rfind('/'));
+    if ((mkdir(parent.c_str(), 0755) && errno != EEXIST) || (mkdir(dir.c_str(), 0755) && errno != EEXIST))
+        return false;
+    // write a temporary file and rename it, in case another process is doing the same
+    char suffix[32];
+    sprintf(suffix, ".%d.tmp", (int)getpid());
+    std::string temp_path = wisdom_path + suffix;
+    if (!fftwf_export_wisdom_to_filename(temp_path.c_str()) || rename(temp_path.c_str(), wisdom_path.c_str()))
+    {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Magnitudes of a halfcomplex spectrum of len (a power of 2) values. The
+/// upper half of dst mirrors the lower half, so that all len values are usable.
+static void halfcomplex_magnitudes(const float *src, float *dst, int len)
+{
+    int half = len >> 1, k = 1;
+    dst[0] = fabs(src[0]);
+    dst[half] = fabs(src[half]);
+#if defined(__SSE__)
+    for (; k + 4 <= half; k += 4)
+    {
+        // imaginary parts are stored backwards, starting from the end of the array
+        __m128 re = _mm_loadu_ps(src + k);
+        __m128 im = _mm_loadu_ps(src + len - k - 3);
+        im = _mm_shuffle_ps(im, im, _MM_SHUFFLE(0, 1, 2, 3));
+        __m128 mag = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)));
+        _mm_storeu_ps(dst + k, mag);
+        _mm_storeu_ps(dst + len - k - 3, _mm_shuffle_ps(mag, mag, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+#endif
+    for (; k < half; k++)
+        dst[k] = dst[len - k] = sqrtf(src[k] * src[k] + src[len - k] * src[len - k]);
+}
+
+/// hold[i] = max(hold[i], |src[i]|)
+static void update_hold(float *hold, const float *src, int len)
+{
+    int i = 0;
+#if defined(__SSE__)
+    const __m128 sign_mask = _mm_set1_ps(-0.f);
+    for (; i + 4 <= len; i += 4)
+        _mm_storeu_ps(hold + i, _mm_max_ps(_mm_loadu_ps(hold + i), _mm_andnot_ps(sign_mask, _mm_loadu_ps(src + i))));
+#endif
+    for (; i < len; i++)
+        hold[i] = std::max(hold[i], fabsf(src[i]));
+}
+
+/// Falling: restart the fall (delta = 1) of all the values exceeded by |src[i]|
+static void update_falling(float *smooth, float *delta, const float *src, int len)
+{
+    int i = 0;
+#if defined(__SSE__)
+    const __m128 sign_mask = _mm_set1_ps(-0.f);
+    const __m128 one = _mm_set1_ps(1.f);
+    for (; i + 4 <= len; i += 4)
+    {
+        __m128 val = _mm_andnot_ps(sign_mask, _mm_loadu_ps(src + i));
+        __m128 sm = _mm_loadu_ps(smooth + i);
+        __m128 rise = _mm_cmplt_ps(sm, val);
+        _mm_storeu_ps(smooth + i, _mm_or_ps(_mm_and_ps(rise, val), _mm_andnot_ps(rise, sm)));
+        __m128 dl = _mm_loadu_ps(delta + i);
+        _mm_storeu_ps(delta + i, _mm_or_ps(_mm_and_ps(rise, one), _mm_andnot_ps(rise, dl)));
+    }
+#endif
+    for (; i < len; i++)
+    {
+        float val = fabsf(src[i]);
+        if (smooth[i] < val)
+        {
+            smooth[i] = val;
+            delta[i] = 1.f;
+        }
+    }
+}
+
+namespace calf_plugins {
+
+/// Parameters of a single analysis frame
+struct analyzer_job
+{
+    int accuracy, windowing, mode;
+};
+
+/// Result of a single analysis frame: magnitudes of job.accuracy bins per channel
+struct analyzer_snapshot
+{
+    analyzer_job job;
+    /// False if the frame couldn't be captured
+    bool valid;
+    float *magL, *magR;
+};
+
+/// Background thread doing the windowing and FFT for one analyzer. The GUI
+/// thread requests one frame at a time; results are written into alternate
+/// snapshots, so that the GUI thread can copy the previous result while the
+/// next one is being calculated.
+class analyzer_worker
+{
+    const float *ring;
+    const volatile uint32_t *ring_pos;
+    /// FFT input (both channels) and output, allocated with fftwf_malloc
+    float *fft_in[2], *fft_out;
+    /// Window for the current accuracy and windowing mode; the base window is
+    /// applied to the second channel in the single channel modes
+    std::vector<float> window, window_base;
+    int window_size, window_type;
+    analyzer_snapshot snapshots[2];
+    
+    pthread_t thread;
+    bool thread_started, thread_running;
+    sem_t wakeup;
+    volatile bool quit;
+    /// Request being processed by the thread; job_seq is changed by the GUI
+    /// thread, done_seq by the worker when the request is finished
+    analyzer_job job;
+    int job_seq;
+    volatile int done_seq;
+    bool job_pending;
+    
+    void start_thread();
+    void update_window(int size, int type);
+    bool compute(const analyzer_job &j, analyzer_snapshot &snap);
+    static void *thread_func(void *arg);
+public:
+    analyzer_worker(const float *_ring, const volatile uint32_t *_ring_pos);
+    ~analyzer_worker();
+    /// Return the result of the previous request (NULL if not done yet) and
+    /// send a new one. GUI thread only. The result stays valid until the next
+    /// call that returns a non-NULL value.
+    const analyzer_snapshot *exchange(const analyzer_job &next);
+};
+
+analyzer_worker::analyzer_worker(const float *_ring, const volatile uint32_t *_ring_pos)
+{
+    ring = _ring;
+    ring_pos = _ring_pos;
+    fft_in[0] = (float *)fftwf_malloc(analyzer::max_fft_cache_size * sizeof(float));
+    fft_in[1] = (float *)fftwf_malloc(analyzer::max_fft_cache_size * sizeof(float));
+    fft_out = (float *)fftwf_malloc(analyzer::max_fft_cache_size * sizeof(float));
+    window_size = window_type = -1;
+    for (int i = 0; i < 2; i++)
+    {
+        snapshots[i].valid = false;
+        snapshots[i].magL = (float *)calloc(analyzer::max_fft_cache_size, sizeof(float));
+        snapshots[i].magR = (float *)calloc(analyzer::max_fft_cache_size, sizeof(float));
+    }
+    thread_started = thread_running = false;
+    quit = false;
+    job_seq = done_seq = 0;
+    job_pending = false;
+}
+
+analyzer_worker::~analyzer_worker()
+{
+    if (thread_running)
+    {
+        quit = true;
+        sem_post(&wakeup);
+        pthread_join(thread, NULL);
+        sem_destroy(&wakeup);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        free(snapshots[i].magR);
+        free(snapshots[i].magL);
+    }
+    fftwf_free(fft_out);
+    fftwf_free(fft_in[1]);
+    fftwf_free(fft_in[0]);
+}
+
+void analyzer_worker::start_thread()
+{
+    thread_started = true;
+    sem_init(&wakeup, 0, 0);
+    if (pthread_create(&thread, NULL, thread_func, this))
+    {
+        fprintf(stderr, "Warning: could not create an analyzer thread, doing FFT in the GUI thread\n");
+        sem_destroy(&wakeup);
+        return;
+    }
+    thread_running = true;
+}
+
+void *analyzer_worker::thread_func(void *arg)
+{
+    analyzer_worker *w = (analyzer_worker *)arg;
+    for(;;)
+    {
+        while(sem_wait(&w->wakeup) == -1 && errno == EINTR)
+            ;
+        if (w->quit)
+            break;
+        analyzer_snapshot &snap = w->snapshots[w->job_seq & 1];
+        snap.valid = w->compute(w->job, snap);
+        // the snapshot needs to be complete before the GUI thread sees done_seq
+        __sync_synchronize();
+        w->done_seq = w->job_seq;
+    }
+    return NULL;
+}
+
+const analyzer_snapshot *analyzer_worker::exchange(const analyzer_job &next)
+{
+    if (!thread_started)
+        start_thread();
+    if (!thread_running)
+    {
+        // no thread - same thing, just done right away
+        snapshots[0].valid = compute(next, snapshots[0]);
+        return snapshots[0].valid ? &snapshots[0] : NULL;
+    }
+    const analyzer_snapshot *result = NULL;
+    if (job_pending)
+    {
+        if (done_seq != job_seq)
+            return NULL;
+        __sync_synchronize();
+        job_pending = false;
+        if (snapshots[job_seq & 1].valid)
+            result = &snapshots[job_seq & 1];
+    }
+    // the next result goes into the other snapshot
+    job = next;
+    job_seq++;
+    job_pending = true;
+    sem_post(&wakeup);
+    return result;
+}
+
+void analyzer_worker::update_window(int size, int type)
+{
+    if (size == window_size && type == window_type)
+        return;
+    window.resize(size);
+    window_base.resize(size);
+    double n1 = size - 1, a0, a1, a2, a3;
+    for (int i = 0; i < size; i++)
+    {
+        // all the windows below are applied on top of the Hamming window
+        double base = 0.54 - 0.46 * cos(2 * M_PI * i / size);
+        double c1 = cos(2 * M_PI * i / n1), c2 = cos(4 * M_PI * i / n1), c3 = cos(6 * M_PI * i / n1);
+        double f, x;
+        switch(type) {
+            case 0:
+            default:
+                // Linear
+                f = 1;
+                break;
+            case 1:
+                // Hamming
+                f = 0.54 - 0.46 * c1;
+                break;
+            case 2:
+                // von Hann
+                f = 0.5 * (1 - c1);
+                break;
+            case 3:
+                // Blackman
+                f = 0.42 - 0.5 * c1 + 0.08 * c2;
+                break;
+            case 4:
+                // Blackman-Harris
+                a0 = 0.35875; a1 = 0.48829; a2 = 0.14128; a3 = 0.01168;
+                f = a0 - a1 * c1 + a2 * c2 - a3 * c3;
+                break;
+            case 5:
+                // Blackman-Nuttall
+                a0 = 0.3635819; a1 = 0.4891775; a2 = 0.1365995; a3 = 0.0106411;
+                f = a0 - a1 * c1 + a2 * c2 - a3 * c3;
+                break;
+            case 6:
+                // Sine
+                f = sin(M_PI * i / n1);
+                break;
+            case 7:
+                // Lanczos
+                x = 2 * i / n1 - 1;
+                f = x ? sin(M_PI * x) / (M_PI * x) : 1;
+                break;
+            case 8:
+                // Gauß
+                x = (i - n1 / 2) / (0.4 * n1 / 2);
+                f = exp(-0.5 * x * x);
+                break;
+            case 9:
+                // Bartlett
+                f = 1 - fabs(2 * i / n1 - 1);
+                break;
+            case 10:
+                // Triangular
+                f = 1 - fabs((i - n1 / 2) / (size / 2.0));
+                break;
+            case 11:
+                // Bartlett-Hann
+                f = 0.62 - 0.48 * fabs(i / n1 - 0.5) - 0.38 * c1;
+                break;
+        }
+        window[i] = base * f;
+        window_base[i] = base;
+    }
+    window_size = size;
+    window_type = type;
+}
+
+bool analyzer_worker::compute(const analyzer_job &j, analyzer_snapshot &snap)
+{
+    snap.job = j;
+    int size = j.accuracy;
+    fftwf_plan plan = analyzer_fft_plans::get().get_plan(size);
+    if (!plan)
+        return false;
+    update_window(size, j.windowing);
+    
+    // read the latest size frames from the ring (in up to two pieces)
+    const uint32_t mask = analyzer::capture_frames - 1;
+    uint32_t end = *ring_pos;
+    __sync_synchronize();
+    uint32_t start = end - size;
+    // the selected windowing function only applies to both channels in the
+    // stereo modes, the first channel always gets it
+    const float *winR = j.mode > 2 ? &window[0] : &window_base[0];
+    float *inL = fft_in[0], *inR = fft_in[1];
+    for (int i = 0; i < size; )
+    {
+        int pos = (start + i) & mask;
+        int run = std::min(size - i, (int)analyzer::capture_frames - pos);
+        const float *src = ring + 2 * pos;
+        for (int k = 0; k < run; k++, i++)
+        {
+            float L = src[2 * k] * window[i];
+            float R = src[2 * k + 1] * winR[i];
+            switch(j.mode) {
+                default:
+                    // left channel (mode 1)
+                    // or both channels (mode 3, 4, 5, 7, 9, 10)
+                    inL[i] = L;
+                    inR[i] = R;
+                    break;
+                case 0:
+                case 6:
+                    // average
+                    inL[i] = inR[i] = (L + R) / 2;
+                    break;
+                case 2:
+                case 8:
+                    // right channel
+                    inL[i] = R;
+                    inR[i] = L;
+                    break;
+            }
+        }
+    }
+    __sync_synchronize();
+    // the audio thread might have overwritten the start of the frame while it
+    // was being read (ring_pos may be up to 64 frames behind the audio thread)
+    if (*ring_pos - end + 64 > (uint32_t)(analyzer::capture_frames - size))
+        return false;
+    
+    fftwf_execute_r2r(plan, inL, fft_out);
+    halfcomplex_magnitudes(fft_out, snap.magL, size);
+    // the right channel is needed for stereo image and stereo difference modes
+    if (j.mode >= 3) {
+        fftwf_execute_r2r(plan, inR, fft_out);
+        halfcomplex_magnitudes(fft_out, snap.magR, size);
+    } else
+        dsp::zero(snap.magR, size);
+    return true;
+}
+
+};
+
 analyzer::analyzer() {
     _accuracy       = -1;
     _acc            = -1;
@@ -49,18 +512,17 @@ analyzer::analyzer() {
     _view           = -1;
     _windowing      = -1;
     _speed          = -1;
-    fpos            = 0;
     _draw_upper     = 0;
     sanitize        = true;
     recreate_plan   = true;
     
     spline_buffer = (int*) calloc(200, sizeof(int));
     
-    fft_buffer = (float*) calloc(max_fft_buffer_size, sizeof(float));
+    capture = (float*) calloc(capture_frames * 2, sizeof(float));
+    capture_written = 0;
+    capture_pos     = 0;
     
-    fft_inL = (float*) calloc(max_fft_cache_size, sizeof(float));
     fft_outL = (float*) calloc(max_fft_cache_size, sizeof(float));
-    fft_inR = (float*) calloc(max_fft_cache_size, sizeof(float));
     fft_outR = (float*) calloc(max_fft_cache_size, sizeof(float));
     
     fft_smoothL = (float*) calloc(max_fft_cache_size, sizeof(float));
@@ -75,12 +537,15 @@ analyzer::analyzer() {
     fft_freezeL = (float*) calloc(max_fft_cache_size, sizeof(float));
     fft_freezeR = (float*) calloc(max_fft_cache_size, sizeof(float));
     
-    fft_plan = NULL;
+    // the thread itself is only started when the graph is drawn, and it
+    // creates the FFT plans it needs
+    worker = new analyzer_worker(capture, &capture_pos);
     
     analyzer_phase_drawn = 0;
 }
 analyzer::~analyzer()
 {
+    delete worker;
     free(fft_freezeR);
     free(fft_freezeL);
     free(fft_holdR);
@@ -91,13 +556,8 @@ analyzer::~analyzer()
     free(fft_smoothL);
     free(fft_outR);
     free(fft_outL);
-    free(fft_inR);
-    free(fft_inL);
+    free(capture);
     free(spline_buffer);
-    if (fft_plan) {
-        fftwf_destroy_plan(fft_plan);
-        fft_plan = NULL;
-    }
 }
 void analyzer::set_sample_rate(uint32_t sr) {
     srate = sr;
@@ -143,27 +603,56 @@ void analyzer::set_params(float resolution, float offset, int accuracy, int hold
     }
 }
 void analyzer::process(float L, float R) {
-    fft_buffer[fpos] = L;
-    fft_buffer[fpos + 1] = R;
-    fpos += 2;
-    fpos %= (max_fft_buffer_size - 2);
+    int pos = (capture_written & (capture_frames - 1)) * 2;
+    capture[pos] = L;
+    capture[pos + 1] = R;
+    capture_written++;
+    // make the samples visible to the worker in small batches, a memory
+    // barrier per sample would be a waste
+    if (!(capture_written & 63)) {
+        __sync_synchronize();
+        capture_pos = capture_written;
+    }
+}
+
+bool analyzer::fetch_spectrum() const
+{
+    analyzer_job job;
+    job.accuracy  = _accuracy;
+    job.windowing = _windowing;
+    job.mode      = _mode;
+    const analyzer_snapshot *snap = worker->exchange(job);
+    // discard spectra calculated with settings that have changed since
+    if (!snap or snap->job.accuracy != _accuracy or snap->job.mode != _mode)
+        return false;
+    
+    // we want to remember old fft_out values for smoothing as well
+    // and we fill the hold buffer before the new values are copied
+    if(_smooth == 2) {
+        memcpy(fft_smoothL, fft_outL, _accuracy * sizeof(float));
+        memcpy(fft_smoothR, fft_outR, _accuracy * sizeof(float));
+    }
+    if(_smooth == 1) {
+        update_falling(fft_smoothL, fft_deltaL, fft_outL, _accuracy);
+        update_falling(fft_smoothR, fft_deltaR, fft_outR, _accuracy);
+    }
+    update_hold(fft_holdL, fft_outL, _accuracy);
+    update_hold(fft_holdR, fft_outR, _accuracy);
+    
+    memcpy(fft_outL, snap->magL, _accuracy * sizeof(float));
+    memcpy(fft_outR, snap->magR, _accuracy * sizeof(float));
+    return true;
 }
 
 bool analyzer::do_fft(int subindex, int points) const
 {
     if (recreate_plan) {
-        // recreate fftw plan
-        if (fft_plan) fftwf_destroy_plan (fft_plan);
-        //fft_plan = rfftw_create_plan(_accuracy, FFTW_FORWARD, 0);
-        fft_plan = fftwf_plan_r2r_1d(_accuracy, NULL, NULL, FFTW_R2HC, FFTW_ESTIMATE);
         lintrans = -1;
         recreate_plan = false;
         sanitize = true;
     }
     if (sanitize) {
         // null the overall buffer
-        dsp::zero(fft_inL,     max_fft_cache_size);
-        dsp::zero(fft_inR,     max_fft_cache_size);
         dsp::zero(fft_outL,    max_fft_cache_size);
         dsp::zero(fft_outR,    max_fft_cache_size);
         dsp::zero(fft_holdL,   max_fft_cache_size);
@@ -183,187 +672,20 @@ bool analyzer::do_fft(int subindex, int points) const
         // there's no falling for difference mode, only smoothing
         _smooth = 2;
     }
-    if(_mode > 5 and _mode < 11) {
-        // there's no smoothing for spectralizer mode
-        //_smooth = 0;
-    }
     
     if(subindex == 0) {
         // #####################################################################
-        // We are doing FFT here, so we first have to setup fft-buffers from
-        // the main buffer and we use this cycle for filling other buffers
-        // like smoothing, delta and hold
+        // The FFT itself is done by the worker, we only pick up the result
+        // and use this cycle for filling other buffers like smoothing, delta
+        // and hold
         // #####################################################################
         if(!((int)analyzer_phase_drawn % __speed)) {
-            // seems we have to do a fft, so let's read the latest data from the
-            // buffer to send it to fft afterwards
-            // we want to remember old fft_out values for smoothing as well
-            // and we fill the hold buffer in this (extra) cycle
-            for(int i = 0; i < _accuracy; i++) {
-                // go to the right position back in time according to accuracy
-                // settings and cycling in the main buffer
-                int _fpos = (fpos - _accuracy * 2 \
-                    + (i * 2)) % max_fft_buffer_size;
-                if(_fpos < 0)
-                    _fpos = max_fft_buffer_size + _fpos;
-                float L = fft_buffer[_fpos];
-                float R = fft_buffer[_fpos + 1];
-                float win = 0.54 - 0.46 * cos(2 * M_PI * i / _accuracy);
-                L *= win;
-                R *= win;
-                
-                // #######################################
-                // Do some windowing functions on the
-                // buffer
-                // #######################################
-                int _m = 2;
-                float _f = 1.f;
-                float _a, a0, a1, a2, a3;
-                switch(_windowing) {
-                    case 0:
-                    default:
-                        // Linear
-                        _f = 1.f;
-                        break;
-                    case 1:
-                        // Hamming
-                        _f = 0.54 + 0.46 * cos(2 * M_PI * (i - 2 / points));
-                        break;
-                    case 2:
-                        // von Hann
-                        _f = 0.5 * (1 + cos(2 * M_PI * (i - 2 / points)));
-                        break;
-                    case 3:
-                        // Blackman
-                        _a = 0.16;
-                        a0 = 1.f - _a / 2.f;
-                        a1 = 0.5;
-                        a2 = _a / 2.f;
-                        _f = a0 + a1 * cos((2.f * M_PI * i) / points - 1) + \
-                            a2 * cos((4.f * M_PI * i) / points - 1);
-                        break;
-                    case 4:
-                        // Blackman-Harris
-                        a0 = 0.35875;
-                        a1 = 0.48829;
-                        a2 = 0.14128;
-                        a3 = 0.01168;
-                        _f = a0 - a1 * cos((2.f * M_PI * i) / points - 1) + \
-                            a2 * cos((4.f * M_PI * i) / points - 1) - \
-                            a3 * cos((6.f * M_PI * i) / points - 1);
-                        break;
-                    case 5:
-                        // Blackman-Nuttall
-                        a0 = 0.3653819;
-                        a1 = 0.4891775;
-                        a2 = 0.1365995;
-                        a3 = 0.0106411;
-                        _f = a0 - a1 * cos((2.f * M_PI * i) / points - 1) + \
-                            a2 * cos((4.f * M_PI * i) / points - 1) - \
-                            a3 * cos((6.f * M_PI * i) / points - 1);
-                        break;
-                    case 6:
-                        // Sine
-                        _f = sin((M_PI * i) / (points - 1));
-                        break;
-                    case 7:
-                        // Lanczos
-                        _f = sinc((2.f * i) / (points - 1) - 1);
-                        break;
-                    case 8:
-                        // Gauß
-                        _a = 2.718281828459045;
-                        _f = pow(_a, -0.5f * pow((i - (points - 1) / 2) / (0.4 * (points - 1) / 2.f), 2));
-                        break;
-                    case 9:
-                        // Bartlett
-                        _f = (2.f / (points - 1)) * (((points - 1) / 2.f) - \
-                            fabs(i - ((points - 1) / 2.f)));
-                        break;
-                    case 10:
-                        // Triangular
-                        _f = (2.f / points) * ((2.f / points) - fabs(i - ((points - 1) / 2.f)));
-                        break;
-                    case 11:
-                        // Bartlett-Hann
-                        a0 = 0.62;
-                        a1 = 0.48;
-                        a2 = 0.38;
-                        _f = a0 - a1 * fabs((i / (points - 1)) - 0.5) - \
-                            a2 * cos((2 * M_PI * i) / (points - 1));
-                        break;
-                }
-                L *= _f;
-                if(_mode > _m)
-                    R *= _f;
-
-                // perhaps we need to compute two FFT's, so store left and right
-                // channel in case we need only one FFT, the left channel is
-                // used as 'standard'"
-                float valL;
-                float valR;
-                
-                switch(_mode) {
-                    default:
-                        // left channel (mode 1)
-                        // or both channels (mode 3, 4, 5, 7, 9, 10)
-                        valL = L;
-                        valR = R;
-                        break;
-                    case 0:
-                    case 6:
-                        // average (mode 0)
-                        valL = (L + R) / 2;
-                        valR = (L + R) / 2;
-                        break;
-                    case 2:
-                    case 8:
-                        // right channel (mode 2)
-                        valL = R;
-                        valR = L;
-                        break;
-                }
-                // store values in analyzer buffer
-                fft_inL[i] = valL;
-                fft_inR[i] = valR;
-                
-                // fill smoothing & falling buffer
-                if(_smooth == 2) {
-                    fft_smoothL[i] = fft_outL[i];
-                    fft_smoothR[i] = fft_outR[i];
-                }
-                if(_smooth == 1) {
-                    if(fft_smoothL[i] < fabs(fft_outL[i])) {
-                        fft_smoothL[i] = fabs(fft_outL[i]);
-                        fft_deltaL[i] = 1.f;
-                    }
-                    if(fft_smoothR[i] < fabs(fft_outR[i])) {
-                        fft_smoothR[i] = fabs(fft_outR[i]);
-                        fft_deltaR[i] = 1.f;
-                    }
-                }
-                
-                // fill hold buffer with last out values
-                // before fft is recalced
-                if(fabs(fft_outL[i]) > fft_holdL[i])
-                    fft_holdL[i] = fabs(fft_outL[i]);
-                if(fabs(fft_outR[i]) > fft_holdR[i])
-                    fft_holdR[i] = fabs(fft_outR[i]);
-            }
-            
-            // run fft
-            // this takes our latest buffer and returns an array with
-            // non-normalized
-            if (fft_plan)
-                fftwf_execute_r2r(fft_plan, fft_inL, fft_outL);
-            //run fft for for right channel too. it is needed for stereo image 
-            //and stereo difference modes
-            if(_mode >= 3 and fft_plan) {
-                fftwf_execute_r2r(fft_plan, fft_inR, fft_outR);
-            }
-            // ...and set some values for later use
-            analyzer_phase_drawn = 0;     
-            fftdone = true;  
+            // time for a new spectrum; if the worker isn't done yet, try again
+            // on the next redraw
+            if (!fetch_spectrum())
+                return false;
+            analyzer_phase_drawn = 0;
+            fftdone = true;
         }
         analyzer_phase_drawn ++;
     }
@@ -131,16 +131,16 @@ void biquad_filter_module::calculate_filter(float freq, float q, int mode, float
 {
     if (mode <= mode_36db_lp) {
         order = mode + 1;
-        left[0].set_lp_rbj(freq, pow(q, 1.0 / order), srate, gain);
+        left[0].set_lp_rbj_lut(freq, pow(q, 1.0 / order), srate, gain);
     } else if ( mode_12db_hp <= mode && mode <= mode_36db_hp ) {
         order = mode - mode_12db_hp + 1;
-        left[0].set_hp_rbj(freq, pow(q, 1.0 / order), srate, gain);
+        left[0].set_hp_rbj_lut(freq, pow(q, 1.0 / order), srate, gain);
     } else if ( mode_6db_bp <= mode && mode <= mode_18db_bp ) {
         order = mode - mode_6db_bp + 1;
-        left[0].set_bp_rbj(freq, pow(q, 1.0 / order), srate, gain);
+        left[0].set_bp_rbj_lut(freq, pow(q, 1.0 / order), srate, gain);
     } else { // mode_6db_br <= mode <= mode_18db_br
         order = mode - mode_6db_br + 1;
-        left[0].set_br_rbj(freq, order * 0.1 * q, srate, gain);
+        left[0].set_br_rbj_lut(freq, order * 0.1 * q, srate, gain);
     }
 
     right[0].copy_coeffs(left[0]);
@@ -398,28 +398,40 @@ void tap_distortion::set_sample_rate(uint32_t sr)
 {
     srate = sr;
     over = srate * 2 > 96000 ? 1 : 2;
-    resampler.set_params(srate, over, 2);
+    // the distorted signal is mixed with the dry one by most users, so keep the delay low
+    resampler.set_params(over, true);
 }
 
-float tap_distortion::process(float in)
+void tap_distortion::process(const float *in, float *out, uint32_t len)
 {
-    double *samples = resampler.upsample((double)in);
+    // room for a block at the highest oversampling factor set_sample_rate picks
+    float samples[2 * oversampler::MAX_BLOCK];
     meter = 0.f;
-    for (int o = 0; o < over; o++) {
-        float proc = samples[o];
-        float med;
-        if (proc >= 0.0f) {
-            med = (D(ap + proc * (kpa - proc)) + kpb) * pwrq;
-        } else {
-            med = (D(an - proc * (kna + proc)) + knb) * pwrq * -1.0f;
+    for (uint32_t offset = 0; offset < len; offset += oversampler::MAX_BLOCK) {
+        uint32_t count = std::min<uint32_t>(oversampler::MAX_BLOCK, len - offset);
+        resampler.upsample(in + offset, samples, count);
+        for (uint32_t i = 0; i < count * over; i++) {
+            float proc = samples[i];
+            float med;
+            if (proc >= 0.0f) {
+                med = (D(ap + proc * (kpa - proc)) + kpb) * pwrq;
+            } else {
+                med = (D(an - proc * (kna + proc)) + knb) * pwrq * -1.0f;
+            }
+            proc = srct * (med - prev_med + prev_out);
+            prev_med = M(med);
+            prev_out = M(proc);
+            samples[i] = proc;
+            meter = std::max(meter, proc);
         }
-        proc = srct * (med - prev_med + prev_out);
-        prev_med = M(med);
-        prev_out = M(proc);
-        samples[o] = proc;
-        meter = std::max(meter, proc);
+        resampler.downsample(samples, out + offset, count);
     }
-    float out = (float)resampler.downsample(samples);
+}
+
+float tap_distortion::process(float in)
+{
+    float out;
+    process(&in, &out, 1);
     return out;
 }
 
@@ -566,6 +578,10 @@ lookahead_limiter::lookahead_limiter() {
     id = 0;
     buffer_size = 0;
     overall_buffer_size = 0;
+    allocated_size = 0;
+    buffer = NULL;
+    nextpos = NULL;
+    nextdelta = NULL;
     att = 1.f;
     att_max = 1.0;
     pos = 0;
@@ -621,11 +637,20 @@ void lookahead_limiter::set_sample_rate(uint32_t sr)
     srate = sr;
     // rebuild buffer
     overall_buffer_size = (int)(srate * (100.f / 1000.f) * channels) + channels; // buffer size attack rate multiplied by 2 channels
-    buffer = (float*) calloc(overall_buffer_size, sizeof(float));
+    if (overall_buffer_size > allocated_size) {
+        free(buffer);
+        free(nextpos);
+        free(nextdelta);
+        buffer = (float*) calloc(overall_buffer_size, sizeof(float));
+        nextdelta = (float*) calloc(overall_buffer_size, sizeof(float));
+        nextpos = (int*) malloc(overall_buffer_size * sizeof(int));
+        allocated_size = overall_buffer_size;
+    } else {
+        memset(buffer, 0, overall_buffer_size * sizeof(float));
+        memset(nextdelta, 0, overall_buffer_size * sizeof(float));
+    }
     pos = 0;
 
-    nextdelta = (float*) calloc(overall_buffer_size, sizeof(float));
-    nextpos = (int*) malloc(overall_buffer_size * sizeof(int));
     memset(nextpos, -1, overall_buffer_size * sizeof(int));
     
     reset();
@@ -1031,6 +1056,8 @@ crossover::crossover() {
     bands     = -1;
     mode      = -1;
     redraw_graph = 1;
+    cascade_changed = true;
+    dsp::zero(work, sizeof(work) / sizeof(work[0]));
 }
 void crossover::set_sample_rate(uint32_t sr) {
     srate = sr;
@@ -1049,6 +1076,8 @@ void crossover::init(int c, int b, uint32_t sr) {
             out[c][b] = 0.f;
         }
     }
+    cascade.set_lanes(channels * bands);
+    cascade_changed = true;
 }
 float crossover::set_filter(int b, float f, bool force) {
     // keep between neighbour bands
@@ -1100,6 +1129,7 @@ float crossover::set_filter(int b, float f, bool force) {
             hp[c][b][1].copy_coeffs(hp[c][b][0]);
         }
     }
+    cascade_changed = true;
     redraw_graph = std::min(2, redraw_graph + 1);
     return freq[b];
 }
@@ -1110,6 +1140,9 @@ void crossover::set_mode(int m) {
     for(int i = 0; i < bands - 1; i ++) {
         set_filter(i, freq[i], true);
     }
+    // the stages that were passing the signal through so far have no valid state
+    cascade.reset();
+    cascade_changed = true;
     redraw_graph = std::min(2, redraw_graph + 1);
 }
 void crossover::set_active(int b, bool a) {
@@ -1124,7 +1157,54 @@ void crossover::set_level(int b, float l) {
     level[b] = l;
     redraw_graph = std::min(2, redraw_graph + 1);
 }
+void crossover::update_cascade() {
+    int filters = get_filter_count();
+    for(int b = 0; b < bands; b ++) {
+        for (int c = 0; c < channels; c++) {
+            int lane = b * channels + c;
+            for (int f = 0; f < 4; f++) {
+                if (f < filters and b + 1 < bands)
+                    cascade.set_coeffs(2 * f, lane, lp[c][b][f]);
+                else
+                    cascade.set_passthru(2 * f, lane);
+                if (f < filters and b > 0)
+                    cascade.set_coeffs(2 * f + 1, lane, hp[c][b - 1][f]);
+                else
+                    cascade.set_passthru(2 * f + 1, lane);
+            }
+        }
+    }
+    cascade_changed = false;
+}
+void crossover::process(const float *const *in, float *const *outputs, uint32_t numsamples) {
+    if (cascade_changed)
+        update_cascade();
+    int stride = cascade.get_stride();
+    uint32_t chunk = sizeof(work) / sizeof(work[0]) / stride;
+    int sections = 2 * get_filter_count();
+    for (uint32_t pos = 0; pos < numsamples; pos += chunk) {
+        uint32_t len = std::min(chunk, numsamples - pos);
+        // all the bands of a channel are fed the same signal
+        for (uint32_t i = 0; i < len; i++) {
+            double *frame = work + i * stride;
+            for(int b = 0; b < bands; b ++)
+                for (int c = 0; c < channels; c++)
+                    frame[b * channels + c] = in[c][pos + i];
+        }
+        cascade.process(work, len, 0, sections);
+        for(int b = 0; b < bands; b ++) {
+            for (int c = 0; c < channels; c++) {
+                const double *src = work + b * channels + c;
+                float *dst = outputs[b * channels + c] + pos;
+                for (uint32_t i = 0; i < len; i++, src += stride)
+                    dst[i] = *src * level[b];
+            }
+        }
+    }
+}
 void crossover::process(float *data) {
+    // a block of one sample would be mostly overhead in the cascade, so this
+    // runs the filters directly (on their own state)
     for (int c = 0; c < channels; c++) {
         for(int b = 0; b < bands; b ++) {
             out[c][b] = data[c];
@@ -1151,21 +1231,17 @@ bool crossover::get_graph(int subindex, int phase, float *data, int points, cair
         redraw_graph = std::max(0, redraw_graph - 1);
         return false;
     }
-    float ret;
-    double freq;
-    for (int i = 0; i < points; i++) {
-        ret = 1.f;
-        freq = 20.0 * pow (20000.0 / 20.0, i * 1.0 / points);
-        for(int f = 0; f < get_filter_count(); f ++) {
-            if(subindex < bands -1)
-                ret *= lp[0][subindex][f].freq_gain(freq, (float)srate);
-            if(subindex > 0)
-                ret *= hp[0][subindex - 1][f].freq_gain(freq, (float)srate);
-        }
-        ret *= level[subindex];
-        context->set_source_rgba(0.15, 0.2, 0.0, !active[subindex] ? 0.3 : 0.8);
-        data[i] = dB_grid(ret);
+    dsp::biquad_response &r = band_response[subindex];
+    r.begin();
+    for(int f = 0; f < get_filter_count(); f ++) {
+        if(subindex < bands -1)
+            r.add(lp[0][subindex][f]);
+        if(subindex > 0)
+            r.add(hp[0][subindex - 1][f]);
     }
+    r.add_gain(level[subindex]);
+    r.get_graph(data, points, (float)srate);
+    context->set_source_rgba(0.15, 0.2, 0.0, !active[subindex] ? 0.3 : 0.8);
     return true;
 }
 bool crossover::get_layers(int index, int generation, unsigned int &layers) const
@@ -1325,56 +1401,6 @@ bool bitreduction::get_gridline(int subindex, int phase, float &pos, bool &verti
 
 //////////////////////////////////////////////////////////////////
 
-resampleN::resampleN()
-{
-    factor  = 2;
-    srate   = 0;
-    filters = 2;
-}
-resampleN::~resampleN()
-{
-    free(tmp);
-}
-void resampleN::set_params(uint32_t sr, int fctr = 2, int fltrs = 2)
-{
-    srate   = sr;
-    factor  = std::min(16, std::max(1, fctr));
-    filters = std::min(4, std::max(1, fltrs));
-    // set all filters
-    filter[0][0].set_lp_rbj(std::max(25000., (double)srate / 2), 0.8, (float)srate * factor);
-    for (int i = 1; i < filters; i++) {
-        filter[0][i].copy_coeffs(filter[0][0]);
-        filter[1][i].copy_coeffs(filter[0][0]);
-    }
-}
-double *resampleN::upsample(double sample)
-{
-    tmp[0] = sample;
-    if (factor > 1) {
-        for (int f = 0; f < filters; f++)
-            tmp[0] = filter[0][f].process(sample);
-        for (int i = 1; i < factor; i++) {
-            tmp[i] = 0;
-            for (int f = 0; f < filters; f++)
-                tmp[i] = filter[0][f].process(sample);
-        }
-    }
-    return tmp;
-}
-double resampleN::downsample(double *sample)
-{
-    if (factor > 1) {
-        for(int i = 0; i < factor; i++) {
-            for (int f = 0; f < filters; f++) {
-                sample[i] = filter[1][f].process(sample[i]);
-            }
-        }
-    }
-    return sample[0];
-}
-
-//////////////////////////////////////////////////////////////////
-
 samplereduction::samplereduction()
 {
     target  = 0;
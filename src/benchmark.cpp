@@ -33,10 +33,14 @@
 #endif
 
 #include <calf/audio_fx.h>
+#include <calf/fdn_reverb.h>
 #include <calf/fft.h>
 #include <calf/loudness.h>
 #include <calf/benchmark.h>
 #include <getopt.h>
+#include <errno.h>
+#include <string>
+#include <vector>
 
 // #define TEST_OSC
 
@@ -52,6 +56,33 @@ using namespace osctl;
 
 bool benchmark_globals::warned = false;
 
+/// Settings of the 'plugins' unit (set from the command line)
+struct plugin_benchmark_options
+{
+    /// Plugins to measure (all in modulelist.h if empty)
+    vector<string> plugins;
+    vector<int> sample_rates, block_sizes;
+    /// Number of measured runs per configuration
+    int runs;
+    /// Length of audio processed in each run, in seconds
+    double duration;
+    /// File to write the results into as JSON, "-" for stdout, empty for none
+    string json_file;
+    
+    plugin_benchmark_options()
+    {
+        runs = 9;
+        duration = 0.25;
+        sample_rates.push_back(44100);
+        sample_rates.push_back(96000);
+        block_sizes.push_back(32);
+        block_sizes.push_back(256);
+        block_sizes.push_back(1024);
+    }
+};
+
+static plugin_benchmark_options plugin_options;
+
 template<int BUF_SIZE>
 struct empty_benchmark
 {
@@ -150,10 +181,177 @@ struct filter_12dB_lp_d2: public filter_lp24dB_benchmark<biquad_d2 >
     }
 };
 
-template<int N>
+/// Two channels through a block cascade, to be compared with the per-sample biquad_d2 versions
+struct filter_24dB_lp_cascade_stereo: public filter_lp24dB_benchmark<biquad_d2 >
+{
+    biquad_cascade<2, 2> cascade;
+    double work[BUF_SIZE * 2];
+    void prepare()
+    {
+        filter_lp24dB_benchmark<biquad_d2 >::prepare();
+        for (int l = 0; l < 2; l++)
+        {
+            cascade.set_coeffs(0, l, biquad);
+            cascade.set_coeffs(1, l, biquad2);
+        }
+    }
+    void run()
+    {
+        for (int i = 0; i < BUF_SIZE; i++)
+            work[2 * i] = work[2 * i + 1] = buffer[i];
+        cascade.process(work, BUF_SIZE);
+        for (int i = 0; i < BUF_SIZE; i++)
+            buffer[i] = work[2 * i];
+    }
+    double scaler() { return BUF_SIZE * 2; }
+};
+
+/// Recalculating filter coefficients for a modulated filter, using either
+/// the exact sin/cos or the table-driven (*_lut) setters
+template<bool Lut>
+struct coeffs_benchmark
+{
+    enum { BUF_SIZE = 256 };
+    float freqs[BUF_SIZE];
+    float result;
+    biquad_coeffs lp, pk;
+    void prepare()
+    {
+        for (int i = 0; i < BUF_SIZE; i++)
+            freqs[i] = 20 * pow(1000.0, i * 1.0 / BUF_SIZE);
+        result = 0;
+    }
+    void run()
+    {
+        for (int i = 0; i < BUF_SIZE; i++)
+        {
+            if (Lut)
+            {
+                lp.set_lp_rbj_lut(freqs[i], 0.7, 44100);
+                pk.set_peakeq_rbj_lut(freqs[i], 2.0, 4.0, 44100);
+            }
+            else
+            {
+                lp.set_lp_rbj(freqs[i], 0.7, 44100);
+                pk.set_peakeq_rbj(freqs[i], 2.0, 4.0, 44100);
+            }
+        }
+    }
+    void cleanup() { result = lp.b1 + pk.b1; }
+    double scaler() { return BUF_SIZE; }
+};
+
+/// One block of the original allpass loop reverb (dsp::reverb) or of the
+/// feedback delay network one (dsp::fdn_reverb), with the same settings
+template<bool Fdn>
+struct reverb_benchmark
+{
+    enum { BUF_SIZE = 256 };
+    float left[BUF_SIZE], right[BUF_SIZE];
+    float result;
+    dsp::reverb classic;
+    dsp::fdn_reverb fdn;
+    void prepare()
+    {
+        classic.setup(44100);
+        classic.set_type_and_diffusion(2, 0.5);
+        classic.set_time(4);
+        classic.set_cutoff(5000);
+        classic.reset();
+        fdn.setup(44100);
+        fdn.set_type_and_diffusion(2, 0.5);
+        fdn.set_time(4);
+        fdn.set_cutoff(5000);
+        fdn.reset();
+        result = 0;
+    }
+    void run()
+    {
+        // short bursts of noise, so that the reverb is never silent
+        for (int i = 0; i < BUF_SIZE; i++)
+            left[i] = right[i] = i < 16 ? (rand() & 1023) * (1.0 / 1024) - 0.5 : 0;
+        if (Fdn)
+            fdn.process(left, right, BUF_SIZE);
+        else
+        {
+            for (int i = 0; i < BUF_SIZE; i++)
+                classic.process(left[i], right[i]);
+        }
+        result += left[BUF_SIZE - 1];
+    }
+    void cleanup() {}
+    double scaler() { return BUF_SIZE; }
+};
+
+void reverb_test()
+{
+    do_simple_benchmark<reverb_benchmark<false> >(5, 10000);
+    do_simple_benchmark<reverb_benchmark<true> >(5, 10000);
+}
+
+/// The original radix-2 FFT from dsp::fft, computing twiddle indexes in the inner
+/// loop - kept here as a reference for the benchmark
+template<class T, int O>
+class fft_reference
+{
+    typedef typename std::complex<T> complex;
+    int scramble[1<<O];
+    complex sines[1<<O];
+public:
+    fft_reference()
+    {
+        int N=1<<O;
+        for (int i=0; i<N; i++)
+        {
+            int v=0;
+            for (int j=0; j<O; j++)
+                if (i&(1<<j))
+                    v+=(N>>(j+1));
+            scramble[i]=v;
+        }
+        int N90 = N >> 2;
+        T divN = 2 * M_PI / N;
+        for (int i=0; i<N90; i++)
+        {
+            T angle = divN * i;
+            T c = cos(angle), s = sin(angle);
+            sines[i + 3 * N90] = -(sines[i + N90] = complex(-s, c));
+            sines[i + 2 * N90] = -(sines[i] = complex(c, s));
+        }
+    }
+    void calculate(complex *input, complex *output, bool inverse)
+    {
+        int N=1<<O;
+        int N1=N-1;
+        int i;
+        assert(!inverse);
+        for (i=0; i<N; i++)
+            output[i]=input[scramble[i]];
+        for (i=0; i<O; i++)
+        {
+            int PO=1<<i, PNO=1<<(O-i-1);
+            int j,k;
+            for (j=0; j<PNO; j++)
+            {
+                int base=j<<(i+1);
+                for (k=0; k<PO; k++)
+                {
+                    int B1=base+k;
+                    int B2=base+k+(1<<i);
+                    complex r1=output[B1];
+                    complex r2=output[B2];
+                    output[B1]=r1+r2*sines[(B1<<(O-i-1))&N1];
+                    output[B2]=r1+r2*sines[(B2<<(O-i-1))&N1];
+                }
+            }
+        }
+    }
+};
+
+template<int N, class FFT = fft<float, N> >
 struct fft_test_class
 {
-    typedef fft<float, N> fft_class;
+    typedef FFT fft_class;
     fft_class ffter;
     float result;
     complex<float> data[1 << N], output[1 << N];
@@ -164,6 +362,7 @@ struct fft_test_class
     }
     void cleanup()
     {
+        result = abs(output[1]);
     }
     void run()
     {
@@ -172,6 +371,30 @@ struct fft_test_class
     double scaler() { return 1 << N; }
 };
 
+template<int N>
+struct fft_real_test_class
+{
+    typedef fft<float, N> fft_class;
+    fft_class ffter;
+    float result;
+    float data[1 << N];
+    complex<float> output[1 << N];
+    void prepare() {
+        for (int i = 0; i < (1 << N); i++)
+            data[i] = sin(i);
+        result = 0;
+    }
+    void cleanup()
+    {
+        result = abs(output[1]);
+    }
+    void run()
+    {
+        ffter.calculate_real(data, output);
+    }
+    double scaler() { return 1 << N; }
+};
+
 #define ALIGN_TEST_RUN 1024
 
 struct __attribute__((aligned(8))) alignment_test: public empty_benchmark<ALIGN_TEST_RUN>
@@ -223,9 +446,31 @@ static struct option long_options[] = {
     {"help", 0, 0, 'h'},
     {"version", 0, 0, 'v'},
     {"unit", 1, 0, 'u'},
+    {"plugin", 1, 0, 'p'},
+    {"sample-rates", 1, 0, 's'},
+    {"block-sizes", 1, 0, 'b'},
+    {"runs", 1, 0, 'r'},
+    {"duration", 1, 0, 'd'},
+    {"json", 1, 0, 'j'},
     {0,0,0,0},
 };
 
+/// Parse a comma separated list of positive integers
+static vector<int> parse_int_list(const char *arg)
+{
+    vector<int> values;
+    for (const char *p = arg; *p; )
+    {
+        int value = atoi(p);
+        if (value > 0)
+            values.push_back(value);
+        p += strcspn(p, ",");
+        if (*p)
+            p++;
+    }
+    return values;
+}
+
 void biquad_test()
 {
         do_simple_benchmark<filter_24dB_lp_twopass_d1>();
@@ -235,11 +480,48 @@ void biquad_test()
         do_simple_benchmark<filter_24dB_lp_onepass_d2>();
         do_simple_benchmark<filter_24dB_lp_onepass_d2_lp>();
         do_simple_benchmark<filter_12dB_lp_d2>();
+        do_simple_benchmark<filter_24dB_lp_cascade_stereo>();
 }
 
 void fft_test()
 {
+        do_simple_benchmark<fft_test_class<12, fft_reference<float, 12> > >(5, 1000);
+        do_simple_benchmark<fft_test_class<12> >(5, 1000);
+        do_simple_benchmark<fft_real_test_class<12> >(5, 1000);
+        do_simple_benchmark<fft_test_class<17, fft_reference<float, 17> > >(5, 10);
         do_simple_benchmark<fft_test_class<17> >(5, 10);
+        do_simple_benchmark<fft_real_test_class<17> >(5, 10);
+}
+
+static double coeffs_error(const biquad_coeffs &exact, const biquad_coeffs &lut)
+{
+    const double *e = &exact.a0, *l = &lut.a0;
+    double err = 0;
+    for (int i = 0; i < 5; i++)
+        err = std::max(err, fabs(e[i] - l[i]) / std::max(1.0, fabs(e[i])));
+    return err;
+}
+
+void coeffs_test()
+{
+    // compare the table-driven setters with the exact ones over the whole audio range
+    double err = 0;
+    for (int i = 0; i <= 1000; i++)
+    {
+        float freq = 10 * pow(2205.0, i / 1000.0), q = 0.1 + 0.02 * i, gain = pow(10.0, (i % 49 - 24) / 20.0);
+        biquad_coeffs e, l;
+        e.set_lp_rbj(freq, q, 44100, gain); l.set_lp_rbj_lut(freq, q, 44100, gain); err = std::max(err, coeffs_error(e, l));
+        e.set_hp_rbj(freq, q, 44100, gain); l.set_hp_rbj_lut(freq, q, 44100, gain); err = std::max(err, coeffs_error(e, l));
+        e.set_bp_rbj(freq, q, 44100, gain); l.set_bp_rbj_lut(freq, q, 44100, gain); err = std::max(err, coeffs_error(e, l));
+        e.set_br_rbj(freq, q, 44100, gain); l.set_br_rbj_lut(freq, q, 44100, gain); err = std::max(err, coeffs_error(e, l));
+        e.set_peakeq_rbj(freq, q, gain, 44100); l.set_peakeq_rbj_lut(freq, q, gain, 44100); err = std::max(err, coeffs_error(e, l));
+        e.set_lowshelf_rbj(freq, q, gain, 44100); l.set_lowshelf_rbj_lut(freq, q, gain, 44100); err = std::max(err, coeffs_error(e, l));
+        e.set_highshelf_rbj(freq, q, gain, 44100); l.set_highshelf_rbj_lut(freq, q, gain, 44100); err = std::max(err, coeffs_error(e, l));
+    }
+    printf("Maximum coefficient error of table-driven setters: %g\n", err);
+    assert(err < 1e-9);
+    do_simple_benchmark<coeffs_benchmark<false> >();
+    do_simple_benchmark<coeffs_benchmark<true> >();
 }
 
 void alignment_test()
@@ -262,6 +544,19 @@ void get_default_effect_params<calf_plugins::reverb_audio_module>(float params[3
     sr = 4000;
 }
 
+/// Reverb plugin using the feedback delay network engine
+struct fdn_reverb_audio_module: public calf_plugins::reverb_audio_module
+{
+};
+
+template<>
+void get_default_effect_params<fdn_reverb_audio_module>(float params[], uint32_t &sr)
+{
+    typedef calf_plugins::reverb_audio_module mod;
+    get_default_effect_params<mod>(params, sr);
+    params[mod::par_engine] = 1;
+}
+
 template<>
 void get_default_effect_params<calf_plugins::filter_audio_module>(float params[4], uint32_t &sr)
 {
@@ -346,7 +641,8 @@ public:
     }
     void run()
     {
-        effect.params_changed();
+        // the same path as the hosts, which also updates the parameter ramps
+        effect.params_changed_if_needed(false);
         effect.process(0, bufsize, 3, 3);
     }
     void cleanup()
@@ -363,16 +659,252 @@ void effect_test()
 {
     dsp::do_simple_benchmark<effect_benchmark<calf_plugins::flanger_audio_module> >(5, 10000);
     dsp::do_simple_benchmark<effect_benchmark<calf_plugins::reverb_audio_module> >(5, 1000);
+    dsp::do_simple_benchmark<effect_benchmark<fdn_reverb_audio_module> >(5, 1000);
     dsp::do_simple_benchmark<effect_benchmark<calf_plugins::filter_audio_module> >(5, 10000);
     dsp::do_simple_benchmark<effect_benchmark<calf_plugins::compressor_audio_module> >(5, 10000);
     dsp::do_simple_benchmark<effect_benchmark<calf_plugins::multichorus_audio_module> >(5, 10000);
 }
 
+extern "C" calf_plugins::audio_module_iface *create_calf_plugin_by_name(const char *effect_name);
+
+/// Parameter sets the plugins are measured with
+enum plugin_benchmark_param_set
+{
+    /// Default values, unchanged during the run; synths play a chord of 4 notes
+    pbs_default,
+    /// Integer, boolean and enum parameters at their maximum (more bands, voices,
+    /// higher oversampling etc.), except bypass and mute; continuous parameters swept
+    /// through their whole range, so that coefficients are recalculated every block;
+    /// synths play 16 notes
+    pbs_worst,
+    pbs_count
+};
+
+static const char *plugin_benchmark_param_set_names[pbs_count] = { "default", "worst" };
+
+/// Measurements of a single plugin/parameter set/sample rate/block size combination
+struct plugin_benchmark_result
+{
+    string plugin;
+    int param_set, sample_rate, block_size;
+    /// CPU time per sample (median, minimum, median absolute deviation), in ns;
+    /// summed over all the threads, so that the work of the voice workers and
+    /// the convolver's background stages is included
+    double ns_per_sample, ns_per_sample_min, ns_per_sample_mad;
+    /// Wall clock time per sample (median), in ns
+    double wall_ns_per_sample;
+    /// Timestamp counter cycles per sample (median), 0 if not available
+    double cycles_per_sample;
+    /// How many times faster than real time the plugin runs (median, from the wall
+    /// clock time, as that's what the deadline of the host is measured in)
+    double realtime_factor;
+};
+
+/// A plugin instance, with the parameter storage and audio buffers owned by the benchmark
+class plugin_benchmark_instance
+{
+public:
+    calf_plugins::audio_module_iface *module;
+    const calf_plugins::plugin_metadata_iface *metadata;
+    float **ins, **outs, **params;
+    vector<float> param_values, buffers;
+    /// Input signal of all the blocks of a run, generated before the measurements
+    vector<float> noise;
+    int in_count, out_count, param_count, block_size;
+    /// Parameters that are swept by the worst case parameter set
+    vector<int> swept;
+    
+    plugin_benchmark_instance(calf_plugins::audio_module_iface *_module, int param_set, int sample_rate, int _block_size)
+    : module(_module)
+    , block_size(_block_size)
+    {
+        using namespace calf_plugins;
+        module->get_port_arrays(ins, outs, params);
+        metadata = module->get_metadata_iface();
+        in_count = metadata->get_input_count();
+        out_count = metadata->get_output_count();
+        param_count = metadata->get_param_count();
+        param_values.resize(param_count);
+        for (int i = 0; i < param_count; i++)
+        {
+            const parameter_properties &pp = *metadata->get_param_props(i);
+            params[i] = &param_values[i];
+            param_values[i] = pp.def_value;
+            if (param_set != pbs_worst || (pp.flags & PF_PROP_OUTPUT))
+                continue;
+            string name = pp.short_name;
+            if (name.find("bypass") != string::npos || name.find("mute") != string::npos)
+                continue;
+            if ((pp.flags & PF_TYPEMASK) == PF_FLOAT)
+                swept.push_back(i);
+            else
+                param_values[i] = pp.max;
+        }
+        buffers.resize(out_count * block_size);
+        for (int i = 0; i < out_count; i++)
+            outs[i] = &buffers[i * block_size];
+        module->post_instantiate(sample_rate);
+        module->set_sample_rate(sample_rate);
+        module->activate();
+        module->params_changed_if_needed(true);
+        if (metadata->get_midi())
+        {
+            int notes = param_set == pbs_worst ? 16 : 4;
+            for (int i = 0; i < notes; i++)
+                module->note_on(0, 48 + 4 * i, 100);
+        }
+    }
+    ~plugin_benchmark_instance()
+    {
+        module->deactivate();
+        delete module;
+    }
+    /// Generate the noise (at -12 dBFS) for a given number of blocks
+    void generate_input(int blocks)
+    {
+        uint32_t seed = 1;
+        noise.resize((size_t)blocks * in_count * block_size);
+        for (size_t i = 0; i < noise.size(); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            noise[i] = 0.25f * ((int32_t)seed * (1.0f / 2147483648.0f));
+        }
+    }
+    /// Process the block-th block of the generated noise, with parameter sweep position pos (0..1)
+    void process(int block, double pos)
+    {
+        for (int i = 0; i < in_count; i++)
+            ins[i] = &noise[((size_t)block * in_count + i) * block_size];
+        if (!swept.empty())
+        {
+            // triangle wave, so that there are no jumps
+            double value = pos < 0.5 ? 2 * pos : 2 - 2 * pos;
+            for (size_t i = 0; i < swept.size(); i++)
+                param_values[swept[i]] = metadata->get_param_props(swept[i])->from_01(value);
+        }
+        module->params_changed_if_needed(false);
+        module->process_slice(0, block_size);
+    }
+};
+
+static void plugin_benchmark_run(const char *name, int param_set, int sample_rate, int block_size, vector<plugin_benchmark_result> &results)
+{
+    calf_plugins::audio_module_iface *module = create_calf_plugin_by_name(name);
+    if (!module)
+    {
+        fprintf(stderr, "Unknown plugin: %s\n", name);
+        return;
+    }
+    plugin_benchmark_instance inst(module, param_set, sample_rate, block_size);
+    int blocks = std::max(1, (int)(plugin_options.duration * sample_rate / block_size));
+    // one full sweep every second of audio
+    double sweep_step = block_size * 1.0 / sample_rate, sweep_pos = 0;
+    // the same input for every run, so that only the processing is timed
+    inst.generate_input(blocks);
+    // warm up (caches, branch predictors, lazily built tables, envelopes reaching their sustain levels)
+    for (int i = 0; i < blocks; i++, sweep_pos = fmod(sweep_pos + sweep_step, 1.0))
+        inst.process(i, sweep_pos);
+    dsp::median_stat time_stat, wall_stat, cycle_stat;
+    time_stat.start(plugin_options.runs);
+    wall_stat.start(plugin_options.runs);
+    cycle_stat.start(plugin_options.runs);
+    double frames = (double)blocks * block_size;
+    for (int r = 0; r < plugin_options.runs; r++)
+    {
+        double start = process_cpu_time(), start_wall = wall_time();
+        uint64_t start_cycles = read_cycle_counter();
+        for (int i = 0; i < blocks; i++, sweep_pos = fmod(sweep_pos + sweep_step, 1.0))
+            inst.process(i, sweep_pos);
+        cycle_stat.add((read_cycle_counter() - start_cycles) / frames);
+        wall_stat.add((wall_time() - start_wall) / frames);
+        time_stat.add((process_cpu_time() - start) / frames);
+    }
+    time_stat.end();
+    wall_stat.end();
+    cycle_stat.end();
+    
+    plugin_benchmark_result res;
+    res.plugin = name;
+    res.param_set = param_set;
+    res.sample_rate = sample_rate;
+    res.block_size = block_size;
+    res.ns_per_sample = time_stat.get() * 1e9;
+    res.ns_per_sample_min = time_stat.get_min() * 1e9;
+    res.ns_per_sample_mad = time_stat.get_mad() * 1e9;
+    res.wall_ns_per_sample = wall_stat.get() * 1e9;
+    res.cycles_per_sample = cycle_stat.get();
+    res.realtime_factor = wall_stat.get() > 0 ? 1.0 / (wall_stat.get() * sample_rate) : 0;
+    results.push_back(res);
+    printf("%-20s %-8s %6d %5d %10.2f %10.2f %7.2f%% %10.2f %10.1f %10.1f\n", name, plugin_benchmark_param_set_names[param_set], sample_rate, block_size,
+        res.ns_per_sample, res.ns_per_sample_min, res.ns_per_sample > 0 ? 100.0 * res.ns_per_sample_mad / res.ns_per_sample : 0.0,
+        res.wall_ns_per_sample, res.cycles_per_sample, res.realtime_factor);
+    fflush(stdout);
+}
+
+static void plugin_benchmark_write_json(FILE *f, const vector<plugin_benchmark_result> &results)
+{
+    fprintf(f, "{\n  \"package\": \"%s\",\n  \"runs\": %d,\n  \"duration\": %g,\n", PACKAGE_STRING, plugin_options.runs, plugin_options.duration);
+    // the CPU times include the plugins' helper threads, the cycle counts are elapsed timestamp counter cycles
+    fprintf(f, "  \"cpu_time\": \"all threads\",\n  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const plugin_benchmark_result &r = results[i];
+        fprintf(f, "    {\"plugin\": \"%s\", \"params\": \"%s\", \"sample_rate\": %d, \"block_size\": %d, "
+            "\"ns_per_sample\": %.3f, \"ns_per_sample_min\": %.3f, \"ns_per_sample_mad\": %.3f, "
+            "\"wall_ns_per_sample\": %.3f, \"cycles_per_sample\": %.2f, \"realtime_factor\": %.2f}%s\n",
+            r.plugin.c_str(), plugin_benchmark_param_set_names[r.param_set], r.sample_rate, r.block_size,
+            r.ns_per_sample, r.ns_per_sample_min, r.ns_per_sample_mad, r.wall_ns_per_sample, r.cycles_per_sample, r.realtime_factor,
+            i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/// Measure all the plugins (or the ones selected by --plugin) with all the
+/// parameter sets, sample rates and block sizes
+void plugin_test()
+{
+    vector<string> names = plugin_options.plugins;
+    if (names.empty())
+    {
+        #define PER_MODULE_ITEM(name, isSynth, jackname) names.push_back(jackname);
+        #include <calf/modulelist.h>
+    }
+    
+    int priority = getpriority(PRIO_PROCESS, getpid());
+    if (setpriority(PRIO_PROCESS, getpid(), -20) < 0)
+        fprintf(stderr, "Warning: could not set process priority, measurements can be worthless\n");
+    printf("%-20s %-8s %6s %5s %10s %10s %8s %10s %10s %10s\n", "plugin", "params", "srate", "block", "ns/sample", "min", "MAD", "wall ns", "cycles/smp", "x realtime");
+    vector<plugin_benchmark_result> results;
+    for (size_t i = 0; i < names.size(); i++)
+        for (int ps = 0; ps < pbs_count; ps++)
+            for (size_t sr = 0; sr < plugin_options.sample_rates.size(); sr++)
+                for (size_t bs = 0; bs < plugin_options.block_sizes.size(); bs++)
+                    plugin_benchmark_run(names[i].c_str(), ps, plugin_options.sample_rates[sr], plugin_options.block_sizes[bs], results);
+    setpriority(PRIO_PROCESS, getpid(), priority);
+    
+    if (plugin_options.json_file.empty())
+        return;
+    FILE *f = plugin_options.json_file == "-" ? stdout : fopen(plugin_options.json_file.c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "Cannot write %s: %s\n", plugin_options.json_file.c_str(), strerror(errno));
+        return;
+    }
+    plugin_benchmark_write_json(f, results);
+    if (f != stdout)
+        fclose(f);
+}
+
 #else
 void effect_test()
 {
     printf("Test temporarily removed due to refactoring\n");
 }
+
+void plugin_test()
+{
+    printf("Test temporarily removed due to refactoring\n");
+}
 #endif
 void reverbir_calc()
 {
@@ -498,13 +1030,20 @@ int main(int argc, char *argv[])
 {
     while(1) {
         int option_index;
-        int c = getopt_long(argc, argv, "u:hv", long_options, &option_index);
+        int c = getopt_long(argc, argv, "u:p:s:b:r:d:j:hv", long_options, &option_index);
         if (c == -1)
             break;
         switch(c) {
             case 'h':
             case '?':
-                printf("Benchmark suite Calf plugin pack\nSyntax: %s [--help] [--version] [--unit biquad|alignment|effects]\n", argv[0]);
+                printf("Benchmark suite Calf plugin pack\nSyntax: %s [--help] [--version] [--unit biquad|coeffs|alignment|reverb|effects|plugins]\n"
+                    "Options of the plugins unit:\n"
+                    "  --plugin name[,name...]   measure only the given plugins (default: all)\n"
+                    "  --sample-rates sr[,sr...] sample rates to use (default: 44100,96000)\n"
+                    "  --block-sizes n[,n...]    block sizes to use (default: 32,256,1024)\n"
+                    "  --runs n                  number of measured runs per configuration (default: 9)\n"
+                    "  --duration seconds        length of audio processed in each run (default: 0.25)\n"
+                    "  --json file               write the results as JSON to a file (- for stdout)\n", argv[0]);
                 return 0;
             case 'v':
                 printf("%s\n", PACKAGE_STRING);
@@ -512,6 +1051,32 @@ int main(int argc, char *argv[])
             case 'u':
                 unit = optarg;
                 break;
+            case 'p':
+                for (const char *p = optarg; *p; )
+                {
+                    size_t len = strcspn(p, ",");
+                    if (len)
+                        plugin_options.plugins.push_back(string(p, len));
+                    p += len;
+                    if (*p)
+                        p++;
+                }
+                break;
+            case 's':
+                plugin_options.sample_rates = parse_int_list(optarg);
+                break;
+            case 'b':
+                plugin_options.block_sizes = parse_int_list(optarg);
+                break;
+            case 'r':
+                plugin_options.runs = std::max(1, atoi(optarg));
+                break;
+            case 'd':
+                plugin_options.duration = atof(optarg);
+                break;
+            case 'j':
+                plugin_options.json_file = optarg;
+                break;
         }
     }
     
@@ -523,12 +1088,22 @@ int main(int argc, char *argv[])
     if (!unit || !strcmp(unit, "biquad"))
         biquad_test();
     
+    if (!unit || !strcmp(unit, "coeffs"))
+        coeffs_test();
+    
     if (!unit || !strcmp(unit, "alignment"))
         alignment_test();
 
+    if (!unit || !strcmp(unit, "reverb"))
+        reverb_test();
+
     if (!unit || !strcmp(unit, "effects"))
         effect_test();
 
+    // takes a long time, so it's only run on request
+    if (unit && !strcmp(unit, "plugins"))
+        plugin_test();
+
     if (unit && !strcmp(unit, "reverbir"))
         reverbir_calc();
 
@@ -0,0 +1,281 @@
+/* Calf DSP Library
+ * Block processing kernels for biquad filter cascades and coefficient tables
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#include <calf/biquad.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// AVX version is compiled regardless of compiler flags and only used if the CPU supports it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CALF_BIQUAD_AVX 1
+#include <immintrin.h>
+#endif
+
+using namespace dsp;
+
+typedef void (*biquad_kernel)(double *buf, uint32_t nsamples, int stride, const double *coeffs, double *state, int sections);
+
+static inline void sanitize_state(double *state, int stride)
+{
+    for (int l = 0; l < 2 * stride; l++)
+        dsp::sanitize(state[l]);
+}
+
+#if !defined(__SSE2__)
+static void biquad_cascade_scalar(double *buf, uint32_t nsamples, int stride, const double *coeffs, double *state, int sections)
+{
+    for (int s = 0; s < sections; s++, coeffs += 5 * stride, state += 2 * stride)
+    {
+        for (int l = 0; l < stride; l++)
+        {
+            double a0 = coeffs[l], a1 = coeffs[stride + l], a2 = coeffs[2 * stride + l];
+            double b1 = coeffs[3 * stride + l], b2 = coeffs[4 * stride + l];
+            double w1 = state[l], w2 = state[stride + l];
+            double *p = buf + l;
+            for (uint32_t i = 0; i < nsamples; i++, p += stride)
+            {
+                double tmp = *p - w1 * b1 - w2 * b2;
+                *p = tmp * a0 + w1 * a1 + w2 * a2;
+                w2 = w1;
+                w1 = tmp;
+            }
+            state[l] = w1;
+            state[stride + l] = w2;
+        }
+        sanitize_state(state, stride);
+    }
+}
+#endif
+
+#if defined(__SSE2__)
+static void biquad_cascade_sse2(double *buf, uint32_t nsamples, int stride, const double *coeffs, double *state, int sections)
+{
+    for (int s = 0; s < sections; s++, coeffs += 5 * stride, state += 2 * stride)
+    {
+        for (int l = 0; l < stride; l += 2)
+        {
+            __m128d a0 = _mm_loadu_pd(coeffs + l);
+            __m128d a1 = _mm_loadu_pd(coeffs + stride + l);
+            __m128d a2 = _mm_loadu_pd(coeffs + 2 * stride + l);
+            __m128d b1 = _mm_loadu_pd(coeffs + 3 * stride + l);
+            __m128d b2 = _mm_loadu_pd(coeffs + 4 * stride + l);
+            __m128d w1 = _mm_loadu_pd(state + l);
+            __m128d w2 = _mm_loadu_pd(state + stride + l);
+            double *p = buf + l;
+            for (uint32_t i = 0; i < nsamples; i++, p += stride)
+            {
+                __m128d fb = _mm_add_pd(_mm_mul_pd(w1, b1), _mm_mul_pd(w2, b2));
+                __m128d ff = _mm_add_pd(_mm_mul_pd(w1, a1), _mm_mul_pd(w2, a2));
+                __m128d tmp = _mm_sub_pd(_mm_loadu_pd(p), fb);
+                _mm_storeu_pd(p, _mm_add_pd(_mm_mul_pd(tmp, a0), ff));
+                w2 = w1;
+                w1 = tmp;
+            }
+            _mm_storeu_pd(state + l, w1);
+            _mm_storeu_pd(state + stride + l, w2);
+        }
+        sanitize_state(state, stride);
+    }
+}
+#endif
+
+#if CALF_BIQUAD_AVX
+__attribute__((target("avx")))
+static void biquad_cascade_avx(double *buf, uint32_t nsamples, int stride, const double *coeffs, double *state, int sections)
+{
+    for (int s = 0; s < sections; s++, coeffs += 5 * stride, state += 2 * stride)
+    {
+        for (int l = 0; l < stride; l += 4)
+        {
+            __m256d a0 = _mm256_loadu_pd(coeffs + l);
+            __m256d a1 = _mm256_loadu_pd(coeffs + stride + l);
+            __m256d a2 = _mm256_loadu_pd(coeffs + 2 * stride + l);
+            __m256d b1 = _mm256_loadu_pd(coeffs + 3 * stride + l);
+            __m256d b2 = _mm256_loadu_pd(coeffs + 4 * stride + l);
+            __m256d w1 = _mm256_loadu_pd(state + l);
+            __m256d w2 = _mm256_loadu_pd(state + stride + l);
+            double *p = buf + l;
+            for (uint32_t i = 0; i < nsamples; i++, p += stride)
+            {
+                __m256d fb = _mm256_add_pd(_mm256_mul_pd(w1, b1), _mm256_mul_pd(w2, b2));
+                __m256d ff = _mm256_add_pd(_mm256_mul_pd(w1, a1), _mm256_mul_pd(w2, a2));
+                __m256d tmp = _mm256_sub_pd(_mm256_loadu_pd(p), fb);
+                _mm256_storeu_pd(p, _mm256_add_pd(_mm256_mul_pd(tmp, a0), ff));
+                w2 = w1;
+                w1 = tmp;
+            }
+            _mm256_storeu_pd(state + l, w1);
+            _mm256_storeu_pd(state + stride + l, w2);
+        }
+        sanitize_state(state, stride);
+    }
+}
+#endif
+
+static biquad_kernel select_biquad_kernel(bool wide)
+{
+#if CALF_BIQUAD_AVX
+    __builtin_cpu_init();
+    if (wide && __builtin_cpu_supports("avx"))
+        return biquad_cascade_avx;
+#endif
+#if defined(__SSE2__)
+    return biquad_cascade_sse2;
+#else
+    return biquad_cascade_scalar;
+#endif
+}
+
+/// Kernel for strides that are a multiple of 2 (not 4)
+static biquad_kernel biquad_kernel_narrow = select_biquad_kernel(false);
+/// Kernel for strides that are a multiple of 4
+static biquad_kernel biquad_kernel_wide = select_biquad_kernel(true);
+
+void dsp::biquad_cascade_run(double *buf, uint32_t nsamples, int stride, const double *coeffs, double *state, int sections)
+{
+    if (!nsamples)
+        return;
+    if (stride & 3)
+        biquad_kernel_narrow(buf, nsamples, stride, coeffs, state, sections);
+    else
+        biquad_kernel_wide(buf, nsamples, stride, coeffs, state, sections);
+}
+
+biquad_sincos_table::biquad_sincos_table()
+{
+    for (int i = 0; i <= SIZE; i++)
+    {
+        sn[i] = sin(M_PI * i / SIZE);
+        cs[i] = cos(M_PI * i / SIZE);
+    }
+}
+
+const biquad_sincos_table dsp::biquad_sincos_values;
+
+biquad_response::biquad_response()
+{
+    table_points = 0;
+    table_srate = 0;
+    cached_hash = 0;
+    cache_valid = false;
+    begin();
+}
+
+void biquad_response::begin()
+{
+    nsections = 0;
+    gain2 = 1.f;
+    hash = 2166136261u;
+}
+
+void biquad_response::add(const biquad_coeffs &c, int count)
+{
+    if (count <= 0)
+        return;
+    assert(nsections < MAX_FILTERS);
+    section &s = sections[nsections++];
+    // |p0 + p1 z + p2 z^2|^2 = (p0 + p1 + p2)^2 - 4 (p0 p1 + 4 p0 p2 + p1 p2) phi + 16 p0 p2 phi^2
+    s.n0 = (c.a0 + c.a1 + c.a2) * (c.a0 + c.a1 + c.a2);
+    s.n1 = -4 * (c.a0 * c.a1 + 4 * c.a0 * c.a2 + c.a1 * c.a2);
+    s.n2 = 16 * c.a0 * c.a2;
+    s.d0 = (1 + c.b1 + c.b2) * (1 + c.b1 + c.b2);
+    s.d1 = -4 * (c.b1 + 4 * c.b2 + c.b1 * c.b2);
+    s.d2 = 16 * c.b2;
+    s.count = count;
+    hash_value(&s, sizeof(s));
+}
+
+void biquad_response::add_gain(float gain)
+{
+    gain2 *= gain * gain;
+    hash_value(&gain, sizeof(gain));
+}
+
+void biquad_response::evaluate()
+{
+    int points = table_points, i = 0;
+    float *pw = &power[0];
+    const float *ph = &phi[0];
+    for (int j = 0; j < points; j++)
+        pw[j] = gain2;
+    for (int k = 0; k < nsections; k++)
+    {
+        const section &s = sections[k];
+        i = 0;
+#if defined(__SSE2__)
+        __m128 n0 = _mm_set1_ps(s.n0), n1 = _mm_set1_ps(s.n1), n2 = _mm_set1_ps(s.n2);
+        __m128 d0 = _mm_set1_ps(s.d0), d1 = _mm_set1_ps(s.d1), d2 = _mm_set1_ps(s.d2);
+        for (; i + 4 <= points; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(ph + i);
+            __m128 num = _mm_add_ps(n0, _mm_mul_ps(x, _mm_add_ps(n1, _mm_mul_ps(x, n2))));
+            __m128 den = _mm_add_ps(d0, _mm_mul_ps(x, _mm_add_ps(d1, _mm_mul_ps(x, d2))));
+            __m128 r = _mm_div_ps(num, den), p = _mm_loadu_ps(pw + i);
+            for (int n = 0; n < s.count; n++)
+                p = _mm_mul_ps(p, r);
+            _mm_storeu_ps(pw + i, p);
+        }
+#endif
+        for (; i < points; i++)
+        {
+            float x = ph[i];
+            float r = (s.n0 + x * (s.n1 + x * s.n2)) / (s.d0 + x * (s.d1 + x * s.d2));
+            for (int n = 0; n < s.count; n++)
+                pw[i] *= r;
+        }
+    }
+}
+
+void biquad_response::get_graph(float *data, int points, float srate, float res, float ofs)
+{
+    if (points != table_points || srate != table_srate)
+    {
+        phi.resize(points);
+        power.resize(points);
+        curve.resize(points);
+        for (int i = 0; i < points; i++)
+        {
+            double freq = 20.0 * pow(20000.0 / 20.0, i * 1.0 / points);
+            double s = sin(M_PI * freq / srate);
+            phi[i] = s * s;
+        }
+        table_points = points;
+        table_srate = srate;
+        // the cached curve is for a different table
+        cache_valid = false;
+    }
+    hash_value(&points, sizeof(points));
+    hash_value(&srate, sizeof(srate));
+    hash_value(&res, sizeof(res));
+    hash_value(&ofs, sizeof(ofs));
+    if (!cache_valid || hash != cached_hash)
+    {
+        evaluate();
+        // dB_grid of the magnitude, log(|H|) = log(|H|^2) / 2
+        float scale = 0.5 / log(res);
+        for (int i = 0; i < points; i++)
+            curve[i] = log(power[i]) * scale + ofs;
+        cached_hash = hash;
+        cache_valid = true;
+    }
+    memcpy(data, &curve[0], points * sizeof(float));
+}
@@ -37,6 +37,15 @@
 
 namespace calf_plugins {
 
+class analyzer_worker;
+
+/**
+ * Spectrum analyzer shared by the analyzer and the EQ plugins. The audio
+ * thread only writes the samples into a lock-free capture ring. Windowing and
+ * FFT are done by a worker thread, which is started when the graph is drawn for
+ * the first time; the GUI thread picks up finished spectra from it and only
+ * does the (per-pixel) smoothing, post-processing and drawing.
+ */
 class analyzer: public frequency_response_line_graph
 {
 private:
@@ -72,17 +81,25 @@ public:
     bool get_moving(int subindex, int &direction, float *data, int x, int y, int &offset, uint32_t &color) const;
     bool get_gridline(int subindex, int phase, float &pos, bool &vertical, std::string &legend, cairo_iface *context) const;
     bool get_layers(int generation, unsigned int &layers) const;
+    static const int max_fft_cache_size = 32768;
+    /// Size of the capture ring in frames (twice the largest FFT, so that a
+    /// whole frame can be read while the audio thread keeps writing)
+    static const int capture_frames = max_fft_cache_size * 2;
 protected:
     int fft_buffer_size;
-    float *fft_buffer;
     int *spline_buffer;
-    int fpos;
+    /// Interleaved L/R capture ring, capture_frames frames
+    float *capture;
+    /// Number of frames written (audio thread only)
+    uint32_t capture_written;
+    /// Number of frames the worker may read; updated every few samples
+    volatile uint32_t capture_pos;
+    analyzer_worker *worker;
     mutable bool sanitize, recreate_plan;
-    mutable fftwf_plan fft_plan;
-    static const int max_fft_cache_size = 32768;
-    static const int max_fft_buffer_size = max_fft_cache_size * 2;
-    float *fft_inL, *fft_outL;
-    float *fft_inR, *fft_outR;
+    /// Fetch the next spectrum from the worker into fft_outL/fft_outR (after
+    /// updating the smoothing and hold buffers); false if none is ready yet
+    bool fetch_spectrum() const;
+    float *fft_outL, *fft_outR;
     float *fft_smoothL, *fft_smoothR;
     float *fft_deltaL, *fft_deltaR;
     float *fft_holdL, *fft_holdR;
@@ -27,6 +27,7 @@
 #include "inertia.h"
 #include "giface.h"
 #include "onepole.h"
+#include "oversampler.h"
 #include <complex>
 
 namespace calf_plugins {
@@ -234,6 +235,14 @@ protected:
     float fb;
     int last_delay_pos, last_actual_delay_pos;
     int ramp_pos, ramp_delay_pos;
+    /// Maximum number of samples processed at once (MaxDelay needs to be a power of 2)
+    enum { BlockSize = 64 };
+    /// Tap position (16.16 fixed point) for a given LFO phase
+    inline int get_delay_pos(fixed_point<unsigned int, 20> lfo_phase, int mds, int mdepth) const {
+        unsigned int ipart = lfo_phase.ipart();
+        int lfo = lfo_phase.lerp_by_fract_int<int, 14, int>(this->sine.data[ipart], this->sine.data[ipart+1]);
+        return mds + (mdepth * lfo >> 6);
+    }
 public:
     simple_flanger()
     : fb(0) {}
@@ -262,58 +271,59 @@ public:
             return;
         int mds = this->min_delay_samples + this->mod_depth_samples * 1024 + 2 * 65536;
         int mdepth = this->mod_depth_samples;
-        int delay_pos;
-        unsigned int ipart = this->phase.ipart();
-        int lfo = phase.lerp_by_fract_int<int, 14, int>(this->sine.data[ipart], this->sine.data[ipart+1]);
-        delay_pos = mds + (mdepth * lfo >> 6);
-
-        if (delay_pos != last_delay_pos || ramp_pos < 1024)
-        {
-            if (delay_pos != last_delay_pos) {
-                // we need to ramp from what the delay tap length actually was,
-                // not from old (ramp_delay_pos) or desired (delay_pos) tap length
-                ramp_delay_pos = last_actual_delay_pos;
-                ramp_pos = 0;
-            }
-
-            int64_t dp = 0;
-            for (int i=0; i<nsamples; i++) {
-                float in = *buf_in++;
-                T fd; // signal from delay's output
-                dp = (((int64_t)ramp_delay_pos) * (1024 - ramp_pos) + ((int64_t)delay_pos) * ramp_pos) >> 10;
-                ramp_pos++;
-                if (ramp_pos > 1024) ramp_pos = 1024;
-                this->delay.get_interp(fd, dp >> 16, (dp & 0xFFFF)*(1.0/65536.0));
-                sanitize(fd);
-                T sdry = in * this->dry;
-                T swet = fd * this->wet;
-                *buf_out++ = sdry + swet;
-                this->delay.put(in+fb*fd);
+        int delay_pos = get_delay_pos(this->phase, mds, mdepth);
+        bool ramp = delay_pos != last_delay_pos || ramp_pos < 1024;
+        if (delay_pos != last_delay_pos) {
+            // we need to ramp from what the delay tap length actually was,
+            // not from old (ramp_delay_pos) or desired (delay_pos) tap length
+            ramp_delay_pos = last_actual_delay_pos;
+            ramp_pos = 0;
+        }
 
-                this->phase += this->dphase;
-                ipart = this->phase.ipart();
-                lfo = phase.lerp_by_fract_int<int, 14, int>(this->sine.data[ipart], this->sine.data[ipart+1]);
-                delay_pos = mds + (mdepth * lfo >> 6);
+        // Tap positions are calculated for a chunk of samples and the taps
+        // are read with gather_interp before the chunk (with feedback) is
+        // written into the delay line. So a chunk has to end before the first
+        // sample whose tap would reach into the chunk itself.
+        int dp[BlockSize], lfo_pos[BlockSize + 1], pos[BlockSize];
+        float frac[BlockSize];
+        T fd[BlockSize]; // signal from delay's output
+        while(nsamples > 0) {
+            int len = std::min(nsamples, (int)BlockSize);
+            int start = this->delay.pos;
+            fixed_point<unsigned int, 20> lfo_phase = this->phase;
+            lfo_pos[0] = delay_pos;
+            for (int i = 0; i < len; i++) {
+                if (ramp) {
+                    int rp = std::min(ramp_pos + i, 1024);
+                    dp[i] = (((int64_t)ramp_delay_pos) * (1024 - rp) + ((int64_t)lfo_pos[i]) * rp) >> 10;
+                }
+                else
+                    dp[i] = lfo_pos[i];
+                int ofs = i - (dp[i] >> 16);
+                if ((ofs & (MaxDelay - 1)) < i || ((ofs - 1) & (MaxDelay - 1)) < i) {
+                    len = i;
+                    break;
+                }
+                pos[i] = (start + ofs) & (MaxDelay - 1);
+                frac[i] = (dp[i] & 0xFFFF)*(1.0/65536.0);
+                lfo_phase += this->dphase;
+                lfo_pos[i + 1] = get_delay_pos(lfo_phase, mds, mdepth);
             }
-            last_actual_delay_pos = dp;
-        }
-        else {
-            for (int i=0; i<nsamples; i++) {
+            gather_interp(&this->delay.data[0], MaxDelay - 1, pos, frac, fd, len, false);
+            for (int i = 0; i < len; i++) {
                 float in = *buf_in++;
-                T fd; // signal from delay's output
-                this->delay.get_interp(fd, delay_pos >> 16, (delay_pos & 0xFFFF)*(1.0/65536.0));
-                sanitize(fd);
-                T sdry = in * this->gs_dry.get();
-                T swet = fd * this->gs_wet.get();
+                sanitize(fd[i]);
+                T sdry = in * (ramp ? this->dry : this->gs_dry.get());
+                T swet = fd[i] * (ramp ? this->wet : this->gs_wet.get());
                 *buf_out++ = sdry + swet;
-                this->delay.put(in+fb*fd);
-
+                this->delay.put(in+fb*fd[i]);
                 this->phase += this->dphase;
-                ipart = this->phase.ipart();
-                lfo = phase.lerp_by_fract_int<int, 14, int>(this->sine.data[ipart], this->sine.data[ipart+1]);
-                delay_pos = mds + (mdepth * lfo >> 6);
             }
-            last_actual_delay_pos = delay_pos;
+            if (ramp)
+                ramp_pos = std::min(ramp_pos + len, 1024);
+            delay_pos = lfo_pos[len];
+            last_actual_delay_pos = ramp ? dp[len - 1] : delay_pos;
+            nsamples -= len;
         }
         last_delay_pos = delay_pos;
     }
@@ -377,6 +387,17 @@ public:
     float get_time() const {
         return time;
     }
+    /// @return length of the round trip through both channels, in samples
+    int get_loop_length() const {
+        int len = 0;
+        for (int i = 0; i < 6; i++)
+            len += (tl[i] >> 16) + (tr[i] >> 16) + 69;
+        return len;
+    }
+    /// @return gain of a round trip through both channels (excluding the damping filter)
+    float get_loop_gain() const {
+        return fb * fb;
+    }
     void set_time(float time) {
         this->time = time;
         // fb = pow(1.0f/4096.0f, (float)(1700/(time*sr)));
@@ -551,6 +572,7 @@ public:
     int pos; // where we are actually in our sample buffer
     int buffer_size;
     int overall_buffer_size;
+    int allocated_size; // capacity of buffer, nextpos and nextdelta
     bool is_active;
     bool debug;
     bool auto_release;
@@ -587,6 +609,8 @@ public:
     ~lookahead_limiter();
     void set_multi(bool set);
     void process(float &left, float &right, float *multi_buffer);
+    /// Only allocates when the buffers need to grow, so switching to a rate
+    /// that is not above an earlier one is real-time safe
     void set_sample_rate(uint32_t sr);
     void set_params(float l, float a, float r, float weight = 1.f, bool ar = false, float arc = 1.f, bool d = false);
     float get_attenuation();
@@ -621,14 +645,31 @@ public:
 
 class crossover {
 private:
+    /// All the filters of all the bands of all the channels, one lane per band and channel;
+    /// section 2n is the n-th lowpass stage, section 2n+1 the n-th highpass stage
+    dsp::biquad_cascade<64, 8> cascade;
+    /// Set when the coefficients in lp/hp need to be copied into the cascade
+    bool cascade_changed;
+    /// Lane-interleaved work buffer for the cascade
+    double work[1024];
+    void update_cascade();
 public:
     int channels, bands, mode;
     float freq[8], active[8], level[8], out[8][8];
     dsp::biquad_d2 lp[8][8][4], hp[8][8][4];
     mutable int redraw_graph;
+    /// Cached curves of the bands
+    mutable dsp::biquad_response band_response[8];
     uint32_t srate;
     crossover();
+    /// Process a single sample of each channel, results are available via get_value
+    /// (the filter state is separate from the block version, use one or the other)
     void process(float *data);
+    /// Split a block of samples into bands
+    /// @param in       input buffers, one per channel
+    /// @param outputs  output buffers, one for each band and channel, band b of channel c is outputs[b * channels + c]
+    /// @param numsamples number of samples to process
+    void process(const float *const *in, float *const *outputs, uint32_t numsamples);
     float get_value(int c, int b);
     void set_sample_rate(uint32_t sr);
     float set_filter(int b, float f, bool force = false);
@@ -661,22 +702,6 @@ public:
     bool get_gridline(int subindex, int phase, float &pos, bool &vertical, std::string &legend, calf_plugins::cairo_iface *context) const;
 };
 
-class resampleN
-{
-private:
-public:
-    uint32_t srate; // sample rate; source for upsampling, target for downsampling
-    int factor; // number of added/removed samples, max 16
-    int filters; // how many lowpasses should be used, max 4
-    double tmp[16];
-    dsp::biquad_d2 filter[2][4];
-    resampleN();
-    ~resampleN();
-    void set_params(uint32_t sr, int factor, int filters);
-    double *upsample(double sample);
-    double downsample(double *sample);
-};
-
 class samplereduction
 {
 private:
@@ -700,7 +725,7 @@ private:
     float rdrive, rbdr, kpa, kpb, kna, knb, ap, an, imr, kc, srct, sq, pwrq;
     int over;
     float prev_med, prev_out;
-    resampleN resampler;
+    oversampler resampler;
 public:
     uint32_t srate;
     bool is_active;
@@ -709,7 +734,10 @@ public:
     void deactivate();
     void set_params(float blend, float drive);
     void set_sample_rate(uint32_t sr);
+    /// Process a block of samples (in and out may be the same buffer)
+    void process(const float *in, float *out, uint32_t len);
     float process(float in);
+    /// Highest output level of the oversampled signal during the last block
     float get_distortion_level();
     static inline float M(float x)
     {
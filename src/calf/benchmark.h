@@ -19,7 +19,7 @@
  * Boston, MA  02110-1301  USA
  */
 #ifndef __CALF_BENCHMARK_H
-#define __CALF_BENCHMAR_H
+#define __CALF_BENCHMARK_H
 
 #include <time.h>
 #include <sys/time.h>
@@ -28,6 +28,7 @@
 #include "primitives.h"
 #include <algorithm>
 #include <typeinfo>
+#include <vector>
 
 namespace dsp {
 #if 0
@@ -35,6 +36,9 @@ namespace dsp {
 #endif
 
 
+/// Collects a fixed number of measurements and returns robust statistics
+/// (ones that are not thrown off by an occasional outlier caused by an
+/// interrupt or a context switch)
 class median_stat
 {
 public:
@@ -48,6 +52,9 @@ public:
         count = 0;
         sorted = false;
     }
+    ~median_stat() {
+        delete []data;
+    }
     void start(int items) {
         if (data)
             delete []data;
@@ -63,7 +70,8 @@ public:
     }
     void end()
     {
-        std::sort(&data[0], &data[count]);
+        std::sort(&data[0], &data[pos]);
+        count = pos;
         sorted = true;
     }
     float get()
@@ -71,20 +79,62 @@ public:
         assert(sorted);
         return data[count >> 1];
     }
+    double get_min()
+    {
+        assert(sorted);
+        return data[0];
+    }
+    /// @return median absolute deviation from the median
+    double get_mad()
+    {
+        assert(sorted);
+        double median = data[count >> 1];
+        std::vector<double> dev(count);
+        for (unsigned int i = 0; i < count; i++)
+            dev[i] = fabs(data[i] - median);
+        std::sort(dev.begin(), dev.end());
+        return dev[count >> 1];
+    }
 };
 
-// USE_RDTSC is for testing on my own machine, a crappy 1.6GHz Pentium 4 - it gives less headaches than clock() based measurements
-#define USE_RDTSC 0
-#define CLOCK_SPEED (1.6 * 1000.0 * 1000.0 * 1000.0)
+/// @return CPU time used by the calling thread, in seconds (nanosecond resolution,
+/// unaffected by time spent by other processes)
+inline double thread_cpu_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// @return CPU time used by all the threads of the process, in seconds (includes
+/// helper threads started by the code being measured)
+inline double process_cpu_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-#if USE_RDTSC
-inline uint64_t rdtsc()
+/// @return monotonic wall clock time, in seconds
+inline double wall_time()
 {
-    unsigned long long int x;
-    __asm__ volatile (".byte 0x0f, 0x31" : "=A" (x));
-    return x;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
+
+/// @return value of the CPU timestamp counter (reference cycles, independent of
+/// the current clock frequency), or 0 if not available on this architecture
+inline uint64_t read_cycle_counter()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    return 0;
 #endif
+}
 
 struct benchmark_globals
 {
@@ -116,25 +166,13 @@ public:
         }
         for (int i = 0; i < runs; i++) {
             target.prepare();
-            // XXXKF measuring CPU time with clock() sucks, 
-#if USE_RDTSC
-            uint64_t start = rdtsc();
-#else
-            clock_t start = ::clock();
-#endif
+            double start = thread_cpu_time();
             for (int j = 0; j < repeats; j++) {
                 target.run();
             }
-#if USE_RDTSC
-            uint64_t end = rdtsc();
-            double elapsed = double(end - start) / (CLOCK_SPEED * repeats * target.scaler());
-#else
-            clock_t end = ::clock();
-            double elapsed = double(end - start) / (double(CLOCKS_PER_SEC) * repeats * target.scaler());
-#endif
+            double elapsed = (thread_cpu_time() - start) / (repeats * target.scaler());
             stat.add(elapsed);
             target.cleanup();
-            // printf("elapsed = %f start = %d end = %d diff = %d\n", elapsed, start, end, end - start);
         }
         setpriority(PRIO_PROCESS, getpid(), priority);
         stat.end();
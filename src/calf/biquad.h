@@ -24,10 +24,55 @@
 #define __CALF_BIQUAD_H
 
 #include <complex>
+#include <vector>
 #include "primitives.h"
 
 namespace dsp {
 
+/**
+ * Table of sines and cosines of angles from 0 to pi, used by the *_lut
+ * coefficient setters of biquad_coeffs. Those are meant for filters that are
+ * modulated (recalculated every few samples), where the calls to sin/cos are
+ * the most expensive part of the coefficient calculation.
+ *
+ * Values between the grid points are calculated using the angle sum identities
+ * and a short Taylor series of the (small) remainder, so the results are within
+ * a few ulps of sin/cos and the filters are exactly as stable as the ones
+ * calculated the usual way. Q and gain don't need tables, because the RBJ
+ * formulas only use them in basic arithmetic and square roots.
+ */
+struct biquad_sincos_table
+{
+    enum { SIZE_BITS = 8, SIZE = 1 << SIZE_BITS };
+    /// sin and cos of pi * i / SIZE
+    double sn[SIZE + 1], cs[SIZE + 1];
+    biquad_sincos_table();
+};
+
+extern const biquad_sincos_table biquad_sincos_values;
+
+/// Calculate sin and cos of 2 * pi * fnorm using biquad_sincos_values
+/// @param fnorm  normalized frequency (frequency / sample rate), 0 to 0.5 (other values are handled, but slowly)
+inline void biquad_sincos(double fnorm, double &sn, double &cs)
+{
+    double pos = fnorm * (2 * biquad_sincos_table::SIZE);
+    if (!(pos >= 0 && pos <= biquad_sincos_table::SIZE))
+    {
+        sn = sin(2 * M_PI * fnorm);
+        cs = cos(2 * M_PI * fnorm);
+        return;
+    }
+    int i = (int)(pos + 0.5);
+    // |r| <= pi / (2 * SIZE), so the Taylor series error is below 1e-13
+    double r = (pos - i) * (M_PI / biquad_sincos_table::SIZE);
+    double r2 = r * r;
+    double sr = r * (1 - r2 * (1.0 / 6));
+    double cr = 1 - r2 * (0.5 - r2 * (1.0 / 24));
+    const biquad_sincos_table &t = biquad_sincos_values;
+    sn = t.sn[i] * cr + t.cs[i] * sr;
+    cs = t.cs[i] * cr - t.sn[i] * sr;
+}
+
 /**
  * Coefficients for two-pole two-zero filter, for floating point values,
  * plus a bunch of functions to set them to typical values.
@@ -70,15 +115,15 @@ public:
     inline void set_lp_rbj(float fc, float q, float sr, float gain = 1.0)
     {
         double omega=(2.0*M_PI*fc/sr);
-        double sn=sin(omega);
-        double cs=cos(omega);
-        double alpha=(sn/(2*q));
-        double inv=(1.0/(1.0+alpha));
+        set_lp_rbj_sc(sin(omega), cos(omega), q, gain);
+    }
 
-        a2 = a0 =  (gain*inv*(1.0 - cs)*0.5);
-        a1 =  a0 + a0;
-        b1 =  (-2.0*cs*inv);
-        b2 =  ((1.0 - alpha)*inv);
+    /// Same as set_lp_rbj, using the sin/cos table (@see biquad_sincos_table)
+    inline void set_lp_rbj_lut(float fc, float q, float sr, float gain = 1.0)
+    {
+        double sn, cs;
+        biquad_sincos(fc / (double)sr, sn, cs);
+        set_lp_rbj_sc(sn, cs, q, gain);
     }
 
     // different lowpass filter, based on Zoelzer's equations, modified by
@@ -110,17 +155,15 @@ public:
     inline void set_hp_rbj(float fc, float q, float esr, float gain=1.0)
     {
         double omega=(double)(2*M_PI*fc/esr);
-        double sn=sin(omega);
-        double cs=cos(omega);
-        double alpha=(double)(sn/(2*q));
-
-        double inv=(double)(1.0/(1.0+alpha));
+        set_hp_rbj_sc(sin(omega), cos(omega), q, gain);
+    }
 
-        a0 =  (gain*inv*(1 + cs)/2);
-        a1 =  -2.f * a0;
-        a2 =  a0;
-        b1 =  (-2*cs*inv);
-        b2 =  ((1 - alpha)*inv);
+    /// Same as set_hp_rbj, using the sin/cos table (@see biquad_sincos_table)
+    inline void set_hp_rbj_lut(float fc, float q, float esr, float gain=1.0)
+    {
+        double sn, cs;
+        biquad_sincos(fc / (double)esr, sn, cs);
+        set_hp_rbj_sc(sn, cs, q, gain);
     }
 
     // this replaces sin/cos with polynomial approximation
@@ -149,34 +192,30 @@ public:
     inline void set_bp_rbj(double fc, double q, double esr, double gain=1.0)
     {
         double omega=(double)(2*M_PI*fc/esr);
-        double sn=sin(omega);
-        double cs=cos(omega);
-        double alpha=(double)(sn/(2*q));
-
-        double inv=(double)(1.0/(1.0+alpha));
+        set_bp_rbj_sc(sin(omega), cos(omega), q, gain);
+    }
 
-        a0 =  (double)(gain*inv*alpha);
-        a1 =  0.f;
-        a2 =  (double)(-gain*inv*alpha);
-        b1 =  (double)(-2*cs*inv);
-        b2 =  (double)((1 - alpha)*inv);
+    /// Same as set_bp_rbj, using the sin/cos table (@see biquad_sincos_table)
+    inline void set_bp_rbj_lut(double fc, double q, double esr, double gain=1.0)
+    {
+        double sn, cs;
+        biquad_sincos(fc / esr, sn, cs);
+        set_bp_rbj_sc(sn, cs, q, gain);
     }
     
     // rbj's bandreject
     inline void set_br_rbj(double fc, double q, double esr, double gain=1.0)
     {
         double omega=(double)(2*M_PI*fc/esr);
-        double sn=sin(omega);
-        double cs=cos(omega);
-        double alpha=(double)(sn/(2*q));
-
-        double inv=(double)(1.0/(1.0+alpha));
+        set_br_rbj_sc(sin(omega), cos(omega), q, gain);
+    }
 
-        a0 =  (gain*inv);
-        a1 =  (-gain*inv*2.*cs);
-        a2 =  (gain*inv);
-        b1 =  (-2.*cs*inv);
-        b2 =  ((1. - alpha)*inv);
+    /// Same as set_br_rbj, using the sin/cos table (@see biquad_sincos_table)
+    inline void set_br_rbj_lut(double fc, double q, double esr, double gain=1.0)
+    {
+        double sn, cs;
+        biquad_sincos(fc / esr, sn, cs);
+        set_br_rbj_sc(sn, cs, q, gain);
     }
     // this is mine (and, I guess, it sucks/doesn't work)
     void set_allpass(float freq, float pole_r, float sr)
@@ -235,14 +274,16 @@ public:
     /// @param peak   peak gain (1.0 means no peak, >1.0 means a peak, less than 1.0 is a dip)
     inline void set_peakeq_rbj(double freq, double q, double peak, double sr)
     {
-        double A = sqrt(peak);
         double w0 = freq * 2 * M_PI * (1.0 / sr);
-        double alpha = sin(w0) / (2 * q);
-        double ib0 = 1.0 / (1 + alpha/A);
-        a1 = b1 = -2*cos(w0) * ib0;
-        a0 = ib0 * (1 + alpha*A);
-        a2 = ib0 * (1 - alpha*A);
-        b2 = ib0 * (1 - alpha/A);
+        set_peakeq_rbj_sc(sin(w0), cos(w0), q, peak);
+    }
+
+    /// Same as set_peakeq_rbj, using the sin/cos table (@see biquad_sincos_table)
+    inline void set_peakeq_rbj_lut(double freq, double q, double peak, double sr)
+    {
+        double sn, cs;
+        biquad_sincos(freq / sr, sn, cs);
+        set_peakeq_rbj_sc(sn, cs, q, peak);
     }
     
     /// RBJ low shelf EQ - amplitication of 'peak' at 0 Hz and of 1.0 (0dB) at sr/2 Hz
@@ -251,10 +292,102 @@ public:
     /// @param peak   shelf gain (1.0 means no peak, >1.0 means a peak, less than 1.0 is a dip)
     inline void set_lowshelf_rbj(float freq, float q, float peak, float sr)
     {
-        double A = sqrt(peak);
         double w0 = freq * 2 * M_PI * (1.0 / sr);
-        double alpha = sin(w0) / (2 * q);
-        double cw0 = cos(w0);
+        set_lowshelf_rbj_sc(sin(w0), cos(w0), q, peak);
+    }
+
+    /// Same as set_lowshelf_rbj, using the sin/cos table (@see biquad_sincos_table)
+    inline void set_lowshelf_rbj_lut(float freq, float q, float peak, float sr)
+    {
+        double sn, cs;
+        biquad_sincos(freq / (double)sr, sn, cs);
+        set_lowshelf_rbj_sc(sn, cs, q, peak);
+    }
+    
+    /// RBJ high shelf EQ - amplitication of 0dB at 0 Hz and of peak at sr/2 Hz
+    /// @param freq   corner frequency (gain at freq is sqrt(peak))
+    /// @param q      q (relates bandwidth and peak frequency), the higher q, the louder the resonant peak (situated above fc) is
+    /// @param peak   shelf gain (1.0 means no peak, >1.0 means a peak, less than 1.0 is a dip)
+    inline void set_highshelf_rbj(float freq, float q, float peak, float sr)
+    {
+        double w0 = freq * 2 * M_PI * (1.0 / sr);
+        set_highshelf_rbj_sc(sin(w0), cos(w0), q, peak);
+    }
+
+    /// Same as set_highshelf_rbj, using the sin/cos table (@see biquad_sincos_table)
+    inline void set_highshelf_rbj_lut(float freq, float q, float peak, float sr)
+    {
+        double sn, cs;
+        biquad_sincos(freq / (double)sr, sn, cs);
+        set_highshelf_rbj_sc(sn, cs, q, peak);
+    }
+    
+    /// The actual RBJ formulas, taking the sin and cos of the angular frequency
+    inline void set_lp_rbj_sc(double sn, double cs, double q, double gain)
+    {
+        double alpha=(sn/(2*q));
+        double inv=(1.0/(1.0+alpha));
+
+        a2 = a0 =  (gain*inv*(1.0 - cs)*0.5);
+        a1 =  a0 + a0;
+        b1 =  (-2.0*cs*inv);
+        b2 =  ((1.0 - alpha)*inv);
+    }
+
+    inline void set_hp_rbj_sc(double sn, double cs, double q, double gain)
+    {
+        double alpha=(double)(sn/(2*q));
+
+        double inv=(double)(1.0/(1.0+alpha));
+
+        a0 =  (gain*inv*(1 + cs)/2);
+        a1 =  -2.f * a0;
+        a2 =  a0;
+        b1 =  (-2*cs*inv);
+        b2 =  ((1 - alpha)*inv);
+    }
+
+    inline void set_bp_rbj_sc(double sn, double cs, double q, double gain)
+    {
+        double alpha=(double)(sn/(2*q));
+
+        double inv=(double)(1.0/(1.0+alpha));
+
+        a0 =  (double)(gain*inv*alpha);
+        a1 =  0.f;
+        a2 =  (double)(-gain*inv*alpha);
+        b1 =  (double)(-2*cs*inv);
+        b2 =  (double)((1 - alpha)*inv);
+    }
+
+    inline void set_br_rbj_sc(double sn, double cs, double q, double gain)
+    {
+        double alpha=(double)(sn/(2*q));
+
+        double inv=(double)(1.0/(1.0+alpha));
+
+        a0 =  (gain*inv);
+        a1 =  (-gain*inv*2.*cs);
+        a2 =  (gain*inv);
+        b1 =  (-2.*cs*inv);
+        b2 =  ((1. - alpha)*inv);
+    }
+
+    inline void set_peakeq_rbj_sc(double sn, double cs, double q, double peak)
+    {
+        double A = sqrt(peak);
+        double alpha = sn / (2 * q);
+        double ib0 = 1.0 / (1 + alpha/A);
+        a1 = b1 = -2*cs * ib0;
+        a0 = ib0 * (1 + alpha*A);
+        a2 = ib0 * (1 - alpha*A);
+        b2 = ib0 * (1 - alpha/A);
+    }
+
+    inline void set_lowshelf_rbj_sc(double sn, double cw0, double q, double peak)
+    {
+        double A = sqrt(peak);
+        double alpha = sn / (2 * q);
         double tmp = 2 * sqrt(A) * alpha;
         double b0 = 0.f, ib0 = 0.f;
         
@@ -272,17 +405,11 @@ public:
         a1 *= ib0;
         a2 *= ib0;
     }
-    
-    /// RBJ high shelf EQ - amplitication of 0dB at 0 Hz and of peak at sr/2 Hz
-    /// @param freq   corner frequency (gain at freq is sqrt(peak))
-    /// @param q      q (relates bandwidth and peak frequency), the higher q, the louder the resonant peak (situated above fc) is
-    /// @param peak   shelf gain (1.0 means no peak, >1.0 means a peak, less than 1.0 is a dip)
-    inline void set_highshelf_rbj(float freq, float q, float peak, float sr)
+
+    inline void set_highshelf_rbj_sc(double sn, double cw0, double q, double peak)
     {
         double A = sqrt(peak);
-        double w0 = freq * 2 * M_PI * (1.0 / sr);
-        double alpha = sin(w0) / (2 * q);
-        double cw0 = cos(w0);
+        double alpha = sn / (2 * q);
         double tmp = 2 * sqrt(A) * alpha;
         double b0 = 0.f, ib0 = 0.f;
         
@@ -582,6 +709,156 @@ struct biquad_d1_lerp: public biquad_coeffs
     
 };
     
+/// Run a block through a number of biquad_cascade sections, see biquad_cascade::process (implemented in biquad.cpp,
+/// picks the widest SIMD instruction set supported by the CPU at runtime)
+extern void biquad_cascade_run(double *buf, uint32_t nsamples, int stride, const double *coeffs, double *state, int sections);
+
+/**
+ * A cascade of Direct II biquad sections, running on several independent
+ * lanes (channels, bands etc.) at once, and processing a whole block
+ * of samples per call.
+ * 
+ * Coefficients and state are stored in a transposed form: for each section,
+ * the values for all lanes are adjacent, and so are the samples of all lanes
+ * in the processed buffer. This allows the inner loop to process several lanes
+ * with one SIMD instruction. A lane may be set to pass the signal through
+ * a section unchanged.
+ * 
+ * Unlike biquad_d2, the state is only sanitized once per block.
+ */
+template<int MaxLanes, int Sections>
+class biquad_cascade
+{
+public:
+    enum { max_stride = (MaxLanes + 3) & ~3, max_sections = Sections };
+protected:
+    /// Number of lanes in use
+    int lanes;
+    /// Distance between consecutive samples of the same lane (lanes padded to a multiple of SIMD width)
+    int stride;
+    /// a0, a1, a2, b1, b2 for every section
+    double coeffs[Sections * 5 * max_stride];
+    /// w1, w2 for every section
+    double state[Sections * 2 * max_stride];
+public:
+    biquad_cascade()
+    {
+        set_lanes(MaxLanes);
+    }
+    /// Set the number of lanes in use; resets all coefficients and state
+    void set_lanes(int _lanes)
+    {
+        assert(_lanes > 0 && _lanes <= MaxLanes);
+        lanes = _lanes;
+        stride = lanes <= 2 ? 2 : (lanes + 3) & ~3;
+        for (int s = 0; s < Sections; s++)
+            for (int l = 0; l < stride; l++)
+                set_passthru(s, l);
+        reset();
+    }
+    inline int get_lanes() const { return lanes; }
+    /// @return distance between consecutive samples of the same lane in the processed buffer
+    inline int get_stride() const { return stride; }
+    /// Copy filter coefficients for a single lane of a single section
+    inline void set_coeffs(int section, int lane, const biquad_coeffs &c)
+    {
+        double *p = coeffs + section * 5 * stride + lane;
+        p[0] = c.a0;
+        p[stride] = c.a1;
+        p[2 * stride] = c.a2;
+        p[3 * stride] = c.b1;
+        p[4 * stride] = c.b2;
+    }
+    /// Make a section of a given lane a no-op
+    inline void set_passthru(int section, int lane)
+    {
+        biquad_coeffs unity;
+        set_coeffs(section, lane, unity);
+    }
+    /// Clear the state of a single lane of a single section
+    inline void reset(int section, int lane)
+    {
+        state[section * 2 * stride + lane] = 0.0;
+        state[section * 2 * stride + stride + lane] = 0.0;
+    }
+    /// Clear the state of all the sections
+    inline void reset()
+    {
+        dsp::zero(state, Sections * 2 * max_stride);
+    }
+    /// Process a block of samples through a range of sections
+    /// @param buf         lane-interleaved buffer (nsamples * get_stride() values), processed in place
+    /// @param nsamples    number of sample frames
+    /// @param first       first section to run
+    /// @param count       number of sections to run
+    inline void process(double *buf, uint32_t nsamples, int first = 0, int count = Sections)
+    {
+        assert(first >= 0 && first + count <= Sections);
+        biquad_cascade_run(buf, nsamples, stride, coeffs + first * 5 * stride, state + first * 2 * stride, count);
+    }
+};
+
+/**
+ * Magnitude response of a cascade of biquads (plus a constant gain), evaluated
+ * for all the points of a frequency response graph (20 Hz - 20 kHz, log scale)
+ * in one go, instead of calling freq_gain for every filter and every point.
+ *
+ * Each filter is reduced to |H|^2 written as a ratio of two quadratics in
+ * phi = sin^2(w/2) (see the RBJ Audio EQ Cookbook), with the coefficients
+ * calculated in double precision. This only needs a table of phi values per
+ * graph size and sample rate, involves no cancellation at low frequencies, and
+ * can be evaluated in single precision with SSE, four points at a time.
+ *
+ * The curve is cached: if the cascade, the gain and the graph parameters hash
+ * to the same value as in the previous call, the previous curve is returned.
+ *
+ * Usage: begin(), then add() every filter, then get_graph().
+ */
+class biquad_response
+{
+public:
+    enum { MAX_FILTERS = 32 };
+protected:
+    /// |H|^2 = (n0 + n1 * phi + n2 * phi^2) / (d0 + d1 * phi + d2 * phi^2), applied count times
+    struct section
+    {
+        float n0, n1, n2, d0, d1, d2;
+        int count;
+    };
+    section sections[MAX_FILTERS];
+    int nsections;
+    /// Squared gain
+    float gain2;
+    /// Hash of the current cascade and of the one the cached curve was calculated for
+    uint32_t hash, cached_hash;
+    bool cache_valid;
+    /// Graph size and sample rate the phi table is calculated for
+    int table_points;
+    float table_srate;
+    std::vector<float> phi, power, curve;
+
+    inline void hash_value(const void *data, int len)
+    {
+        // FNV-1a
+        const uint8_t *p = (const uint8_t *)data;
+        for (int i = 0; i < len; i++)
+            hash = (hash ^ p[i]) * 16777619u;
+    }
+    /// Calculate |H|^2 of the cascade at every point of the table
+    void evaluate();
+public:
+    biquad_response();
+    /// Start a new cascade (no filters, unity gain)
+    void begin();
+    /// Add a filter to the cascade, applied count times (0 = not at all)
+    void add(const biquad_coeffs &c, int count = 1);
+    /// Multiply the response by a constant
+    void add_gain(float gain);
+    /// Calculate the curve for the current cascade (or return the cached one),
+    /// converted to graph positions like dB_grid(gain, res, ofs)
+    void get_graph(float *data, int points, float srate, float res = 256, float ofs = 0.4);
+};
+
 /// Compose two filters in series
 template<class F1, class F2>
 class filter_compose {
@@ -0,0 +1,178 @@
+/* Calf DSP Library
+ * Zero-latency partitioned convolution
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#ifndef __CALF_CONVOLUTION_H
+#define __CALF_CONVOLUTION_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <complex>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace dsp {
+
+class wavetable_cache;
+class convolution_stage;
+
+/// Multiply-accumulate of two complex vectors: acc[i] += a[i] * b[i]
+inline void complex_mac(std::complex<float> *acc, const std::complex<float> *a, const std::complex<float> *b, int len)
+{
+    int i = 0;
+#if defined(__SSE__)
+    const __m128 sign = _mm_set_ps(1.f, -1.f, 1.f, -1.f);
+    float *pacc = (float *)acc;
+    const float *pa = (const float *)a, *pb = (const float *)b;
+    for (; i + 2 <= len; i += 2)
+    {
+        __m128 av = _mm_loadu_ps(pa + 2 * i);
+        __m128 bv = _mm_loadu_ps(pb + 2 * i);
+        __m128 ar = _mm_shuffle_ps(av, av, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 ai = _mm_shuffle_ps(av, av, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 bs = _mm_shuffle_ps(bv, bv, _MM_SHUFFLE(2, 3, 0, 1));
+        // (ar * br - ai * bi, ar * bi + ai * br)
+        __m128 t = _mm_add_ps(_mm_mul_ps(bv, ar), _mm_mul_ps(_mm_mul_ps(bs, ai), sign));
+        _mm_storeu_ps(pacc + 2 * i, _mm_add_ps(_mm_loadu_ps(pacc + 2 * i), t));
+    }
+#endif
+    for (; i < len; i++)
+    {
+        // written out to avoid the NaN/Inf checks of std::complex multiplication
+        float re = a[i].real() * b[i].real() - a[i].imag() * b[i].imag();
+        float im = a[i].real() * b[i].imag() + a[i].imag() * b[i].real();
+        acc[i] = std::complex<float>(acc[i].real() + re, acc[i].imag() + im);
+    }
+}
+
+/**
+ * Impulse response stored in a WAV file (16/24/32-bit PCM or 32-bit float).
+ * The file is memory-mapped rather than read, so that even very long
+ * multichannel responses only take address space while they're being
+ * converted into partition spectra.
+ */
+class impulse_response
+{
+protected:
+    const char *map;
+    size_t map_size;
+    /// Start of the interleaved sample data within the mapping
+    const char *samples;
+    int channels, sample_rate, bytes_per_sample;
+    bool is_float;
+    uint32_t length;
+    std::string file_path;
+    /// Identifies the version of the file, for caching the derived data
+    std::string file_key;
+public:
+    impulse_response();
+    ~impulse_response();
+    /// Map and parse a file; returns false and sets error if it's not a usable WAV file
+    bool load(const char *path, std::string &error);
+    void close();
+    int get_channels() const { return channels; }
+    int get_sample_rate() const { return sample_rate; }
+    uint32_t get_length() const { return length; }
+    const std::string &get_path() const { return file_path; }
+    /// Path, size and modification time of the file
+    const std::string &get_file_key() const { return file_key; }
+    /// Convert one channel into floats (get_length() values)
+    void read_channel(int channel, float *dst) const;
+};
+
+/**
+ * Uniformly/non-uniformly partitioned convolution with no latency, for long
+ * impulse responses (reverbs). The first HEAD_SIZE taps are applied directly
+ * in time domain. The rest is split into sections of increasing partition
+ * sizes (64, 1024 and 8192 samples); a section with partition size B starts
+ * at offset B (if processed in the audio thread) or 2B (if processed by a
+ * background thread, which then has a whole block worth of time to finish).
+ * Each section uses a frequency domain delay line of input spectra and
+ * overlap-add.
+ *
+ * Supported impulse responses are mono (same for both channels), stereo
+ * (L to L and R to R) and 4-channel "true stereo" (LL, LR, RL, RR).
+ *
+ * Partition spectra are stored in an on-disk cache (see wavetable_cache) and
+ * used directly from the mapped file, so that instances sharing the same
+ * impulse response (also in different processes) share the memory.
+ */
+class convolver
+{
+public:
+    /// MAX_SECONDS = longest impulse response accepted
+    enum { MAX_CHANNELS = 2, MAX_PATHS = 4, HEAD_SIZE = 64, MAX_SECONDS = 60 };
+    /// Routing of one channel of the impulse response
+    struct path
+    {
+        int input, output, channel;
+    };
+protected:
+    int npaths, nchannels;
+    path paths[MAX_PATHS];
+    /// Impulse response length after resampling
+    uint32_t length;
+    /// First HEAD_SIZE taps of each channel of the impulse response
+    std::vector<float> head[MAX_PATHS];
+    /// Recent inputs, newest first, stored twice so that the last HEAD_SIZE inputs are contiguous
+    std::vector<float> head_hist[MAX_CHANNELS];
+    int head_pos;
+    /// Position within the current HEAD_SIZE block (the smallest partition size)
+    int block_pos;
+    std::vector<convolution_stage *> stages;
+    /// Partition spectra of all sections, if not taken from the cache
+    std::vector<std::complex<float> > spectra;
+    wavetable_cache *cache;
+    /// SCHED_FIFO priority for the background threads (0 = not real-time)
+    volatile int rt_priority;
+    /// Set if rt_priority should be taken from the audio thread on the next process call
+    bool follow_audio_thread;
+
+    /// Lay out the sections for the current length
+    void create_stages();
+    /// Size (in complex values) of the spectra of all sections
+    size_t get_spectra_size() const;
+    /// Calculate head and partition spectra from the (resampled) impulse response channels
+    void calculate(const std::vector<float> *ir);
+    void use_spectra(const std::complex<float> *data);
+    /// Read head and partition spectra from a loaded cache; false if the contents don't match
+    bool read_cache(wavetable_cache &c);
+    void write_cache(wavetable_cache &c);
+public:
+    convolver();
+    ~convolver();
+    /// Prepare convolution with a given impulse response, resampled to srate. Not real-time safe.
+    /// @arg rt_priority SCHED_FIFO priority for the background threads, 0 if non-real-time, or -1
+    ///                  for one below the priority of the thread calling process (if real-time)
+    bool init(const impulse_response &ir, uint32_t srate, int rt_priority, std::string &error);
+    /// Clear the state (waits for the background threads)
+    void reset();
+    /// Convolve len samples of two input channels, overwriting two output channels
+    void process(const float *const *ins, float *const *outs, uint32_t len);
+    /// Impulse response length, in samples
+    uint32_t get_length() const { return length; }
+};
+
+};
+
+#endif
@@ -25,6 +25,10 @@
 #include "buffer.h"
 #include "onepole.h"
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 namespace dsp {
 
 /**
@@ -180,6 +184,157 @@ struct simple_delay {
     }
 };
 
+/**
+ * Read several interpolated taps from a circular buffer of a power-of-2 size
+ * at once: out[i] = lerp(data[pos[i]], data[pos[i] - 1], frac[i]), which is
+ * what simple_delay::get_interp returns for the same position.
+ * @param mask buffer size - 1
+ * @param pos absolute buffer positions of the taps (within 0..mask)
+ * @param frac fractional parts of the tap delays (0..1)
+ * @param accumulate add the taps to out instead of overwriting it
+ */
+template<class T>
+inline void gather_interp(const T *data, int mask, const int *pos, const float *frac, T *out, int len, bool accumulate)
+{
+    for (int i = 0; i < len; i++)
+    {
+        T v = lerp(data[pos[i]], data[(pos[i] - 1) & mask], frac[i]);
+        out[i] = accumulate ? out[i] + v : v;
+    }
+}
+
+#if defined(__SSE__)
+inline void gather_interp(const float *data, int mask, const int *pos, const float *frac, float *out, int len, bool accumulate)
+{
+    int i = 0;
+    for (; i + 4 <= len; i += 4)
+    {
+        const int *p = pos + i;
+        __m128 v1 = _mm_setr_ps(data[p[0]], data[p[1]], data[p[2]], data[p[3]]);
+        __m128 v2 = _mm_setr_ps(data[(p[0] - 1) & mask], data[(p[1] - 1) & mask], data[(p[2] - 1) & mask], data[(p[3] - 1) & mask]);
+        __m128 v = _mm_add_ps(v1, _mm_mul_ps(_mm_sub_ps(v2, v1), _mm_loadu_ps(frac + i)));
+        if (accumulate)
+            v = _mm_add_ps(_mm_loadu_ps(out + i), v);
+        _mm_storeu_ps(out + i, v);
+    }
+    for (; i < len; i++)
+    {
+        float v = lerp(data[pos[i]], data[(pos[i] - 1) & mask], frac[i]);
+        out[i] = accumulate ? out[i] + v : v;
+    }
+}
+#endif
+
+/**
+ * Per-process allocator for delay line memory. Blocks are page-aligned and
+ * carved out of large anonymous mappings shared by all the plugin instances.
+ * The memory is zero-filled and only becomes resident when it's written to,
+ * so a delay line can reserve room for its longest possible delay while only
+ * paying for the part it actually uses. Freed blocks are handed back to the
+ * OS and reused.
+ *
+ * Environment variables: CALF_DELAY_HUGEPAGES=1 asks for transparent huge
+ * pages for the mappings (fewer TLB misses on long delay lines),
+ * CALF_DELAY_PREFAULT=1 makes every block resident as soon as it's allocated
+ * (no page faults in the audio thread, at the cost of memory).
+ *
+ * Not real-time safe, use from set_sample_rate and similar.
+ */
+class delay_arena
+{
+public:
+    /// Allocate a zero-filled, page-aligned block of at least bytes bytes
+    /// @return NULL if the memory couldn't be mapped
+    static void *alloc(size_t bytes);
+    /// Release a block returned by alloc (bytes = the size it was allocated with)
+    static void free(void *ptr, size_t bytes);
+    /// Make the first bytes bytes of a block resident, so that the audio thread
+    /// doesn't take page faults when it starts using them
+    static void prefault(void *ptr, size_t bytes);
+};
+
+/**
+ * Delay line with the same interface as simple_delay (the subset used for
+ * fixed, non-modulated delays), but with the length set at runtime and
+ * the memory taken from delay_arena. Meant for delays whose maximum length
+ * depends on the sample rate. If the memory can't be allocated, the line
+ * has no length and passes the input through undelayed.
+ */
+template<class T>
+class arena_delay
+{
+    T *data;
+    int size, mask, pos;
+    arena_delay &operator=(const arena_delay &);
+public:
+    arena_delay() : data(NULL), size(0), mask(0), pos(0) {}
+    /// The copy gets its own (empty) line of the same size
+    arena_delay(const arena_delay &src) : data(NULL), size(0), mask(0), pos(0)
+    {
+        if (src.size)
+            set_max_delay(src.size - 1);
+    }
+    ~arena_delay()
+    {
+        if (data)
+            delay_arena::free(data, size * sizeof(T));
+    }
+    /// Make room for delays up to max_delay samples (not real-time safe, clears the line)
+    /// @return false if out of memory
+    bool set_max_delay(int max_delay)
+    {
+        int new_size = 16;
+        while (new_size <= max_delay)
+            new_size <<= 1;
+        if (new_size != size)
+        {
+            if (data)
+                delay_arena::free(data, size * sizeof(T));
+            data = (T *)delay_arena::alloc(new_size * sizeof(T));
+            size = data ? new_size : 0;
+            mask = data ? size - 1 : 0;
+            if (data)
+                delay_arena::prefault(data, size * sizeof(T));
+        }
+        reset();
+        return data != NULL;
+    }
+    void reset()
+    {
+        pos = 0;
+        for (int i = 0; i < size; i++)
+            zero(data[i]);
+    }
+    inline void put(T idata)
+    {
+        if (!data)
+            return;
+        data[pos] = idata;
+        pos = (pos + 1) & mask;
+    }
+    template<class U>
+    inline void get(U &odata, int delay)
+    {
+        if (!data) {
+            zero(odata);
+            return;
+        }
+        assert(delay >= 0 && delay < size);
+        odata = data[(pos - delay) & mask];
+    }
+    /// Read and write during the same function call
+    inline T process(T idata, int delay)
+    {
+        if (!data)
+            return idata;
+        assert(delay >= 0 && delay < size);
+        T odata = data[(pos - delay) & mask];
+        data[pos] = idata;
+        pos = (pos + 1) & mask;
+        return odata;
+    }
+};
+
 };
 
 #endif
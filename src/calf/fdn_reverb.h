@@ -0,0 +1,128 @@
+/* Calf DSP Library
+ * Feedback delay network reverb
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#ifndef __CALF_FDN_REVERB_H
+#define __CALF_FDN_REVERB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace dsp {
+
+/**
+ * Reverb built from a feedback delay network of 16 lines. The outputs of
+ * the lines are passed through a short allpass (one per line, for echo
+ * density - its gain is set by the diffusion), a damping lowpass and a gain
+ * that gives the requested decay time, then mixed with a 16x16 Hadamard
+ * matrix and fed back. The input is spread over all the lines with
+ * different signs, the two outputs are taken from all the lines with two
+ * other (orthogonal) sign patterns. Line lengths are mutually prime and
+ * the read positions are slowly modulated, which avoids metallic ringing.
+ *
+ * Since all the lines are longer than a processing block, the whole block
+ * can be read from the lines before anything is written back. So the lines
+ * are read (and written) one at a time for the whole block, and the work
+ * done for each sample - allpasses, damping, mixing - is done for 4 lines
+ * at once with SSE.
+ *
+ * Takes the same parameters as dsp::reverb (decay time, high frequency
+ * damping, room type and diffusion). The decay time is the RT60 of the
+ * network. The delay lines are allocated in setup (not real-time safe),
+ * large enough for all the room types.
+ */
+class fdn_reverb
+{
+public:
+    /// MAX_BLOCK = the most samples processed at once, CLEAR_SLICE = the most floats of the lines cleared per process call
+    enum { LINES = 16, MAX_BLOCK = 64, ROOM_TYPES = 6, CLEAR_SLICE = 32768 };
+protected:
+    /// LINES delay lines of size samples, followed by LINES allpass lines of ap_size samples (one delay_arena block)
+    float *lines, *ap_lines;
+    int size, ap_size;
+    /// Write position (common to all the lines)
+    int pos;
+    /// Number of floats at the end of the lines still to be cleared (see start_reset)
+    int clear_left;
+    int sr;
+    int type;
+    float time, cutoff, diffusion;
+    /// Lengths of the delay lines and of the allpasses, in samples
+    int length[LINES], ap_length[LINES];
+    /// Feedback gain of each line, including the Hadamard matrix scaling
+    float gain[LINES];
+    /// Input/output sign patterns, including the scaling
+    float in_l[LINES], in_r[LINES], out_l[LINES], out_r[LINES];
+    float ap_coeff, lp_coeff;
+    /// Damping lowpass states
+    float lp_state[LINES];
+    /// Modulation depth in samples, LFO phases, increments (per sample) and current values (in samples)
+    float mod_depth;
+    double lfo_phase[LINES];
+    float lfo_dphase[LINES], lfo_value[LINES];
+    /// Length of a processing block, limited by the shortest line
+    int block;
+    /// Line outputs, allpass line outputs and the values to be written to both,
+    /// for a whole block (LINES values per sample)
+    float rd[MAX_BLOCK * LINES], ap_rd[MAX_BLOCK * LINES], wr[MAX_BLOCK * LINES], ap_wr[MAX_BLOCK * LINES];
+
+    /// Set the constant parts of the state and allocate the lines
+    void init(int sample_rate);
+    /// Calculate line lengths for the current room type and sample rate
+    void update_times();
+    /// Calculate the line gains for the current decay time
+    void update_gains();
+    /// Read a block worth of line and allpass outputs
+    void read_block(int len);
+    /// Run the network for a block, replacing the input with the output
+    void mix_block(float *left, float *right, int len);
+    /// Write a block worth of values into the lines
+    void write_block(int len);
+    fdn_reverb &operator=(const fdn_reverb &);
+public:
+    fdn_reverb();
+    /// Copies the settings; the copy gets its own (empty) delay lines
+    fdn_reverb(const fdn_reverb &src);
+    ~fdn_reverb();
+    /// Set the sample rate (allocates the delay lines, not real-time safe)
+    void setup(int sample_rate);
+    /// Clear the delay lines and filters
+    void reset();
+    /// Same as reset, but the delay lines are cleared a slice at a time by the
+    /// following process calls, which output silence until it's done (real-time safe)
+    void start_reset();
+    float get_time() const { return time; }
+    /// Set the decay time (RT60) in seconds
+    void set_time(float time);
+    float get_cutoff() const { return cutoff; }
+    /// Set the cutoff frequency of the damping lowpass
+    void set_cutoff(float cutoff);
+    /// Set the room type (0-5, same as in dsp::reverb) and the diffusion (0-1)
+    void set_type_and_diffusion(int type, float diffusion);
+    /// @return average length of a round trip through the network, in samples
+    int get_loop_length() const;
+    /// @return gain of an average round trip (excluding the damping filter)
+    float get_loop_gain() const;
+    /// Process len samples of two channels in place (the result is the wet signal only)
+    void process(float *left, float *right, uint32_t len);
+};
+
+};
+
+#endif
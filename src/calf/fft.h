@@ -15,26 +15,102 @@
  *
  * You should have received a copy of the GNU Lesser General
  * Public License along with this program; if not, write to the
- * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
  * Boston, MA 02111-1307, USA.
  */
 
 #ifndef __CALF_FFT_H
 #define __CALF_FFT_H
 
+#include <assert.h>
+#include <math.h>
 #include <complex>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 namespace dsp {
 
-/// FFT routine copied from my old OneSignal library, modified to 
-/// match Calf's style. It's not fast at all, just a straightforward
-/// implementation.
+/// One pass of radix-2 butterflies over the whole (bit-reversed) buffer.
+/// @param data     N complex values, processed in place
+/// @param N        buffer size
+/// @param m        half-size of the butterflies in this pass
+/// @param w        m twiddle factors for this pass
+template<class T>
+inline void fft_butterflies(std::complex<T> *data, int N, int m, const std::complex<T> *w)
+{
+    for (int base = 0; base < N; base += 2 * m)
+    {
+        std::complex<T> *p = data + base, *q = p + m;
+        for (int k = 0; k < m; k++)
+        {
+            // written out to avoid the NaN/Inf checks of std::complex multiplication
+            T tr = q[k].real() * w[k].real() - q[k].imag() * w[k].imag();
+            T ti = q[k].real() * w[k].imag() + q[k].imag() * w[k].real();
+            std::complex<T> t(tr, ti);
+            q[k] = p[k] - t;
+            p[k] += t;
+        }
+    }
+}
+
+#if defined(__SSE__)
+/// SSE version for single precision, two butterflies per iteration
+inline void fft_butterflies(std::complex<float> *data, int N, int m, const std::complex<float> *w)
+{
+    if (m < 2)
+    {
+        fft_butterflies<float>(data, N, m, w);
+        return;
+    }
+    const __m128 sign = _mm_set_ps(1.f, -1.f, 1.f, -1.f);
+    const float *tw = (const float *)w;
+    for (int base = 0; base < N; base += 2 * m)
+    {
+        float *p = (float *)(data + base), *q = (float *)(data + base + m);
+        for (int k = 0; k < 2 * m; k += 4)
+        {
+            __m128 wv = _mm_loadu_ps(tw + k);
+            __m128 wr = _mm_shuffle_ps(wv, wv, _MM_SHUFFLE(2, 2, 0, 0));
+            __m128 wi = _mm_shuffle_ps(wv, wv, _MM_SHUFFLE(3, 3, 1, 1));
+            __m128 qv = _mm_loadu_ps(q + k);
+            __m128 qs = _mm_shuffle_ps(qv, qv, _MM_SHUFFLE(2, 3, 0, 1));
+            // (qr * wr - qi * wi, qi * wr + qr * wi)
+            __m128 t = _mm_add_ps(_mm_mul_ps(qv, wr), _mm_mul_ps(_mm_mul_ps(qs, wi), sign));
+            __m128 pv = _mm_loadu_ps(p + k);
+            _mm_storeu_ps(q + k, _mm_sub_ps(pv, t));
+            _mm_storeu_ps(p + k, _mm_add_ps(pv, t));
+        }
+    }
+}
+#endif
+
+/// Iterative radix-2 FFT, originally from my old OneSignal library.
+/// Twiddle factors are precomputed separately for each pass and stored
+/// contiguously, so that the inner loop doesn't have to calculate any
+/// indexes and can process several butterflies per SIMD instruction.
+/// Forward transform uses positive exponent, inverse one is scaled by 1/N.
 template<class T, int O>
 class fft
 {
     typedef typename std::complex<T> complex;
     int scramble[1<<O];
-    complex sines[1<<O];
+    /// Twiddle factors of all the passes; pass with butterfly half-size m uses
+    /// twiddles[m] to twiddles[2m - 1], which are exp(i * pi * k / m)
+    complex twiddles[1<<O];
+
+    /// Unscaled forward transform of the first 2^order values of data, which are in bit-reversed order
+    void transform(complex *data, int order) const
+    {
+        int N = 1 << order;
+        for (int m = 1; m < N; m <<= 1)
+            fft_butterflies(data, N, m, twiddles + m);
+    }
+    static inline complex swap(const complex &c)
+    {
+        return complex(c.imag(), c.real());
+    }
 public:
     fft()
     {
@@ -48,62 +124,99 @@ public:
                     v+=(N>>(j+1));
             scramble[i]=v;
         }
-        int N90 = N >> 2;
-        T divN = 2 * M_PI / N;
-        // use symmetry
-        for (int i=0; i<N90; i++)
+        twiddles[0] = 0;
+        for (int m = 1; m < N; m <<= 1)
         {
-            T angle = divN * i;
-            T c = cos(angle), s = sin(angle);
-            sines[i + 3 * N90] = -(sines[i + N90] = complex(-s, c));
-            sines[i + 2 * N90] = -(sines[i] = complex(c, s));
+            for (int k = 0; k < m; k++)
+            {
+                double angle = M_PI * k / m;
+                twiddles[m + k] = complex(cos(angle), sin(angle));
+            }
         }
     }
     void calculate(complex *input, complex *output, bool inverse)
     {
         int N=1<<O;
-        int N1=N-1;
         int i;
         // Scramble the input data
         if (inverse)
         {
-            float mf=1.0/N;
+            T mf=1.0/N;
             for (i=0; i<N; i++)
-            {
-                complex &c=input[scramble[i]];
-                output[i]=mf*complex(c.imag(),c.real());
-            }
+                output[i]=mf*swap(input[scramble[i]]);
         }
         else
             for (i=0; i<N; i++)
                 output[i]=input[scramble[i]];
 
-        // O butterfiles
-        for (i=0; i<O; i++)
-        {
-            int PO=1<<i, PNO=1<<(O-i-1);
-            int j,k;
-            for (j=0; j<PNO; j++)
-            {
-                int base=j<<(i+1);
-                for (k=0; k<PO; k++)
-                {
-                    int B1=base+k;
-                    int B2=base+k+(1<<i);
-                    complex r1=output[B1];
-                    complex r2=output[B2];
-                    output[B1]=r1+r2*sines[(B1<<(O-i-1))&N1];
-                    output[B2]=r1+r2*sines[(B2<<(O-i-1))&N1];
-                }
-            }
-        }
+        transform(output, O);
         if (inverse)
         {
             for (i=0; i<N; i++)
+                output[i]=swap(output[i]);
+        }
+    }
+    /// Forward transform of a real signal, done as a half-size complex transform.
+    /// Produces the same result as calculate(input, output, false) with the
+    /// imaginary parts of the input set to zero.
+    /// @param input    N real values
+    /// @param output   N complex values
+    void calculate_real(const T *input, complex *output)
+    {
+        int N = 1 << O, M = N >> 1;
+        // pack even/odd samples as real/imaginary parts, bit-reversed on the half size
+        for (int i = 0; i < M; i++)
+        {
+            int j = scramble[i] >> 1;
+            output[i] = complex(input[2 * j], input[2 * j + 1]);
+        }
+        transform(output, O - 1);
+        // separate the spectra of even and odd samples and do the final pass of butterflies
+        const complex *w = twiddles + M;
+        for (int k = 0; k <= M / 2; k++)
+        {
+            complex z1 = output[k], z2 = output[(M - k) & (M - 1)];
+            // spectra of even and odd samples at bin k (at bin M - k, they're the conjugates)
+            complex e = (z1 + std::conj(z2)) * T(0.5), o = (z1 - std::conj(z2)) * complex(0, -0.5);
+            if (!k)
             {
-                const complex &c=output[i];
-                output[i]=complex(c.imag(),c.real());
+                // w[0] = 1, exp(i * pi) = -1
+                output[0] = e + o;
+                output[M] = e - o;
+                continue;
             }
+            complex x1 = e + w[k] * o, x2 = std::conj(e - w[k] * o);
+            output[k] = x1;
+            output[N - k] = std::conj(x1);
+            output[M - k] = x2;
+            output[M + k] = std::conj(x2);
+        }
+    }
+    /// Inverse transform producing a real signal. Produces the same result as the real
+    /// part of calculate(input, output, true); the input does not need to be conjugate-symmetric.
+    /// @param input    N complex values
+    /// @param output   N real values
+    /// @param temp     N/2 complex values of scratch space
+    void calculate_real_inverse(const complex *input, T *output, complex *temp)
+    {
+        int N = 1 << O, M = N >> 1;
+        T mf = 1.0 / N;
+        const complex *w = twiddles + M;
+        // take the conjugate-symmetric part of the spectrum, combine the even
+        // and odd sample spectra into one and swap real/imaginary parts, so that
+        // the forward transform can be used
+        for (int k = 0; k < M; k++)
+        {
+            complex h1 = (input[k] + std::conj(input[(N - k) & (N - 1)])) * T(0.5);
+            complex h2 = (input[k + M] + std::conj(input[M - k])) * T(0.5);
+            complex a = h1 + h2, b = (h1 - h2) * std::conj(w[k]);
+            temp[scramble[k] >> 1] = mf * swap(a + complex(-b.imag(), b.real()));
+        }
+        transform(temp, O - 1);
+        for (int i = 0; i < M; i++)
+        {
+            output[2 * i] = temp[i].imag();
+            output[2 * i + 1] = temp[i].real();
         }
     }
 };
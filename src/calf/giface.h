@@ -23,6 +23,7 @@
 
 #include <config.h>
 #include "primitives.h"
+#include "inertia.h"
 #include <complex>
 #include <exception>
 #include <string>
@@ -36,7 +37,74 @@ namespace osctl {
 namespace calf_plugins {
 
 enum {
-    MAX_SAMPLE_RUN = 256
+    MAX_SAMPLE_RUN = 256,
+    /// Maximum number of parameter changes scheduled in advance (per plugin instance)
+    MAX_PARAM_EVENTS = 64
+};
+
+/// Inputs below this level (about -144 dB) are considered silent
+#define SILENCE_THRESHOLD (1.0f / 16777216.0f)
+
+/// @return number of samples it takes for a signal circulating in a feedback
+/// loop to decay below SILENCE_THRESHOLD, or -1 if it doesn't decay (or takes
+/// too long)
+/// @param loop_samples length of the loop, in samples
+/// @param feedback gain of the loop
+inline int feedback_tail_length(double loop_samples, double feedback)
+{
+    feedback = fabs(feedback);
+    if (feedback >= 0.999)
+        return -1;
+    // number of round trips to lose 144 dB
+    double trips = feedback > 0 ? ceil(-7.2 / log10(feedback)) : 0;
+    double tail = (trips + 1) * loop_samples;
+    return tail < 0x40000000 ? (int)tail + 1 : -1;
+}
+
+/// Find the peak absolute value of a block of samples and check it for NaNs and
+/// infinities. Works on the bit patterns (so it isn't affected by -ffast-math),
+/// four samples at a time where SSE2 is available.
+/// @retval false if the block contains a NaN or an infinity (peak is then meaningless)
+bool scan_audio_block(const float *data, uint32_t len, float &peak);
+
+/// How often process_slice checks the audio data for NaNs, infinities and absurdly
+/// large values. Set from CALF_VALIDATE environment variable ("always", "never" or
+/// "sampled:N") when the library is loaded; the default is to check every block, as a
+/// single NaN on an input can poison the state of a module for good.
+struct validation_policy
+{
+    enum mode_type {
+        ALWAYS,     ///< check every block
+        SAMPLED,    ///< check every interval-th block processed by each module
+        NEVER,      ///< don't check
+    };
+    /// Check every interval-th block, 1 = every block, 0 = never
+    static volatile int interval;
+    /// Change the policy (may be called at any time, modules pick it up at their next check)
+    static void set(mode_type mode, int sampling_interval = 8);
+    /// @return the interval given by CALF_VALIDATE (or the default)
+    static int from_environment();
+};
+
+/// Results of the audio data checks done by process_slice
+struct validation_stats
+{
+    /// Number of blocks checked
+    uint32_t blocks_checked;
+    /// Number of checked blocks with questionable values on the inputs
+    uint32_t input_errors;
+    /// Number of checked blocks with questionable values on the outputs (replaced by silence)
+    uint32_t output_errors;
+    validation_stats() : blocks_checked(0), input_errors(0), output_errors(0) {}
+};
+
+/// Parameter change scheduled for a given sample position
+struct param_event
+{
+    /// Position (in the same units as the process_slice offsets)
+    uint32_t time;
+    int param_no;
+    float value;
 };
     
 struct automation_range;
@@ -84,6 +152,7 @@ enum parameter_flags
   PF_PROP_OUTPUT    = 0x080000, ///< output port
   PF_PROP_OPTIONAL  = 0x100000, ///< connection optional
   PF_PROP_GRAPH     = 0x200000, ///< add graph
+  PF_PROP_LATENCY   = 0x400000, ///< lv2:reportsLatency, output port holding the latency of the plugin in samples
   
   PF_UNITMASK     = 0xFF000000,  ///< bit mask for units   \todo reduce to use only 5 bits
   PF_UNIT_DB      = 0x01000000,  ///< decibels
@@ -526,6 +595,20 @@ struct audio_module_iface
     virtual void set_progress_report_iface(progress_report_iface *iface) = 0;
     /// Clear a part of output buffers that have 0s at mask; subdivide the buffer so that no runs > MAX_SAMPLE_RUN are fed to process function
     virtual uint32_t process_slice(uint32_t offset, uint32_t end) = 0;
+    /// Schedule a parameter change at a given position within the following process_slice calls; the parameter
+    /// value is written and params_changed called (if necessary) exactly at that position. Only for hosts that own
+    /// the parameter value storage. Returns false if the queue is full (the value should then be set directly).
+    virtual bool schedule_param_change(uint32_t time, int param_no, float value) = 0;
+    /// Call params_changed if any input parameter without a ramp has changed since the last call (or if force is true)
+    virtual void params_changed_if_needed(bool force) = 0;
+    /// @return number of samples after which the output becomes silent when the inputs are silent,
+    /// with the current parameters; -1 if unknown or if the module generates sound on its own
+    virtual int get_tail_length() const = 0;
+    /// @return true if process_slice skipped processing the last time, because the inputs had
+    /// been silent for longer than the tail length
+    virtual bool is_sleeping() const = 0;
+    /// @return counters of the audio data checks (see validation_policy)
+    virtual const validation_stats &get_validation_stats() const = 0;
     /// The audio processing loop; assumes numsamples <= MAX_SAMPLE_RUN, for larger buffers, call process_slice
     virtual uint32_t process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask) = 0;
     /// Message port processing function
@@ -551,16 +634,44 @@ public:
     float *params[Metadata::param_count];
     bool questionable_data_reported_in;
     bool questionable_data_reported_out;
+    /// Number of silent samples seen on all the inputs since the last non-silent one (saturates)
+    uint32_t silent_samples;
+    /// Set when process calls are skipped because of silence
+    bool sleeping;
+    /// Number of blocks left until the next audio data check
+    int validation_countdown;
+    validation_stats validation;
 
     progress_report_iface *progress_report;
 
+    /// Scheduled parameter changes, sorted by time
+    param_event param_events[MAX_PARAM_EVENTS];
+    int param_event_count;
+    /// Input parameter values seen by the last params_changed_if_needed call
+    float last_param_values[Metadata::param_count];
+    /// False until the first params_changed_if_needed call (which is then forced)
+    bool param_values_valid;
+    /// Ramps smoothing the parameter values, see ramp_param (NULL = parameter not ramped)
+    dsp::inertia<dsp::linear_ramp> *param_ramps[Metadata::param_count];
+    /// Indexes of the ramped parameters
+    int ramped_params[Metadata::param_count];
+    int ramped_param_count;
+
     audio_module() {
         progress_report = NULL;
         memset(ins, 0, sizeof(ins));
         memset(outs, 0, sizeof(outs));
         memset(params, 0, sizeof(params));
+        memset(param_ramps, 0, sizeof(param_ramps));
         questionable_data_reported_in = false;
         questionable_data_reported_out = false;
+        param_event_count = 0;
+        ramped_param_count = 0;
+        silent_samples = 0;
+        sleeping = false;
+        validation_countdown = 0;
+        param_values_valid = false;
+        memset(last_param_values, 0, sizeof(last_param_values));
     }
 
     /// Handle MIDI Note On
@@ -597,6 +708,12 @@ public:
     void params_reset() {}
     /// Called after instantiating (after all the feature pointers are set - including interfaces like progress_report_iface)
     void post_instantiate(uint32_t) {}
+    /// Number of samples the output takes to become silent after the inputs have become silent (-1 = never
+    /// skip processing). Modules that have no internal sound sources (and no meters that need to keep
+    /// moving) can return their tail length to be put to sleep while their inputs are silent.
+    int get_tail_length() const { return -1; }
+    bool is_sleeping() const { return sleeping; }
+    virtual const validation_stats &get_validation_stats() const { return validation; }
     /// Handle 'message context' port message
     /// @arg output_ports pointer to bit array of output port "changed" flags, note that 0 = first audio input, not first parameter (use input_count + output_count)
     uint32_t message_run(const void *valid_ports, void *output_ports) { 
@@ -615,6 +732,86 @@ public:
     /// Set the progress report interface to communicate progress to
     virtual void set_progress_report_iface(progress_report_iface *iface) { progress_report = iface; }
 
+    /// Smooth a parameter using a given ramp. The ramp's target follows the parameter
+    /// value (changes coming through schedule_param_change happen at the right sample)
+    /// and the module should read it once per sample using ramp.get(). Changes of
+    /// ramped parameters alone don't make params_changed_if_needed call params_changed.
+    void ramp_param(int param_no, dsp::inertia<dsp::linear_ramp> &ramp)
+    {
+        if (!param_ramps[param_no])
+            ramped_params[ramped_param_count++] = param_no;
+        param_ramps[param_no] = &ramp;
+    }
+    /// Set the targets of all parameter ramps to the current parameter values
+    /// @param now jump to the target values immediately
+    void update_param_ramps(bool now)
+    {
+        for (int i = 0; i < ramped_param_count; i++) {
+            int p = ramped_params[i];
+            if (!params[p])
+                continue;
+            if (now)
+                param_ramps[p]->set_now(*params[p]);
+            else
+                param_ramps[p]->set_inertia(*params[p]);
+        }
+    }
+    virtual bool schedule_param_change(uint32_t time, int param_no, float value)
+    {
+        if (param_event_count >= MAX_PARAM_EVENTS || !params[param_no])
+            return false;
+        // keep the queue sorted, events for the same time are applied in the order of arrival
+        int pos = param_event_count++;
+        while(pos > 0 && param_events[pos - 1].time > time) {
+            param_events[pos] = param_events[pos - 1];
+            pos--;
+        }
+        param_events[pos].time = time;
+        param_events[pos].param_no = param_no;
+        param_events[pos].value = value;
+        return true;
+    }
+    virtual void params_changed_if_needed(bool force)
+    {
+        // don't rely on a NaN sentinel here, comparisons with NaN are
+        // optimized away with -ffast-math
+        if (!param_values_valid) {
+            force = true;
+            param_values_valid = true;
+        }
+        bool changed = force;
+        for (int i = 0; i < Metadata::param_count; i++) {
+            if (param_ramps[i] || !params[i] || (Metadata::param_props[i].flags & PF_PROP_OUTPUT))
+                continue;
+            if (force || *params[i] != last_param_values[i]) {
+                last_param_values[i] = *params[i];
+                changed = true;
+            }
+        }
+        if (changed)
+            params_changed();
+        update_param_ramps(force);
+    }
+    /// Apply the events due at the position 'offset'
+    /// @return end of the run that can be processed before the next event (at most 'end')
+    uint32_t apply_param_events(uint32_t offset, uint32_t end)
+    {
+        int done = 0;
+        while(done < param_event_count && param_events[done].time <= offset) {
+            const param_event &ev = param_events[done++];
+            *params[ev.param_no] = ev.value;
+        }
+        if (done) {
+            for (int i = done; i < param_event_count; i++)
+                param_events[i - done] = param_events[i];
+            param_event_count -= done;
+            params_changed_if_needed(false);
+        }
+        if (param_event_count && param_events[0].time < end)
+            end = param_events[0].time;
+        return end;
+    }
+
     /// utility function: zero port values if mask is 0
     inline void zero_by_mask(uint32_t mask, uint32_t offset, uint32_t nsamples)
     {
@@ -627,53 +824,73 @@ public:
     /// utility function: call process, and if it returned zeros in output masks, zero out the relevant output port buffers
     uint32_t process_slice(uint32_t offset, uint32_t end)
     {
-        bool had_errors = false;
-        for (int i=0; i<Metadata::in_count; ++i) {
-            float *indata = ins[i];
-            if (indata) {
-                float errval = 0;
-                for (uint32_t j = offset; j < end; j++)
-                {
-                    if (!std::isfinite(indata[j]) || fabs(indata[j]) > 4294967296.0) {
-                        errval = indata[j];
-                        had_errors = true;
+        uint32_t start = offset;
+        int interval = validation_policy::interval;
+        bool check = false;
+        if (interval > 0 && --validation_countdown <= 0) {
+            validation_countdown = interval;
+            check = true;
+            validation.blocks_checked++;
+        }
+        int tail = get_tail_length();
+        bool had_errors = false, silent = true;
+        if (check || tail >= 0) {
+            for (int i=0; i<Metadata::in_count; ++i) {
+                float *indata = ins[i];
+                if (!indata)
+                    continue;
+                float peak;
+                bool finite = scan_audio_block(indata + offset, end - offset, peak);
+                if (!finite || peak >= SILENCE_THRESHOLD)
+                    silent = false;
+                if (check && (!finite || peak > 4294967296.0)) {
+                    if (!had_errors)
+                        validation.input_errors++;
+                    had_errors = true;
+                    if (!questionable_data_reported_in) {
+                        fprintf(stderr, "Warning: Plugin %s got questionable value %f on its input %d\n", Metadata::get_name(), finite ? peak : NAN, i);
+                        questionable_data_reported_in = true;
                     }
                 }
-                if (had_errors && !questionable_data_reported_in) {
-                    fprintf(stderr, "Warning: Plugin %s got questionable value %f on its input %d\n", Metadata::get_name(), errval, i);
-                    questionable_data_reported_in = true;
-                }
             }
         }
+        // sleep if the inputs are silent and the tail of the last sound has already
+        // been output; wake up as soon as there's anything on the inputs
+        bool skip = tail >= 0 && Metadata::in_count > 0 && silent && silent_samples >= (uint32_t)tail;
+        if (silent)
+            silent_samples = std::min<uint32_t>(silent_samples + (end - offset), 0x7FFFFFFF);
+        else
+            silent_samples = 0;
+        sleeping = skip;
         uint32_t total_out_mask = 0;
         while(offset < end)
         {
             uint32_t newend = std::min(offset + MAX_SAMPLE_RUN, end);
-            uint32_t out_mask = !had_errors ? process(offset, newend - offset, -1, -1) : 0;
+            if (param_event_count)
+                newend = apply_param_events(offset, newend);
+            uint32_t out_mask = !had_errors && !skip ? process(offset, newend - offset, -1, -1) : 0;
             total_out_mask |= out_mask;
             zero_by_mask(out_mask, offset, newend - offset);
             offset = newend;
         }
+        if (!check)
+            return total_out_mask;
+        had_errors = false;
         for (int i=0; i<Metadata::out_count; ++i) {
-            if (total_out_mask & (1 << i))
-            {
-                had_errors = false;
-                float *outdata = outs[i];
-                float errval = 0;
-                for (uint32_t j = offset; j < end; j++)
-                {
-                    if (!std::isfinite(outdata[j]) || fabs(outdata[j]) > 4294967296.0) {
-                        errval = outdata[j];
-                        had_errors = true;
-                    }
-                }
-                if (had_errors && !questionable_data_reported_out) {
-                    fprintf(stderr, "Warning: Plugin %s generated questionable value %f on its output %d - this is most likely a bug in the plugin!\n", Metadata::get_name(), errval, i);
-                    questionable_data_reported_out = true;
-                }
-                if (had_errors)
-                    dsp::zero(outs[i] + offset, end - offset);
+            if (!(total_out_mask & (1 << i)))
+                continue;
+            float peak;
+            bool finite = scan_audio_block(outs[i] + start, end - start, peak);
+            if (finite && peak <= 4294967296.0)
+                continue;
+            if (!had_errors)
+                validation.output_errors++;
+            had_errors = true;
+            if (!questionable_data_reported_out) {
+                fprintf(stderr, "Warning: Plugin %s generated questionable value %f on its output %d - this is most likely a bug in the plugin!\n", Metadata::get_name(), finite ? peak : NAN, i);
+                questionable_data_reported_out = true;
             }
+            dsp::zero(outs[i] + start, end - start);
         }
         return total_out_mask;
     }
@@ -38,6 +38,8 @@ namespace calf_plugins {
         plugin_gui_window *gui_win;
         calf_connector *connector;
         GtkWidget *strip_table, *name, *button, *con, *midi_in, *extra, *leftBox, *rightBox, *inBox, *outBox;
+        /// Label showing the share of the JACK period spent processing the plugin
+        GtkWidget *load;
         std::vector<GtkWidget *> audio_in, audio_out;
     };
     
@@ -70,12 +72,16 @@ namespace calf_plugins {
     protected:
         GtkWidget *progress_window;
         window_update_controller refresh_controller;
+        /// Number of idle calls until the DSP load labels are updated again
+        int load_update_countdown;
     
     protected:
         plugin_strip *create_strip(jack_host *plugin);
         void update_strip(plugin_ctl_iface *plugin);
         void sort_strips();
         static gboolean on_idle(void *data);
+        /// Update the DSP load labels of all the strips
+        void update_load_labels();
         std::string make_plugin_list(GtkActionGroup *actions);
         static void add_plugin_action(GtkWidget *src, gpointer data);
         void display_error(const char *error, const char *filename);
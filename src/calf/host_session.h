@@ -60,6 +60,8 @@ public:
     session_manager_iface *session_manager;
     /// Save has been requested from SIGUSR1 handler
     volatile bool save_file_on_next_idle_call;
+    /// Processing time statistics dump has been requested from SIGUSR2 handler
+    volatile bool dump_load_stats_on_next_idle_call;
     /// If non-zero, quit has been requested through signal with same value
     volatile int quit_on_next_idle_call;
     /// JACK session event to handle on the next idle call
@@ -70,6 +72,8 @@ public:
     std::string jack_session_id;
     /// Command used to start the JACK host
     std::string calfjackhost_cmd;
+    /// Number of threads used for running independent plugins in parallel (1 = JACK process thread only)
+    int worker_threads;
     
     // these are not saved
     jack_client client;
@@ -92,7 +96,8 @@ public:
     void remove_all_plugins();
     std::string get_next_instance_name(const std::string &effect_name);
     
-    /// Set handlers for SIGUSR1 (that LADISH uses to invoke Save function), SIGTERM and SIGHUP
+    /// Set handlers for SIGUSR1 (that LADISH uses to invoke Save function), SIGUSR2 (printing
+    /// processing time statistics), SIGTERM and SIGHUP
     void set_signal_handlers();
     
     /// unix signal handler
@@ -27,7 +27,10 @@
 
 #include "utils.h"
 #include "vumeter.h"
+#include "workers.h"
 #include <pthread.h>
+#include <stdio.h>
+#include <time.h>
 #include <jack/jack.h>
 #include <jack/session.h>
 
@@ -47,21 +50,145 @@ struct automation_iface
     virtual ~automation_iface() {}
 };
 
-class jack_client {
+/// Processing time statistics of a plugin (or of the whole process callback).
+/// Written by the thread that does the processing, once per period, and read
+/// by the non-real-time threads without any locking. A reader may see a period
+/// that is being overwritten, which only makes the statistics slightly inexact.
+struct jack_load_stats
+{
+    enum { history_size = 1024 };
+    /// Processing times of the most recent periods, in microseconds
+    volatile float history[history_size];
+    /// Number of periods measured so far
+    volatile uint32_t periods;
+
+    /// Statistics over the most recent periods
+    struct summary
+    {
+        /// Number of periods the statistics are calculated from
+        int periods;
+        /// Processing time per period, in microseconds
+        float mean, p99, max;
+        /// Mean processing time in percent of the period length
+        float load;
+    };
+
+    jack_load_stats() : periods(0) {}
+    /// @return monotonic time in nanoseconds (cheap, no system call with vDSO)
+    static inline uint64_t now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * (uint64_t)1000000000 + ts.tv_nsec;
+    }
+    /// Record the processing time of one period (start is the value of now() at the start of the period)
+    inline void add(uint64_t start)
+    {
+        uint32_t pos = periods;
+        history[pos % history_size] = (now() - start) * 0.001f;
+        periods = pos + 1;
+    }
+    /// Calculate the statistics of the recorded periods (called from a non-real-time thread)
+    /// @param period_us length of a period in microseconds
+    void get_summary(summary &s, double period_us) const;
+};
+
+/// Plugins in processing order, together with their dependency graph. The process
+/// thread only ever sees complete lists, which are replaced as a whole.
+struct jack_plugin_list
+{
+    std::vector<jack_host *> plugins;
+    /// Output port buffers of all the plugins (in order of the plugins vector), fetched
+    /// when the list is made, so that the process thread doesn't need to
+    std::vector<float *> out_buffers;
+    /// Value of jack_client::port_generation when out_buffers was filled
+    int port_generation;
+    /// Dependencies between plugins (in order of the plugins vector), NULL if unknown or out of date
+    calf_utils::task_graph *graph;
+    jack_plugin_list() : port_generation(0), graph(NULL) {}
+    ~jack_plugin_list() { delete graph; }
+};
+
+/// Change requested by one of the non-real-time threads, applied by the process
+/// thread at the start of a cycle. Replaced objects travel back the same way, to
+/// be freed outside of the process thread.
+struct jack_command
+{
+    enum command_type {
+        SET_PARAM,          ///< set parameter param_no of plugin to value
+        SWAP_AUTOMATION,    ///< swap the automation map of plugin with amap
+        SWAP_PLUGINS,       ///< swap the plugin list with list
+    } type;
+    jack_host *plugin;
+    int param_no;
+    float value;
+    automation_map *amap;
+    jack_plugin_list *list;
+};
+
+class jack_client: public calf_utils::task_graph_iface {
 protected:
+    enum { command_queue_size = 1024 };
+    /// Plugins in the current order (as seen by the non-real-time threads)
     std::vector<jack_host *> plugins;
+    /// Taken by the threads making changes, never by the process thread
     calf_utils::ptmutex mutex;
+    /// Changes waiting for the process thread
+    calf_utils::spsc_queue<jack_command, command_queue_size> commands;
+    /// Applied commands holding objects to be deleted
+    calf_utils::spsc_queue<jack_command, command_queue_size> garbage;
+    /// Number of commands posted (producer side)
+    int commands_posted;
+    /// Number of commands applied (process thread side)
+    volatile int commands_applied;
+    /// True if the process callback may be running; if false, commands are applied directly
+    bool active;
+    /// Plugin list used by the process thread
+    jack_plugin_list *rt_plugins;
+    /// Incremented on every buffer size change (the output buffers may have moved)
+    volatile int port_generation;
 
     /// Common port for MIDI parameter automation
     jack_port_t *automation_port;
+    /// Worker threads used for running independent plugins in parallel (NULL = run everything in the JACK thread)
+    calf_utils::worker_pool *workers;
+    /// Size of the buffer being processed in the current (or last) cycle
+    volatile jack_nframes_t cycle_nframes;
+
+    void get_plugin_dependencies(std::multimap<int, int> &run_before);
+    static void do_jack_port_connect(jack_port_id_t a, jack_port_id_t b, int connect, void *p);
+    virtual void run_task(int index, int worker);
+    /// Pass a change to the process thread, waiting if the queue is full (mutex must be held)
+    void post(const jack_command &cmd);
+    /// Pass a change to the process thread (mutex must be held)
+    /// @retval false if the queue is full
+    bool try_post(const jack_command &cmd);
+    /// Pass the current plugin list with a given graph to the process thread (mutex must be held)
+    void post_plugin_list(calf_utils::task_graph *graph);
+    /// Wait until the process thread has applied all the posted commands (mutex must be held)
+    void sync();
+    /// Delete the objects replaced by the process thread (mutex must be held)
+    void collect_garbage();
+    /// Delete the object replaced by an applied command
+    static void free_command(jack_command &cmd);
+    /// Apply all the pending commands (called from the process thread)
+    void process_commands();
+    void apply_command(jack_command &cmd);
 
 public:
     jack_client_t *client;
     int input_nr, output_nr, midi_nr;
     std::string name, input_name, output_name, midi_name;
     int sample_rate;
+    /// Set when connections have changed and the plugin dependency graph needs recalculating
+    volatile bool graph_changed;
+    /// Time spent in the process callback
+    jack_load_stats load;
+    /// Number of xruns reported by JACK since the client has been opened
+    volatile int xruns;
 
     jack_client();
+    ~jack_client();
     void add(jack_host *plugin);
     void del(jack_host *plugin);
     void open(const char *client_name, const char *jack_session_id);
@@ -75,16 +202,24 @@ public:
     void close();
     void apply_plugin_order(const std::vector<int> &indices);
     void calculate_plugin_order(std::vector<int> &indices);
+    /// Use given number of threads (including the JACK process thread) for running the plugins;
+    /// only allowed while the client is not active
+    void set_worker_threads(int threads);
+    /// @return true if the plugins can be processed in parallel
+    bool is_parallel() const { return workers != NULL; }
     const char **get_ports(const char *name_re, const char *type_re, unsigned long flags);
     
     static int do_jack_process(jack_nframes_t nframes, void *p);
     static int do_jack_bufsize(jack_nframes_t numsamples, void *p);
-    template<class T>
-    void atomic_swap(T &v1, T &v2)
-    {
-        calf_utils::ptlock lock(mutex);
-        std::swap(v1, v2);
-    }
+    static int do_jack_xrun(void *p);
+    /// @return length of the current JACK period, in microseconds
+    double get_period_us() const;
+    /// Print processing time statistics of all the plugins, the overall DSP load and the xrun count
+    void dump_load_stats(FILE *f);
+    /// Set a parameter value of a plugin from a non-real-time thread
+    void set_param_value(jack_host *plugin, int param_no, float value);
+    /// Replace the automation map of a plugin from a non-real-time thread (the client takes ownership of amap)
+    void replace_automation_map(jack_host *plugin, automation_map *amap);
 };
 
 class jack_host: public plugin_ctl_iface {
@@ -103,7 +238,10 @@ public:
     float *param_values;
     float midi_meter;
     audio_module_iface *module;
+    /// Automation map as seen by the non-real-time threads
     automation_map *cc_mappings;
+    /// Automation map used by the process thread (a copy of cc_mappings)
+    automation_map *rt_cc_mappings;
     std::vector<int> write_serials;
     int last_modify_serial;
     uint32_t last_designator;
@@ -111,12 +249,15 @@ public:
 public:
     typedef int (*process_func)(jack_nframes_t nframes, void *p);
     jack_client *client;
+    /// Set when params_changed needs to be called (only used by the process thread once the plugin is running)
     bool changed;
     port midi_port;
     std::string name;
     std::string instance_name;
     int in_count, out_count, param_count;
     const plugin_metadata_iface *metadata;
+    /// Time spent processing the plugin in each period
+    jack_load_stats load;
     
 public:
     jack_host(jack_client *_client, audio_module_iface *_module, const std::string &_name, const std::string &_instance_name, calf_plugins::progress_report_iface *_priface);
@@ -136,11 +277,17 @@ public:
     int process(jack_nframes_t nframes, automation_iface &automation);
     /// Retrieve and cache output port buffers
     void cache_ports();
+    /// Append the output port buffers to bufs (for jack_plugin_list::out_buffers)
+    void get_output_buffers(std::vector<float *> &bufs);
+    /// Use the output port buffers from bufs (as appended by get_output_buffers)
+    /// @return number of the buffers used
+    int set_output_buffers(float *const *bufs);
     /// Retrieve the full list of input ports, audio+MIDI (the pointers are temporary, may point to nowhere after any changes etc.)
     void get_all_input_ports(std::vector<port *> &ports);
     /// Retrieve the full list of output ports (the pointers are temporary, may point to nowhere after any changes etc.)
     void get_all_output_ports(std::vector<port *> &ports);
-    void handle_automation_cc(uint32_t designator, int value);
+    /// Handle automation MIDI CC received at a given position in the buffer
+    void handle_automation_cc(uint32_t designator, int value, uint32_t time);
     
 public:
     // Port access
@@ -157,8 +304,12 @@ public:
     }
     virtual void set_param_value(int param_no, float value) {
         assert(param_no >= 0 && param_no < param_count);
+        // written here too, so that the new value can be read back immediately
         param_values[param_no] = value;
-        changed = true;
+        if (client)
+            client->set_param_value(this, param_no, value);
+        else
+            changed = true;
     }
     virtual void execute(int cmd_no) { module->execute(cmd_no); }
     virtual char *configure(const char *key, const char *value);
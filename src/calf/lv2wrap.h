@@ -275,12 +275,14 @@ struct lv2_wrapper
     {
         instance *const inst = (instance *)Instance;
         audio_module_iface *mod = inst->module;
+        bool activated = false;
         if (inst->set_srate) {
             mod->set_sample_rate(inst->srate_to_set);
             mod->activate();
             inst->set_srate = false;
+            activated = true;
         }
-        mod->params_changed();
+        mod->params_changed_if_needed(activated);
         uint32_t offset = 0;
         if (inst->event_data)
         {
@@ -66,11 +66,19 @@ struct filterclavier_metadata: public plugin_metadata<filterclavier_metadata>
 
 struct reverb_metadata: public plugin_metadata<reverb_metadata>
 {
-    enum { par_clip, par_meter_wet, par_meter_out, par_decay, par_hfdamp, par_roomsize, par_diffusion, par_amount, par_dry, par_predelay, par_basscut, par_treblecut, param_count };
+    enum { par_clip, par_meter_wet, par_meter_out, par_decay, par_hfdamp, par_roomsize, par_diffusion, par_amount, par_dry, par_predelay, par_basscut, par_treblecut, par_engine, param_count };
     enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true };
     PLUGIN_NAME_ID_LABEL("reverb", "reverb", "Reverb")
 };
 
+struct convolution_reverb_metadata: public plugin_metadata<convolution_reverb_metadata>
+{
+    enum { par_clip, par_meter_wet, par_meter_out, par_amount, par_dry, par_predelay, par_basscut, par_treblecut, param_count };
+    enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true };
+    PLUGIN_NAME_ID_LABEL("convolutionreverb", "convolutionreverb", "Convolution Reverb")
+    void get_configure_vars(std::vector<std::string> &names) const;
+};
+
 struct vintage_delay_metadata: public plugin_metadata<vintage_delay_metadata>
 {
     enum { par_bpm, par_bpm_host, par_divide, par_time_l, par_time_r, par_feedback, par_amount, par_mixmode, par_medium, par_dryamount, par_width, par_sync, param_count };
@@ -299,6 +307,7 @@ struct limiter_metadata: public plugin_metadata<limiter_metadata>
            param_att,
            param_asc, param_asc_led, param_asc_coeff,
            param_oversampling,
+           param_latency,
            param_count };
     PLUGIN_NAME_ID_LABEL("limiter", "limiter", "Limiter")
 };
@@ -319,6 +328,7 @@ struct multibandlimiter_metadata: public plugin_metadata<multibandlimiter_metada
            param_effrelease0, param_effrelease1, param_effrelease2, param_effrelease3,
            param_asc, param_asc_led, param_asc_coeff,
            param_oversampling,
+           param_latency,
            param_count };
     PLUGIN_NAME_ID_LABEL("multibandlimiter", "multibandlimiter", "Multiband Limiter")
 };
@@ -340,6 +350,7 @@ struct sidechainlimiter_metadata: public plugin_metadata<sidechainlimiter_metada
            param_effrelease0, param_effrelease1, param_effrelease2, param_effrelease3, param_effrelease_sc,
            param_asc, param_asc_led, param_asc_coeff,
            param_oversampling, param_level_sc,
+           param_latency,
            param_count };
     PLUGIN_NAME_ID_LABEL("sidechainlimiter", "sidechainlimiter", "Sidechain Limiter")
 };
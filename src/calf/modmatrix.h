@@ -23,6 +23,7 @@
  
 #include "giface.h"
 #include <stdio.h>
+#include <vector>
 
 namespace dsp {
 
@@ -61,6 +62,14 @@ struct modulation_entry
     }
 };
 
+/// Modulation matrix row compiled for evaluation: dest += (c0 + c1 * src1 + c2 * src1^2) * src2,
+/// with the modulation amount already included in the coefficients
+struct modulation_op
+{
+    int src1, src2, dest;
+    float c0, c1, c2;
+};
+
 };
 
 namespace calf_plugins {
@@ -73,7 +82,34 @@ protected:
     unsigned int matrix_rows;
     /// Polynomials for different scaling modes (1, x, x^2)
     static const float scaling_coeffs[calf_plugins::mod_matrix_metadata::map_type_count][3];
+    /// Three copies of the compiled matrix (rows that have any effect, sorted by destination);
+    /// whenever the matrix changes, a copy that is neither the current one nor
+    /// possibly used by the audio thread is rebuilt, and then made current
+    std::vector<dsp::modulation_op> programs[3];
+    /// Number of operations in each copy
+    int program_size[3];
+    /// Index of the current copy
+    volatile int current_program;
+    /// Index of the copy the audio thread has acknowledged (and may be using)
+    volatile int program_in_use;
 
+    /// Compile the matrix rows into a spare copy of the program and make it current
+    void compile_modmatrix();
+    /// Acknowledge the current copy of the program and return its index (audio thread).
+    /// Only the copy acknowledged last is safe from being rebuilt, so threads other than
+    /// the audio thread must use the index acquired for them by the audio thread.
+    inline int acquire_program()
+    {
+        int prg;
+        // if the copy changed before the acknowledgement was visible, the
+        // compiling thread may be rebuilding it, so take the new one instead
+        do {
+            prg = current_program;
+            program_in_use = prg;
+            __sync_synchronize();
+        } while(prg != current_program);
+        return prg;
+    }
 public:
     mod_matrix_impl(dsp::modulation_entry *_matrix, calf_plugins::mod_matrix_metadata *_metadata);
 
@@ -82,17 +118,23 @@ public:
     {
         for (int i = 0; i < moddest_count; i++)
             moddest[i] = 0;
-        for (unsigned int i = 0; i < matrix_rows; ++i)
+        int prg = acquire_program();
+        const dsp::modulation_op *ops = &programs[prg][0];
+        int size = program_size[prg];
+        for (int i = 0; i < size; ++i)
         {
-            dsp::modulation_entry &slot = matrix[i];
-            if (slot.dest) {
-                float value = modsrc[slot.src1];
-                const float *c = scaling_coeffs[slot.mapping];
-                value = c[0] + c[1] * value + c[2] * value * value;
-                moddest[slot.dest] += value * modsrc[slot.src2] * slot.amount;
-            }
+            const dsp::modulation_op &op = ops[i];
+            float value = modsrc[op.src1];
+            moddest[op.dest] += (op.c0 + value * (op.c1 + value * op.c2)) * modsrc[op.src2];
         }
     }
+    /// Process modulation matrix for several voices at once. Each source and
+    /// destination is a row of 'stride' values, one for each voice.
+    /// @param moddest  moddest_count rows of outputs
+    /// @param modsrc   rows of inputs (as many as the metadata has sources)
+    /// @param voices   number of voices (columns) to calculate
+    /// @param program  copy of the program to use, as returned by acquire_program
+    void calculate_modmatrix_voices(float *moddest, int moddest_count, const float *modsrc, int voices, int stride, int program);
     void send_configures(send_configure_iface *);
     char *configure(const char *key, const char *value);
     
@@ -54,6 +54,9 @@ public:
     void set_params(float att, float rel, float thr, float rat, float kn, float mak, float det, float stl, float byp, float mu);
     void update_curve();
     void process(float &left, float &right, const float *det_left = NULL, const float *det_right = NULL);
+    /// Process a block of samples in place, using the signal itself for detection.
+    /// Output and compression levels are then the peak and the strongest reduction within the block.
+    void process(float *left, float *right, uint32_t len);
     void activate();
     void deactivate();
     int id;
@@ -120,6 +123,9 @@ public:
     void set_params(float att, float rel, float thr, float rat, float kn, float mak, float det, float stl, float byp, float mu, float ran);
     void update_curve();
     void process(float &left, float &right, const float *det_left = NULL, const float *det_right = NULL);
+    /// Process a block of samples in place, using the signal itself for detection.
+    /// Output and gating levels are then the peak and the strongest reduction within the block.
+    void process(float *left, float *right, uint32_t len);
     void activate();
     void deactivate();
     int id;
@@ -214,7 +220,8 @@ private:
     typedef multibandcompressor_audio_module AM;
     static const int strips = 4;
     bool solo[strips];
-    float xout[strips], xin[2];
+    /// Input (after level_in) and per-band signals of the block being processed
+    float in_buf[2][MAX_SAMPLE_RUN], band_buf[strips * 2][MAX_SAMPLE_RUN];
     bool no_solo;
     float meter_inL, meter_inR, meter_outL, meter_outR;
     gain_reduction_audio_module strip[strips];
@@ -381,7 +388,8 @@ private:
     typedef multibandgate_audio_module AM;
     static const int strips = 4;
     bool solo[strips];
-    float xout[strips], xin[2];
+    /// Input (after level_in) and per-band signals of the block being processed
+    float in_buf[2][MAX_SAMPLE_RUN], band_buf[strips * 2][MAX_SAMPLE_RUN];
     bool no_solo;
     float meter_inL, meter_inR, meter_outL, meter_outR;
     expander_audio_module gate[strips];
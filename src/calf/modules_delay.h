@@ -33,6 +33,10 @@
 #include "loudness.h"
 #include <math.h>
 #include "plugin_tools.h"
+#include "convolution.h"
+#include "fdn_reverb.h"
+#include "workers.h"
+#include <string>
 
 namespace calf_plugins {
 
@@ -47,7 +51,10 @@ class reverb_audio_module: public audio_module<reverb_metadata>
     vumeters meters;
 public:    
     dsp::reverb reverb;
-    dsp::simple_delay<131072, dsp::stereo_sample<float> > pre_delay;
+    /// Alternative engine (par_engine = 1)
+    dsp::fdn_reverb fdn;
+    int engine;
+    dsp::arena_delay<dsp::stereo_sample<float> > pre_delay;
     dsp::onepole<float> left_lo, right_lo, left_hi, right_hi;
     uint32_t srate;
     dsp::gain_smoothing amount, dryamount;
@@ -55,13 +62,63 @@ public:
     float meter_wet, meter_out;
     uint32_t clip;
     
+    reverb_audio_module();
     void params_changed();
     uint32_t process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask);
     void activate();
     void set_sample_rate(uint32_t sr);
+    int get_tail_length() const;
     void deactivate();
 };
 
+/**********************************************************************
+ * CONVOLUTION REVERB
+**********************************************************************/
+
+class convolution_reverb_audio_module: public audio_module<convolution_reverb_metadata>
+{
+    enum { queue_size = 4 };
+    vumeters meters;
+    /// Engine used by the audio thread (NULL = no impulse response loaded)
+    dsp::convolver *engine;
+    /// Engines prepared by configure(), waiting to be picked up by the audio thread
+    calf_utils::spsc_queue<dsp::convolver *, queue_size> incoming;
+    /// Engines replaced in the audio thread, to be deleted outside of it (twice the size,
+    /// as everything that has been queued on incoming may end up here before collect_garbage runs)
+    calf_utils::spsc_queue<dsp::convolver *, 2 * queue_size> garbage;
+    /// True between activate() and deactivate(), when engine is owned by the audio thread
+    volatile bool active;
+    std::string ir_file;
+    /// Sample rate the queued/current engine was made for
+    uint32_t engine_srate;
+
+    /// Load ir_file for the current sample rate and pass it to the audio thread
+    char *load_impulse_response();
+    /// Start using a new engine (may be NULL); false if there are too many engines queued already
+    bool set_engine(dsp::convolver *new_engine);
+    /// Delete engines released by the audio thread
+    void collect_garbage();
+public:
+    dsp::arena_delay<dsp::stereo_sample<float> > pre_delay;
+    dsp::onepole<float> left_lo, right_lo, left_hi, right_hi;
+    uint32_t srate;
+    dsp::gain_smoothing amount, dryamount;
+    int predelay_amt;
+    /// Wet signal before and after the convolution
+    float wet_in[2][MAX_SAMPLE_RUN], wet_out[2][MAX_SAMPLE_RUN];
+
+    convolution_reverb_audio_module();
+    ~convolution_reverb_audio_module();
+    void params_changed();
+    uint32_t process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask);
+    void activate();
+    void deactivate();
+    void set_sample_rate(uint32_t sr);
+    int get_tail_length() const;
+    char *configure(const char *key, const char *value);
+    void send_configures(send_configure_iface *sci);
+};
+
 /**********************************************************************
  * VINTAGE DELAY by Krzysztof Foltman
 **********************************************************************/
@@ -69,12 +126,20 @@ public:
 class vintage_delay_audio_module: public audio_module<vintage_delay_metadata>
 {
 public:    
-    // 1MB of delay memory per channel... uh, RAM is cheap
-    enum { MAX_DELAY = 262144, ADDR_MASK = MAX_DELAY - 1 };
+    /// Longest delay possible with the parameter ranges (16 beats at 30 BPM), and
+    /// the initial size of the part of the buffers in use
+    enum { MAX_DELAY_SECONDS = 32, MIN_BUFFER = 16384 };
     enum { MIXMODE_STEREO, MIXMODE_PINGPONG, MIXMODE_LR, MIXMODE_RL }; 
-    float buffers[2][MAX_DELAY];
+    /// Delay memory of both channels (from dsp::delay_arena), buf_capacity values each
+    /// (enough for both delays at their longest, as the ping-pong taps use the sum).
+    /// Only the first buf_mask + 1 values are used as a ring buffer; that part grows
+    /// with the delay times and never shrinks, so the rest never becomes resident.
+    float *buffers[2];
+    int buf_capacity, buf_mask;
     int bufptr, deltime_l, deltime_r, mixmode, medium, old_medium;
-    /// number of table entries written (value is only important when it is less than MAX_DELAY, which means that the buffer hasn't been totally filled yet)
+    /// Ring size and delay times waiting for the ring to wrap around (grow_mask = 0 if none)
+    int grow_mask, grow_deltime_l, grow_deltime_r;
+    /// number of table entries written (value is only important when it is less than the buffer size, which means that the buffer hasn't been totally filled yet)
     int age;
     
     dsp::gain_smoothing amt_left, amt_right, fb_left, fb_right, dry, chmix;
@@ -84,12 +149,18 @@ public:
     uint32_t srate;
     
     vintage_delay_audio_module();
+    ~vintage_delay_audio_module();
     
+    /// Switch to the larger ring requested by params_changed, see process
+    void apply_grow();
     void params_changed();
     void activate();
     void deactivate();
     void set_sample_rate(uint32_t sr);
+    int get_tail_length() const;
     void calc_filters();
+    /// Process the samples from offset to end with the current ring
+    void process_run(uint32_t offset, uint32_t end);
     uint32_t process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask);
     
     long _tap_avg;
@@ -126,6 +197,7 @@ public:
     void activate();
     void deactivate();
     void set_sample_rate(uint32_t sr);
+    int get_tail_length() const;
     uint32_t process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask);
 };
 
@@ -66,10 +66,21 @@ private:
     dsp::biquad_d2 hp[3][2], lp[3][2];
     dsp::biquad_d2 lsL, lsR, hsL, hsR;
     dsp::biquad_d2 pL[PeakBands], pR[PeakBands];
+    /// Section slots in the cascade: lp stages, hp stages, low shelf, high shelf, peaks
+    enum { lp_section = 0, hp_section = 3, ls_section = 6, hs_section = 7, peak_section = 8, sections = peak_section + PeakBands };
+    /// The filters above (which only hold the coefficients) are run as a two lane cascade - L and R, or M and S
+    dsp::biquad_cascade<2, sections> cascade;
+    /// Lanes (bit 0 - left/mid, bit 1 - right/side) of each section that were active in the previous block
+    int section_lanes[sections];
     dsp::bypass bypass;
+    /// Smoothed input and output levels
+    dsp::gain_smoothing level_in, level_out;
     int keep_gliding;
     mutable int last_peak;
-    inline void process_hplp(float &left, float &right);
+    /// Cached curves: the overall response, then one per band (in last_peak order)
+    mutable dsp::biquad_response graph_response[PeakBands + 5];
+    inline void setup_section(int section, int active, const dsp::biquad_d2 &left, const dsp::biquad_d2 &right);
+    inline void run_sections(double *buf, uint32_t len, int first, int count, int active, bool &ms);
 public:
     typedef std::complex<double> cfloat;
     uint32_t srate;
@@ -88,6 +99,8 @@ public:
     {
         srate = sr;
         _analyzer.set_sample_rate(sr);
+        level_in.set_sample_rate(sr);
+        level_out.set_sample_rate(sr);
         int meter[] = {AM::param_meter_inL, AM::param_meter_inR,  AM::param_meter_outL, AM::param_meter_outR};
         int clip[] = {AM::param_clip_inL, AM::param_clip_inR, AM::param_clip_outL, AM::param_clip_outR};
         meters.init(params, meter, clip, 4, sr);
@@ -319,7 +332,6 @@ public:
     uint32_t srate;
     bool is_active;
     float * buffer;
-    float in[channels];
     unsigned int pos;
     unsigned int buffer_size;
     int last_peak;
@@ -362,6 +374,8 @@ public:
     vumeters meters;
     analyzer _analyzer;
     double attack, release, fcoeff, log2_;
+    /// Cached curves of the bands
+    mutable dsp::biquad_response band_response[32];
     vocoder_audio_module();
     void activate();
     void deactivate();
@@ -26,6 +26,7 @@
 #include "biquad.h"
 #include "inertia.h"
 #include "audio_fx.h"
+#include "oversampler.h"
 #include "giface.h"
 #include "metadata.h"
 #include "plugin_tools.h"
@@ -42,9 +43,17 @@ private:
     typedef limiter_audio_module AM;
     uint32_t asc_led;
     int mode, mode_old, oversampling_old;
+    /// Highest oversampling factor (the range of param_oversampling)
+    static const int max_over = 4;
     dsp::lookahead_limiter limiter;
-    dsp::resampleN resampler[2];
+    dsp::oversampler resampler[2];
     dsp::bypass bypass;
+    /// Dry signal for the bypass, delayed by the latency of the oversampling
+    dry_delay<2, 128> dry;
+    /// Latency of the oversampling (reported to the host), in samples
+    int latency;
+    /// Input (after level_in) and oversampled signal of the block being processed
+    float in_buf[2][MAX_SAMPLE_RUN], over_buf[2][MAX_SAMPLE_RUN * max_over];
     vumeters meters;
 public:
     uint32_t srate;
@@ -69,15 +78,25 @@ class multibandlimiter_audio_module: public audio_module<multibandlimiter_metada
 private:
     typedef multibandlimiter_audio_module AM;
     static const int strips = 4;
+    /// Highest oversampling factor (the range of param_oversampling)
+    static const int max_over = 4;
     uint32_t asc_led, cnt;
     int _mode, mode_old;
     bool solo[strips];
     bool no_solo;
     dsp::lookahead_limiter strip[strips];
     dsp::lookahead_limiter broadband;
-    dsp::resampleN resampler[strips][2];
+    dsp::oversampler resampler[strips][2];
     dsp::crossover crossover;
     dsp::bypass bypass;
+    /// Dry signal for the bypass, delayed by the latency of the oversampling
+    dry_delay<2, 128> dry;
+    /// Latency of the oversampling (reported to the host), in samples
+    int latency;
+    /// Input (after level_in) and per-band signals of the block being processed
+    float in_buf[2][MAX_SAMPLE_RUN], band_buf[strips * 2][MAX_SAMPLE_RUN];
+    /// Oversampled bands and oversampled sum of the limited bands
+    float over_buf[strips * 2][MAX_SAMPLE_RUN * max_over], res_buf[2][MAX_SAMPLE_RUN * max_over];
     float over;
     unsigned int pos;
     unsigned int buffer_size;
@@ -112,15 +131,26 @@ class sidechainlimiter_audio_module: public audio_module<sidechainlimiter_metada
 private:
     typedef sidechainlimiter_audio_module AM;
     static const int strips = 5;
+    /// Highest oversampling factor (the range of param_oversampling)
+    static const int max_over = 4;
     uint32_t asc_led, cnt;
     int _mode, mode_old;
     bool solo[strips];
     bool no_solo;
     dsp::lookahead_limiter strip[strips];
     dsp::lookahead_limiter broadband;
-    dsp::resampleN resampler[strips][2];
+    dsp::oversampler resampler[strips][2];
     dsp::crossover crossover;
     dsp::bypass bypass;
+    /// Dry signal for the bypass, delayed by the latency of the oversampling
+    dry_delay<2, 128> dry;
+    /// Latency of the oversampling (reported to the host), in samples
+    int latency;
+    /// Input (after level_in) and per-band signals of the block being processed;
+    /// the last band is the sidechain input
+    float in_buf[2][MAX_SAMPLE_RUN], band_buf[strips * 2][MAX_SAMPLE_RUN];
+    /// Oversampled bands and oversampled sum of the limited bands
+    float over_buf[strips * 2][MAX_SAMPLE_RUN * max_over], res_buf[2][MAX_SAMPLE_RUN * max_over];
     float over;
     unsigned int pos;
     unsigned int buffer_size;
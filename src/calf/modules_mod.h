@@ -51,6 +51,7 @@ public:
         is_active = false;
     }
     void set_sample_rate(uint32_t sr);
+    int get_tail_length() const;
     void params_changed();
     void params_reset();
     void activate();
@@ -86,6 +87,7 @@ public:
     void params_reset();
     void activate();
     void set_sample_rate(uint32_t sr);
+    int get_tail_length() const;
     void deactivate();
     uint32_t process(uint32_t offset, uint32_t nsamples, uint32_t inputs_mask, uint32_t outputs_mask) {
         left.process(outs[0] + offset, ins[0] + offset, nsamples);
@@ -169,6 +171,7 @@ public:
     void activate();
     void deactivate();
     void set_sample_rate(uint32_t sr);
+    int get_tail_length() const;
     bool get_graph(int index, int subindex, int phase, float *data, int points, cairo_iface *context, int *mode) const;
     float freq_gain(int subindex, float freq) const;
     bool get_dot(int index, int subindex, int phase, float &x, float &y, int &size, cairo_iface *context) const;
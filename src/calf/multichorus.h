@@ -49,6 +49,7 @@ public:
     /// LFO Range scaling for non-100% overlap
     uint32_t voice_depth;
 public:
+    enum { MaxVoices = Voices };
     sine_multi_lfo()
     {
         phase = dphase = vphase = 0.0;
@@ -92,6 +93,17 @@ public:
         // apply the voice offset/depth (rescale from -65535..65535 to appropriate voice's "band")
         return -65535 + voice * voice_offset + ((voice_depth >> (30-13)) * (65536 + intval) >> 13);
     }
+    /// Get LFO values for given voice for the next len steps, without advancing the phase (same as get_value + step)
+    inline void get_values(uint32_t voice, int *values, int len) const {
+        chorus_phase voice_phase = phase + vphase * (int)voice;
+        uint32_t offset = -65535 + voice * voice_offset, depth = voice_depth >> (30-13);
+        for (int i = 0; i < len; i++) {
+            unsigned int ipart = voice_phase.ipart();
+            int intval = voice_phase.lerp_by_fract_int<int, 14, int>(sine.data[ipart], sine.data[ipart+1]);
+            values[i] = offset + (depth * (65536 + intval) >> 13);
+            voice_phase += dphase;
+        }
+    }
     inline void step() {
         phase += dphase;
     }
@@ -104,13 +116,17 @@ public:
 };
 
 /**
- * Multi-tap chorus without feedback.
+ * Multi-tap chorus without feedback. Processed in blocks: LFO values and
+ * tap positions of all voices are computed for a whole block, then the taps
+ * are read with gather_interp.
  * Perhaps MaxDelay should be a bit longer!
  */
 template<class T, class MultiLfo, class Postprocessor, int MaxDelay=4096>
 class multichorus: public chorus_base
 {
 protected:
+    /// Number of samples processed at once (MaxDelay needs to be a power of 2)
+    enum { BlockSize = 64 };
     simple_delay<MaxDelay,T> delay;
 public:    
     MultiLfo lfo;
@@ -150,31 +166,62 @@ public:
         // NB: calculation of mod_depth_samples (and multiply-by-32) is in chorus_base::set_mod_depth
         mdepth = mdepth >> 2;
         T scale = lfo.get_scale();
-        for (int i=0; i<nsamples; i++) {
-            phase += dphase;
-            
-            float in = *buf_in++;
+        unsigned int nvoices = lfo.get_voices();
+        // The block is written into the delay line first, then each voice's
+        // taps are read for the whole block. Every tap is at least 2 samples
+        // behind the sample being processed, so the only thing to watch for
+        // is the newly written samples overwriting the oldest ones that
+        // the longest taps still need - which limits the block length.
+        float in[BlockSize];
+        T out[BlockSize];
+        int dv[MultiLfo::MaxVoices * BlockSize], pos[BlockSize];
+        float frac[BlockSize];
+        while(nsamples > 0) {
+            int len = std::min(nsamples, (int)BlockSize);
+            int maxdv = 0;
+            for (unsigned int v = 0; v < nvoices; v++)
+            {
+                int *vdv = dv + v * BlockSize;
+                lfo.get_values(v, vdv, len);
+                for (int i = 0; i < len; i++)
+                {
+                    // 3 = log2(32 >> 2) + 1 because the LFO value is in range of [-65535, 65535] (17 bits)
+                    vdv[i] = mds + (mdepth * vdv[i] >> (3 + 1));
+                    maxdv = std::max(maxdv, vdv[i]);
+                }
+            }
+            len = std::max(1, std::min(len, MaxDelay - (maxdv >> 16)));
             
-            delay.put(in);
-            unsigned int nvoices = lfo.get_voices();
-            T out = 0.f;
+            int start = delay.pos;
+            for (int i = 0; i < len; i++)
+            {
+                in[i] = *buf_in++;
+                delay.put(in[i]);
+                out[i] = 0.f;
+            }
             // add up values from all voices, each voice tell its LFO phase and the buffer value is picked at that location
             for (unsigned int v = 0; v < nvoices; v++)
             {
-                int lfo_output = lfo.get_value(v);
-                // 3 = log2(32 >> 2) + 1 because the LFO value is in range of [-65535, 65535] (17 bits)
-                int dv = mds + (mdepth * lfo_output >> (3 + 1));
-                int ifv = dv >> 16;
-                T fd; // signal from delay's output
-                delay.get_interp(fd, ifv, (dv & 0xFFFF)*(1.0/65536.0));
-                out += fd;
+                const int *vdv = dv + v * BlockSize;
+                for (int i = 0; i < len; i++)
+                {
+                    pos[i] = (start + i + 1 - (vdv[i] >> 16)) & (MaxDelay - 1);
+                    frac[i] = (vdv[i] & 0xFFFF)*(1.0/65536.0);
+                }
+                gather_interp(&delay.data[0], MaxDelay - 1, pos, frac, out, len, true);
             }
             // apply the post filter
-            out = post.process(out);
-            T sdry = in * gs_dry.get();
-            T swet = out * gs_wet.get() * scale;
-            *buf_out++ = sdry + swet;
-            lfo.step();
+            for (int i = 0; i < len; i++)
+                out[i] = post.process(out[i]);
+            for (int i = 0; i < len; i++)
+            {
+                phase += dphase;
+                T sdry = in[i] * gs_dry.get();
+                T swet = out[i] * gs_wet.get() * scale;
+                *buf_out++ = sdry + swet;
+                lfo.step();
+            }
+            nsamples -= len;
         }
         post.sanitize();
     }
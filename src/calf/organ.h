@@ -213,9 +213,43 @@ public:
     void process(organ_parameters *parameters, float (*data)[2], unsigned int len, float sample_rate);
 };
 
+/// Drawbar oscillators (using the small waves) of all the voices that render their
+/// next block at the same time, stored as a structure of arrays, so that four of
+/// them can be calculated at once in SIMD registers.
+class organ_voice_bank
+{
+public:
+    enum { BlockSize = 64, MaxLanes = 128 };
+protected:
+    int lanes;
+    /// Phases and phase increments (20 fractional bits), with room for padding to a multiple of 4
+    uint32_t phase[MaxLanes + 3], dphase[MaxLanes + 3];
+    const float *data[MaxLanes + 3];
+    float ampl[MaxLanes], ampr[MaxLanes];
+    float (*out[MaxLanes])[2];
+public:
+    organ_voice_bank() : lanes(0) {}
+    /// Add an oscillator that adds BlockSize samples of the wave to out (panned
+    /// according to l and r gains). If the bank is full, it's rendered first.
+    inline void add(uint32_t _phase, uint32_t _dphase, const float *wave, float l, float r, float (*dest)[2])
+    {
+        if (lanes == MaxLanes)
+            render();
+        phase[lanes] = _phase;
+        dphase[lanes] = _dphase;
+        data[lanes] = wave;
+        ampl[lanes] = l;
+        ampr[lanes] = r;
+        out[lanes] = dest;
+        lanes++;
+    }
+    /// Render all the oscillators added so far and empty the bank
+    void render();
+};
+
 class organ_voice: public dsp::voice, public organ_voice_base {
 protected:    
-    enum { Channels = 2, BlockSize = 64, EnvCount = organ_parameters::EnvCount, FilterCount = organ_parameters::FilterCount, MaxSampleRun = calf_plugins::MAX_SAMPLE_RUN };
+    enum { Channels = 2, BlockSize = organ_voice_bank::BlockSize, EnvCount = organ_parameters::EnvCount, FilterCount = organ_parameters::FilterCount, MaxSampleRun = calf_plugins::MAX_SAMPLE_RUN };
     union {
         float output_buffer[BlockSize][Channels];
         float aux_buffers[3][BlockSize][Channels];
@@ -246,6 +280,11 @@ public:
     virtual float get_priority() { return stolen ? 20000 : (perc_released ? 1 : (sostenuto ? 200 : 100)); }
     virtual void steal();
     void render_block(int current_snapshot);
+    /// First part of render_block: clear the buffers and add the drawbars to the bank.
+    /// @retval false if the voice is silent or only has percussion (which is already rendered)
+    bool prepare_block(organ_voice_bank &bank);
+    /// Second part of render_block, after the bank has been rendered: envelopes, filters and vibrato
+    void finish_block();
     
     virtual int get_current_note() {
         return note;
@@ -285,16 +324,23 @@ public:
 };
 
 struct drawbar_organ: public dsp::basic_synth, public calf_plugins::organ_enums {
+    enum { MaxVoices = 36 };
     organ_parameters *parameters;
     percussion_voice percussion;
     scanner_vibrato global_vibrato;
     two_band_eq eq_l, eq_r;
+    /// Drawbars of the voices being rendered, one bank per render partition
+    organ_voice_bank voice_bank[MaxRenderPartitions];
+    /// Voices waiting for the bank to be rendered
+    dsp::block_voice<organ_voice> *pending_voices[MaxRenderPartitions][MaxVoices];
     
      drawbar_organ(organ_parameters *_parameters)
     : parameters(_parameters)
     , percussion(_parameters) {
-        init_voices(36);
+        init_voices(MaxVoices);
     }
+    /// Render a range of voices; blocks of voices that are aligned are rendered together
+    virtual void render_voices(dsp::voice **first, dsp::voice **last, float (*output)[2], int nsamples, int partition);
     void render_separate(float *output[], int nsamples);
     dsp::voice *alloc_voice();
     virtual void percussion_note_on(int note, int vel);
@@ -88,22 +88,16 @@ struct bandlimiter
     void compute_spectrum(float input[SIZE])
     {
         dsp::fft<float, SIZE_BITS> &fft = get_fft();
-        std::complex<float> *data = new std::complex<float>[SIZE];
-        for (int i = 0; i < SIZE; i++)
-            data[i] = input[i];
-        fft.calculate(data, spectrum, false);
-        delete []data;
+        fft.calculate_real(input, spectrum);
     }
     
     /// Generate the waveform from the contained spectrum.
     void compute_waveform(float output[SIZE])
     {
         dsp::fft<float, SIZE_BITS> &fft = get_fft();
-        std::complex<float> *data = new std::complex<float>[SIZE];
-        fft.calculate(spectrum, data, true);
-        for (int i = 0; i < SIZE; i++)
-            output[i] = data[i].real();
-        delete []data;
+        std::complex<float> *temp = new std::complex<float>[SIZE / 2];
+        fft.calculate_real_inverse(spectrum, output, temp);
+        delete []temp;
     }
     
     /// remove DC offset of the spectrum (it usually does more harm than good!)
@@ -117,9 +111,9 @@ struct bandlimiter
     void make_waveform(float output[SIZE], int cutoff, bool foldover = false)
     {
         dsp::fft<float, SIZE_BITS> &fft = get_fft();
-        std::vector<std::complex<float> > new_spec, iffted;
+        std::vector<std::complex<float> > new_spec, temp;
         new_spec.resize(SIZE);
-        iffted.resize(SIZE);
+        temp.resize(SIZE / 2);
         // Copy original harmonics up to cutoff point
         new_spec[0] = spectrum[0];
         for (int i = 1; i < cutoff; i++)
@@ -152,9 +146,7 @@ struct bandlimiter
                 new_spec[SIZE - i] = 0.f;
         }
         // convert back to time domain (IFFT) and extract only real part
-        fft.calculate(&new_spec.front(), &iffted.front(), true);
-        for (int i = 0; i < SIZE; i++)
-            output[i] = iffted[i].real();
+        fft.calculate_real_inverse(&new_spec.front(), output, &temp.front());
     }
 };
 
@@ -167,6 +159,13 @@ struct waveform_family: public std::map<uint32_t, float *>
     using std::map<uint32_t, float *>::end;
     using std::map<uint32_t, float *>::lower_bound;
     float original[SIZE];
+    /// The waveforms are not owned by the family (eg. they are mapped from a wavetable cache file)
+    bool external_data;
+    
+    waveform_family()
+    {
+        external_data = false;
+    }
     
     /// Fill the family using specified bandlimiter and original waveform. Optionally apply foldover. 
     /// Does not produce harmonics over specified limit (limit = (SIZE / 2) / min_number_of_harmonics)
@@ -220,12 +219,21 @@ struct waveform_family: public std::map<uint32_t, float *>
         // printf("Level = %08x\n", i->first);
         return i->second;
     }
+    /// Delete the waveforms (unless owned by someone else) and remove them from the map.
+    void release()
+    {
+        if (!external_data)
+        {
+            for (iterator i = begin(); i != end(); i++)
+                delete []i->second;
+        }
+        clear();
+        external_data = false;
+    }
     /// Destructor, deletes the waveforms and removes them from the map.
     ~waveform_family()
     {
-        for (iterator i = begin(); i != end(); i++)
-            delete []i->second;
-        clear();
+        release();
     }
 };
 
@@ -0,0 +1,148 @@
+/* Calf DSP Library
+ * Block-based polyphase FIR oversampling
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#ifndef __CALF_OVERSAMPLER_H
+#define __CALF_OVERSAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace dsp {
+
+/// Anti-imaging/anti-aliasing lowpass of a single integer ratio resampling
+/// stage, split into polyphase components. Kernels are shared between all
+/// the resamplers and never freed.
+struct resampler_kernel
+{
+    /// Ratio of the stage
+    int factor;
+    /// Length of each polyphase component (a multiple of 4, zero-padded)
+    int taps;
+    /// factor polyphase components of taps coefficients each; component p
+    /// holds h[p], h[p + factor], h[p + 2 * factor]... of the full kernel h
+    std::vector<float> phases;
+    /// For components that consist of a single non-zero tap (every factor-th
+    /// tap of a linear phase Nyquist filter is zero), the index of that tap,
+    /// otherwise -1
+    std::vector<int> delay_tap;
+    /// Delay of the kernel at DC, in samples of the higher rate
+    double delay;
+
+    /// Return a kernel for a stage of a given ratio, working at 'ratio' times
+    /// the base sample rate (on the lower rate side); designed on first use
+    static const resampler_kernel *get(int factor, int ratio, bool minimum_phase);
+};
+
+/// Dot product of two float vectors; len needs to be a multiple of 4
+float dot_product(const float *a, const float *b, int len);
+
+/// Interpolator (factor times more output than input samples)
+class upsampler_stage
+{
+    const resampler_kernel *kernel;
+    /// Most recent inputs, newest first, stored twice so that the last
+    /// kernel->taps inputs are always contiguous
+    std::vector<float> hist;
+    int pos;
+public:
+    upsampler_stage() : kernel(NULL), pos(0) {}
+    /// Make room for the history of a kernel, so that set_kernel(k) doesn't allocate
+    void reserve(const resampler_kernel *k);
+    void set_kernel(const resampler_kernel *k);
+    void reset();
+    void process(const float *in, float *out, uint32_t len);
+};
+
+/// Decimator (factor times less output than input samples)
+class downsampler_stage
+{
+    const resampler_kernel *kernel;
+    /// factor histories of 2 * kernel->taps items each, one for each polyphase
+    /// component, stored the same way as in upsampler_stage
+    std::vector<float> hist;
+    int pos;
+public:
+    downsampler_stage() : kernel(NULL), pos(0) {}
+    /// Make room for the history of a kernel, so that set_kernel(k) doesn't allocate
+    void reserve(const resampler_kernel *k);
+    void set_kernel(const resampler_kernel *k);
+    void reset();
+    /// @param len number of output samples (reads len * factor inputs)
+    void process(const float *in, float *out, uint32_t len);
+};
+
+/**
+ * Oversampling by an integer factor between 1 and 16 using polyphase FIR
+ * filters, with a matching downsampler for returning to the original rate.
+ * Factors are split into a cascade of stages: the odd part of the factor
+ * (if any) first, followed by 2x half-band stages. Only the stage running
+ * at the lowest rate needs a steep transition band, the following ones get
+ * progressively shorter. Filters pass up to 0.45 of the base sample rate
+ * and reject everything that would alias into that range by 85 dB or more.
+ *
+ * Linear phase filters have a constant delay, which is usually what's wanted
+ * for processing that doesn't mix the result with the original signal.
+ * Minimum phase versions of the same filters have the same magnitude
+ * response and a much lower delay, at a cost of phase distortion near
+ * the top of the passband.
+ *
+ * Blocks of any length can be processed. set_params may allocate memory,
+ * unless the factor has been covered by an earlier call to prepare.
+ */
+class oversampler
+{
+public:
+    enum { MAX_FACTOR = 16, MAX_STAGES = 4, MAX_BLOCK = 256 };
+protected:
+    int factor, stages;
+    bool minimum_phase;
+    upsampler_stage up[MAX_STAGES];
+    downsampler_stage down[MAX_STAGES];
+    /// Factors of the individual stages
+    int stage_factor[MAX_STAGES];
+    /// Intermediate results between the stages
+    std::vector<float> scratch[2];
+    double latency;
+    /// Split a factor into the ratios of the stages, return the number of stages
+    static int split_factor(int factor, int *stage_factor);
+public:
+    oversampler();
+    /// Design the kernels and allocate the buffers for all the factors up to
+    /// max_factor, so that switching between them in set_params is real-time
+    /// safe; not real-time safe itself
+    void prepare(int max_factor, bool minimum_phase = false);
+    /// Set the oversampling factor (1-16) and filter type; resets the state
+    /// if anything has changed
+    void set_params(int factor, bool minimum_phase = false);
+    int get_factor() const { return factor; }
+    /// Combined delay of upsampling and downsampling (at DC), in samples of the base rate
+    double get_latency() const { return latency; }
+    /// Clear the filter histories
+    void reset();
+    /// Upsample len samples into len * factor samples (in and out must not overlap)
+    void upsample(const float *in, float *out, uint32_t len);
+    /// Downsample len * factor samples into len samples (in and out may be the same buffer)
+    void downsample(const float *in, float *out, uint32_t len);
+};
+
+};
+
+#endif
@@ -25,6 +25,7 @@
 
 #include "giface.h"
 #include "vumeter.h"
+#include "bypass.h"
 
 namespace calf_plugins {
 
@@ -53,19 +54,49 @@ public:
         params = prms;
     }
     void process(float *values) {
-        for (size_t i = 0; i < meters.size(); ++i) {
-            meter_data &md = meters[i];
-            if ((md.level_idx != -1 && params[(int)fabs(md.level_idx)] != NULL) || 
-                (md.clip_idx != -1 && params[(int)fabs(md.clip_idx)] != NULL))
-            {
-                md.meter.process(values[i]);
-                if (md.level_idx != -1 && params[(int)fabs(md.level_idx)])
-                    *params[(int)fabs(md.level_idx)] = md.meter.level;
-                if (md.clip_idx != -1 && params[(int)fabs(md.clip_idx)])
-                    *params[(int)fabs(md.clip_idx)] = md.meter.clip > 0 ? 1.f : 0.f;
-            }
+        for (size_t i = 0; i < meters.size(); ++i)
+            process(i, values[i]);
+    }
+    /// Feed a single value to one of the meters
+    void process(int index, float value) {
+        meter_data &md = meters[index];
+        if (is_connected(md))
+        {
+            md.meter.process(value);
+            write_params(md);
+        }
+    }
+    /// Feed a block of samples (multiplied by gain) to one of the meters; same as
+    /// calling process for each of them, but vectorized, and the parameters are
+    /// only written once
+    void process(int index, const float *values, unsigned int len, float gain = 1.f) {
+        meter_data &md = meters[index];
+        if (is_connected(md))
+        {
+            md.meter.run_sample_loop(values, len, gain);
+            write_params(md);
         }
     }
+    /// Feed two channels of a block of samples (multiplied by gain) to one of the meters
+    void process_stereo(int index, const float *left, const float *right, unsigned int len, float gain = 1.f) {
+        meter_data &md = meters[index];
+        if (is_connected(md))
+        {
+            md.meter.run_sample_loop(left, len, gain);
+            md.meter.run_sample_loop(right, len, gain);
+            write_params(md);
+        }
+    }
+    inline bool is_connected(const meter_data &md) const {
+        return (md.level_idx != -1 && params[(int)fabs(md.level_idx)] != NULL) || 
+            (md.clip_idx != -1 && params[(int)fabs(md.clip_idx)] != NULL);
+    }
+    inline void write_params(const meter_data &md) {
+        if (md.level_idx != -1 && params[(int)fabs(md.level_idx)])
+            *params[(int)fabs(md.level_idx)] = md.meter.level;
+        if (md.clip_idx != -1 && params[(int)fabs(md.clip_idx)])
+            *params[(int)fabs(md.clip_idx)] = md.meter.clip > 0 ? 1.f : 0.f;
+    }
     void fall(unsigned int numsamples) {
         for (size_t i = 0; i < meters.size(); ++i)
             if (meters[i].level_idx != -1)
@@ -73,6 +104,62 @@ public:
     }
 };
 
+/// Dry signal path of a module whose processing has latency: the inputs
+/// delayed by the same amount, so that the processed and the bypassed signal
+/// line up (in the crossfade, and with the latency reported to the host)
+/// @param MaxLatency longest latency in samples (a power of 2)
+template<int Channels, int MaxLatency>
+class dry_delay
+{
+    enum { SIZE = 2 * MaxLatency, MASK = SIZE - 1 };
+    float line[Channels][SIZE];
+    int pos, latency;
+public:
+    /// Delayed inputs of the last process call
+    float buffer[Channels][MAX_SAMPLE_RUN];
+
+    dry_delay() : latency(0) { reset(); }
+    void reset()
+    {
+        memset(line, 0, sizeof(line));
+        pos = 0;
+    }
+    /// @param samples latency to compensate (0 to MaxLatency)
+    void set_latency(int samples)
+    {
+        latency = std::max(0, std::min(samples, (int)MaxLatency));
+    }
+    int get_latency() const { return latency; }
+    /// Delay len (<= MAX_SAMPLE_RUN) samples of each input starting at offset into buffer
+    void process(float *inputs[], uint32_t offset, uint32_t len)
+    {
+        int p = pos;
+        for (int c = 0; c < Channels; c++)
+        {
+            p = pos;
+            for (uint32_t i = 0; i < len; i++)
+            {
+                line[c][p] = inputs[c][offset + i];
+                buffer[c][i] = line[c][(p - latency) & MASK];
+                p = (p + 1) & MASK;
+            }
+        }
+        pos = p;
+    }
+    /// Crossfade the outputs (starting at offset) with the delayed inputs, see bypass::crossfade
+    void crossfade(dsp::bypass &bp, float *outputs[], uint32_t offset, uint32_t len)
+    {
+        float *dry[Channels], *outs[Channels];
+        for (int c = 0; c < Channels; c++)
+        {
+            dry[c] = buffer[c];
+            outs[c] = outputs[c] + offset;
+        }
+        bp.crossfade(dry, outs, Channels, 0, len);
+    }
+};
+
+
 struct debug_send_configure_iface: public send_configure_iface
 {
     void send_configure(const char *key, const char *value)
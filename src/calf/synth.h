@@ -29,6 +29,8 @@
 #include <bitset>
 #include <list>
 #include <stack>
+#include <vector>
+#include "workers.h"
 
 namespace dsp {
 
@@ -295,10 +297,38 @@ protected:
     /// Maximum allocated number of channels
     unsigned int polyphony_limit;
 
+    /// Executes one partition of the active voices per task
+    struct partition_renderer: public calf_utils::task_graph_iface
+    {
+        basic_synth *synth;
+        virtual void run_task(int index, int worker) { synth->render_partition(index); }
+    };
+    /// Helper threads for rendering voices, NULL if voices are rendered by the calling thread only
+    calf_utils::worker_pool *render_pool;
+    /// One node per partition, no dependencies between them
+    calf_utils::task_graph *render_graph;
+    partition_renderer renderer;
+    /// Number of partitions the active voices are split into
+    int render_partitions;
+    /// Accumulation buffers of the partitions (RenderBlock stereo samples each), except the first
+    /// partition, which renders directly into the output
+    std::vector<float> render_buffers;
+    /// Output and length of the slice being rendered by the partitions
+    float (*render_output)[2];
+    int render_nsamples;
+
     void init_voices(int count);
     void kill_note(int note, int vel, bool just_one);
     virtual dsp::voice *alloc_voice() = 0;
+    /// Render a range of the active voices, adding the result to output. Called from several
+    /// threads at once (with different ranges) when rendering in parallel.
+    /// @param partition index of the partition being rendered, for keeping any scratch space separate
+    virtual void render_voices(dsp::voice **first, dsp::voice **last, float (*output)[2], int nsamples, int partition);
+    /// Render one partition of the active voices (called by the worker threads)
+    void render_partition(int index);
 public:
+    enum { MaxRenderPartitions = 8, RenderBlock = 256 };
+    basic_synth();
     virtual void setup(int sr) {
         sample_rate = sr;
         hold = false;
@@ -317,6 +347,13 @@ public:
     virtual void pitch_bend(int amt) {}
     virtual void on_pedal_release();
     virtual bool check_percussion() { return active_voices.empty(); }
+    /// Render the voices using a given number of threads, including the caller, each
+    /// one working on its own subset of the voices; 1 renders all the voices in
+    /// the calling thread. The partitions are mixed in a fixed order, so the result
+    /// doesn't depend on the timing of the threads. Starts/stops threads, so it must
+    /// not be called while rendering. Also enabled by CALF_VOICE_THREADS environment
+    /// variable (with real-time priority of the helpers set by CALF_VOICE_THREADS_RTPRIO).
+    void set_render_threads(int threads, int rt_priority = 0);
     virtual ~basic_synth();
 };
 
@@ -22,10 +22,43 @@
 #define __CALF_VUMETER_H
 
 #include <math.h>
+#include <algorithm>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 namespace dsp {
 
-/// Peak meter class
+/// Calculate the peak absolute value and the sum of squares of a block of samples
+inline void measure_block(const float *src, unsigned int len, float &peak, float &sumsq)
+{
+    unsigned int i = 0;
+    float p = 0.f, s = 0.f;
+#if defined(__SSE__)
+    __m128 zero = _mm_setzero_ps(), vpeak = zero, vsum1 = zero, vsum2 = zero;
+    for (; i + 8 <= len; i += 8)
+    {
+        __m128 a = _mm_loadu_ps(src + i), b = _mm_loadu_ps(src + i + 4);
+        vpeak = _mm_max_ps(vpeak, _mm_max_ps(_mm_max_ps(a, _mm_sub_ps(zero, a)), _mm_max_ps(b, _mm_sub_ps(zero, b))));
+        vsum1 = _mm_add_ps(vsum1, _mm_mul_ps(a, a));
+        vsum2 = _mm_add_ps(vsum2, _mm_mul_ps(b, b));
+    }
+    float tmp[4];
+    _mm_storeu_ps(tmp, vpeak);
+    p = std::max(std::max(tmp[0], tmp[1]), std::max(tmp[2], tmp[3]));
+    _mm_storeu_ps(tmp, _mm_add_ps(vsum1, vsum2));
+    s = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+#endif
+    for (; i < len; i++)
+    {
+        p = std::max(p, (float)fabs(src[i]));
+        s += src[i] * src[i];
+    }
+    peak = p;
+    sumsq = s;
+}
+
+/// Peak meter class, also keeping track of the RMS level
 struct vumeter
 {
     /// Measured signal level
@@ -40,6 +73,11 @@ struct vumeter
     int count_over;
     /// reverse VU meter
     bool reverse;
+    /// Mean square of the signal, smoothed so that it falls at the same rate as the peak level
+    float mean_square;
+    /// Sum of squares and number of the samples fed since the last fall
+    float block_sumsq;
+    unsigned int block_count;
     
     vumeter()
     {
@@ -53,6 +91,10 @@ struct vumeter
     {
         level = reverse ? 1 : 0;
         clip = 0;
+        count_over = 0;
+        mean_square = 0;
+        block_sumsq = 0;
+        block_count = 0;
     }
     
     /// Set falloff so that the meter falls 20dB in time_20dB seconds, assuming sample rate of sample_rate
@@ -94,10 +136,34 @@ struct vumeter
         if (src2)
             run_sample_loop(src2, len);
     }
-    inline void run_sample_loop(const float *src, unsigned int len)
+    /// Feed a block of samples, multiplied by gain, to the meter (without the falloff)
+    inline void run_sample_loop(const float *src, unsigned int len, float gain = 1.f)
+    {
+        if (reverse)
+        {
+            for (unsigned int i = 0; i < len; i++)
+                process(src[i] * gain);
+            return;
+        }
+        float peak, sumsq;
+        measure_block(src, len, peak, sumsq);
+        peak *= fabs(gain);
+        block_sumsq += sumsq * gain * gain;
+        block_count += len;
+        if (peak > 1.f)
+        {
+            // rare case, count the consecutive samples over 0 dB the hard way
+            for (unsigned int i = 0; i < len; i++)
+                process(src[i] * gain);
+            return;
+        }
+        level = std::max(level, peak);
+        count_over = 0;
+    }
+    /// @return RMS level of the signal fed so far
+    float get_rms() const
     {
-        for (unsigned int i = 0; i < len; i++)
-            process(src[i]);
+        return sqrtf(mean_square);
     }
     inline void process(const float value)
     {
@@ -111,10 +177,12 @@ struct vumeter
     }
     void fall(unsigned int len) {
         // "Age" the old level by falloff^length
+        float decay = pow(falloff, len);
+        integrate_rms(decay);
         if (reverse)
-            level /= pow(falloff, len);
+            level /= decay;
         else
-            level *= pow(falloff, len);
+            level *= decay;
         // Same for clip level (using different fade constant)
         clip *= pow(clip_falloff, len);
         dsp::sanitize(level);
@@ -123,11 +191,26 @@ struct vumeter
     /// Update clip meter as if update was called with all-zero input signal
     inline void update_zeros(unsigned int len)
     {
-        level *= pow((double)falloff, (double)len);
+        block_count += len;
+        float decay = pow((double)falloff, (double)len);
+        integrate_rms(decay);
+        level *= decay;
         clip *= pow((double)clip_falloff, (double)len);
         dsp::sanitize(level);
         dsp::sanitize(clip);
     }
+    /// Mix the mean square of the samples fed since the last call into the smoothed value
+    /// @param decay falloff of the level over the block (the mean square falls by its square)
+    inline void integrate_rms(float decay)
+    {
+        if (!block_count)
+            return;
+        float k = decay * decay;
+        mean_square = k * mean_square + (1 - k) * (block_sumsq / block_count);
+        dsp::sanitize(mean_square);
+        block_sumsq = 0;
+        block_count = 0;
+    }
 };
 
 };
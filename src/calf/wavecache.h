@@ -0,0 +1,143 @@
+/* Calf DSP Library
+ * On-disk cache of precalculated waveform families
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#ifndef __CALF_WAVECACHE_H
+#define __CALF_WAVECACHE_H
+
+#include <config.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "primitives.h"
+#include "osc.h"
+
+/// Identifies the release of the code that generates the waveforms. Changes in the
+/// generated tables between releases are marked by the version passed to wavetable_cache.
+#define WAVETABLE_CACHE_BUILD_ID PACKAGE_VERSION
+
+namespace dsp {
+
+/**
+ * A file containing precalculated waveform families, so that they don't need to
+ * be recalculated every time a plugin library is loaded. The file is mapped
+ * read-only and the families read from it point directly into the mapped memory,
+ * which is shared between all the processes using the same cache file.
+ *
+ * Cache files are stored in $XDG_CACHE_HOME/calf (or ~/.cache/calf). The file
+ * name starts with the cache name and a hash of the key passed by the user
+ * (which should identify the build and the parameters used for generating the
+ * waveforms), followed by the table version, the file format version and a
+ * hash of the binary layout of the data. When a new file is written, the files
+ * with the same start and different versions are deleted; files written by
+ * other builds are left alone, as they may still be in use. Things that only
+ * change the contents (like the modification time of a source file) can be
+ * passed separately; they're only checked against the file header, so a new
+ * file simply replaces the old one. Setting
+ * CALF_NO_WAVETABLE_CACHE environment variable disables the cache.
+ *
+ * The mapping is kept until the cache object is destroyed, so the cache must
+ * outlive all the families read from it.
+ */
+class wavetable_cache
+{
+protected:
+    /// Start of the file names of all the cache files with a given name and key
+    std::string prefix;
+    /// Part of the file name following the prefix that holds the versions (eg. "v1.1-")
+    std::string version_tag;
+    std::string path;
+    uint32_t hash;
+    /// Mapped file contents (NULL if not mapped)
+    const char *data;
+    /// Mapped file size
+    size_t size;
+    /// Read position within the mapped file
+    size_t pos;
+    /// File being written (NULL if not writing)
+    FILE *out;
+    /// Name of the temporary file being written
+    std::string temp_path;
+    /// False if there was an error while writing
+    bool out_ok;
+
+    /// Delete cache files with the same name and key, but different versions
+    void remove_stale_files();
+public:
+    /// @param name    name of the set of waveforms (eg. "organ")
+    /// @param key     identifies the build and the parameters of the waveforms (eg. WAVETABLE_CACHE_BUILD_ID)
+    /// @param version version of the generated tables, increased when the generating code changes
+    /// @param content anything else the contents depend on, not included in the file name (eg. source file size and time)
+    wavetable_cache(const char *name, const char *key, int version = 0, const char *content = NULL);
+    ~wavetable_cache();
+    /// Map the cache file; returns false if it doesn't exist or is invalid
+    bool load();
+    /// Start writing a new cache file; returns false if not possible (the cache is then simply not used)
+    bool create();
+    /// Finish writing the cache file and replace the old one (if any); returns false on error
+    bool commit();
+    /// Return a pointer to the next 'bytes' bytes of the mapped file, or NULL if beyond the end of file
+    const char *read_bytes(size_t bytes);
+    /// Append raw data to the file being created
+    void write_bytes(const void *src, size_t bytes);
+
+    /// Read the next waveform family from the mapped file. The family is expected to be empty.
+    /// @retval false if the remaining data doesn't contain a family of a matching size
+    template<int SIZE_BITS>
+    bool read(waveform_family<SIZE_BITS> &family)
+    {
+        enum { SIZE = 1 << SIZE_BITS };
+        const uint32_t *hdr = (const uint32_t *)read_bytes(2 * sizeof(uint32_t));
+        if (!hdr || hdr[0] != SIZE_BITS)
+            return false;
+        uint32_t levels = hdr[1];
+        const char *original = read_bytes(sizeof(family.original));
+        if (!original)
+            return false;
+        memcpy(family.original, original, sizeof(family.original));
+        family.external_data = true;
+        for (uint32_t i = 0; i < levels; i++)
+        {
+            const uint32_t *level = (const uint32_t *)read_bytes(sizeof(uint32_t) + (SIZE + 1) * sizeof(float));
+            if (!level)
+                return false;
+            family[level[0]] = (float *)(level + 1);
+        }
+        return true;
+    }
+    /// Write a waveform family into the file being created
+    template<int SIZE_BITS>
+    void write(const waveform_family<SIZE_BITS> &family)
+    {
+        enum { SIZE = 1 << SIZE_BITS };
+        uint32_t hdr[2] = { SIZE_BITS, (uint32_t)family.size() };
+        write_bytes(hdr, sizeof(hdr));
+        write_bytes(family.original, sizeof(family.original));
+        for (typename waveform_family<SIZE_BITS>::const_iterator i = family.begin(); i != family.end(); i++)
+        {
+            uint32_t key = i->first;
+            write_bytes(&key, sizeof(key));
+            write_bytes(i->second, (SIZE + 1) * sizeof(float));
+        }
+    }
+};
+
+};
+
+#endif
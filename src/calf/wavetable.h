@@ -48,6 +48,8 @@ class wavetable_voice: public dsp::voice
 public:
     enum { Channels = 2, BlockSize = 64, MaxSampleRun = MAX_SAMPLE_RUN, EnvCount = 3, OscCount = 2 };
     float output_buffer[BlockSize][Channels];
+    /// Current calculated mod matrix outputs
+    float moddest[wavetable_metadata::moddest_count];
 protected:
     int note;
     wavetable_audio_module *parent;
@@ -57,8 +59,6 @@ protected:
     dsp::adsr envs[EnvCount];
     /// Current MIDI velocity
     float velocity;
-    /// Current calculated mod matrix outputs
-    float moddest[wavetable_metadata::moddest_count];
     /// Last oscillator shift (wavetable index) of each oscillator
     float last_oscshift[OscCount];
     /// Last oscillator amplitude of each oscillator
@@ -75,6 +75,11 @@ public:
     void channel_pressure(int value);
     void steal();
     void render_block(int current_snapshot);
+    /// First part of render_block: advance the envelopes and LFOs and store the
+    /// modulation sources, one every stride items
+    void calc_modsrc(float *modsrc, int stride);
+    /// Second part of render_block, using the mod matrix outputs already in moddest
+    void render_block_from_moddest(int current_snapshot);
     const int16_t *get_last_table(int osc) const;
     virtual int get_current_note() {
         return note;
@@ -99,9 +104,18 @@ public:
     using dsp::basic_synth::control_change;
     using dsp::basic_synth::pitch_bend;
 
+    enum { MaxVoices = 36 };
 protected:
     uint32_t crate;
     bool panic_flag;
+    /// Modulation sources and destinations of the voices starting a new block, one row per
+    /// source/destination, separate for each render partition
+    float voice_modsrc[MaxRenderPartitions][modsrc_count * MaxVoices], voice_moddest[MaxRenderPartitions][moddest_count * MaxVoices];
+    /// Indexes (within the rendered range) of the voices starting a new block
+    int pending_index[MaxRenderPartitions][MaxVoices];
+    /// Copy of the mod matrix program used by all the render partitions, acquired
+    /// by the audio thread before they start
+    int render_program;
 
 public:
     int16_t tables[wt_count][129][256]; // one dummy level for interpolation
@@ -131,6 +145,8 @@ public:
     }
     
     uint32_t get_crate() const { return crate; }
+    /// Render a range of voices; voices starting a new block at the same time share the mod matrix evaluation
+    virtual void render_voices(dsp::voice **first, dsp::voice **last, float (*output)[2], int nsamples, int partition);
     
     /// process function copied from Organ (will probably need some adjustments as well as implementing the panic flag elsewhere
     uint32_t process(uint32_t offset, uint32_t nsamples, uint32_t inputs_mask, uint32_t outputs_mask) {
@@ -145,7 +161,8 @@ public:
         fill_snapshots(nsamples);
         float buf[MAX_SAMPLE_RUN][2];
         dsp::zero(&buf[0][0], 2 * nsamples);
-        basic_synth::render_to(buf, nsamples);
+        render_program = acquire_program();
+        render_to(buf, nsamples);
         if (!active_voices.empty())
             last_voice = (wavetable_voice *)*active_voices.begin();
         float gain = 1.0f;
@@ -0,0 +1,215 @@
+/* Calf DSP Library
+ * Real-time worker threads and dependency graph scheduling.
+ *
+ * Copyright (C) 2007-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#ifndef __CALF_WORKERS_H
+#define __CALF_WORKERS_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <vector>
+
+namespace calf_utils
+{
+
+/// Hint to the CPU that we're in a busy-wait loop
+inline void spin_pause()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#else
+    __sync_synchronize();
+#endif
+}
+
+/// Busy-wait step: give up the CPU every now and then, so that a waiting thread
+/// cannot starve the one it is waiting for if they happen to share a core
+inline void spin_wait(int &spins)
+{
+    if (++spins & 63)
+        spin_pause();
+    else
+        sched_yield();
+}
+
+/// Fixed-size lock-free queue for passing items from one thread to another,
+/// eg. from the GUI thread to the audio thread. There may be only one thread
+/// pushing and one thread popping at any given time (others need to use a lock
+/// of their own to take turns).
+template<class T, int N>
+class spsc_queue
+{
+    T items[N];
+    /// Index of the next item to pop (only changed by the consumer)
+    volatile int head;
+    /// Index of the next slot to push to (only changed by the producer)
+    volatile int tail;
+public:
+    spsc_queue() : head(0), tail(0) {}
+    /// Add an item; returns false (without blocking) if the queue is full
+    bool push(const T &item)
+    {
+        int pos = tail, next = (pos + 1) % N;
+        if (next == head)
+            return false;
+        items[pos] = item;
+        // the item needs to be visible before the consumer sees the new tail
+        __sync_synchronize();
+        tail = next;
+        return true;
+    }
+    /// Remove the oldest item; returns false (without blocking) if the queue is empty
+    bool pop(T &item)
+    {
+        int pos = head;
+        if (pos == tail)
+            return false;
+        __sync_synchronize();
+        item = items[pos];
+        // the slot must not be reused before it's been read
+        __sync_synchronize();
+        head = (pos + 1) % N;
+        return true;
+    }
+    bool empty() const { return head == tail; }
+    /// @return true if push would fail (only meaningful in the producer thread)
+    bool full() const { return (tail + 1) % N == head; }
+};
+
+/// Something that can execute the nodes of a task_graph
+struct task_graph_iface
+{
+    /// Run the node with a given index (called from any of the worker threads)
+    virtual void run_task(int index, int worker) = 0;
+    virtual ~task_graph_iface() {}
+};
+
+/// A static dependency graph (DAG) of tasks, together with its per-run state.
+/// Built outside the audio thread, then executed by worker_pool::run once
+/// per cycle without any allocations or locks.
+class task_graph
+{
+public:
+    /// Number of nodes
+    int count;
+    /// Number of predecessors of each node
+    std::vector<int> dep_count;
+    /// Start offset of the successor list of each node in successors (count + 1 items)
+    std::vector<int> succ_start;
+    /// Concatenated successor lists
+    std::vector<int> successors;
+
+    /// Per-run: number of unfinished predecessors of each node
+    std::vector<int> pending;
+    /// Per-run: lock-free ready queue (each node is pushed exactly once per run)
+    std::vector<int> ready;
+    /// Per-run: index of the next ready queue slot to be written
+    volatile int ready_tail;
+    /// Per-run: index of the next ready queue slot to be read
+    volatile int ready_head;
+    /// Per-run: number of nodes not finished yet
+    volatile int remaining;
+
+    /// Create a graph of nodes with no dependencies
+    task_graph(int _count);
+    /// Declare that node 'before' needs to finish before node 'after' is started.
+    /// All edges must be added before finalize is called. The caller is responsible
+    /// for not creating cycles.
+    void add_edge(int before, int after);
+    /// Build the successor lists (call once after all edges are added)
+    void finalize();
+
+    /// Reset per-run state and queue all the nodes that have no dependencies
+    void start();
+    /// Put a node that has all its dependencies satisfied on the ready queue
+    inline void push(int node)
+    {
+        int slot = __sync_fetch_and_add(&ready_tail, 1);
+        *(volatile int *)&ready[slot] = node;
+    }
+    /// Take a node off the ready queue, or return -1 if none is available at the moment
+    inline int pop()
+    {
+        for(;;)
+        {
+            int head = ready_head;
+            if (head >= ready_tail)
+                return -1;
+            if (__sync_bool_compare_and_swap(&ready_head, head, head + 1))
+            {
+                // the producer may have reserved the slot but not stored the value yet
+                volatile int *slot = &ready[head];
+                int spins = 0;
+                while(*slot == -1)
+                    spin_wait(spins);
+                int node = *slot;
+                __sync_synchronize();
+                return node;
+            }
+        }
+    }
+    /// Execute ready nodes until the whole graph has been processed
+    void work(task_graph_iface *exec, int worker);
+
+private:
+    std::vector<std::pair<int, int> > edges;
+};
+
+/// A small pool of (preferably real-time) threads that help the calling thread
+/// with executing a task_graph. All the waiting is done by busy-looping, so that
+/// it's suitable for use from within a real-time audio callback.
+class worker_pool
+{
+protected:
+    struct worker
+    {
+        worker_pool *pool;
+        int index;
+        pthread_t thread;
+        sem_t wakeup;
+    };
+    std::vector<worker *> workers;
+    /// Graph being executed in the current run
+    task_graph *volatile graph;
+    /// Graph executor for the current run
+    task_graph_iface *volatile exec;
+    /// Number of workers that haven't finished the current run yet
+    volatile int busy;
+    /// Set to terminate the threads
+    volatile bool quit;
+
+    static void *thread_func(void *arg);
+    void worker_loop(worker *w);
+public:
+    /// Create the pool and start (threads - 1) worker threads, the calling thread being the remaining one
+    /// @arg threads total number of threads used for processing, including the caller (limited to the number of CPUs)
+    /// @arg rt_priority SCHED_FIFO priority for the helper threads, or 0 if non-real-time
+    worker_pool(int threads, int rt_priority = 0);
+    ~worker_pool();
+    /// @return number of threads that may work on a graph, including the caller
+    int get_thread_count() const { return workers.size() + 1; }
+    /// Execute the whole graph, using the calling thread and the worker threads; returns
+    /// after all the nodes have been processed
+    void run(task_graph *graph, task_graph_iface *exec);
+};
+
+};
+
+#endif
@@ -0,0 +1,769 @@
+/* Calf DSP Library
+ * Zero-latency partitioned convolution
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#include <calf/convolution.h>
+#include <calf/fft.h>
+#include <calf/oversampler.h>
+#include <calf/wavecache.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace dsp;
+using namespace std;
+
+/// Increase when the layout of the partitions or the contents of the cache change
+#define CONVOLUTION_CACHE_FORMAT 1
+
+static inline uint32_t le16(const char *p)
+{
+    return (uint8_t)p[0] | ((uint8_t)p[1] << 8);
+}
+
+static inline uint32_t le32(const char *p)
+{
+    return le16(p) | (le16(p + 2) << 16);
+}
+
+impulse_response::impulse_response()
+{
+    map = NULL;
+    map_size = 0;
+    samples = NULL;
+    channels = 0;
+    sample_rate = 0;
+    bytes_per_sample = 0;
+    is_float = false;
+    length = 0;
+}
+
+impulse_response::~impulse_response()
+{
+    close();
+}
+
+void impulse_response::close()
+{
+    if (map)
+        munmap((void *)map, map_size);
+    map = NULL;
+    map_size = 0;
+    samples = NULL;
+    length = 0;
+}
+
+bool impulse_response::load(const char *path, string &error)
+{
+    close();
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        error = string("Cannot open ") + path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < 44)
+    {
+        ::close(fd);
+        error = string(path) + " is not a WAV file";
+        return false;
+    }
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        error = string("Cannot map ") + path + ": " + strerror(errno);
+        return false;
+    }
+    map = (const char *)ptr;
+    map_size = st.st_size;
+    if (memcmp(map, "RIFF", 4) || memcmp(map + 8, "WAVE", 4))
+    {
+        close();
+        error = string(path) + " is not a WAV file";
+        return false;
+    }
+
+    int format = 0, bits = 0;
+    size_t data_size = 0, pos = 12;
+    channels = 0;
+    while(pos + 8 <= map_size)
+    {
+        const char *chunk = map + pos;
+        size_t chunk_size = le32(chunk + 4), avail = map_size - pos - 8;
+        if (!memcmp(chunk, "fmt ", 4) && chunk_size >= 16 && avail >= 16)
+        {
+            format = le16(chunk + 8);
+            channels = le16(chunk + 10);
+            sample_rate = le32(chunk + 12);
+            bits = le16(chunk + 22);
+            // WAVE_FORMAT_EXTENSIBLE - the real format is at the start of the subformat GUID
+            if (format == 0xFFFE && chunk_size >= 40 && avail >= 40)
+                format = le16(chunk + 32);
+        }
+        else if (!memcmp(chunk, "data", 4))
+        {
+            samples = chunk + 8;
+            // the size may be missing if the file was written as a stream
+            data_size = std::min(chunk_size, avail);
+            break;
+        }
+        pos += 8 + chunk_size + (chunk_size & 1);
+    }
+    bool supported = (format == 1 && (bits == 16 || bits == 24 || bits == 32)) || (format == 3 && bits == 32);
+    if (!samples || !channels || sample_rate <= 0 || !supported)
+    {
+        close();
+        error = string(path) + ": unsupported WAV format (16/24/32-bit PCM or 32-bit float expected)";
+        return false;
+    }
+    is_float = format == 3;
+    bytes_per_sample = bits / 8;
+    length = data_size / (channels * bytes_per_sample);
+    if (!length)
+    {
+        close();
+        error = string(path) + " contains no samples";
+        return false;
+    }
+    char info[64];
+    sprintf(info, " %lld %lld.%09ld", (long long)st.st_size, (long long)st.st_mtime, (long)st.st_mtim.tv_nsec);
+    file_path = path;
+    file_key = path + string(info);
+    return true;
+}
+
+void impulse_response::read_channel(int channel, float *dst) const
+{
+    const char *p = samples + channel * bytes_per_sample;
+    int stride = channels * bytes_per_sample;
+    for (uint32_t i = 0; i < length; i++, p += stride)
+    {
+        if (is_float)
+        {
+            uint32_t v = le32(p);
+            memcpy(&dst[i], &v, sizeof(float));
+        }
+        else if (bytes_per_sample == 2)
+            dst[i] = (int16_t)le16(p) * (1.f / 32768.f);
+        else if (bytes_per_sample == 3)
+            dst[i] = ((int32_t)(le32(p - 1) & 0xFFFFFF00) >> 8) * (1.f / 8388608.f);
+        else
+            dst[i] = (int32_t)le32(p) * (1.f / 2147483648.f);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace dsp {
+
+/// A section of the impulse response split into partitions of equal size,
+/// with the state of its frequency domain delay line and (optionally) the
+/// background thread that processes it
+class convolution_stage
+{
+public:
+    typedef std::complex<float> complex;
+    /// Partition size, number of frequency bins used (block + 1), start of the section within the impulse response
+    int block, bins, offset, partitions;
+    /// True if processed in a separate thread, with one block of extra delay
+    bool background;
+    int npaths;
+    const convolver::path *paths;
+    /// Spectra of the partitions, [channel][partition][bin]
+    const complex *spectra;
+    /// Input spectra of the past 'partitions' blocks of each input, [partition][bin]; fdl_pos is the newest
+    vector<complex> fdl[convolver::MAX_CHANNELS];
+    int fdl_pos;
+    /// Two blocks of each input/output - one being filled/played by the audio thread, the other used by the job in progress
+    vector<float> input[convolver::MAX_CHANNELS], output[convolver::MAX_CHANNELS];
+    /// Second half of the last inverse transform of each output
+    vector<float> overlap[convolver::MAX_CHANNELS];
+    /// Scratch space
+    vector<complex> acc, freq, half;
+    vector<float> time;
+    /// Position within the current block, and the block slot used by the audio thread
+    int pos, slot;
+
+    pthread_t thread;
+    bool thread_running;
+    /// Real-time priority wanted for the thread (owned by the convolver, 0 = not real-time) and the one last set
+    const volatile int *wanted_priority;
+    int priority;
+    sem_t wakeup, done;
+    volatile bool quit;
+    /// Slot to be processed by the background thread
+    volatile int job_slot;
+    /// Set if a job has been started and its completion hasn't been waited for yet
+    bool job_pending;
+
+    convolution_stage(int _block, int _offset, int _partitions, bool _background);
+    virtual ~convolution_stage();
+    /// Forward transform of 2 * block real values into 2 * block complex values
+    virtual void forward(const float *src, complex *dst) = 0;
+    /// Inverse transform of 2 * block complex values into real values, temp is block complex values
+    virtual void inverse(const complex *src, float *dst, complex *temp) = 0;
+
+    /// Calculate the spectra of the section for each channel of the impulse response
+    void calculate_spectra(const vector<float> *ir, int nchannels, complex *dst);
+    void start_thread(const volatile int *_wanted_priority);
+    /// Switch the background thread to *wanted_priority (called by the thread itself)
+    void update_priority();
+    void stop_thread();
+    void wait_for_job();
+    void reset();
+    /// Convolve the input block in a given slot and write the next output block into the same slot
+    void compute(int s);
+    static void *thread_func(void *arg);
+
+    /// Feed n samples (not crossing a block boundary) and add the section's output to outs
+    inline void run(const float *const *ins, float *const *outs, uint32_t ofs, uint32_t n)
+    {
+        for (int c = 0; c < convolver::MAX_CHANNELS; c++)
+        {
+            memcpy(&input[c][slot * block + pos], ins[c] + ofs, n * sizeof(float));
+            const float *src = &output[c][slot * block + pos];
+            float *dst = outs[c] + ofs;
+            for (uint32_t i = 0; i < n; i++)
+                dst[i] += src[i];
+        }
+        pos += n;
+        if (pos == block)
+        {
+            pos = 0;
+            block_done();
+        }
+    }
+    void block_done();
+};
+
+template<int O>
+class fft_convolution_stage: public convolution_stage
+{
+    dsp::fft<float, O> fft;
+public:
+    fft_convolution_stage(int _offset, int _partitions, bool _background)
+    : convolution_stage(1 << (O - 1), _offset, _partitions, _background)
+    {
+    }
+    virtual void forward(const float *src, complex *dst)
+    {
+        fft.calculate_real(src, dst);
+    }
+    virtual void inverse(const complex *src, float *dst, complex *temp)
+    {
+        fft.calculate_real_inverse(src, dst, temp);
+    }
+};
+
+};
+
+convolution_stage::convolution_stage(int _block, int _offset, int _partitions, bool _background)
+{
+    block = _block;
+    bins = _block + 1;
+    offset = _offset;
+    partitions = _partitions;
+    background = _background;
+    npaths = 0;
+    paths = NULL;
+    spectra = NULL;
+    for (int c = 0; c < convolver::MAX_CHANNELS; c++)
+    {
+        fdl[c].resize(partitions * bins);
+        input[c].resize(2 * block);
+        output[c].resize(2 * block);
+        overlap[c].resize(block);
+    }
+    acc.resize(bins);
+    freq.resize(2 * block);
+    half.resize(block);
+    time.resize(2 * block);
+    thread_running = false;
+    wanted_priority = NULL;
+    priority = 0;
+    quit = false;
+    job_slot = 0;
+    job_pending = false;
+    fdl_pos = 0;
+    pos = 0;
+    slot = 0;
+}
+
+convolution_stage::~convolution_stage()
+{
+    stop_thread();
+}
+
+void convolution_stage::calculate_spectra(const vector<float> *ir, int nchannels, complex *dst)
+{
+    for (int ch = 0; ch < nchannels; ch++)
+    {
+        for (int j = 0; j < partitions; j++)
+        {
+            uint32_t start = offset + j * block;
+            uint32_t end = std::min<uint32_t>(start + block, ir[ch].size());
+            std::fill(time.begin(), time.end(), 0.f);
+            if (start < end)
+                std::copy(ir[ch].begin() + start, ir[ch].begin() + end, time.begin());
+            forward(&time[0], &freq[0]);
+            dst = std::copy(freq.begin(), freq.begin() + bins, dst);
+        }
+    }
+}
+
+void convolution_stage::compute(int s)
+{
+    int N = 2 * block;
+    fdl_pos = fdl_pos ? fdl_pos - 1 : partitions - 1;
+    for (int c = 0; c < convolver::MAX_CHANNELS; c++)
+    {
+        std::copy(input[c].begin() + s * block, input[c].begin() + (s + 1) * block, time.begin());
+        std::fill(time.begin() + block, time.end(), 0.f);
+        forward(&time[0], &freq[0]);
+        std::copy(freq.begin(), freq.begin() + bins, fdl[c].begin() + fdl_pos * bins);
+    }
+    for (int o = 0; o < convolver::MAX_CHANNELS; o++)
+    {
+        std::fill(acc.begin(), acc.end(), complex(0.f, 0.f));
+        for (int p = 0; p < npaths; p++)
+        {
+            if (paths[p].output != o)
+                continue;
+            const complex *h = spectra + paths[p].channel * partitions * bins;
+            const complex *x = &fdl[paths[p].input][0];
+            // partition j is applied to the input block that is j blocks old
+            int k = fdl_pos;
+            for (int j = 0; j < partitions; j++)
+            {
+                complex_mac(&acc[0], h + j * bins, x + k * bins, bins);
+                if (++k == partitions)
+                    k = 0;
+            }
+        }
+        std::copy(acc.begin(), acc.end(), freq.begin());
+        for (int k = 1; k < block; k++)
+            freq[N - k] = std::conj(acc[k]);
+        inverse(&freq[0], &time[0], &half[0]);
+        float *out = &output[o][s * block], *ov = &overlap[o][0];
+        for (int i = 0; i < block; i++)
+        {
+            out[i] = time[i] + ov[i];
+            ov[i] = time[block + i];
+        }
+    }
+}
+
+void convolution_stage::block_done()
+{
+    if (!background)
+    {
+        // the output is played during the next block, there is only one slot
+        compute(0);
+        return;
+    }
+    if (!thread_running)
+    {
+        // same timing as with a thread, only the job is done right away
+        compute(slot);
+        slot ^= 1;
+        return;
+    }
+    // the previous job produces the output for the next block
+    wait_for_job();
+    job_slot = slot;
+    job_pending = true;
+    sem_post(&wakeup);
+    slot ^= 1;
+}
+
+void convolution_stage::wait_for_job()
+{
+    if (!job_pending)
+        return;
+    while(sem_wait(&done) == -1 && errno == EINTR)
+        ;
+    job_pending = false;
+}
+
+void *convolution_stage::thread_func(void *arg)
+{
+    convolution_stage *st = (convolution_stage *)arg;
+    for(;;)
+    {
+        while(sem_wait(&st->wakeup) == -1 && errno == EINTR)
+            ;
+        if (st->quit)
+            break;
+        if (*st->wanted_priority != st->priority)
+            st->update_priority();
+        st->compute(st->job_slot);
+        sem_post(&st->done);
+    }
+    return NULL;
+}
+
+void convolution_stage::start_thread(const volatile int *_wanted_priority)
+{
+    wanted_priority = _wanted_priority;
+    int rt_priority = *wanted_priority;
+    // if the thread can't get this priority, it's not tried again
+    priority = rt_priority;
+    sem_init(&wakeup, 0, 0);
+    sem_init(&done, 0, 0);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (rt_priority > 0)
+    {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = rt_priority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    int err = pthread_create(&thread, &attr, thread_func, this);
+    if (err && rt_priority > 0)
+    {
+        fprintf(stderr, "Warning: could not create a real-time convolution thread, using normal priority\n");
+        pthread_attr_destroy(&attr);
+        pthread_attr_init(&attr);
+        err = pthread_create(&thread, &attr, thread_func, this);
+    }
+    pthread_attr_destroy(&attr);
+    if (err)
+    {
+        fprintf(stderr, "Warning: could not create a convolution thread\n");
+        sem_destroy(&wakeup);
+        sem_destroy(&done);
+        return;
+    }
+    thread_running = true;
+}
+
+void convolution_stage::update_priority()
+{
+    int wanted = *wanted_priority;
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = wanted;
+    if (pthread_setschedparam(pthread_self(), wanted > 0 ? SCHED_FIFO : SCHED_OTHER, &param))
+        fprintf(stderr, "Warning: could not set the priority of a convolution thread to %d\n", wanted);
+    priority = wanted;
+}
+
+void convolution_stage::stop_thread()
+{
+    if (!thread_running)
+        return;
+    wait_for_job();
+    quit = true;
+    sem_post(&wakeup);
+    pthread_join(thread, NULL);
+    sem_destroy(&wakeup);
+    sem_destroy(&done);
+    thread_running = false;
+}
+
+void convolution_stage::reset()
+{
+    wait_for_job();
+    for (int c = 0; c < convolver::MAX_CHANNELS; c++)
+    {
+        std::fill(fdl[c].begin(), fdl[c].end(), complex(0.f, 0.f));
+        std::fill(input[c].begin(), input[c].end(), 0.f);
+        std::fill(output[c].begin(), output[c].end(), 0.f);
+        std::fill(overlap[c].begin(), overlap[c].end(), 0.f);
+    }
+    fdl_pos = 0;
+    pos = 0;
+    slot = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Windowed sinc interpolation of a whole signal to 'ratio' times the sample rate
+static void resample(const vector<float> &src, vector<float> &dst, double ratio)
+{
+    // cut off at the lower of the two Nyquist frequencies
+    double fc = std::min(1.0, ratio);
+    int half = (int)ceil(16 / fc);
+    int n = src.size();
+    for (size_t i = 0; i < dst.size(); i++)
+    {
+        double t = i / ratio, sum = 0;
+        int centre = (int)floor(t);
+        for (int k = std::max(centre - half + 1, 0); k <= centre + half && k < n; k++)
+        {
+            double x = t - k;
+            double sinc = fabs(x) < 1e-9 ? fc : sin(M_PI * fc * x) / (M_PI * x);
+            sum += src[k] * sinc * (0.5 + 0.5 * cos(M_PI * x / half));
+        }
+        dst[i] = sum;
+    }
+}
+
+static uint32_t fnv_hash(const string &str)
+{
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < str.length(); i++)
+    {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+convolver::convolver()
+{
+    npaths = 0;
+    nchannels = 0;
+    length = 0;
+    head_pos = 0;
+    block_pos = 0;
+    cache = NULL;
+    rt_priority = 0;
+    follow_audio_thread = false;
+    for (int c = 0; c < MAX_CHANNELS; c++)
+        head_hist[c].resize(2 * HEAD_SIZE);
+}
+
+convolver::~convolver()
+{
+    for (size_t i = 0; i < stages.size(); i++)
+        delete stages[i];
+    // the spectra may be in the mapped cache file
+    delete cache;
+}
+
+void convolver::create_stages()
+{
+    // audio thread section: 64 sample partitions up to 2048, then background
+    // sections of 1024 and 8192 sample partitions, each starting at twice
+    // its partition size
+    if (length > HEAD_SIZE)
+        stages.push_back(new fft_convolution_stage<7>(HEAD_SIZE, (std::min<uint32_t>(length, 2048) - HEAD_SIZE + 63) / 64, false));
+    if (length > 2048)
+        stages.push_back(new fft_convolution_stage<11>(2048, (std::min<uint32_t>(length, 16384) - 2048 + 1023) / 1024, true));
+    if (length > 16384)
+        stages.push_back(new fft_convolution_stage<14>(16384, (length - 16384 + 8191) / 8192, true));
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        stages[i]->npaths = npaths;
+        stages[i]->paths = paths;
+    }
+}
+
+size_t convolver::get_spectra_size() const
+{
+    size_t size = 0;
+    for (size_t i = 0; i < stages.size(); i++)
+        size += nchannels * stages[i]->partitions * stages[i]->bins;
+    return size;
+}
+
+void convolver::use_spectra(const std::complex<float> *data)
+{
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        stages[i]->spectra = data;
+        data += nchannels * stages[i]->partitions * stages[i]->bins;
+    }
+}
+
+void convolver::calculate(const vector<float> *ir)
+{
+    for (int ch = 0; ch < nchannels; ch++)
+    {
+        head[ch].assign(HEAD_SIZE, 0.f);
+        std::copy(ir[ch].begin(), ir[ch].begin() + std::min<uint32_t>(HEAD_SIZE, length), head[ch].begin());
+    }
+    spectra.resize(get_spectra_size());
+    std::complex<float> *dst = &spectra[0];
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        stages[i]->calculate_spectra(ir, nchannels, dst);
+        dst += nchannels * stages[i]->partitions * stages[i]->bins;
+    }
+    use_spectra(&spectra[0]);
+}
+
+bool convolver::read_cache(wavetable_cache &c)
+{
+    const uint32_t *hdr = (const uint32_t *)c.read_bytes(2 * sizeof(uint32_t));
+    if (!hdr || hdr[0] != (uint32_t)nchannels || hdr[1] != length)
+        return false;
+    const float *heads = (const float *)c.read_bytes(nchannels * HEAD_SIZE * sizeof(float));
+    const char *data = c.read_bytes(get_spectra_size() * sizeof(std::complex<float>));
+    if (!heads || !data)
+        return false;
+    for (int ch = 0; ch < nchannels; ch++)
+        head[ch].assign(heads + ch * HEAD_SIZE, heads + (ch + 1) * HEAD_SIZE);
+    use_spectra((const std::complex<float> *)data);
+    return true;
+}
+
+void convolver::write_cache(wavetable_cache &c)
+{
+    uint32_t hdr[2] = { (uint32_t)nchannels, length };
+    c.write_bytes(hdr, sizeof(hdr));
+    for (int ch = 0; ch < nchannels; ch++)
+        c.write_bytes(&head[ch][0], HEAD_SIZE * sizeof(float));
+    c.write_bytes(&spectra[0], spectra.size() * sizeof(std::complex<float>));
+}
+
+bool convolver::init(const impulse_response &ir, uint32_t srate, int rt_priority, string &error)
+{
+    static const path routings[][MAX_PATHS] = {
+        { {0, 0, 0}, {1, 1, 0} },
+        { {0, 0, 0}, {1, 1, 1} },
+        { {0, 0, 0}, {0, 1, 1}, {1, 0, 2}, {1, 1, 3} },
+    };
+    nchannels = ir.get_channels();
+    int routing = nchannels == 1 ? 0 : (nchannels == 2 ? 1 : (nchannels == 4 ? 2 : -1));
+    if (routing == -1)
+    {
+        error = "Unsupported number of channels in the impulse response (1, 2 or 4 expected)";
+        return false;
+    }
+    npaths = routing == 2 ? 4 : 2;
+    std::copy(routings[routing], routings[routing] + npaths, paths);
+
+    double ratio = (double)srate / ir.get_sample_rate();
+    double len = ceil(ir.get_length() * ratio);
+    if (len > (double)MAX_SECONDS * srate)
+    {
+        error = "Impulse response is too long";
+        return false;
+    }
+    length = (uint32_t)len;
+    create_stages();
+
+    // the file name only depends on the path and the rate, so that the spectra
+    // of an edited impulse response replace the old ones
+    char name[32], layout[64];
+    sprintf(name, "ir%u-%08x", srate, fnv_hash(ir.get_path()));
+    sprintf(layout, "head%d", (int)HEAD_SIZE);
+    cache = new wavetable_cache(name, layout, CONVOLUTION_CACHE_FORMAT, ir.get_file_key().c_str());
+    if (!cache->load() || !read_cache(*cache))
+    {
+        vector<float> channels[MAX_PATHS];
+        for (int ch = 0; ch < nchannels; ch++)
+        {
+            vector<float> &data = channels[ch];
+            data.resize(ir.get_length());
+            ir.read_channel(ch, &data[0]);
+            if (ir.get_sample_rate() != (int)srate)
+            {
+                vector<float> resampled(length);
+                resample(data, resampled, ratio);
+                data.swap(resampled);
+            }
+            data.resize(length);
+        }
+        // normalize to the same energy (white noise gain) of the louder output
+        double energy[MAX_CHANNELS] = {0, 0};
+        for (int p = 0; p < npaths; p++)
+        {
+            const vector<float> &data = channels[paths[p].channel];
+            for (uint32_t i = 0; i < length; i++)
+                energy[paths[p].output] += data[i] * data[i];
+        }
+        double max_energy = std::max(energy[0], energy[1]);
+        if (max_energy > 0)
+        {
+            float gain = 1.0 / sqrt(max_energy);
+            for (int ch = 0; ch < nchannels; ch++)
+                for (uint32_t i = 0; i < length; i++)
+                    channels[ch][i] *= gain;
+        }
+        calculate(channels);
+        // use the mapped copy from now on, so that it's shared with other instances
+        if (cache->create())
+        {
+            write_cache(*cache);
+            if (cache->commit() && cache->load() && read_cache(*cache))
+                vector<std::complex<float> >().swap(spectra);
+            else
+                use_spectra(&spectra[0]);
+        }
+    }
+    follow_audio_thread = rt_priority < 0;
+    this->rt_priority = std::max(rt_priority, 0);
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        if (stages[i]->background)
+            stages[i]->start_thread(&this->rt_priority);
+    }
+    reset();
+    return true;
+}
+
+void convolver::reset()
+{
+    for (size_t i = 0; i < stages.size(); i++)
+        stages[i]->reset();
+    for (int c = 0; c < MAX_CHANNELS; c++)
+        std::fill(head_hist[c].begin(), head_hist[c].end(), 0.f);
+    head_pos = 0;
+    block_pos = 0;
+}
+
+void convolver::process(const float *const *ins, float *const *outs, uint32_t len)
+{
+    if (follow_audio_thread)
+    {
+        // the audio thread waits for the background threads, so they should run
+        // just below it; they pick up the new priority on their next job
+        follow_audio_thread = false;
+        int policy;
+        struct sched_param param;
+        if (!pthread_getschedparam(pthread_self(), &policy, &param) && (policy == SCHED_FIFO || policy == SCHED_RR) && param.sched_priority > 1)
+            rt_priority = param.sched_priority - 1;
+    }
+    uint32_t offset = 0;
+    while(offset < len)
+    {
+        // chunks never cross the boundaries of the smallest partitions
+        uint32_t n = std::min<uint32_t>(len - offset, HEAD_SIZE - block_pos);
+        for (uint32_t i = offset; i < offset + n; i++)
+        {
+            head_pos = head_pos ? head_pos - 1 : HEAD_SIZE - 1;
+            for (int c = 0; c < MAX_CHANNELS; c++)
+                head_hist[c][head_pos] = head_hist[c][head_pos + HEAD_SIZE] = ins[c][i];
+            outs[0][i] = outs[1][i] = 0.f;
+            for (int p = 0; p < npaths; p++)
+                outs[paths[p].output][i] += dot_product(&head[paths[p].channel][0], &head_hist[paths[p].input][head_pos], HEAD_SIZE);
+        }
+        for (size_t s = 0; s < stages.size(); s++)
+            stages[s]->run(ins, outs, offset, n);
+        block_pos = (block_pos + n) % HEAD_SIZE;
+        offset += n;
+    }
+}
@@ -0,0 +1,163 @@
+/* Calf DSP Library
+ * Shared, page-aligned memory for delay lines
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#include <complex>
+#include <calf/delay.h>
+#include <algorithm>
+#include <map>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace dsp;
+
+namespace {
+
+/// State of the arena: mappings are never unmapped, free parts of them are
+/// kept in free_blocks (start -> size, adjacent blocks merged)
+struct arena_state
+{
+    enum { CHUNK_SIZE = 16 << 20, HUGE_PAGE_SIZE = 2 << 20 };
+    pthread_mutex_t mutex;
+    std::map<char *, size_t> free_blocks;
+    size_t page_size;
+    bool huge_pages, prefault_all;
+
+    arena_state()
+    {
+        pthread_mutex_init(&mutex, NULL);
+        page_size = sysconf(_SC_PAGESIZE);
+        const char *env = getenv("CALF_DELAY_HUGEPAGES");
+        huge_pages = env && atoi(env);
+        env = getenv("CALF_DELAY_PREFAULT");
+        prefault_all = env && atoi(env);
+    }
+    /// Map a new area of at least bytes bytes and add it to the free list
+    bool grow(size_t bytes)
+    {
+        size_t align = huge_pages ? (size_t)HUGE_PAGE_SIZE : page_size;
+        size_t size = std::max((size_t)CHUNK_SIZE, (bytes + align - 1) & ~(align - 1));
+        // map a bit more, so that the start can be aligned to a huge page
+        size_t map_size = size + (align > page_size ? align : 0);
+        char *map = (char *)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (map == MAP_FAILED)
+            return false;
+        char *start = (char *)(((uintptr_t)map + align - 1) & ~(uintptr_t)(align - 1));
+        if (start > map)
+            munmap(map, start - map);
+        if (map + map_size > start + size)
+            munmap(start + size, map + map_size - (start + size));
+#ifdef MADV_HUGEPAGE
+        if (huge_pages)
+            madvise(start, size, MADV_HUGEPAGE);
+#endif
+        release(start, size);
+        return true;
+    }
+    /// Add a block to the free list, merging it with its neighbours
+    void release(char *ptr, size_t size)
+    {
+        std::map<char *, size_t>::iterator next = free_blocks.lower_bound(ptr);
+        if (next != free_blocks.end() && ptr + size == next->first)
+        {
+            size += next->second;
+            free_blocks.erase(next++);
+        }
+        if (next != free_blocks.begin())
+        {
+            std::map<char *, size_t>::iterator prev = next;
+            --prev;
+            if (prev->first + prev->second == ptr)
+            {
+                prev->second += size;
+                return;
+            }
+        }
+        free_blocks[ptr] = size;
+    }
+    /// First fit from the free list
+    char *take(size_t size)
+    {
+        for (std::map<char *, size_t>::iterator i = free_blocks.begin(); i != free_blocks.end(); ++i)
+        {
+            if (i->second < size)
+                continue;
+            char *ptr = i->first;
+            size_t rest = i->second - size;
+            free_blocks.erase(i);
+            if (rest)
+                free_blocks[ptr + size] = rest;
+            return ptr;
+        }
+        return NULL;
+    }
+};
+
+arena_state &get_arena()
+{
+    // never destroyed, as plugin instances may outlive static destructors
+    static arena_state *arena = new arena_state;
+    return *arena;
+}
+
+}
+
+void *delay_arena::alloc(size_t bytes)
+{
+    arena_state &a = get_arena();
+    size_t size = (std::max(bytes, (size_t)1) + a.page_size - 1) & ~(a.page_size - 1);
+    pthread_mutex_lock(&a.mutex);
+    char *ptr = a.take(size);
+    if (!ptr && a.grow(size))
+        ptr = a.take(size);
+    bool prefault_all = a.prefault_all;
+    pthread_mutex_unlock(&a.mutex);
+    if (!ptr)
+    {
+        fprintf(stderr, "Cannot allocate %lu bytes of delay memory\n", (unsigned long)bytes);
+        return NULL;
+    }
+    if (prefault_all)
+        prefault(ptr, size);
+    return ptr;
+}
+
+void delay_arena::free(void *ptr, size_t bytes)
+{
+    if (!ptr)
+        return;
+    arena_state &a = get_arena();
+    size_t size = (std::max(bytes, (size_t)1) + a.page_size - 1) & ~(a.page_size - 1);
+    // give the memory back to the OS; the pages read as zeros when used again
+    madvise(ptr, size, MADV_DONTNEED);
+    pthread_mutex_lock(&a.mutex);
+    a.release((char *)ptr, size);
+    pthread_mutex_unlock(&a.mutex);
+}
+
+void delay_arena::prefault(void *ptr, size_t bytes)
+{
+    size_t page_size = get_arena().page_size;
+    volatile char *p = (volatile char *)ptr;
+    // writing (not just reading) is needed, reads would map the shared zero page
+    for (size_t i = 0; i < bytes; i += page_size)
+        p[i] = p[i];
+}
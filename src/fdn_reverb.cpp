@@ -0,0 +1,438 @@
+/* Calf DSP Library
+ * Feedback delay network reverb
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#include <complex>
+#include <calf/delay.h>
+#include <calf/fdn_reverb.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+using namespace dsp;
+
+/// Shortest and longest delay line, shortest and longest allpass (in ms) for each room type
+static const float room_times[fdn_reverb::ROOM_TYPES][4] = {
+    {  8,  30, 1.5, 3.5 }, // small
+    { 12,  45, 2.0, 4.5 }, // medium
+    { 18,  70, 2.5, 6.0 }, // large
+    { 55,  75, 3.0, 7.0 }, // tunnel-like
+    { 14,  85, 3.0, 8.0 }, // large/smooth
+    {  4, 120, 1.2, 9.0 }, // experimental
+};
+
+/// Modulation depth of the line lengths, in seconds
+static const float modulation_time = 0.0002f;
+
+/// Values below this are flushed to zero when written into the lines
+static const float denormal_limit = 1e-20f;
+
+static bool is_prime(int n)
+{
+    if (n < 2)
+        return false;
+    for (int i = 2; i * i <= n; i++)
+        if (!(n % i))
+            return false;
+    return true;
+}
+
+/// Sign of row 'row' of a Sylvester-type Hadamard matrix in column 'col'
+static inline float hadamard_sign(int row, int col)
+{
+    return __builtin_popcount(row & col) & 1 ? -1.f : 1.f;
+}
+
+fdn_reverb::fdn_reverb()
+{
+    time = 1.0;
+    cutoff = 9000;
+    type = 2;
+    diffusion = 1.f;
+    init(44100);
+}
+
+fdn_reverb::fdn_reverb(const fdn_reverb &src)
+{
+    time = src.time;
+    cutoff = src.cutoff;
+    type = src.type;
+    diffusion = src.diffusion;
+    init(src.sr);
+}
+
+void fdn_reverb::init(int sample_rate)
+{
+    lines = ap_lines = NULL;
+    size = ap_size = 0;
+    pos = 0;
+    clear_left = 0;
+    ap_coeff = 0.15f + 0.55f * diffusion;
+    for (int i = 0; i < LINES; i++)
+    {
+        // different rows of the Hadamard matrix, so that the inputs and outputs are decorrelated
+        in_l[i] = 0.25f * hadamard_sign(3, i);
+        in_r[i] = 0.25f * hadamard_sign(12, i);
+        out_l[i] = 0.5f * hadamard_sign(5, i);
+        out_r[i] = 0.5f * hadamard_sign(10, i);
+        lfo_phase[i] = 2 * M_PI * i / LINES;
+    }
+    setup(sample_rate);
+}
+
+fdn_reverb::~fdn_reverb()
+{
+    if (lines)
+        delay_arena::free(lines, LINES * (size + ap_size) * sizeof(float));
+}
+
+void fdn_reverb::setup(int sample_rate)
+{
+    sr = sample_rate;
+    float longest = 0, longest_ap = 0;
+    for (int i = 0; i < ROOM_TYPES; i++)
+    {
+        longest = std::max(longest, room_times[i][1]);
+        longest_ap = std::max(longest_ap, room_times[i][3]);
+    }
+    // room for the longest (prime) line, the modulation and a block
+    mod_depth = modulation_time * sr;
+    int max_length = (int)(longest * 0.001 * sr * 1.1) + (int)mod_depth + MAX_BLOCK + 4;
+    int max_ap_length = (int)(longest_ap * 0.001 * sr * 1.1) + MAX_BLOCK + 4;
+    int new_size = 16, new_ap_size = 16;
+    while (new_size <= max_length)
+        new_size <<= 1;
+    while (new_ap_size <= max_ap_length)
+        new_ap_size <<= 1;
+    if (new_size != size || new_ap_size != ap_size)
+    {
+        if (lines)
+            delay_arena::free(lines, LINES * (size + ap_size) * sizeof(float));
+        lines = (float *)delay_arena::alloc(LINES * (new_size + new_ap_size) * sizeof(float));
+        // without the memory, process outputs silence
+        size = lines ? new_size : 0;
+        ap_size = lines ? new_ap_size : 0;
+        ap_lines = lines ? lines + LINES * size : NULL;
+    }
+    for (int i = 0; i < LINES; i++)
+    {
+        // spread the LFO rates between 0.3 and 1.2 Hz
+        lfo_dphase[i] = 2 * M_PI * (0.3 + 0.9 * ((i * 5) & (LINES - 1)) / (LINES - 1)) / sr;
+    }
+    update_times();
+    set_cutoff(cutoff);
+    reset();
+}
+
+void fdn_reverb::reset()
+{
+    start_reset();
+    if (lines)
+        memset(lines, 0, clear_left * sizeof(float));
+    clear_left = 0;
+}
+
+void fdn_reverb::start_reset()
+{
+    clear_left = LINES * (size + ap_size);
+    pos = 0;
+    for (int i = 0; i < LINES; i++)
+    {
+        lp_state[i] = 0.f;
+        lfo_value[i] = mod_depth * sin(lfo_phase[i]);
+    }
+}
+
+void fdn_reverb::set_time(float time)
+{
+    this->time = time;
+    update_gains();
+}
+
+void fdn_reverb::set_cutoff(float cutoff)
+{
+    this->cutoff = cutoff;
+    lp_coeff = 1.f - exp(-2 * M_PI * std::min(cutoff, 0.49f * sr) / sr);
+}
+
+void fdn_reverb::set_type_and_diffusion(int type, float diffusion)
+{
+    type = std::max(0, std::min(type, (int)ROOM_TYPES - 1));
+    this->diffusion = diffusion;
+    ap_coeff = 0.15f + 0.55f * diffusion;
+    if (type != this->type)
+    {
+        this->type = type;
+        update_times();
+    }
+}
+
+/// Smallest prime >= n that isn't in any of the count first elements of a and b, nor equal to other
+static int unique_prime(int n, const int *a, const int *b, int count, int other)
+{
+    for (;; n++)
+    {
+        if (!is_prime(n) || n == other)
+            continue;
+        bool taken = false;
+        for (int i = 0; i < count && !taken; i++)
+            taken = a[i] == n || b[i] == n;
+        if (!taken)
+            return n;
+    }
+}
+
+void fdn_reverb::update_times()
+{
+    const float *t = room_times[type];
+    for (int i = 0; i < LINES; i++)
+    {
+        // geometric spread of lengths, shuffled so that neighbouring lines
+        // (and the line/allpass pairs) differ in length
+        float x = ((i * 7) & (LINES - 1)) * (1.f / (LINES - 1));
+        float y = ((i * 11 + 5) & (LINES - 1)) * (1.f / (LINES - 1));
+        length[i] = unique_prime((int)(t[0] * pow(t[1] / t[0], x) * 0.001 * sr), length, ap_length, i, -1);
+        ap_length[i] = unique_prime((int)(t[2] * pow(t[3] / t[2], y) * 0.001 * sr), length, ap_length, i, length[i]);
+    }
+    block = MAX_BLOCK;
+    for (int i = 0; i < LINES; i++)
+        block = std::min(block, std::min(length[i] - (int)ceil(mod_depth) - 1, ap_length[i]));
+    block = std::max(block, 1);
+    update_gains();
+}
+
+void fdn_reverb::update_gains()
+{
+    for (int i = 0; i < LINES; i++)
+    {
+        // -60 dB after time seconds; the allpass adds its length to the average delay;
+        // 0.25 normalizes the Hadamard matrix
+        gain[i] = 0.25f * pow(10.0, -3.0 * (length[i] + ap_length[i]) / (time * sr));
+    }
+}
+
+int fdn_reverb::get_loop_length() const
+{
+    int total = 0;
+    for (int i = 0; i < LINES; i++)
+        total += length[i] + ap_length[i];
+    return total / LINES;
+}
+
+float fdn_reverb::get_loop_gain() const
+{
+    return pow(10.0, -3.0 * get_loop_length() / (time * sr));
+}
+
+void fdn_reverb::read_block(int len)
+{
+    int mask = size - 1, ap_mask = ap_size - 1;
+    int ipos[MAX_BLOCK];
+    float frac[MAX_BLOCK], tmp[MAX_BLOCK];
+    for (int i = 0; i < LINES; i++)
+    {
+        // the modulation is a slow sine, linear interpolation over a block is good enough
+        float d0 = length[i] + lfo_value[i];
+        lfo_phase[i] += lfo_dphase[i] * len;
+        if (lfo_phase[i] >= 2 * M_PI)
+            lfo_phase[i] -= 2 * M_PI;
+        lfo_value[i] = mod_depth * sin(lfo_phase[i]);
+        float delta = (length[i] + lfo_value[i] - d0) / len;
+        for (int t = 0; t < len; t++)
+        {
+            float d = d0 + delta * t;
+            int id = (int)d;
+            ipos[t] = (pos + t - id) & mask;
+            frac[t] = d - id;
+        }
+        gather_interp(lines + i * size, mask, ipos, frac, tmp, len, false);
+        const float *ap = ap_lines + i * ap_size;
+        for (int t = 0; t < len; t++)
+        {
+            rd[t * LINES + i] = tmp[t];
+            ap_rd[t * LINES + i] = ap[(pos + t - ap_length[i]) & ap_mask];
+        }
+    }
+}
+
+void fdn_reverb::write_block(int len)
+{
+    int mask = size - 1, ap_mask = ap_size - 1;
+    for (int i = 0; i < LINES; i++)
+    {
+        float *line = lines + i * size, *ap = ap_lines + i * ap_size;
+        for (int t = 0; t < len; t++)
+        {
+            line[(pos + t) & mask] = wr[t * LINES + i];
+            ap[(pos + t) & ap_mask] = ap_wr[t * LINES + i];
+        }
+    }
+}
+
+#if defined(__SSE__)
+
+/// Sum of the 4 elements
+static inline float horizontal_sum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+/// 4-point Hadamard transform of the elements of a vector
+static inline __m128 hadamard4(__m128 v)
+{
+    const __m128 sign1 = _mm_setr_ps(1.f, -1.f, 1.f, -1.f), sign2 = _mm_setr_ps(1.f, 1.f, -1.f, -1.f);
+    v = _mm_add_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)), _mm_mul_ps(v, sign1));
+    return _mm_add_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)), _mm_mul_ps(v, sign2));
+}
+
+void fdn_reverb::mix_block(float *left, float *right, int len)
+{
+    const __m128 g = _mm_set1_ps(ap_coeff), c = _mm_set1_ps(lp_coeff);
+    const __m128 sign_mask = _mm_set1_ps(-0.f), limit = _mm_set1_ps(denormal_limit);
+    __m128 lp[4], gv[4], il[4], ir[4], ol[4], orr[4];
+    for (int j = 0; j < 4; j++)
+    {
+        lp[j] = _mm_loadu_ps(lp_state + 4 * j);
+        gv[j] = _mm_loadu_ps(gain + 4 * j);
+        il[j] = _mm_loadu_ps(in_l + 4 * j);
+        ir[j] = _mm_loadu_ps(in_r + 4 * j);
+        ol[j] = _mm_loadu_ps(out_l + 4 * j);
+        orr[j] = _mm_loadu_ps(out_r + 4 * j);
+    }
+    for (int t = 0; t < len; t++)
+    {
+        const float *x = rd + t * LINES, *a = ap_rd + t * LINES;
+        float *w = wr + t * LINES, *aw = ap_wr + t * LINES;
+        __m128 y[4], suml = _mm_setzero_ps(), sumr = _mm_setzero_ps();
+        for (int j = 0; j < 4; j++)
+        {
+            __m128 av = _mm_loadu_ps(a + 4 * j);
+            __m128 ain = _mm_add_ps(_mm_loadu_ps(x + 4 * j), _mm_mul_ps(g, av));
+            __m128 aout = _mm_sub_ps(av, _mm_mul_ps(g, ain));
+            _mm_storeu_ps(aw + 4 * j, ain);
+            lp[j] = _mm_add_ps(lp[j], _mm_mul_ps(c, _mm_sub_ps(aout, lp[j])));
+            y[j] = _mm_mul_ps(lp[j], gv[j]);
+            suml = _mm_add_ps(suml, _mm_mul_ps(aout, ol[j]));
+            sumr = _mm_add_ps(sumr, _mm_mul_ps(aout, orr[j]));
+        }
+        // 16-point Hadamard transform: 4-point across the vectors, then within each of them
+        __m128 s0 = _mm_add_ps(y[0], y[1]), d0 = _mm_sub_ps(y[0], y[1]);
+        __m128 s1 = _mm_add_ps(y[2], y[3]), d1 = _mm_sub_ps(y[2], y[3]);
+        y[0] = _mm_add_ps(s0, s1);
+        y[1] = _mm_add_ps(d0, d1);
+        y[2] = _mm_sub_ps(s0, s1);
+        y[3] = _mm_sub_ps(d0, d1);
+        __m128 l = _mm_set1_ps(left[t]), r = _mm_set1_ps(right[t]);
+        for (int j = 0; j < 4; j++)
+        {
+            __m128 v = _mm_add_ps(hadamard4(y[j]), _mm_add_ps(_mm_mul_ps(il[j], l), _mm_mul_ps(ir[j], r)));
+            // flush denormals, so that the lines don't fill up with them when the input goes silent
+            v = _mm_and_ps(v, _mm_cmpge_ps(_mm_andnot_ps(sign_mask, v), limit));
+            _mm_storeu_ps(w + 4 * j, v);
+        }
+        left[t] = horizontal_sum(suml);
+        right[t] = horizontal_sum(sumr);
+    }
+    for (int j = 0; j < 4; j++)
+        _mm_storeu_ps(lp_state + 4 * j, lp[j]);
+}
+
+#else
+
+void fdn_reverb::mix_block(float *left, float *right, int len)
+{
+    for (int t = 0; t < len; t++)
+    {
+        const float *x = rd + t * LINES, *a = ap_rd + t * LINES;
+        float *w = wr + t * LINES, *aw = ap_wr + t * LINES;
+        float suml = 0.f, sumr = 0.f;
+        for (int i = 0; i < LINES; i++)
+        {
+            float ain = x[i] + ap_coeff * a[i];
+            float aout = a[i] - ap_coeff * ain;
+            aw[i] = ain;
+            lp_state[i] += lp_coeff * (aout - lp_state[i]);
+            w[i] = lp_state[i] * gain[i];
+            suml += aout * out_l[i];
+            sumr += aout * out_r[i];
+        }
+        // in-place fast Walsh-Hadamard transform
+        for (int h = 1; h < LINES; h <<= 1)
+        {
+            for (int i = 0; i < LINES; i += 2 * h)
+            {
+                for (int j = i; j < i + h; j++)
+                {
+                    float u = w[j], v = w[j + h];
+                    w[j] = u + v;
+                    w[j + h] = u - v;
+                }
+            }
+        }
+        for (int i = 0; i < LINES; i++)
+        {
+            w[i] += in_l[i] * left[t] + in_r[i] * right[t];
+            if (fabs(w[i]) < denormal_limit)
+                w[i] = 0.f;
+        }
+        left[t] = suml;
+        right[t] = sumr;
+    }
+}
+
+#endif
+
+void fdn_reverb::process(float *left, float *right, uint32_t len)
+{
+    if (!lines)
+    {
+        dsp::zero(left, len);
+        dsp::zero(right, len);
+        return;
+    }
+    if (clear_left)
+    {
+        // still clearing after start_reset
+        int n = std::min(clear_left, (int)CLEAR_SLICE);
+        clear_left -= n;
+        memset(lines + clear_left, 0, n * sizeof(float));
+        dsp::zero(left, len);
+        dsp::zero(right, len);
+        return;
+    }
+    while(len > 0)
+    {
+        int n = std::min((int)len, block);
+        read_block(n);
+        mix_block(left, right, n);
+        write_block(n);
+        pos = (pos + n) & (size - 1);
+        left += n;
+        right += n;
+        len -= n;
+    }
+    for (int i = 0; i < LINES; i++)
+        sanitize(lp_state[i]);
+}
@@ -22,6 +22,9 @@
 #include <limits.h>
 #include <calf/giface.h>
 #include <calf/utils.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 using namespace calf_utils;
@@ -522,3 +525,74 @@ table_via_configure::~table_via_configure()
 }
 
 #endif
+
+///////////////////////////////////////////////////////////////////////////////////////
+
+bool calf_plugins::scan_audio_block(const float *data, uint32_t len, float &peak)
+{
+    // absolute values of IEEE floats compare the same way as their bit patterns
+    // (as integers); anything above the largest finite value is an infinity or a NaN
+    const uint32_t abs_mask = 0x7FFFFFFF, max_finite = 0x7F7FFFFF;
+    uint32_t i = 0, bad = 0;
+    float p = 0.f;
+#if defined(__SSE2__)
+    __m128i vabs_mask = _mm_set1_epi32(abs_mask), vmax_finite = _mm_set1_epi32(max_finite);
+    __m128i vbad = _mm_setzero_si128();
+    __m128 vpeak = _mm_setzero_ps();
+    for (; i + 4 <= len; i += 4)
+    {
+        __m128i bits = _mm_and_si128(_mm_loadu_si128((const __m128i *)(data + i)), vabs_mask);
+        vbad = _mm_or_si128(vbad, _mm_cmpgt_epi32(bits, vmax_finite));
+        vpeak = _mm_max_ps(vpeak, _mm_castsi128_ps(bits));
+    }
+    float peaks[4];
+    _mm_storeu_ps(peaks, vpeak);
+    p = std::max(std::max(peaks[0], peaks[1]), std::max(peaks[2], peaks[3]));
+    bad = _mm_movemask_epi8(vbad);
+#endif
+    for (; i < len; i++)
+    {
+        union { float f; uint32_t i; } u;
+        u.f = data[i];
+        u.i &= abs_mask;
+        bad |= u.i > max_finite;
+        p = std::max(p, u.f);
+    }
+    peak = p;
+    return !bad;
+}
+
+volatile int validation_policy::interval = validation_policy::from_environment();
+
+void validation_policy::set(mode_type mode, int sampling_interval)
+{
+    switch(mode)
+    {
+    case ALWAYS:
+        interval = 1;
+        break;
+    case SAMPLED:
+        interval = std::max(1, sampling_interval);
+        break;
+    case NEVER:
+        interval = 0;
+        break;
+    }
+}
+
+int validation_policy::from_environment()
+{
+    int result = 1;
+    const char *value = getenv("CALF_VALIDATE");
+    if (!value)
+        return result;
+    if (!strcmp(value, "always"))
+        result = 1;
+    else if (!strcmp(value, "never"))
+        result = 0;
+    else if (!strncmp(value, "sampled", 7))
+        result = value[7] == ':' ? std::max(1, atoi(value + 8)) : 8;
+    else
+        fprintf(stderr, "Warning: unknown CALF_VALIDATE value '%s', expected always, never or sampled:N\n", value);
+    return result;
+}
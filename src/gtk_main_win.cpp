@@ -37,6 +37,7 @@ gtk_main_window::gtk_main_window()
     notifier = NULL;
     is_closed = true;
     progress_window = NULL;
+    load_update_countdown = 0;
 }
 
 static const char *ui_xml = 
@@ -363,6 +364,12 @@ plugin_strip *gtk_main_window::create_strip(jack_host *plugin)
     gtk_box_pack_start(GTK_BOX(buttonBox), GTK_WIDGET(strip->button), FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(buttonBox), GTK_WIDGET(strip->con), FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(buttonBox), GTK_WIDGET(strip->extra), FALSE, FALSE, 0);
+    
+    // DSP load
+    strip->load = gtk_label_new("");
+    gtk_widget_set_size_request(GTK_WIDGET(strip->load), 70, -1);
+    gtk_box_pack_start(GTK_BOX(buttonBox), GTK_WIDGET(strip->load), FALSE, FALSE, 0);
+    gtk_widget_show(strip->load);
     gtk_table_attach(GTK_TABLE(strip->strip_table), buttonBox, 1, 2, row + 1, row + 2, (GtkAttachOptions)0, (GtkAttachOptions)0, 10, 10);
     gtk_widget_show(buttonBox);
     
@@ -737,6 +744,13 @@ gboolean gtk_main_window::on_idle(void *data)
     
     if (!self->refresh_controller.check_redraw(GTK_WIDGET(self->toplevel)))
         return TRUE;
+    
+    // percentiles of 1024 periods don't change much at 30 fps
+    if (--self->load_update_countdown <= 0)
+    {
+        self->load_update_countdown = 15;
+        self->update_load_labels();
+    }
 
     for (std::map<plugin_ctl_iface *, plugin_strip *>::iterator i = self->plugins.begin(); i != self->plugins.end(); i++)
     {
@@ -767,6 +781,26 @@ gboolean gtk_main_window::on_idle(void *data)
     return TRUE;
 }
 
+void gtk_main_window::update_load_labels()
+{
+    for (std::map<plugin_ctl_iface *, plugin_strip *>::iterator i = plugins.begin(); i != plugins.end(); i++)
+    {
+        plugin_strip *strip = i->second;
+        if (!strip)
+            continue;
+        jack_host *plugin = strip->plugin;
+        jack_load_stats::summary s;
+        plugin->load.get_summary(s, plugin->client ? plugin->client->get_period_us() : 0);
+        if (!s.periods)
+            continue;
+        char buf[64], tip[128];
+        sprintf(buf, "DSP %.1f%%", s.load);
+        sprintf(tip, "Processing time per period: mean %.1f us, 99th percentile %.1f us, max %.1f us", s.mean, s.p99, s.max);
+        gtk_label_set_text(GTK_LABEL(strip->load), buf);
+        gtk_widget_set_tooltip_text(strip->load, tip);
+    }
+}
+
 void gtk_main_window::open_file()
 {
     GtkWidget *dialog;
@@ -40,10 +40,12 @@ host_session::host_session(session_environment_iface *se)
     calfjackhost_cmd = "calfjackhost";
     session_env = se;
     autoconnect_midi_index = -1;
+    worker_threads = 1;
     gui_win = NULL;
     session_manager = NULL;
     only_load_if_exists = false;
     save_file_on_next_idle_call = false;
+    dump_load_stats_on_next_idle_call = false;
     quit_on_next_idle_call = 0;
     handle_event_on_next_idle_call = NULL;
 
@@ -116,6 +118,8 @@ void host_session::open()
     
     client.open(client_name.c_str(), !jack_session_id.empty() ? jack_session_id.c_str() : NULL);
     jack_set_session_callback(client.client, session_callback, this);
+    if (worker_threads > 1)
+        client.set_worker_threads(worker_threads);
     main_win->add_condition("jackhost");
     main_win->add_condition("directlink");
     main_win->add_condition("configure");
@@ -529,6 +533,9 @@ void host_session::signal_handler(int signum)
     case SIGUSR1:
         instance->save_file_on_next_idle_call = true;
         break;
+    case SIGUSR2:
+        instance->dump_load_stats_on_next_idle_call = true;
+        break;
     case SIGTERM:
     case SIGHUP:
         instance->quit_on_next_idle_call = signum;
@@ -545,12 +552,20 @@ void host_session::on_idle()
         printf("LADISH Level 1 support: file '%s' saved\n", get_current_filename().c_str());
     }
 
+    if (dump_load_stats_on_next_idle_call)
+    {
+        dump_load_stats_on_next_idle_call = false;
+        client.dump_load_stats(stdout);
+    }
+
     if (handle_event_on_next_idle_call)
     {
         jack_session_event_t *ev = handle_event_on_next_idle_call;
         handle_event_on_next_idle_call = NULL;
         handle_jack_session_event(ev);
     }
+    if (client.is_parallel() && client.graph_changed)
+        reorder_plugins();
     if (quit_on_next_idle_call > 0)
     {
         printf("Quit requested through signal %d\n", quit_on_next_idle_call);
@@ -570,6 +585,7 @@ void host_session::set_signal_handlers()
     sigaction(SIGTERM, &sa, NULL);
     sigaction(SIGHUP,  &sa, NULL);
     sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGUSR2, &sa, NULL);
 }
 
 void host_session::reorder_plugins()
@@ -24,7 +24,9 @@
 #include <jack/midiport.h>
 #include <calf/giface.h>
 #include <calf/jackhost.h>
+#include <algorithm>
 #include <set>
+#include <unistd.h>
 
 using namespace std;
 using namespace calf_utils;
@@ -39,12 +41,30 @@ jack_client::jack_client()
     sample_rate = 0;
     client = NULL;
     automation_port = NULL;
+    workers = NULL;
+    cycle_nframes = 0;
+    graph_changed = false;
+    xruns = 0;
+    commands_posted = 0;
+    commands_applied = 0;
+    active = false;
+    rt_plugins = new jack_plugin_list;
+    port_generation = 0;
+}
+
+jack_client::~jack_client()
+{
+    collect_garbage();
+    delete rt_plugins;
+    delete workers;
 }
 
 void jack_client::add(jack_host *plugin)
 {
     calf_utils::ptlock lock(mutex);
     plugins.push_back(plugin);
+    graph_changed = true;
+    post_plugin_list(NULL);
 }
 
 void jack_client::del(jack_host *plugin)
@@ -55,12 +75,151 @@ void jack_client::del(jack_host *plugin)
         if (plugins[i] == plugin)
         {
             plugins.erase(plugins.begin()+i);
+            graph_changed = true;
+            post_plugin_list(NULL);
+            // the caller is going to delete the plugin
+            sync();
             return;
         }
     }
     assert(0);
 }
 
+void jack_client::post(const jack_command &cmd)
+{
+    // the process thread empties the queue every cycle
+    while(!try_post(cmd))
+        usleep(1000);
+}
+
+bool jack_client::try_post(const jack_command &cmd)
+{
+    collect_garbage();
+    if (!active)
+    {
+        // nothing is processing, so it's safe to do it here
+        jack_command tmp = cmd;
+        apply_command(tmp);
+        free_command(tmp);
+        return true;
+    }
+    if (!commands.push(cmd))
+        return false;
+    commands_posted++;
+    return true;
+}
+
+void jack_client::post_plugin_list(calf_utils::task_graph *graph)
+{
+    jack_command cmd;
+    cmd.type = jack_command::SWAP_PLUGINS;
+    cmd.list = new jack_plugin_list;
+    cmd.list->plugins = plugins;
+    cmd.list->graph = graph;
+    // if the buffer size changes after this, the process thread fetches the buffers again
+    cmd.list->port_generation = port_generation;
+    __sync_synchronize();
+    for (unsigned int i = 0; i < plugins.size(); i++)
+        plugins[i]->get_output_buffers(cmd.list->out_buffers);
+    post(cmd);
+}
+
+void jack_client::sync()
+{
+    while(active && commands_applied != commands_posted)
+    {
+        // the process thread stops applying commands when it has no room for the garbage
+        collect_garbage();
+        usleep(1000);
+    }
+    collect_garbage();
+}
+
+void jack_client::collect_garbage()
+{
+    jack_command cmd;
+    while(garbage.pop(cmd))
+        free_command(cmd);
+}
+
+void jack_client::free_command(jack_command &cmd)
+{
+    if (cmd.type == jack_command::SWAP_AUTOMATION)
+        delete cmd.amap;
+    else if (cmd.type == jack_command::SWAP_PLUGINS)
+        delete cmd.list;
+}
+
+void jack_client::process_commands()
+{
+    jack_command cmd;
+    // a command may produce one item of garbage; if there's no room for it,
+    // the rest of the commands wait for the next cycle
+    while(!garbage.full() && commands.pop(cmd))
+    {
+        apply_command(cmd);
+        if (cmd.type != jack_command::SET_PARAM)
+            garbage.push(cmd);
+        __sync_synchronize();
+        commands_applied++;
+    }
+}
+
+void jack_client::apply_command(jack_command &cmd)
+{
+    switch(cmd.type)
+    {
+    case jack_command::SET_PARAM:
+        cmd.plugin->param_values[cmd.param_no] = cmd.value;
+        cmd.plugin->changed = true;
+        break;
+    case jack_command::SWAP_AUTOMATION:
+        std::swap(cmd.plugin->rt_cc_mappings, cmd.amap);
+        break;
+    case jack_command::SWAP_PLUGINS:
+    {
+        std::swap(rt_plugins, cmd.list);
+        // plugins added since the last buffer size change may have stale
+        // buffers, use the ones fetched with the list
+        float *const *bufs = rt_plugins->out_buffers.empty() ? NULL : &rt_plugins->out_buffers[0];
+        for (unsigned int i = 0; i < rt_plugins->plugins.size(); i++)
+            bufs += rt_plugins->plugins[i]->set_output_buffers(bufs);
+        break;
+    }
+    }
+}
+
+void jack_client::set_param_value(jack_host *plugin, int param_no, float value)
+{
+    jack_command cmd;
+    cmd.type = jack_command::SET_PARAM;
+    cmd.plugin = plugin;
+    cmd.param_no = param_no;
+    cmd.value = value;
+    // don't keep the other threads waiting while the queue is full
+    for(;;)
+    {
+        {
+            calf_utils::ptlock lock(mutex);
+            if (try_post(cmd))
+                return;
+        }
+        usleep(1000);
+    }
+}
+
+void jack_client::replace_automation_map(jack_host *plugin, automation_map *amap)
+{
+    jack_command cmd;
+    cmd.type = jack_command::SWAP_AUTOMATION;
+    cmd.plugin = plugin;
+    cmd.amap = amap ? new automation_map(*amap) : NULL;
+    calf_utils::ptlock lock(mutex);
+    delete plugin->cc_mappings;
+    plugin->cc_mappings = amap;
+    post(cmd);
+}
+
 void jack_client::open(const char *client_name, const char *jack_session_id)
 {
     jack_status_t status;
@@ -73,6 +232,8 @@ void jack_client::open(const char *client_name, const char *jack_session_id)
     sample_rate = jack_get_sample_rate(client);
     jack_set_process_callback(client, do_jack_process, this);
     jack_set_buffer_size_callback(client, do_jack_bufsize, this);
+    jack_set_xrun_callback(client, do_jack_xrun, this);
+    jack_set_port_connect_callback(client, do_jack_port_connect, this);
     name = get_name();
 }
 
@@ -83,12 +244,25 @@ std::string jack_client::get_name()
 
 void jack_client::activate()
 {
+    {
+        calf_utils::ptlock lock(mutex);
+        active = true;
+    }
     jack_activate(client);        
 }
 
 void jack_client::deactivate()
 {
     jack_deactivate(client);        
+    calf_utils::ptlock lock(mutex);
+    // the process callback isn't going to be called anymore, so apply whatever is left
+    while(!commands.empty())
+    {
+        process_commands();
+        collect_garbage();
+    }
+    active = false;
+    collect_garbage();
 }
 
 void jack_client::connect(const std::string &p1, const std::string &p2)
@@ -122,7 +296,7 @@ class jack_automation: public automation_iface
         if (event.size == 3 && ((event.buffer[0] & 0xF0) == 0xB0))
         {
             int designator = ((event.buffer[0] & 0xF) << 8) | event.buffer[1];
-            plugin->handle_automation_cc(designator, event.buffer[2]);
+            plugin->handle_automation_cc(designator, event.buffer[2], event.time);
         }
     }
 public:
@@ -152,34 +326,135 @@ public:
 int jack_client::do_jack_process(jack_nframes_t nframes, void *p)
 {
     jack_client *self = (jack_client *)p;
-    pttrylock lock(self->mutex);
-    if (lock.is_locked())
+    uint64_t start = jack_load_stats::now();
+    // never waits for the other threads: whatever they've changed is picked up
+    // here, and the rest will be picked up in the next cycle
+    self->process_commands();
+    jack_plugin_list *list = self->rt_plugins;
+    int port_generation = self->port_generation;
+    if (list->port_generation != port_generation)
     {
-        for(unsigned int i = 0; i < self->plugins.size(); i++)
+        // the buffer size has changed since the list was made
+        for(unsigned int i = 0; i < list->plugins.size(); i++)
+            list->plugins[i]->cache_ports();
+        list->port_generation = port_generation;
+    }
+    self->cycle_nframes = nframes;
+    if (self->workers && list->graph)
+        self->workers->run(list->graph, self);
+    else
+    {
+        for(unsigned int i = 0; i < list->plugins.size(); i++)
         {
-            jack_automation au(self->automation_port, nframes, self->plugins[i]);
-            self->plugins[i]->process(nframes, au);
+            jack_automation au(self->automation_port, nframes, list->plugins[i]);
+            list->plugins[i]->process(nframes, au);
         }
     }
+    self->load.add(start);
     return 0;
 }
 
-int jack_client::do_jack_bufsize(jack_nframes_t numsamples, void *p)
+int jack_client::do_jack_xrun(void *p)
+{
+    jack_client *self = (jack_client *)p;
+    __sync_fetch_and_add(&self->xruns, 1);
+    return 0;
+}
+
+double jack_client::get_period_us() const
+{
+    if (!sample_rate)
+        return 0;
+    jack_nframes_t nframes = cycle_nframes;
+    if (!nframes && client)
+        nframes = jack_get_buffer_size(client);
+    return nframes * 1000000.0 / sample_rate;
+}
+
+void jack_client::dump_load_stats(FILE *f)
+{
+    double period_us = get_period_us();
+    jack_load_stats::summary s;
+    fprintf(f, "%-32s %10s %10s %10s %8s %5s %8s %8s %8s\n", "plugin", "mean [us]", "p99 [us]", "max [us]", "load", "sleep", "checked", "bad in", "bad out");
+    {
+        calf_utils::ptlock lock(mutex);
+        for (size_t i = 0; i < plugins.size(); i++)
+        {
+            audio_module_iface *module = plugins[i]->module;
+            const validation_stats &vs = module->get_validation_stats();
+            plugins[i]->load.get_summary(s, period_us);
+            fprintf(f, "%-32s %10.1f %10.1f %10.1f %7.2f%% %5s %8u %8u %8u\n", plugins[i]->instance_name.c_str(), s.mean, s.p99, s.max, s.load,
+                module->is_sleeping() ? "yes" : "no", vs.blocks_checked, vs.input_errors, vs.output_errors);
+        }
+    }
+    load.get_summary(s, period_us);
+    fprintf(f, "%-32s %10.1f %10.1f %10.1f %7.2f%%\n", "(total)", s.mean, s.p99, s.max, s.load);
+    fprintf(f, "period: %.0f us, JACK DSP load: %.2f%%, xruns: %d\n", period_us, client ? jack_cpu_load(client) : 0.f, (int)xruns);
+    fflush(f);
+}
+
+void jack_load_stats::get_summary(summary &s, double period_us) const
+{
+    float times[history_size];
+    uint32_t total = periods;
+    int count = std::min<uint32_t>(total, history_size);
+    s.periods = count;
+    s.mean = s.p99 = s.max = s.load = 0.f;
+    if (!count)
+        return;
+    double sum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        times[i] = history[(total - 1 - i) % history_size];
+        sum += times[i];
+        s.max = std::max(s.max, times[i]);
+    }
+    s.mean = sum / count;
+    int p99 = std::min(count - 1, count * 99 / 100);
+    std::nth_element(times, times + p99, times + count);
+    s.p99 = times[p99];
+    if (period_us > 0)
+        s.load = 100.0 * s.mean / period_us;
+}
+
+void jack_client::run_task(int index, int worker)
+{
+    jack_host *plugin = rt_plugins->plugins[index];
+    jack_automation au(automation_port, cycle_nframes, plugin);
+    plugin->process(cycle_nframes, au);
+}
+
+void jack_client::do_jack_port_connect(jack_port_id_t a, jack_port_id_t b, int connect, void *p)
 {
     jack_client *self = (jack_client *)p;
+    if (!self->workers)
+        return;
+    // The old graph may be missing the new dependency, so run the plugins
+    // serially until the idle handler recalculates it
     ptlock lock(self->mutex);
-    for(unsigned int i = 0; i < self->plugins.size(); i++)
-        self->plugins[i]->cache_ports();
+    self->graph_changed = true;
+    self->post_plugin_list(NULL);
+}
+
+int jack_client::do_jack_bufsize(jack_nframes_t numsamples, void *p)
+{
+    jack_client *self = (jack_client *)p;
+    // the plugin list belongs to the process thread, which fetches the
+    // buffers again at the start of the next cycle
+    __sync_fetch_and_add(&self->port_generation, 1);
     return 0;
 }
 
 void jack_client::delete_plugins()
 {
     ptlock lock(mutex);
-    for (unsigned int i = 0; i < plugins.size(); i++) {
-        delete plugins[i];
-    }
-    plugins.clear();
+    vector<jack_host *> deleted;
+    deleted.swap(plugins);
+    post_plugin_list(NULL);
+    // make sure the process thread isn't using them anymore
+    sync();
+    for (unsigned int i = 0; i < deleted.size(); i++)
+        delete deleted[i];
 }
 
 void jack_client::create_automation_input()
@@ -195,10 +470,10 @@ void jack_client::destroy_automation_input()
         jack_port_unregister(client, automation_port);
 }
 
-void jack_client::calculate_plugin_order(std::vector<int> &indices)
+void jack_client::get_plugin_dependencies(std::multimap<int, int> &run_before)
 {
     map<string, int> port_to_plugin;
-    multimap<int, int> run_before;
+    run_before.clear();
     for (unsigned int i = 0; i < plugins.size(); i++)
     {
         vector<jack_host::port *> ports;
@@ -232,6 +507,12 @@ void jack_client::calculate_plugin_order(std::vector<int> &indices)
             jack_free(conns);
         }
     }
+}
+
+void jack_client::calculate_plugin_order(std::vector<int> &indices)
+{
+    multimap<int, int> run_before;
+    get_plugin_dependencies(run_before);
     
     struct deptracker
     {
@@ -265,14 +546,63 @@ void jack_client::calculate_plugin_order(std::vector<int> &indices)
     deptracker(indices, run_before, plugins.size()).run();
 }
 
+void jack_client::set_worker_threads(int threads)
+{
+    ptlock lock(mutex);
+    assert(!active);
+    delete workers;
+    workers = NULL;
+    post_plugin_list(NULL);
+    if (threads > 1)
+    {
+        int priority = jack_is_realtime(client) ? jack_client_real_time_priority(client) : 0;
+        workers = new calf_utils::worker_pool(threads, priority > 0 ? priority : 0);
+        graph_changed = true;
+    }
+}
+
 void jack_client::apply_plugin_order(const std::vector<int> &indices)
 {
     std::vector<jack_host *> plugins_new;
     assert(indices.size() == plugins.size());
     for (unsigned int i = 0; i < indices.size(); i++)
         plugins_new.push_back(plugins[indices[i]]);
+    
+    calf_utils::task_graph *graph_new = NULL;
+    if (workers)
+    {
+        {
+            // a connection change from now on sets the flag again, see below
+            ptlock lock(mutex);
+            graph_changed = false;
+        }
+        multimap<int, int> run_before;
+        get_plugin_dependencies(run_before);
+        vector<int> position(indices.size());
+        for (unsigned int i = 0; i < indices.size(); i++)
+            position[indices[i]] = i;
+        graph_new = new calf_utils::task_graph(indices.size());
+        for (multimap<int, int>::const_iterator i = run_before.begin(); i != run_before.end(); ++i)
+        {
+            // Only keep the dependencies that agree with the serial order, this
+            // breaks feedback loops (that have one cycle of delay anyway)
+            int before = position[i->second], after = position[i->first];
+            if (before < after)
+                graph_new->add_edge(before, after);
+        }
+        graph_new->finalize();
+    }
+    
     ptlock lock(mutex);
+    if (graph_changed)
+    {
+        // the connections changed while the dependencies were being read, so the
+        // graph may be missing an edge; run serially until it's recalculated
+        delete graph_new;
+        graph_new = NULL;
+    }
     plugins.swap(plugins_new);
+    post_plugin_list(graph_new);
     
     string s;
     for (unsigned int i = 0; i < plugins.size(); i++)    
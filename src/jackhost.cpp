@@ -51,6 +51,7 @@ jack_host::jack_host(jack_client *_client, audio_module_iface *_module, const st
     
     client = _client;
     cc_mappings = NULL;
+    rt_cc_mappings = NULL;
     changed = true;
 
     module->get_port_arrays(ins, outs, params);
@@ -78,6 +79,8 @@ jack_host::~jack_host()
 {
     delete cc_mappings;
     cc_mappings = NULL;
+    delete rt_cc_mappings;
+    rt_cc_mappings = NULL;
     delete []param_values;
     if (client)
         destroy();
@@ -135,17 +138,23 @@ void jack_host::create_ports() {
     }
 }
 
-void jack_host::handle_automation_cc(uint32_t designator, int value)
+void jack_host::handle_automation_cc(uint32_t designator, int value, uint32_t time)
 {
     last_designator = designator;
-    if (!cc_mappings)
+    if (!rt_cc_mappings)
         return;
-    automation_map::const_iterator i = cc_mappings->find(designator);
-    while (i != cc_mappings->end() && i->first == designator)
+    automation_map::const_iterator i = rt_cc_mappings->find(designator);
+    while (i != rt_cc_mappings->end() && i->first == designator)
     {
         const automation_range &r = i->second;
         const parameter_properties *props = metadata->get_param_props(r.param_no);
-        set_param_value(r.param_no, props->from_01(r.min_value + value * (r.max_value - r.min_value)/ 127.0));
+        float new_value = props->from_01(r.min_value + value * (r.max_value - r.min_value)/ 127.0);
+        // this is the process thread, so the value can be set directly if it cannot be scheduled
+        if (!module->schedule_param_change(time, r.param_no, new_value))
+        {
+            param_values[r.param_no] = new_value;
+            changed = true;
+        }
         write_serials[r.param_no] = ++last_modify_serial;
         ++i;
     }
@@ -242,13 +251,14 @@ float jack_host::get_level(unsigned int port)
 
 int jack_host::process(jack_nframes_t nframes, automation_iface &automation)
 {
+    uint64_t start = jack_load_stats::now();
     for (int i=0; i<in_count; i++) {
         ins[i] = inputs[i].data = (float *)jack_port_get_buffer(inputs[i].handle, nframes);
     }
     if (metadata->get_midi())
         midi_port.data = (float *)jack_port_get_buffer(midi_port.handle, nframes);
     if (changed) {
-        module->params_changed();
+        module->params_changed_if_needed(false);
         changed = false;
     }
 
@@ -277,6 +287,7 @@ int jack_host::process(jack_nframes_t nframes, automation_iface &automation)
         time = endtime;
     }
     module->params_reset();
+    load.add(start);
     return 0;
 }
 
@@ -284,7 +295,7 @@ void jack_host::init_module()
 {
     module->set_sample_rate(client->sample_rate);
     module->activate();
-    module->params_changed();
+    module->params_changed_if_needed(true);
 }
 
 void jack_host::cache_ports()
@@ -294,6 +305,19 @@ void jack_host::cache_ports()
     }
 }
 
+void jack_host::get_output_buffers(std::vector<float *> &bufs)
+{
+    for (int i=0; i<out_count; i++)
+        bufs.push_back((float *)jack_port_get_buffer(outputs[i].handle, 0));
+}
+
+int jack_host::set_output_buffers(float *const *bufs)
+{
+    for (int i=0; i<out_count; i++)
+        outs[i] = outputs[i].data = bufs[i];
+    return out_count;
+}
+
 void jack_host::get_all_input_ports(std::vector<port *> &ports)
 {
     for (int i = 0; i < in_count; i++)
@@ -341,8 +365,7 @@ void jack_host::delete_automation(uint32_t source, int param_no)
 
 void jack_host::replace_automation_map(automation_map *amap)
 {
-    client->atomic_swap(cc_mappings, amap);
-    delete amap;
+    client->replace_automation_map(this, amap);
 }
 
 void jack_host::get_automation(int param_no, multimap<uint32_t, automation_range> &dests)
@@ -382,7 +405,7 @@ char *jack_host::configure(const char *key, const char *value)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static const char *short_options = "c:i:l:o:m:M:s:S:ehv";
+static const char *short_options = "c:i:l:o:m:M:s:S:t:ehv";
 
 static struct option long_options[] = {
     {"help", 0, 0, 'h'},
@@ -395,6 +418,7 @@ static struct option long_options[] = {
     {"state", 1, 0, 's'},
     {"connect-midi", 1, 0, 'M'},
     {"session-id", 1, 0, 'S'},
+    {"threads", 1, 0, 't'},
     {0,0,0,0},
 };
 
@@ -402,7 +426,7 @@ void print_help(char *argv[])
 {
     printf("JACK host for Calf effects\n"
         "Syntax: %s [--client <name>] [--input <name>] [--output <name>] [--midi <name>] [--load|state <session>]\n"
-        "       [--connect-midi <name|capture-index>] [--help] [--version] [!] pluginname[:<preset>] [!] ...\n", 
+        "       [--connect-midi <name|capture-index>] [--threads <count>] [--help] [--version] [!] pluginname[:<preset>] [!] ...\n", 
         argv[0]);
 }
 
@@ -474,6 +498,9 @@ int main(int argc, char *argv[])
             case 'S':
                 sess.jack_session_id = optarg;
                 break;
+            case 't':
+                sess.worker_threads = std::max(1, atoi(optarg));
+                break;
             case 'l':
             case 's':
             {
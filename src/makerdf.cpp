@@ -140,6 +140,11 @@ static bool add_ctl_port(string &ports, const parameter_properties &pp, int pidx
         ss << ind << "lv2:portProperty epp:notAutomatic ;\n";
     if (pp.flags & PF_PROP_OUTPUT_GAIN)
         ss << ind << "lv2:designation param:gain ;\n";
+    if (pp.flags & PF_PROP_LATENCY)
+    {
+        ss << ind << "lv2:portProperty lv2:reportsLatency ;\n";
+        ss << ind << "lv2:designation lv2:latency ;\n";
+    }
     if (type == PF_BOOL)
         ss << ind << "lv2:portProperty lv2:toggled ;\n";
     else if (type == PF_ENUM)
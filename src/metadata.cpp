@@ -124,6 +124,8 @@ CALF_PORT_NAMES(reverb) = {"In L", "In R", "Out L", "Out R"};
 
 const char *reverb_room_sizes[] = { "Small", "Medium", "Large", "Tunnel-like", "Large/smooth", "Experimental" };
 
+const char *reverb_engines[] = { "Classic", "FDN" };
+
 CALF_PORT_PROPS(reverb) = {
     { 0,           0,           1,     0,  PF_FLOAT | PF_CTL_LED | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "clip", "0dB" },
     { 0,           0,           1,     0,  PF_FLOAT | PF_SCALE_GAIN | PF_CTL_METER | PF_CTLO_LABEL | PF_UNIT_DB | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "meter_wet", "Wet amount" },
@@ -137,6 +139,7 @@ CALF_PORT_PROPS(reverb) = {
     { 0,          0,   500,    0, PF_FLOAT | PF_SCALE_LINEAR | PF_CTL_KNOB | PF_UNIT_MSEC, NULL, "predelay", "Pre Delay" },
     { 300,       20, 20000, 0, PF_FLOAT | PF_SCALE_LOG | PF_CTL_KNOB | PF_UNIT_HZ, NULL, "bass_cut", "Bass Cut" },
     { 5000,      20, 20000, 0, PF_FLOAT | PF_SCALE_LOG | PF_CTL_KNOB | PF_UNIT_HZ, NULL, "treble_cut", "Treble Cut" },
+    { 0,          0,    1,    0, PF_ENUM | PF_CTL_COMBO, reverb_engines, "engine", "Engine" },
     {}
 };
 
@@ -144,6 +147,29 @@ CALF_PLUGIN_INFO(reverb) = { 0x847e, "Reverb", "Calf Reverb", "Krzysztof Foltman
 
 ////////////////////////////////////////////////////////////////////////////
 
+CALF_PORT_NAMES(convolution_reverb) = {"In L", "In R", "Out L", "Out R"};
+
+CALF_PORT_PROPS(convolution_reverb) = {
+    { 0,           0,           1,     0,  PF_FLOAT | PF_CTL_LED | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "clip", "0dB" },
+    { 0,           0,           1,     0,  PF_FLOAT | PF_SCALE_GAIN | PF_CTL_METER | PF_CTLO_LABEL | PF_UNIT_DB | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "meter_wet", "Wet amount" },
+    { 0,           0,           1,     0,  PF_FLOAT | PF_SCALE_GAIN | PF_CTL_METER | PF_CTLO_LABEL | PF_UNIT_DB | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "meter_out", "Output" },
+    { 0.25,       0,    2,    0, PF_FLOAT | PF_SCALE_GAIN | PF_CTL_KNOB | PF_UNIT_COEF | PF_PROP_NOBOUNDS, NULL, "amount", "Wet Amount" },
+    { 1.0,        0,    2,    0, PF_FLOAT | PF_SCALE_GAIN | PF_CTL_KNOB | PF_UNIT_COEF | PF_PROP_NOBOUNDS, NULL, "dry", "Dry Amount" },
+    { 0,          0,   500,    0, PF_FLOAT | PF_SCALE_LINEAR | PF_CTL_KNOB | PF_UNIT_MSEC, NULL, "predelay", "Pre Delay" },
+    { 20,        20, 20000, 0, PF_FLOAT | PF_SCALE_LOG | PF_CTL_KNOB | PF_UNIT_HZ, NULL, "bass_cut", "Bass Cut" },
+    { 20000,     20, 20000, 0, PF_FLOAT | PF_SCALE_LOG | PF_CTL_KNOB | PF_UNIT_HZ, NULL, "treble_cut", "Treble Cut" },
+    {}
+};
+
+CALF_PLUGIN_INFO(convolution_reverb) = { 0x8487, "ConvolutionReverb", "Calf Convolution Reverb", "Krzysztof Foltman", calf_plugins::calf_copyright_info, "ReverbPlugin" };
+
+void convolution_reverb_metadata::get_configure_vars(vector<string> &names) const
+{
+    names.push_back("ir_file");
+}
+
+////////////////////////////////////////////////////////////////////////////
+
 CALF_PORT_NAMES(filter) = {"In L", "In R", "Out L", "Out R"};
 
 const char *filter_choices[] = {
@@ -597,6 +623,7 @@ CALF_PORT_PROPS(limiter) = {
 
     { 0.5f,      0.f,         1.f,   0,  PF_FLOAT | PF_SCALE_LINEAR | PF_CTL_KNOB | PF_UNIT_COEF | PF_PROP_GRAPH, NULL, "asc_coeff", "ASC Level" },
     { 1,           1,           4,   0,  PF_INT | PF_SCALE_LINEAR | PF_UNIT_COEF | PF_CTL_KNOB, NULL, "oversampling", "Oversampling" },
+    { 0,           0,           128,   0,  PF_INT | PF_UNIT_SAMPLES | PF_PROP_OUTPUT | PF_PROP_OPTIONAL | PF_PROP_LATENCY, NULL, "latency", "Latency" },
     {}
 };
 
@@ -652,6 +679,7 @@ CALF_PORT_PROPS(multibandlimiter) = {
     { 0.5f,      0.f,         1.f,   0,  PF_FLOAT | PF_SCALE_LINEAR | PF_CTL_KNOB | PF_UNIT_COEF | PF_PROP_GRAPH, NULL, "asc_coeff", "ASC Level" },
     
     { 1,           1,           4,   0,  PF_INT | PF_SCALE_LINEAR | PF_UNIT_COEF | PF_CTL_KNOB, NULL, "oversampling", "Oversampling" },
+    { 0,           0,           128,   0,  PF_INT | PF_UNIT_SAMPLES | PF_PROP_OUTPUT | PF_PROP_OPTIONAL | PF_PROP_LATENCY, NULL, "latency", "Latency" },
     
     {}
 };
@@ -716,6 +744,7 @@ CALF_PORT_PROPS(sidechainlimiter) = {
     
     { 1,           1,           4,   0,  PF_INT | PF_SCALE_LINEAR | PF_UNIT_COEF | PF_CTL_KNOB, NULL, "oversampling", "Oversampling" },
     { 1,           0.015625,    64,    0,  PF_FLOAT | PF_SCALE_GAIN | PF_CTL_KNOB | PF_UNIT_DB, NULL, "level_sc", "Level S/C"},
+    { 0,           0,           128,   0,  PF_INT | PF_UNIT_SAMPLES | PF_PROP_OUTPUT | PF_PROP_OPTIONAL | PF_PROP_LATENCY, NULL, "latency", "Latency" },
     {}
 };
 
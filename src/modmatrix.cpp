@@ -20,6 +20,7 @@
  */
 #include <calf/modmatrix.h>
 #include <calf/utils.h>
+#include <algorithm>
 #include <memory.h>
 #include <sstream>
 
@@ -35,6 +36,69 @@ mod_matrix_impl::mod_matrix_impl(dsp::modulation_entry *_matrix, mod_matrix_meta
     matrix_rows = metadata->get_table_rows();
     for (unsigned int i = 0; i < matrix_rows; i++)
         matrix[i].reset();
+    for (int i = 0; i < 3; i++)
+    {
+        // one extra item, so that there is something to point to when the matrix is empty
+        programs[i].resize(matrix_rows + 1);
+        program_size[i] = 0;
+    }
+    current_program = 0;
+    program_in_use = 0;
+}
+
+static bool modulation_op_less(const modulation_op &a, const modulation_op &b)
+{
+    return a.dest < b.dest;
+}
+
+void mod_matrix_impl::compile_modmatrix()
+{
+    // current_program is only changed here; program_in_use is read after
+    // current_program was last set, so the audio thread can't switch to prg
+    // while it's being rebuilt (see acquire_program)
+    __sync_synchronize();
+    int cur = current_program, in_use = program_in_use;
+    int prg = 0;
+    while(prg == cur || prg == in_use)
+        prg++;
+    vector<modulation_op> &ops = programs[prg];
+    int count = 0;
+    for (unsigned int i = 0; i < matrix_rows; i++)
+    {
+        const modulation_entry &slot = matrix[i];
+        if (!slot.dest || slot.amount == 0.f)
+            continue;
+        const float *c = scaling_coeffs[slot.mapping];
+        modulation_op &op = ops[count++];
+        op.src1 = slot.src1;
+        op.src2 = slot.src2;
+        op.dest = slot.dest;
+        op.c0 = c[0] * slot.amount;
+        op.c1 = c[1] * slot.amount;
+        op.c2 = c[2] * slot.amount;
+    }
+    // rows with the same destination keep their order, so the sums come out the same as before
+    stable_sort(ops.begin(), ops.begin() + count, modulation_op_less);
+    program_size[prg] = count;
+    __sync_synchronize();
+    current_program = prg;
+}
+
+void mod_matrix_impl::calculate_modmatrix_voices(float *moddest, int moddest_count, const float *modsrc, int voices, int stride, int program)
+{
+    for (int i = 0; i < moddest_count; i++)
+        dsp::zero(moddest + i * stride, voices);
+    const modulation_op *ops = &programs[program][0];
+    int size = program_size[program];
+    for (int i = 0; i < size; ++i)
+    {
+        const modulation_op &op = ops[i];
+        const float *src1 = modsrc + op.src1 * stride, *src2 = modsrc + op.src2 * stride;
+        float *dest = moddest + op.dest * stride;
+        // no dependencies between the voices, so the compiler can vectorize this
+        for (int v = 0; v < voices; v++)
+            dest[v] += (op.c0 + src1[v] * (op.c1 + src1[v] * op.c2)) * src2[v];
+    }
 }
 
 const float mod_matrix_impl::scaling_coeffs[mod_matrix_metadata::map_type_count][3] = {
@@ -149,6 +213,7 @@ char *mod_matrix_impl::configure(const char *key, const char *value)
                 case 3: slot.amount = src->amount; break;
                 case 4: slot.dest = src->dest; break;                    
                 }
+                compile_modmatrix();
                 return NULL;
             }
             const table_column_info &ci = metadata->get_table_columns()[column];
@@ -162,6 +227,7 @@ char *mod_matrix_impl::configure(const char *key, const char *value)
         set_cell(row, column, value, error);
         if (!error.empty())
             return strdup(error.c_str());
+        compile_modmatrix();
     }
     return NULL;
 }
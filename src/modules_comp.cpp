@@ -123,6 +123,41 @@ void gain_reduction_audio_module::process(float &left, float &right, const float
     }
 }
 
+void gain_reduction_audio_module::process(float *left, float *right, uint32_t len)
+{
+    if(bypass >= 0.5f)
+        return;
+    // same as the per-sample version, with everything that doesn't change
+    // within the block calculated once
+    bool rms = (detection == 0);
+    bool average = (stereo_link == 0);
+    float attack_coeff = std::min(1.f, 1.f / (attack * srate / 4000.f));
+    float release_coeff = std::min(1.f, 1.f / (release * srate / 4000.f));
+    float slope = linSlope;
+    float peak = 0.f, min_gain = 1.f;
+    for (uint32_t i = 0; i < len; i++) {
+        float absample = average ? (fabs(left[i]) + fabs(right[i])) * 0.5f : std::max(fabs(left[i]), fabs(right[i]));
+        if(rms) absample *= absample;
+
+        dsp::sanitize(slope);
+
+        slope += (absample - slope) * (absample > slope ? attack_coeff : release_coeff);
+        float gain = 1.f;
+        if(slope > 0.f) {
+            gain = output_gain(slope, rms);
+        }
+
+        left[i] *= gain * makeup;
+        right[i] *= gain * makeup;
+        peak = std::max(peak, std::max(fabs(left[i]), fabs(right[i])));
+        min_gain = std::min(min_gain, gain);
+    }
+    linSlope = slope;
+    meter_out = peak;
+    meter_comp = min_gain;
+    detected = rms ? sqrt(linSlope) : linSlope;
+}
+
 float gain_reduction_audio_module::output_level(float slope) const {
     return slope * output_gain(slope, false) * makeup;
 }
@@ -587,6 +622,36 @@ void expander_audio_module::process(float &left, float &right, const float *det_
     }
 }
 
+void expander_audio_module::process(float *left, float *right, uint32_t len)
+{
+    if(bypass >= 0.5f)
+        return;
+    bool rms = (detection == 0);
+    bool average = (stereo_link == 0);
+    float slope = linSlope;
+    float peak = 0.f, min_gain = 1.f;
+    for (uint32_t i = 0; i < len; i++) {
+        float absample = average ? (fabs(left[i]) + fabs(right[i])) * 0.5f : std::max(fabs(left[i]), fabs(right[i]));
+        if(rms) absample *= absample;
+
+        dsp::sanitize(slope);
+
+        slope += (absample - slope) * (absample > slope ? attack_coeff : release_coeff);
+        float gain = 1.f;
+        if(slope > 0.f) {
+            gain = output_gain(slope, rms);
+        }
+        left[i] *= gain * makeup;
+        right[i] *= gain * makeup;
+        peak = std::max(peak, std::max(fabs(left[i]), fabs(right[i])));
+        min_gain = std::min(min_gain, gain);
+    }
+    linSlope = slope;
+    meter_out = peak;
+    meter_gate = min_gain;
+    detected = linSlope;
+}
+
 float expander_audio_module::output_level(float slope) const {
     bool rms = (detection == 0);
     return slope * output_gain(rms ? slope*slope : slope, rms) * makeup;
@@ -770,14 +835,17 @@ uint32_t compressor_audio_module::process(uint32_t offset, uint32_t numsamples,
         while(offset < numsamples) {
             outs[0][offset] = ins[0][offset];
             outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 1};
-            meters.process(values);
             ++offset;
         }
+        float values[] = {0, 0, 1};
+        meters.process(values);
         // displays, too
     } else {
         // process
         uint32_t orig_offset = offset;
+        // the inputs are metered before the outputs are written, as they may share the buffers
+        meters.process_stereo(0, ins[0] + offset, ins[1] + offset, numsamples - offset, *params[param_level_in]);
+        float reduction = 1.f;
         compressor.update_curve();
 
         while(offset < numsamples) {
@@ -809,12 +877,14 @@ uint32_t compressor_audio_module::process(uint32_t offset, uint32_t numsamples,
             outs[0][offset] = outL;
             outs[1][offset] = outR;
 
-            float values[] = {std::max(inL, inR), std::max(outL, outR), compressor.get_comp_level()};
-            meters.process(values);
+            reduction = std::min(reduction, compressor.get_comp_level());
             
             // next sample
             ++offset;
         } // cycle trough samples
+        uint32_t len = numsamples - orig_offset;
+        meters.process_stereo(1, outs[0] + orig_offset, outs[1] + orig_offset, len);
+        meters.process(2, reduction);
         bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
     }
     meters.fall(numsamples);
@@ -1046,13 +1116,15 @@ uint32_t sidechaincompressor_audio_module::process(uint32_t offset, uint32_t num
         while(offset < numsamples) {
             outs[0][offset] = ins[0][offset];
             outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 1};
-            meters.process(values);
             ++offset;
         }
+        float values[] = {0, 0, 1};
+        meters.process(values);
     } else {
         // process
         uint32_t orig_offset = offset;
+        meters.process_stereo(0, ins[0] + offset, ins[1] + offset, numsamples - offset, *params[param_level_in]);
+        float reduction = 1.f;
         compressor.update_curve();
 
         while(offset < numsamples) {
@@ -1152,12 +1224,14 @@ uint32_t sidechaincompressor_audio_module::process(uint32_t offset, uint32_t num
             outs[0][offset] = outL;
             outs[1][offset] = outR;
             
-            float values[] = {std::max(inL, inR), std::max(outL, outR), compressor.get_comp_level()};
-            meters.process(values);
+            reduction = std::min(reduction, compressor.get_comp_level());
             
             // next sample
             ++offset;
         } // cycle trough samples
+        uint32_t len = numsamples - orig_offset;
+        meters.process_stereo(1, outs[0] + orig_offset, outs[1] + orig_offset, len);
+        meters.process(2, reduction);
         bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
         f1L.sanitize();
         f1R.sanitize();
@@ -1310,68 +1384,72 @@ void multibandcompressor_audio_module::set_sample_rate(uint32_t sr)
 uint32_t multibandcompressor_audio_module::process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask)
 {
     bool bypassed = bypass.update(*params[param_bypass] > 0.5f, numsamples);
+    uint32_t orig_offset = offset;
     numsamples += offset;
     
     for (int i = 0; i < strips; i++)
         strip[i].update_curve();
     if(bypassed) {
         // everything bypassed
-        while(offset < numsamples) {
-            outs[0][offset] = ins[0][offset];
-            outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 0, 0, 0, 1, 0, 1, 0, 1, 0, 1};
-            meters.process(values);
-            ++offset;
-        }
+        memcpy(outs[0] + offset, ins[0] + offset, (numsamples - offset) * sizeof(float));
+        memcpy(outs[1] + offset, ins[1] + offset, (numsamples - offset) * sizeof(float));
+        float values[] = {0, 0, 0, 0, 0, 1, 0, 1, 0, 1, 0, 1};
+        meters.process(values);
     } else {
-        // process all strips
-        uint32_t orig_offset = offset;
+        // process all strips, one block at a time
+        float level_in = *params[param_level_in];
+        float level_out = *params[param_level_out];
+        const int bypass_params[strips] = {param_bypass0, param_bypass1, param_bypass2, param_bypass3};
+        const float *xin[] = {in_buf[0], in_buf[1]};
+        float *xout[strips * 2];
+        for (int j = 0; j < strips * 2; j++)
+            xout[j] = band_buf[j];
         while(offset < numsamples) {
-            // cycle through samples
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
+            uint32_t len = std::min(numsamples - offset, (uint32_t)MAX_SAMPLE_RUN);
+            float *outL = outs[0] + offset;
+            float *outR = outs[1] + offset;
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-            // process crossover
-            xin[0] = inL;
-            xin[1] = inR;
-            crossover.process(xin);
-            // out vars
-            float outL = 0.f;
-            float outR = 0.f;
-            for (int i = 0; i < strips; i ++) {
+            for (uint32_t i = 0; i < len; i++) {
+                in_buf[0][i] = ins[0][offset + i] * level_in;
+                in_buf[1][i] = ins[1][offset + i] * level_in;
+            }
+            // split the block into bands
+            crossover.process(xin, xout, len);
+            dsp::zero(outL, len);
+            dsp::zero(outR, len);
+            for (int j = 0; j < strips; j ++) {
                 // cycle trough strips
-                if (solo[i] || no_solo) {
+                if (solo[j] || no_solo) {
                     // strip unmuted
-                    float left  = crossover.get_value(0, i);
-                    float right = crossover.get_value(1, i);
+                    float *left  = band_buf[j * 2];
+                    float *right = band_buf[j * 2 + 1];
                     // process gain reduction
-                    strip[i].process(left, right);
+                    strip[j].process(left, right, len);
                     // sum up output
-                    outL += left;
-                    outR += right;
+                    for (uint32_t i = 0; i < len; i++) {
+                        outL[i] += left[i];
+                        outR[i] += right[i];
+                    }
                 }
             } // process single strip
-
             // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
-
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+            for (uint32_t i = 0; i < len; i++) {
+                outL[i] *= level_out;
+                outR[i] *= level_out;
+            }
             
-            float values[] = {inL, inR, outL, outR,
-                *params[param_bypass0] > 0.5f ? 0 : strip[0].get_output_level(), *params[param_bypass0] > 0.5f ? 1 : strip[0].get_comp_level(),
-                *params[param_bypass1] > 0.5f ? 0 : strip[1].get_output_level(), *params[param_bypass1] > 0.5f ? 1 : strip[1].get_comp_level(),
-                *params[param_bypass2] > 0.5f ? 0 : strip[2].get_output_level(), *params[param_bypass2] > 0.5f ? 1 : strip[2].get_comp_level(),
-                *params[param_bypass3] > 0.5f ? 0 : strip[3].get_output_level(), *params[param_bypass3] > 0.5f ? 1 : strip[3].get_comp_level() };
-            meters.process(values);
-                
-            // next sample
-            ++offset;
-        } // cycle trough samples
+            // in/out meters see every sample, strip meters are updated once per block
+            meters.process(0, in_buf[0], len);
+            meters.process(1, in_buf[1], len);
+            meters.process(2, outL, len);
+            meters.process(3, outR, len);
+            for (int j = 0; j < strips; j ++) {
+                bool off = *params[bypass_params[j]] > 0.5f;
+                meters.process(4 + j * 2, off ? 0 : strip[j].get_output_level());
+                meters.process(5 + j * 2, off ? 1 : strip[j].get_comp_level());
+            }
+            offset += len;
+        } // cycle trough blocks
         bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
     } // process all strips (no bypass)
     meters.fall(numsamples);
@@ -1502,13 +1580,15 @@ uint32_t monocompressor_audio_module::process(uint32_t offset, uint32_t numsampl
         // everything bypassed
         while(offset < numsamples) {
             outs[0][offset] = ins[0][offset];
-            float values[] = {0, 0, 1};
-            meters.process(values);
             ++offset;
         }
+        float values[] = {0, 0, 1};
+        meters.process(values);
     } else {
         // process
         uint32_t orig_offset = offset;
+        meters.process(0, ins[0] + offset, numsamples - offset, *params[param_level_in]);
+        float reduction = 1.f;
         monocompressor.update_curve();
 
         while(offset < numsamples) {
@@ -1540,12 +1620,14 @@ uint32_t monocompressor_audio_module::process(uint32_t offset, uint32_t numsampl
             outs[0][offset] = outL;
             //outs[1][offset] = 0.f;
             
-            float values[] = {inL, outL, monocompressor.get_comp_level()};
-            meters.process(values);
+            reduction = std::min(reduction, monocompressor.get_comp_level());
             
             // next sample
             ++offset;
         } // cycle trough samples
+        uint32_t len = numsamples - orig_offset;
+        meters.process(1, outs[0] + orig_offset, len);
+        meters.process(2, reduction);
         bypass.crossfade(ins, outs, 1, orig_offset, numsamples);
     }
     meters.fall(numsamples);
@@ -1799,14 +1881,16 @@ uint32_t gate_audio_module::process(uint32_t offset, uint32_t numsamples, uint32
         while(offset < numsamples) {
             outs[0][offset] = ins[0][offset];
             outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 1};
-            meters.process(values);
             ++offset;
         }
+        float values[] = {0, 0, 1};
+        meters.process(values);
     } else {
         // process
         gate.update_curve();
         uint32_t orig_offset = offset;
+        meters.process_stereo(0, ins[0] + offset, ins[1] + offset, numsamples - offset, *params[param_level_in]);
+        float reduction = 1.f;
         while(offset < numsamples) {
             // cycle through samples
             float outL = 0.f;
@@ -1829,12 +1913,14 @@ uint32_t gate_audio_module::process(uint32_t offset, uint32_t numsamples, uint32
             outs[0][offset] = outL;
             outs[1][offset] = outR;
             
-            float values[] = {std::max(inL, inR), std::max(outL, outR), gate.get_expander_level()};
-            meters.process(values);
+            reduction = std::min(reduction, gate.get_expander_level());
             
             // next sample
             ++offset;
         } // cycle trough samples
+        uint32_t len = numsamples - orig_offset;
+        meters.process_stereo(1, outs[0] + orig_offset, outs[1] + orig_offset, len);
+        meters.process(2, reduction);
         bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
     }
     meters.fall(numsamples);
@@ -2060,13 +2146,15 @@ uint32_t sidechaingate_audio_module::process(uint32_t offset, uint32_t numsample
         while(offset < numsamples) {
             outs[0][offset] = ins[0][offset];
             outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 1};
-            meters.process(values);
             ++offset;
         }
+        float values[] = {0, 0, 1};
+        meters.process(values);
     } else {
         // process
         uint32_t orig_offset = offset;
+        meters.process_stereo(0, ins[0] + offset, ins[1] + offset, numsamples - offset, *params[param_level_in]);
+        float reduction = 1.f;
         gate.update_curve();
 
         while(offset < numsamples) {
@@ -2161,12 +2249,14 @@ uint32_t sidechaingate_audio_module::process(uint32_t offset, uint32_t numsample
             outs[0][offset] = outL;
             outs[1][offset] = outR;
             
-            float values[] = {std::max(inL, inR), std::max(outL, outR), gate.get_expander_level()};
-            meters.process(values);
+            reduction = std::min(reduction, gate.get_expander_level());
             
             // next sample
             ++offset;
         } // cycle trough samples
+        uint32_t len = numsamples - orig_offset;
+        meters.process_stereo(1, outs[0] + orig_offset, outs[1] + orig_offset, len);
+        meters.process(2, reduction);
         bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
         f1L.sanitize();
         f1R.sanitize();
@@ -2319,66 +2409,70 @@ void multibandgate_audio_module::set_sample_rate(uint32_t sr)
 uint32_t multibandgate_audio_module::process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask)
 {
     bool bypassed = bypass.update(*params[param_bypass] > 0.5f, numsamples);
+    uint32_t orig_offset = offset;
     numsamples += offset;
     for (int i = 0; i < strips; i++)
         gate[i].update_curve();
     if(bypassed) {
         // everything bypassed
-        while(offset < numsamples) {
-            outs[0][offset] = ins[0][offset];
-            outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 0, 0, 0, 1, 0, 1, 0, 1, 0, 1};
-            meters.process(values);
-            ++offset;
-        }
+        memcpy(outs[0] + offset, ins[0] + offset, (numsamples - offset) * sizeof(float));
+        memcpy(outs[1] + offset, ins[1] + offset, (numsamples - offset) * sizeof(float));
+        float values[] = {0, 0, 0, 0, 0, 1, 0, 1, 0, 1, 0, 1};
+        meters.process(values);
     } else {
-        // process all strips
-        uint32_t orig_offset = offset;
+        // process all strips, one block at a time
+        float level_in = *params[param_level_in];
+        float level_out = *params[param_level_out];
+        const int bypass_params[strips] = {param_bypass0, param_bypass1, param_bypass2, param_bypass3};
+        const float *xin[] = {in_buf[0], in_buf[1]};
+        float *xout[strips * 2];
+        for (int j = 0; j < strips * 2; j++)
+            xout[j] = band_buf[j];
         while(offset < numsamples) {
-            // cycle through samples
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
+            uint32_t len = std::min(numsamples - offset, (uint32_t)MAX_SAMPLE_RUN);
+            float *outL = outs[0] + offset;
+            float *outR = outs[1] + offset;
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-            // process crossover
-            xin[0] = inL;
-            xin[1] = inR;
-            crossover.process(xin);
-            // out vars
-            float outL = 0.f;
-            float outR = 0.f;
-            for (int i = 0; i < strips; i ++) {
+            for (uint32_t i = 0; i < len; i++) {
+                in_buf[0][i] = ins[0][offset + i] * level_in;
+                in_buf[1][i] = ins[1][offset + i] * level_in;
+            }
+            // split the block into bands
+            crossover.process(xin, xout, len);
+            dsp::zero(outL, len);
+            dsp::zero(outR, len);
+            for (int j = 0; j < strips; j ++) {
                 // cycle trough strips
-                if (solo[i] || no_solo) {
+                if (solo[j] || no_solo) {
                     // strip unmuted
-                    float left  = crossover.get_value(0, i);
-                    float right = crossover.get_value(1, i);
-                    gate[i].process(left, right);
+                    float *left  = band_buf[j * 2];
+                    float *right = band_buf[j * 2 + 1];
+                    gate[j].process(left, right, len);
                     // sum up output
-                    outL += left;
-                    outR += right;
+                    for (uint32_t i = 0; i < len; i++) {
+                        outL[i] += left[i];
+                        outR[i] += right[i];
+                    }
                 }
             } // process single strip
-
             // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
-
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+            for (uint32_t i = 0; i < len; i++) {
+                outL[i] *= level_out;
+                outR[i] *= level_out;
+            }
 
-            float values[] = {inL, inR, outL, outR,
-                *params[param_bypass0] > 0.5f ? 0 : gate[0].get_output_level(), *params[param_bypass0] > 0.5f ? 1 : gate[0].get_expander_level(),
-                *params[param_bypass1] > 0.5f ? 0 : gate[1].get_output_level(), *params[param_bypass1] > 0.5f ? 1 : gate[1].get_expander_level(),
-                *params[param_bypass2] > 0.5f ? 0 : gate[2].get_output_level(), *params[param_bypass2] > 0.5f ? 1 : gate[2].get_expander_level(),
-                *params[param_bypass3] > 0.5f ? 0 : gate[3].get_output_level(), *params[param_bypass3] > 0.5f ? 1 : gate[3].get_expander_level() };
-            meters.process(values);
-            
-            // next sample
-            ++offset;
-        } // cycle trough samples
+            // in/out meters see every sample, strip meters are updated once per block
+            meters.process(0, in_buf[0], len);
+            meters.process(1, in_buf[1], len);
+            meters.process(2, outL, len);
+            meters.process(3, outR, len);
+            for (int j = 0; j < strips; j ++) {
+                bool off = *params[bypass_params[j]] > 0.5f;
+                meters.process(4 + j * 2, off ? 0 : gate[j].get_output_level());
+                meters.process(5 + j * 2, off ? 1 : gate[j].get_expander_level());
+            }
+            offset += len;
+        } // cycle trough blocks
         bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
 
     } // process all strips (no bypass)
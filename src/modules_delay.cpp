@@ -22,6 +22,8 @@
 #include <limits.h>
 #include <memory.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <calf/giface.h>
 #include <calf/modules_delay.h>
 #include <calf/modules_dev.h>
@@ -36,19 +38,36 @@ using namespace calf_plugins;
  * REVERB by Krzysztof Foltman
 **********************************************************************/
 
+reverb_audio_module::reverb_audio_module()
+{
+    engine = 0;
+}
+
 void reverb_audio_module::activate()
 {
     reverb.reset();
+    fdn.reset();
 }
 
 void reverb_audio_module::deactivate()
 {
 }
 
+int reverb_audio_module::get_tail_length() const
+{
+    // in both engines, the allpasses smear the decay over several round trips, hence the margin
+    int tail = engine == 1 ? feedback_tail_length(fdn.get_loop_length(), fdn.get_loop_gain())
+                           : feedback_tail_length(reverb.get_loop_length(), reverb.get_loop_gain());
+    return tail < 0 ? -1 : 2 * tail + predelay_amt;
+}
+
 void reverb_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
     reverb.setup(sr);
+    fdn.setup(sr);
+    // longest pre-delay is 500 ms
+    pre_delay.set_max_delay(sr / 2 + 1);
     amount.set_sample_rate(sr);
     int meter[] = {par_meter_wet, par_meter_out};
     int clip[] = {-1, par_clip};
@@ -57,9 +76,23 @@ void reverb_audio_module::set_sample_rate(uint32_t sr)
 
 void reverb_audio_module::params_changed()
 {
+    int new_engine = fastf2i_drm(*params[par_engine]);
+    if (new_engine != engine)
+    {
+        // don't play whatever was left in the lines the last time the engine was used;
+        // the FDN lines are too large to be cleared in one go
+        if (new_engine == 1)
+            fdn.start_reset();
+        else
+            reverb.reset();
+        engine = new_engine;
+    }
     reverb.set_type_and_diffusion(fastf2i_drm(*params[par_roomsize]), *params[par_diffusion]);
     reverb.set_time(*params[par_decay]);
     reverb.set_cutoff(*params[par_hfdamp]);
+    fdn.set_type_and_diffusion(fastf2i_drm(*params[par_roomsize]), *params[par_diffusion]);
+    fdn.set_time(*params[par_decay]);
+    fdn.set_cutoff(*params[par_hfdamp]);
     amount.set_inertia(*params[par_amount]);
     dryamount.set_inertia(*params[par_dry]);
     left_lo.set_lp(dsp::clip(*params[par_treblecut], 20.f, (float)(srate * 0.49f)), srate);
@@ -73,22 +106,32 @@ uint32_t reverb_audio_module::process(uint32_t offset, uint32_t numsamples, uint
 {
     numsamples += offset;
     clip   -= std::min(clip, numsamples);
-    for (uint32_t i = offset; i < numsamples; i++) {
-        float dry = dryamount.get();
-        float wet = amount.get();
-        stereo_sample<float> s(ins[0][i], ins[1][i]);
-        stereo_sample<float> s2 = pre_delay.process(s, predelay_amt);
-        
-        float rl = s2.left, rr = s2.right;
-        rl = left_lo.process(left_hi.process(rl));
-        rr = right_lo.process(right_hi.process(rr));
-        reverb.process(rl, rr);
-        outs[0][i] = dry*s.left + wet*rl;
-        outs[1][i] = dry*s.right + wet*rr;
-        meter_wet = std::max(fabs(wet*rl), fabs(wet*rr));
-        meter_out = std::max(fabs(outs[0][i]), fabs(outs[1][i]));
-        if(outs[0][i] > 1.f or outs[1][i] > 1.f) {
-            clip = srate >> 3;
+    float rl[MAX_SAMPLE_RUN], rr[MAX_SAMPLE_RUN];
+    for (uint32_t pos = offset; pos < numsamples; pos += MAX_SAMPLE_RUN) {
+        uint32_t len = std::min(numsamples - pos, (uint32_t)MAX_SAMPLE_RUN);
+        for (uint32_t i = 0; i < len; i++) {
+            stereo_sample<float> s2 = pre_delay.process(stereo_sample<float>(ins[0][pos + i], ins[1][pos + i]), predelay_amt);
+            rl[i] = left_lo.process(left_hi.process(s2.left));
+            rr[i] = right_lo.process(right_hi.process(s2.right));
+        }
+        if (engine == 1)
+            fdn.process(rl, rr, len);
+        else {
+            for (uint32_t i = 0; i < len; i++)
+                reverb.process(rl[i], rr[i]);
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            uint32_t j = pos + i;
+            float dry = dryamount.get();
+            float wet = amount.get();
+            float in_l = ins[0][j], in_r = ins[1][j];
+            outs[0][j] = dry*in_l + wet*rl[i];
+            outs[1][j] = dry*in_r + wet*rr[i];
+            meter_wet = std::max(fabs(wet*rl[i]), fabs(wet*rr[i]));
+            meter_out = std::max(fabs(outs[0][j]), fabs(outs[1][j]));
+            if(outs[0][j] > 1.f or outs[1][j] > 1.f) {
+                clip = srate >> 3;
+            }
         }
     }
     meters.fall(numsamples);
@@ -102,6 +145,205 @@ uint32_t reverb_audio_module::process(uint32_t offset, uint32_t numsamples, uint
     return outputs_mask;
 }
 
+/**********************************************************************
+ * CONVOLUTION REVERB
+**********************************************************************/
+
+convolution_reverb_audio_module::convolution_reverb_audio_module()
+{
+    engine = NULL;
+    active = false;
+    engine_srate = 0;
+    srate = 0;
+    predelay_amt = 1;
+}
+
+convolution_reverb_audio_module::~convolution_reverb_audio_module()
+{
+    dsp::convolver *c;
+    while(incoming.pop(c))
+        delete c;
+    collect_garbage();
+    delete engine;
+}
+
+void convolution_reverb_audio_module::collect_garbage()
+{
+    dsp::convolver *c;
+    while(garbage.pop(c))
+        delete c;
+}
+
+bool convolution_reverb_audio_module::set_engine(dsp::convolver *new_engine)
+{
+    collect_garbage();
+    if (active)
+        return incoming.push(new_engine);
+    // not processing, so the engines can be swapped right here
+    dsp::convolver *c;
+    while(incoming.pop(c))
+    {
+        delete engine;
+        engine = c;
+    }
+    delete engine;
+    engine = new_engine;
+    return true;
+}
+
+char *convolution_reverb_audio_module::load_impulse_response()
+{
+    dsp::convolver *new_engine = NULL;
+    if (!ir_file.empty())
+    {
+        // background partitions are processed by threads with a real-time priority just below
+        // the audio thread, unless CALF_CONVOLUTION_RTPRIO asks for another one (0 = not real-time)
+        const char *prio = getenv("CALF_CONVOLUTION_RTPRIO");
+        std::string error;
+        dsp::impulse_response ir;
+        new_engine = new dsp::convolver;
+        if (!ir.load(ir_file.c_str(), error) || !new_engine->init(ir, srate, prio ? atoi(prio) : -1, error))
+        {
+            delete new_engine;
+            return strdup(error.c_str());
+        }
+    }
+    engine_srate = srate;
+    if (!set_engine(new_engine))
+    {
+        delete new_engine;
+        return strdup("Too many impulse responses waiting to be loaded");
+    }
+    return NULL;
+}
+
+char *convolution_reverb_audio_module::configure(const char *key, const char *value)
+{
+    if (!strcmp(key, "ir_file"))
+    {
+        ir_file = value ? value : "";
+        // the sample rate isn't known yet - defer loading up to set_sample_rate
+        if (!srate)
+            return NULL;
+        return load_impulse_response();
+    }
+    return NULL;
+}
+
+void convolution_reverb_audio_module::send_configures(send_configure_iface *sci)
+{
+    sci->send_configure("ir_file", ir_file.c_str());
+}
+
+void convolution_reverb_audio_module::activate()
+{
+    // the audio thread is not running yet, so pick up anything queued here
+    dsp::convolver *c;
+    while(incoming.pop(c))
+    {
+        delete engine;
+        engine = c;
+    }
+    collect_garbage();
+    if (engine)
+        engine->reset();
+    pre_delay.reset();
+    active = true;
+}
+
+void convolution_reverb_audio_module::deactivate()
+{
+    active = false;
+}
+
+void convolution_reverb_audio_module::set_sample_rate(uint32_t sr)
+{
+    srate = sr;
+    pre_delay.set_max_delay(sr / 2 + 1);
+    amount.set_sample_rate(sr);
+    dryamount.set_sample_rate(sr);
+    int meter[] = {par_meter_wet, par_meter_out};
+    int clip[] = {-1, par_clip};
+    meters.init(params, meter, clip, 2, srate);
+    if (!ir_file.empty() && engine_srate != sr)
+    {
+        char *error = load_impulse_response();
+        if (error)
+        {
+            fprintf(stderr, "%s\n", error);
+            free(error);
+        }
+    }
+}
+
+int convolution_reverb_audio_module::get_tail_length() const
+{
+    return engine ? (int)engine->get_length() + predelay_amt : 0;
+}
+
+void convolution_reverb_audio_module::params_changed()
+{
+    amount.set_inertia(*params[par_amount]);
+    dryamount.set_inertia(*params[par_dry]);
+    left_lo.set_lp(dsp::clip(*params[par_treblecut], 20.f, (float)(srate * 0.49f)), srate);
+    left_hi.set_hp(dsp::clip(*params[par_basscut], 20.f, (float)(srate * 0.49f)), srate);
+    right_lo.copy_coeffs(left_lo);
+    right_hi.copy_coeffs(left_hi);
+    predelay_amt = (int) (srate * (*params[par_predelay]) * (1.0f / 1000.0f) + 1);
+}
+
+uint32_t convolution_reverb_audio_module::process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask)
+{
+    dsp::convolver *new_engine;
+    while(incoming.pop(new_engine))
+    {
+        if (engine)
+            garbage.push(engine);
+        engine = new_engine;
+    }
+    uint32_t end = offset + numsamples;
+    while(offset < end)
+    {
+        uint32_t len = std::min<uint32_t>(end - offset, MAX_SAMPLE_RUN);
+        for (uint32_t i = 0; i < len; i++)
+        {
+            stereo_sample<float> s(ins[0][offset + i], ins[1][offset + i]);
+            stereo_sample<float> s2 = pre_delay.process(s, predelay_amt);
+            wet_in[0][i] = left_lo.process(left_hi.process(s2.left));
+            wet_in[1][i] = right_lo.process(right_hi.process(s2.right));
+        }
+        if (engine)
+        {
+            const float *wet_ins[] = { wet_in[0], wet_in[1] };
+            float *wet_outs[] = { wet_out[0], wet_out[1] };
+            engine->process(wet_ins, wet_outs, len);
+        }
+        else
+        {
+            dsp::zero(wet_out[0], len);
+            dsp::zero(wet_out[1], len);
+        }
+        for (uint32_t i = 0; i < len; i++)
+        {
+            float dry = dryamount.get();
+            float wet = amount.get();
+            wet_out[0][i] *= wet;
+            wet_out[1][i] *= wet;
+            outs[0][offset + i] = dry * ins[0][offset + i] + wet_out[0][i];
+            outs[1][offset + i] = dry * ins[1][offset + i] + wet_out[1][i];
+        }
+        meters.process_stereo(0, wet_out[0], wet_out[1], len);
+        meters.process_stereo(1, outs[0] + offset, outs[1] + offset, len);
+        offset += len;
+    }
+    meters.fall(numsamples);
+    left_lo.sanitize();
+    left_hi.sanitize();
+    right_lo.sanitize();
+    right_hi.sanitize();
+    return outputs_mask;
+}
+
 /**********************************************************************
  * VINTAGE DELAY by Krzysztof Foltman
 **********************************************************************/
@@ -109,22 +351,66 @@ uint32_t reverb_audio_module::process(uint32_t offset, uint32_t numsamples, uint
 vintage_delay_audio_module::vintage_delay_audio_module()
 {
     old_medium = -1;
-    for (int i = 0; i < MAX_DELAY; i++) {
-        buffers[0][i] = 0.f;
-        buffers[1][i] = 0.f;
-    }
+    buffers[0] = buffers[1] = NULL;
+    buf_capacity = 0;
+    buf_mask = 0;
+    grow_mask = 0;
+    bufptr = 0;
+    age = 0;
+    deltime_l = deltime_r = 0;
     _tap_avg = 0;
     _tap_last = 0;
 }
 
+vintage_delay_audio_module::~vintage_delay_audio_module()
+{
+    if (buffers[0])
+        dsp::delay_arena::free(buffers[0], 2 * buf_capacity * sizeof(float));
+}
+
+void vintage_delay_audio_module::apply_grow()
+{
+    // called when the write pointer has just wrapped around, so the whole
+    // old ring is in chronological order; with the write pointer continuing
+    // right after it, the history is already in the right place for the new
+    // ring, and the (never written, so silent) rest of the new ring stands
+    // for the samples too old to be kept
+    bufptr = buf_mask + 1;
+    buf_mask = grow_mask;
+    deltime_l = grow_deltime_l;
+    deltime_r = grow_deltime_r;
+    grow_mask = 0;
+}
+
 void vintage_delay_audio_module::params_changed()
 {
     if (*params[par_sync] > 0.5f)
         *params[par_bpm] = *params[par_bpm_host];
     float unit = 60.0 * srate / (*params[par_bpm] * *params[par_divide]);
-    deltime_l = dsp::fastf2i_drm(unit * *params[par_time_l]);
-    deltime_r = dsp::fastf2i_drm(unit * *params[par_time_r]);
-    int deltime_fb = deltime_l + deltime_r;
+    // half of the buffer each, as the ping-pong taps use the sum of both delays
+    int new_deltime_l = std::max(0, std::min(dsp::fastf2i_drm(unit * *params[par_time_l]), buf_capacity / 2 - 1));
+    int new_deltime_r = std::max(0, std::min(dsp::fastf2i_drm(unit * *params[par_time_r]), buf_capacity / 2 - 1));
+    int deltime_fb = new_deltime_l + new_deltime_r;
+    if (deltime_fb <= buf_mask)
+    {
+        deltime_l = new_deltime_l;
+        deltime_r = new_deltime_r;
+        grow_mask = 0;
+    }
+    else
+    {
+        // the ring is enlarged by process when the write pointer wraps
+        // around (nothing needs moving then); until that happens, use the
+        // longest delays that fit the current ring
+        int new_size = buf_mask + 1;
+        while (new_size <= deltime_fb)
+            new_size <<= 1;
+        grow_mask = new_size - 1;
+        grow_deltime_l = new_deltime_l;
+        grow_deltime_r = new_deltime_r;
+        deltime_l = std::min(new_deltime_l, buf_mask / 2);
+        deltime_r = std::min(new_deltime_r, buf_mask / 2);
+    }
     float fb = *params[par_feedback];
     dry.set_inertia(*params[par_dryamount]);
     mixmode = dsp::fastf2i_drm(*params[par_mixmode]);
@@ -147,14 +433,14 @@ void vintage_delay_audio_module::params_changed()
         fb_left.set_inertia(fb);
         fb_right.set_inertia(fb);
         amt_left.set_inertia(*params[par_amount]);                                          // L is straight 'amount'
-        amt_right.set_inertia(*params[par_amount] * pow(fb, 1.0 * deltime_r / deltime_fb)); // R is amount with feedback based dampening as if it ran through R/FB*100% of delay line's dampening
+        amt_right.set_inertia(*params[par_amount] * pow(fb, 1.0 * new_deltime_r / deltime_fb)); // R is amount with feedback based dampening as if it ran through R/FB*100% of delay line's dampening
         // deltime_l <<< deltime_r -> pow() = fb -> full delay line worth of dampening
         // deltime_l >>> deltime_r -> pow() = 1 -> no dampening
         break;
     case MIXMODE_RL:
         fb_left.set_inertia(fb);
         fb_right.set_inertia(fb);
-        amt_left.set_inertia(*params[par_amount] * pow(fb, 1.0 * deltime_l / deltime_fb));
+        amt_left.set_inertia(*params[par_amount] * pow(fb, 1.0 * new_deltime_l / deltime_fb));
         amt_right.set_inertia(*params[par_amount]);
         break;
     }
@@ -173,9 +459,40 @@ void vintage_delay_audio_module::deactivate()
 {
 }
 
+int vintage_delay_audio_module::get_tail_length() const
+{
+    // the longest loop is the ping-pong one, through both delay lines
+    return feedback_tail_length(deltime_l + deltime_r, *params[par_feedback]);
+}
+
 void vintage_delay_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
+    // both delays at their longest, plus one sample
+    int capacity = MIN_BUFFER;
+    while (capacity <= (int)(2 * MAX_DELAY_SECONDS * sr))
+        capacity <<= 1;
+    if (capacity != buf_capacity)
+    {
+        if (buffers[0])
+            dsp::delay_arena::free(buffers[0], 2 * buf_capacity * sizeof(float));
+        buffers[0] = (float *)dsp::delay_arena::alloc(2 * capacity * sizeof(float));
+        // without the memory, process outputs silence
+        buffers[1] = buffers[0] ? buffers[0] + capacity : NULL;
+        buf_capacity = buffers[0] ? capacity : 0;
+        buf_mask = MIN_BUFFER - 1;
+        grow_mask = 0;
+        deltime_l = deltime_r = 0;
+        bufptr = 0;
+        age = 0;
+        // only the part that will be used right away; the pages of the
+        // rest are touched one at a time as the ring grows
+        if (buffers[0])
+        {
+            dsp::delay_arena::prefault(buffers[0], MIN_BUFFER * sizeof(float));
+            dsp::delay_arena::prefault(buffers[1], MIN_BUFFER * sizeof(float));
+        }
+    }
     old_medium = -1;
     amt_left.set_sample_rate(sr); amt_right.set_sample_rate(sr);
     fb_left.set_sample_rate(sr); fb_right.set_sample_rate(sr);
@@ -238,9 +555,27 @@ static inline void delay_mix(float dry_left, float dry_right, float &out_left, f
 
 uint32_t vintage_delay_audio_module::process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask)
 {
-    uint32_t ostate = 3; // XXXKF optimize!
+    if (!buffers[0])
+        return 0;
     uint32_t end = offset + numsamples;
+    while(offset < end)
+    {
+        if (grow_mask && !bufptr)
+            apply_grow();
+        uint32_t run_end = end;
+        // stop where the write pointer wraps around if the ring is to grow
+        if (grow_mask)
+            run_end = std::min<uint32_t>(end, offset + buf_mask + 1 - bufptr);
+        process_run(offset, run_end);
+        offset = run_end;
+    }
+    return 3; // XXXKF optimize!
+}
+
+void vintage_delay_audio_module::process_run(uint32_t offset, uint32_t end)
+{
     int orig_bufptr = bufptr;
+    const int mask = buf_mask;
     float out_left, out_right, del_left, del_right;
     
     switch(mixmode)
@@ -251,13 +586,13 @@ uint32_t vintage_delay_audio_module::process(uint32_t offset, uint32_t numsample
             int v = mixmode == MIXMODE_PINGPONG ? 1 : 0;
             for(uint32_t i = offset; i < end; i++)
             {                
-                delayline_impl(age, deltime_l, ins[0][i], buffers[v][(bufptr - deltime_l) & ADDR_MASK], out_left, del_left, amt_left, fb_left);
-                delayline_impl(age, deltime_r, ins[1][i], buffers[1 - v][(bufptr - deltime_r) & ADDR_MASK], out_right, del_right, amt_right, fb_right);
+                delayline_impl(age, deltime_l, ins[0][i], buffers[v][(bufptr - deltime_l) & mask], out_left, del_left, amt_left, fb_left);
+                delayline_impl(age, deltime_r, ins[1][i], buffers[1 - v][(bufptr - deltime_r) & mask], out_right, del_right, amt_right, fb_right);
                 delay_mix(ins[0][i], ins[1][i], out_left, out_right, dry.get(), chmix.get());
                 
                 age++;
                 outs[0][i] = out_left; outs[1][i] = out_right; buffers[0][bufptr] = del_left; buffers[1][bufptr] = del_right;
-                bufptr = (bufptr + 1) & (MAX_DELAY - 1);
+                bufptr = (bufptr + 1) & mask;
             }
         }
         break;
@@ -272,18 +607,18 @@ uint32_t vintage_delay_audio_module::process(uint32_t offset, uint32_t numsample
             
             for(uint32_t i = offset; i < end; i++)
             {
-                delayline2_impl(age, deltime_l, ins[0][i], buffers[v][(bufptr - deltime_l_corr) & ADDR_MASK], buffers[v][(bufptr - deltime_fb) & ADDR_MASK], out_left, del_left, amt_left, fb_left);
-                delayline2_impl(age, deltime_r, ins[1][i], buffers[1 - v][(bufptr - deltime_r_corr) & ADDR_MASK], buffers[1-v][(bufptr - deltime_fb) & ADDR_MASK], out_right, del_right, amt_right, fb_right);
+                delayline2_impl(age, deltime_l, ins[0][i], buffers[v][(bufptr - deltime_l_corr) & mask], buffers[v][(bufptr - deltime_fb) & mask], out_left, del_left, amt_left, fb_left);
+                delayline2_impl(age, deltime_r, ins[1][i], buffers[1 - v][(bufptr - deltime_r_corr) & mask], buffers[1-v][(bufptr - deltime_fb) & mask], out_right, del_right, amt_right, fb_right);
                 delay_mix(ins[0][i], ins[1][i], out_left, out_right, dry.get(), chmix.get());
                 
                 age++;
                 outs[0][i] = out_left; outs[1][i] = out_right; buffers[0][bufptr] = del_left; buffers[1][bufptr] = del_right;
-                bufptr = (bufptr + 1) & (MAX_DELAY - 1);
+                bufptr = (bufptr + 1) & mask;
             }
         }
     }
-    if (age >= MAX_DELAY)
-        age = MAX_DELAY;
+    if (age > mask)
+        age = mask + 1;
     if (medium > 0) {
         bufptr = orig_bufptr;
         if (medium == 2)
@@ -292,7 +627,7 @@ uint32_t vintage_delay_audio_module::process(uint32_t offset, uint32_t numsample
             {
                 buffers[0][bufptr] = biquad_left[0].process_lp(biquad_left[1].process(buffers[0][bufptr]));
                 buffers[1][bufptr] = biquad_right[0].process_lp(biquad_right[1].process(buffers[1][bufptr]));
-                bufptr = (bufptr + 1) & (MAX_DELAY - 1);
+                bufptr = (bufptr + 1) & mask;
             }
             biquad_left[0].sanitize();biquad_right[0].sanitize();
         } else {
@@ -300,14 +635,12 @@ uint32_t vintage_delay_audio_module::process(uint32_t offset, uint32_t numsample
             {
                 buffers[0][bufptr] = biquad_left[1].process(buffers[0][bufptr]);
                 buffers[1][bufptr] = biquad_right[1].process(buffers[1][bufptr]);
-                bufptr = (bufptr + 1) & (MAX_DELAY - 1);
+                bufptr = (bufptr + 1) & mask;
             }
         }
         biquad_left[1].sanitize();biquad_right[1].sanitize();
         
     }
-    
-    return ostate;
 }
 
 /**********************************************************************
@@ -349,6 +682,11 @@ void comp_delay_audio_module::deactivate()
 {
 }
 
+int comp_delay_audio_module::get_tail_length() const
+{
+    return delay + 1;
+}
+
 void comp_delay_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
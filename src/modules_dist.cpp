@@ -144,6 +144,19 @@ uint32_t saturator_audio_module::process(uint32_t offset, uint32_t numsamples, u
         }
     } else {
         uint32_t orig_offset = offset;
+        // the oversampled saturation works on whole blocks, so run the
+        // pre filters and the saturation before the per-sample loop
+        float sat[2][MAX_SAMPLE_RUN];
+        for (int i = 0; i < (in_count > 1 && out_count > 1 ? 2 : 1); ++i) {
+            for (uint32_t j = offset; j < numsamples; ++j) {
+                // all pre filters in chain
+                float s = ins[i][j] * *params[param_level_in];
+                s = lp[i][1].process(lp[i][0].process(s));
+                sat[i][j - orig_offset] = hp[i][1].process(hp[i][0].process(s));
+            }
+            // ...saturate...
+            dist[i].process(sat[i], sat[i], numsamples - orig_offset);
+        }
         // process
         while(offset < numsamples) {
             // cycle through samples
@@ -164,19 +177,12 @@ uint32_t saturator_audio_module::process(uint32_t offset, uint32_t numsamples, u
             }
             
             float proc[2];
-            proc[0] = in[0] * *params[param_level_in];
-            proc[1] = in[1] * *params[param_level_in];
             
             float onedivlevelin = 1.0 / *params[param_level_in];
             
             for (int i = 0; i < c; ++i) {
-                // all pre filters in chain
-                proc[i] = lp[i][1].process(lp[i][0].process(proc[i]));
-                proc[i] = hp[i][1].process(hp[i][0].process(proc[i]));
+                proc[i] = sat[i][offset - orig_offset];
 
-                // ...saturate...
-                proc[i] = dist[i].process(proc[i]);
-                
                 // tone control
                 proc[i] = p[i].process(proc[i]);
 
@@ -339,6 +345,19 @@ uint32_t exciter_audio_module::process(uint32_t offset, uint32_t numsamples, uin
         
         float in2out = *params[param_listen] > 0.f ? 0.f : 1.f;
         
+        // the oversampled saturation works on whole blocks, so run the
+        // pre filters and the saturation before the per-sample loop
+        float sat[2][MAX_SAMPLE_RUN];
+        for (int i = 0; i < (in_count > 1 && out_count > 1 ? 2 : 1); ++i) {
+            for (uint32_t j = offset; j < numsamples; ++j) {
+                // all pre filters in chain
+                float s = ins[i][j] * *params[param_level_in];
+                sat[i][j - orig_offset] = hp[i][1].process(hp[i][0].process(s));
+            }
+            // saturate
+            dist[i].process(sat[i], sat[i], numsamples - orig_offset);
+        }
+        
         // process
         while(offset < numsamples) {
             // cycle through samples
@@ -364,15 +383,9 @@ uint32_t exciter_audio_module::process(uint32_t offset, uint32_t numsamples, uin
             }
             
             float proc[2];
-            proc[0] = in[0];
-            proc[1] = in[1];
             
             for (int i = 0; i < c; ++i) {
-                // all pre filters in chain
-                proc[i] = hp[i][1].process(hp[i][0].process(proc[i]));
-                
-                // saturate
-                proc[i] = dist[i].process(proc[i]);
+                proc[i] = sat[i][offset - orig_offset];
 
                 // all post filters in chain
                 proc[i] = hp[i][2].process(hp[i][3].process(proc[i]));
@@ -520,6 +533,18 @@ uint32_t bassenhancer_audio_module::process(uint32_t offset, uint32_t numsamples
     } else {
         // process
         uint32_t orig_offset = offset;
+        // the oversampled saturation works on whole blocks, so run the
+        // pre filters and the saturation before the per-sample loop
+        float sat[2][MAX_SAMPLE_RUN];
+        for (int i = 0; i < (in_count > 1 && out_count > 1 ? 2 : 1); ++i) {
+            for (uint32_t j = offset; j < numsamples; ++j) {
+                // all pre filters in chain
+                float s = ins[i][j] * *params[param_level_in];
+                sat[i][j - orig_offset] = lp[i][1].process(lp[i][0].process(s));
+            }
+            // saturate
+            dist[i].process(sat[i], sat[i], numsamples - orig_offset);
+        }
         while(offset < numsamples) {
             // cycle through samples
             float out[2], in[2] = {0.f, 0.f};
@@ -544,15 +569,9 @@ uint32_t bassenhancer_audio_module::process(uint32_t offset, uint32_t numsamples
             }
             
             float proc[2];
-            proc[0] = in[0];
-            proc[1] = in[1];
             
             for (int i = 0; i < c; ++i) {
-                // all pre filters in chain
-                proc[i] = lp[i][1].process(lp[i][0].process(proc[i]));
-                
-                // saturate
-                proc[i] = dist[i].process(proc[i]);
+                proc[i] = sat[i][offset - orig_offset];
 
                 // all post filters in chain
                 proc[i] = lp[i][2].process(lp[i][3].process(proc[i]));
@@ -32,13 +32,15 @@ using namespace calf_plugins;
  * EQUALIZER N BAND by Markus Schmidt and Krzysztof Foltman
 **********************************************************************/
 
-inline void diff_ms(float &left, float &right) {
-    float tmp = (left + right) / 2;
+template<class T>
+inline void diff_ms(T &left, T &right) {
+    T tmp = (left + right) / 2;
     right = left - right;
     left = tmp;
 }
-inline void undiff_ms(float &left, float &right) {
-    float tmp = left + right / 2;
+template<class T>
+inline void undiff_ms(T &left, T &right) {
+    T tmp = left + right / 2;
     right = left - right / 2;
     left = tmp;
 }
@@ -64,7 +66,11 @@ equalizerNband_audio_module<BaseClass, has_lphp>::equalizerNband_audio_module()
     }
     for (int i = 0; i < graph_param_count; i++)
         old_params_for_graph[i] = -1;
+    for (int i = 0; i < sections; i++)
+        section_lanes[i] = 0;
     redraw_graph = true;
+    AM::ramp_param(AM::param_level_in, level_in);
+    AM::ramp_param(AM::param_level_out, level_out);
 }
 
 template<class BaseClass, bool has_lphp>
@@ -73,6 +79,7 @@ void equalizerNband_audio_module<BaseClass, has_lphp>::activate()
     is_active = true;
     // set all filters
     params_changed();
+    AM::update_param_ramps(true);
 }
 
 template<class BaseClass, bool has_lphp>
@@ -104,6 +111,9 @@ template<class BaseClass, bool has_lphp>
 void equalizerNband_audio_module<BaseClass, has_lphp>::params_changed()
 {
     keep_gliding = 0;
+    // the level ramps follow the parameters for callers that don't go through
+    // params_changed_if_needed too (unchanged targets don't restart the ramps)
+    AM::update_param_ramps(false);
     // set the params of all filters
     
     // lp/hp first (if available)
@@ -185,65 +195,56 @@ void equalizerNband_audio_module<BaseClass, has_lphp>::params_changed()
     }
 }
 
+/// Map the value of a filter's "active" parameter to cascade lanes
+/// (0 - off, 1 - both, 2 - left, 3 - right, 4 - mid, 5 - side)
+static inline int eq_active_lanes(int active)
+{
+    switch(active)
+    {
+        case 1: return 3;
+        case 2: case 4: return 1;
+        case 3: case 5: return 2;
+        default: return 0;
+    }
+}
+
 template<class BaseClass, bool has_lphp>
-inline void equalizerNband_audio_module<BaseClass, has_lphp>::process_hplp(float &left, float &right)
+inline void equalizerNband_audio_module<BaseClass, has_lphp>::setup_section(int section, int active, const biquad_d2 &left, const biquad_d2 &right)
 {
-    if (!has_lphp)
-        return;
-    int active = *params[AM::param_lp_active];
-    if (active > 0.f)
+    int lanes = eq_active_lanes(active);
+    for (int lane = 0; lane < 2; lane++)
     {
-        if (active > 3) diff_ms(left, right);
-        switch(lp_mode)
+        if (lanes & (1 << lane))
         {
-            case MODE12DB:
-                if (active == 1 or active == 2 or active == 4)
-                    left = lp[0][0].process(left);
-                if (active == 1 or active == 3 or active == 5)
-                    right = lp[0][1].process(right);
-                break;
-            case MODE24DB:
-                if (active == 1 or active == 2 or active == 4)
-                    left = lp[1][0].process(lp[0][0].process(left));
-                if (active == 1 or active == 3 or active == 5)
-                    right = lp[1][1].process(lp[0][1].process(right));
-                break;
-            case MODE36DB:
-                if (active == 1 or active == 2 or active == 4)
-                    left = lp[2][0].process(lp[1][0].process(lp[0][0].process(left)));
-                if (active == 1 or active == 3 or active == 5)
-                    right = lp[2][1].process(lp[1][1].process(lp[0][1].process(right)));
-                break;
+            // the state of a lane that was passing the signal through is meaningless
+            if (!(section_lanes[section] & (1 << lane)))
+                cascade.reset(section, lane);
+            cascade.set_coeffs(section, lane, lane ? right : left);
         }
-        if (active > 3) undiff_ms(left, right);
+        else
+            cascade.set_passthru(section, lane);
     }
-    active = *params[AM::param_hp_active];
-    if (active > 0.f)
+    section_lanes[section] = lanes;
+}
+
+template<class BaseClass, bool has_lphp>
+inline void equalizerNband_audio_module<BaseClass, has_lphp>::run_sections(double *buf, uint32_t len, int first, int count, int active, bool &ms)
+{
+    if (active <= 0 || !count)
+        return;
+    // convert the buffer between L/R and M/S only when the next filter needs the other one
+    if ((active > 3) != ms)
     {
-        if (active > 3) diff_ms(left, right);
-        switch(hp_mode)
+        ms = active > 3;
+        for (uint32_t i = 0; i < len; i++)
         {
-            case MODE12DB:
-                if (active == 1 or active == 2 or active == 4)
-                    left = hp[0][0].process(left);
-                if (active == 1 or active == 3 or active == 5)
-                    right = hp[0][1].process(right);
-                break;
-            case MODE24DB:
-                if (active == 1 or active == 2 or active == 4)
-                    left = hp[1][0].process(hp[0][0].process(left));
-                if (active == 1 or active == 3 or active == 5)
-                    right = hp[1][1].process(hp[0][1].process(right));
-                break;
-            case MODE36DB:
-                if (active == 1 or active == 2 or active == 4)
-                    left = hp[2][0].process(hp[1][0].process(hp[0][0].process(left)));
-                if (active == 1 or active == 3 or active == 5)
-                    right = hp[2][1].process(hp[1][1].process(hp[0][1].process(right)));
-                break;
+            if (ms)
+                diff_ms(buf[2 * i], buf[2 * i + 1]);
+            else
+                undiff_ms(buf[2 * i], buf[2 * i + 1]);
         }
-        if (active > 3) undiff_ms(left, right);
     }
+    cascade.process(buf, len, first, count);
 }
 
 template<class BaseClass, bool has_lphp>
@@ -265,93 +266,92 @@ uint32_t equalizerNband_audio_module<BaseClass, has_lphp>::process(uint32_t offs
             params_changed();
     }
     numsamples += offset;
+    uint32_t orig_offset = offset;
     if(bypassed) {
         // everything bypassed
         while(offset < numsamples) {
             outs[0][offset] = ins[0][offset];
             outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 0, 0};
-            meters.process(values);
             _analyzer.process(0, 0);
             ++offset;
         }
+        float values[] = {0, 0, 0, 0};
+        meters.process(values);
+        level_in.step_many(numsamples - orig_offset);
+        level_out.step_many(numsamples - orig_offset);
     } else {
-        // process
-        uint32_t orig_offset = offset;
-        while(offset < numsamples) {
-            // cycle through samples
-            float outL = 0.f;
-            float outR = 0.f;
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
-            // in level
-            inR *= *params[AM::param_level_in];
-            inL *= *params[AM::param_level_in];
-            
-            float procL = inL;
-            float procR = inR;
-            
-            // all filters in chain
-            process_hplp(procL, procR);
-            
-            int active = *params[AM::param_ls_active];
-            if (active > 3) diff_ms(procL, procR);
-            if (active == 1 or active == 2 or active == 4)
-                procL = lsL.process(procL);
-            if (active == 1 or active == 3 or active == 5)
-                procR = lsR.process(procR);
-            if (active > 3) undiff_ms(procL, procR);
-            
-            active = *params[AM::param_hs_active];
-            if (active > 3) diff_ms(procL, procR);
-            if (active == 1 or active == 2 or active == 4)
-                procL = hsL.process(procL);
-            if (active == 1 or active == 3 or active == 5)
-                procR = hsR.process(procR);
-            if (active > 3) undiff_ms(procL, procR);
-            
-            for (int i = 0; i < AM::PeakBands; i++)
+        // copy the current coefficients into the cascade
+        int lp_active = 0, hp_active = 0, lp_count = 0, hp_count = 0;
+        if (has_lphp)
+        {
+            lp_active = *params[AM::param_lp_active];
+            hp_active = *params[AM::param_hp_active];
+            lp_count = lp_mode + 1;
+            hp_count = hp_mode + 1;
+            for (int i = 0; i < 3; i++)
             {
-                int offset = i * params_per_band;
-                int active = *params[AM::param_p1_active + offset];
-                if (active > 3) diff_ms(procL, procR);
-                if (active == 1 or active == 2 or active == 4)
-                    procL = pL[i].process(procL);
-                if (active == 1 or active == 3 or active == 5)
-                    procR = pR[i].process(procR);
-                if (active > 3) undiff_ms(procL, procR);
+                setup_section(lp_section + i, i < lp_count ? lp_active : 0, lp[i][0], lp[i][1]);
+                setup_section(hp_section + i, i < hp_count ? hp_active : 0, hp[i][0], hp[i][1]);
             }
-            
-            outL = procL * *params[AM::param_level_out];
-            outR = procR * *params[AM::param_level_out];
-            
-            // analyzer
-            _analyzer.process((inL + inR) / 2.f, (outL + outR) / 2.f);
+        }
+        int ls_active = *params[AM::param_ls_active];
+        int hs_active = *params[AM::param_hs_active];
+        setup_section(ls_section, ls_active, lsL, lsR);
+        setup_section(hs_section, hs_active, hsL, hsR);
+        int p_active[PeakBands];
+        for (int i = 0; i < PeakBands; i++)
+        {
+            p_active[i] = *params[AM::param_p1_active + i * params_per_band];
+            setup_section(peak_section + i, p_active[i], pL[i], pR[i]);
+        }
         
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+        while(offset < numsamples) {
+            // process a chunk of samples through all the filters in chain
+            enum { chunk_size = 64 };
+            double buf[chunk_size * 2];
+            float gain_in[chunk_size];
+            float meter_in[2][chunk_size];
+            uint32_t len = std::min<uint32_t>(chunk_size, numsamples - offset);
+            for (uint32_t i = 0; i < len; i++) {
+                gain_in[i] = level_in.get();
+                buf[2 * i] = ins[0][offset + i] * gain_in[i];
+                buf[2 * i + 1] = ins[1][offset + i] * gain_in[i];
+            }
+            bool ms = false;
+            run_sections(buf, len, lp_section, lp_count, lp_active, ms);
+            run_sections(buf, len, hp_section, hp_count, hp_active, ms);
+            run_sections(buf, len, ls_section, 1, ls_active, ms);
+            run_sections(buf, len, hs_section, 1, hs_active, ms);
+            for (int i = 0; i < PeakBands; i++)
+                run_sections(buf, len, peak_section + i, 1, p_active[i], ms);
+            if (ms) {
+                for (uint32_t i = 0; i < len; i++)
+                    undiff_ms(buf[2 * i], buf[2 * i + 1]);
+            }
             
-            float values[] = {inL, inR, outL, outR};
-            meters.process(values);
-
-            // next sample
-            ++offset;
-        } // cycle trough samples
-        bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
-        // clean up
-        for(int i = 0; i < 3; ++i) {
-            hp[i][0].sanitize();
-            hp[i][1].sanitize();
-            lp[i][0].sanitize();
-            lp[i][1].sanitize();
-        }
-        lsL.sanitize();
-        hsR.sanitize();
-        for(int i = 0; i < AM::PeakBands; ++i) {
-            pL[i].sanitize();
-            pR[i].sanitize();
+            for (uint32_t i = 0; i < len; i++, offset++) {
+                float inL = ins[0][offset] * gain_in[i];
+                float inR = ins[1][offset] * gain_in[i];
+                float gain_out = level_out.get();
+                float outL = buf[2 * i] * gain_out;
+                float outR = buf[2 * i + 1] * gain_out;
+                
+                // analyzer
+                _analyzer.process((inL + inR) / 2.f, (outL + outR) / 2.f);
+            
+                // send to output
+                outs[0][offset] = outL;
+                outs[1][offset] = outR;
+                
+                meter_in[0][i] = inL;
+                meter_in[1][i] = inR;
+            }
+            meters.process(0, meter_in[0], len);
+            meters.process(1, meter_in[1], len);
+            meters.process(2, outs[0] + offset - len, len);
+            meters.process(3, outs[1] + offset - len, len);
         }
+        bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
     }
     meters.fall(numsamples);
     return outputs_mask;
@@ -373,6 +373,22 @@ static inline float adjusted_lphp_gain(const float *const *params, int param_act
     return 1;
 }
 
+/// Number of times the lp/hp biquad is applied (see adjusted_lphp_gain)
+static inline int lphp_count(const float *const *params, int param_active, int param_mode)
+{
+    if(*params[param_active] > 0.f) {
+        switch((int)*params[param_mode]) {
+            case MODE12DB:
+                return 1;
+            case MODE24DB:
+                return 2;
+            case MODE36DB:
+                return 3;
+        }
+    }
+    return 0;
+}
+
 template<class BaseClass, bool has_lphp>
 bool equalizerNband_audio_module<BaseClass, has_lphp>::get_graph(int index, int subindex, int phase, float *data, int points, cairo_iface *context, int *mode) const
 {
@@ -398,8 +414,23 @@ bool equalizerNband_audio_module<BaseClass, has_lphp>::get_graph(int index, int
         }
         
         // first graph is the overall frequency response graph
-        if (!subindex)
-            return ::get_graph(*this, subindex, data, points, 128 * *params[AM::param_zoom], 0);
+        if (!subindex) {
+            dsp::biquad_response &r = graph_response[0];
+            r.begin();
+            if (has_lphp) {
+                r.add(hp[0][0], lphp_count(params, AM::param_hp_active, AM::param_hp_mode));
+                r.add(lp[0][0], lphp_count(params, AM::param_lp_active, AM::param_lp_mode));
+            }
+            if (*params[AM::param_ls_active] > 0.f)
+                r.add(lsL);
+            if (*params[AM::param_hs_active] > 0.f)
+                r.add(hsL);
+            for (int i = 0; i < PeakBands; i++)
+                if (*params[AM::param_p1_active + i * params_per_band] > 0.f)
+                    r.add(pL[i]);
+            r.get_graph(data, points, (float)srate, 128 * *params[AM::param_zoom], 0);
+            return true;
+        }
         
         // get out if max band is reached
         if (last_peak >= max) {
@@ -435,21 +466,20 @@ bool equalizerNband_audio_module<BaseClass, has_lphp>::get_graph(int index, int
         //}
             
         // draw the individual curve of the actual filter
-        for (int i = 0; i < points; i++) {
-            double freq = 20.0 * pow (20000.0 / 20.0, i * 1.0 / points);
-            if (last_peak < PeakBands) {
-                data[i] = pL[last_peak].freq_gain(freq, (float)srate);
-            } else if (last_peak == PeakBands) {
-                data[i] = lsL.freq_gain(freq, (float)srate);
-            } else if (last_peak == PeakBands + 1) {
-                data[i] = hsL.freq_gain(freq, (float)srate);
-            } else if (last_peak == PeakBands + 2 and has_lphp) {
-                data[i] = adjusted_lphp_gain(params, AM::param_hp_active, AM::param_hp_mode, hp[0][0], freq, (float)srate);
-            } else if (last_peak == PeakBands + 3 and has_lphp) {
-                data[i] = adjusted_lphp_gain(params, AM::param_lp_active, AM::param_lp_mode, lp[0][0], freq, (float)srate);
-            }
-            data[i] = dB_grid(data[i], 128 * *params[AM::param_zoom], 0);
+        dsp::biquad_response &r = graph_response[last_peak + 1];
+        r.begin();
+        if (last_peak < PeakBands) {
+            r.add(pL[last_peak]);
+        } else if (last_peak == PeakBands) {
+            r.add(lsL);
+        } else if (last_peak == PeakBands + 1) {
+            r.add(hsL);
+        } else if (last_peak == PeakBands + 2 and has_lphp) {
+            r.add(hp[0][0], lphp_count(params, AM::param_hp_active, AM::param_hp_mode));
+        } else if (last_peak == PeakBands + 3 and has_lphp) {
+            r.add(lp[0][0], lphp_count(params, AM::param_lp_active, AM::param_lp_mode));
         }
+        r.get_graph(data, points, (float)srate, 128 * *params[AM::param_zoom], 0);
         
         last_peak ++;
         *mode = 4;
@@ -657,12 +687,16 @@ uint32_t emphasis_audio_module::process(uint32_t offset, uint32_t numsamples, ui
         while(offset < numsamples) {
             outs[0][offset] = ins[0][offset];
             outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 0, 0};
-            meters.process(values);
             ++offset;
         }
+        float values[] = {0, 0, 0, 0};
+        meters.process(values);
     } else {
         // process
+        uint32_t block_start = offset;
+        // the inputs are metered before the outputs are written, as they may share the buffers
+        meters.process(0, ins[0] + offset, numsamples - offset, *params[param_level_in]);
+        meters.process(1, ins[1] + offset, numsamples - offset, *params[param_level_in]);
         while(offset < numsamples) {
             // cycle through samples
             float outL = 0.f;
@@ -686,12 +720,12 @@ uint32_t emphasis_audio_module::process(uint32_t offset, uint32_t numsamples, ui
             outs[0][offset] = outL;
             outs[1][offset] = outR;
             
-            float values[] = {inL, inR, outL, outR};
-            meters.process(values);
-            
             // next sample
             ++offset;
         } // cycle trough samples
+        uint32_t len = numsamples - block_start;
+        meters.process(2, outs[0] + block_start, len);
+        meters.process(3, outs[1] + block_start, len);
         bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
         // clean up
         riaacurvL.sanitize();
@@ -791,15 +825,21 @@ uint32_t xover_audio_module<XoverBaseClass>::process(uint32_t offset, uint32_t n
     unsigned int targ = numsamples + offset;
     float xval;
     float values[AM::bands * AM::channels + AM::channels];
+    
+    // split the whole block into bands, straight into the outputs
+    const float *band_ins[AM::channels];
+    float *band_outs[AM::bands * AM::channels];
+    for (int c = 0; c < AM::channels; c++)
+        band_ins[c] = ins[c] + offset;
+    for (int i = 0; i < AM::bands * AM::channels; i++)
+        band_outs[i] = outs[i] + offset;
+    crossover.process(band_ins, band_outs, numsamples);
+    // the filters are linear, so input level can be applied to the bands
+    float level = *params[AM::param_level];
+    
     while(offset < targ) {
         // cycle through samples
         
-        // level
-        for (int c = 0; c < AM::channels; c++) {
-            in[c] = ins[c][offset] * *params[AM::param_level];
-        }
-        crossover.process(in);
-        
         for (int b = 0; b < AM::bands; b++) {
             int nbuf = 0;
             int off = b * params_per_band;
@@ -813,7 +853,7 @@ uint32_t xover_audio_module<XoverBaseClass>::process(uint32_t offset, uint32_t n
                 int ptr = b * AM::channels + c;
                 
                 // get output from crossover module if active
-                xval = *params[AM::param_active1 + off] > 0.5 ? crossover.get_value(c, b) : 0.f;
+                xval = *params[AM::param_active1 + off] > 0.5 ? outs[ptr][offset] * level : 0.f;
                 
                 // fill delay buffer
                 buffer[pos + ptr] = xval;
@@ -939,10 +979,10 @@ uint32_t vocoder_audio_module::process(uint32_t offset, uint32_t numsamples, uin
         while(offset < numsamples) {
             outs[0][offset] = ins[0][offset];
             outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 0, 0, 0, 0};
-            meters.process(values);
             ++offset;
         }
+        float values[] = {0, 0, 0, 0, 0, 0};
+        meters.process(values);
     } else {
         // process
         while(offset < numsamples) {
@@ -1104,20 +1144,20 @@ bool vocoder_audio_module::get_graph(int index, int subindex, int phase, float *
         if (solo and !*params[param_solo0 + subindex * band_params])
             context->set_source_rgba(0,0,0,0.15);
         context->set_line_width(0.99);
-        int drawn = 0;
         double fq = pow(10, fcoeff + (0.5f + (float)subindex) * 3.f / (float)bands);
+        dsp::biquad_response &r = band_response[subindex];
+        r.begin();
+        r.add(detector[0][0][subindex], order);
+        r.add_gain(*params[param_volume0 + subindex * band_params]);
+        r.get_graph(data, points, srate, 256, 0.4);
+        // label the band at its center frequency
         for (int i = 0; i < points; i++) {
             double freq = 20.0 * pow (20000.0 / 20.0, i * 1.0 / points);
-            float level = 1;
-            for (int j = 0; j < order; j++)
-                level *= detector[0][0][subindex].freq_gain(freq, srate);
-            level *= *params[param_volume0 + subindex * band_params];
-            data[i] = dB_grid(level, 256, 0.4);
-            if (!drawn and freq > fq) {
-                drawn = 1;
+            if (freq > fq) {
                 char str[32];
                 sprintf(str, "%d", subindex + 1);
                 draw_cairo_label(context, str, i, context->size_y * (1 - (data[i] + 1) / 2.f), 0, 0, 0.5);
+                break;
             }
         }
     }
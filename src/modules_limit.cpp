@@ -42,6 +42,7 @@ limiter_audio_module::limiter_audio_module()
     limit_old = -1.f;
     oversampling_old = -1;
     asc_old = true;
+    latency = 0;
 }
 
 void limiter_audio_module::activate()
@@ -49,6 +50,7 @@ void limiter_audio_module::activate()
     is_active = true;
     // set all filters and strips
     params_changed();
+    dry.reset();
     limiter.activate();
 }
 
@@ -59,9 +61,12 @@ void limiter_audio_module::deactivate()
 }
 void limiter_audio_module::set_srates()
 {
-    resampler[0].set_params(srate, *params[param_oversampling], 2);
-    resampler[1].set_params(srate, *params[param_oversampling], 2);
-    limiter.set_sample_rate(srate * *params[param_oversampling]);
+    int over = std::min((int)*params[param_oversampling], max_over);
+    resampler[0].set_params(over);
+    resampler[1].set_params(over);
+    latency = (int)(resampler[0].get_latency() + 0.5);
+    dry.set_latency(latency);
+    limiter.set_sample_rate(srate * over);
 }
 void limiter_audio_module::params_changed()
 {
@@ -84,6 +89,11 @@ void limiter_audio_module::params_changed()
 void limiter_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
+    // allocate for the highest oversampling factor, so that params_changed
+    // doesn't have to when it's switched
+    resampler[0].prepare(max_over);
+    resampler[1].prepare(max_over);
+    limiter.set_sample_rate(srate * max_over);
     int meter[] = {param_meter_inL, param_meter_inR,  param_meter_outL, param_meter_outR, -param_att};
     int clip[] = {param_clip_inL, param_clip_inR, param_clip_outL, param_clip_outR, -1};
     meters.init(params, meter, clip, 5, srate);
@@ -95,78 +105,74 @@ uint32_t limiter_audio_module::process(uint32_t offset, uint32_t numsamples, uin
     bool bypassed = bypass.update(*params[param_bypass] > 0.5f, numsamples);
     uint32_t orig_offset = offset;
     numsamples += offset;
+    dry.process(ins, orig_offset, numsamples - orig_offset);
     if(bypassed) {
-        // everything bypassed
-        while(offset < numsamples) {
-            outs[0][offset] = ins[0][offset];
-            outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 0, 0, 1};
-            meters.process(values);
-            ++offset;
-        }
+        // everything bypassed (but delayed like the processed signal)
+        memcpy(outs[0] + offset, dry.buffer[0], (numsamples - offset) * sizeof(float));
+        memcpy(outs[1] + offset, dry.buffer[1], (numsamples - offset) * sizeof(float));
+        float values[] = {0, 0, 0, 0, 1};
+        meters.process(values);
         asc_led    = 0.f;
     } else {
         asc_led   -= std::min(asc_led, numsamples);
 
         while(offset < numsamples) {
-            // cycle through samples
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
+            uint32_t len = std::min(numsamples - offset, (uint32_t)MAX_SAMPLE_RUN);
+            int over = resampler[0].get_factor();
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-            // out vars
-            float outL = inL;
-            float outR = inR;
+            for (uint32_t i = 0; i < len; i++) {
+                in_buf[0][i] = ins[0][offset + i] * *params[param_level_in];
+                in_buf[1][i] = ins[1][offset + i] * *params[param_level_in];
+            }
             
             // upsampling
-            double *samplesL = resampler[0].upsample((double)outL);
-            double *samplesR = resampler[1].upsample((double)outR);
-            
-            float tmpL;
-            float tmpR;
+            resampler[0].upsample(in_buf[0], over_buf[0], len);
+            resampler[1].upsample(in_buf[1], over_buf[1], len);
             
             // process gain reduction
             float fickdich[0];
-            for (int i = 0; i < *params[param_oversampling]; i ++) {
-                tmpL = samplesL[i];
-                tmpR = samplesR[i];
-                limiter.process(tmpL, tmpR, fickdich);
-                samplesL[i] = tmpL;
-                samplesR[i] = tmpR;
+            float att = 1.f;
+            for (uint32_t i = 0; i < len * over; i ++) {
+                limiter.process(over_buf[0][i], over_buf[1][i], fickdich);
                 if(limiter.get_asc())
                     asc_led = srate >> 3;
+                att = std::min(att, limiter.get_attenuation());
             }
             
             // downsampling
-            outL = resampler[0].downsample(samplesL);
-            outR = resampler[1].downsample(samplesR);
+            resampler[0].downsample(over_buf[0], over_buf[0], len);
+            resampler[1].downsample(over_buf[1], over_buf[1], len);
             
-            // should never be used. but hackers are paranoid by default.
-            // so we make shure NOTHING is above limit
-            outL = std::min(std::max(outL, -*params[param_limit]), *params[param_limit]);
-            outR = std::min(std::max(outR, -*params[param_limit]), *params[param_limit]);
-
-            // autolevel
-            outL /= *params[param_limit];
-            outR /= *params[param_limit];
-
-            // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
-
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
-
-            float values[] = {inL, inR, outL, outR, bypassed ? (float)1.0 : (float)limiter.get_attenuation()};
-            meters.process (values);
-
-            // next sample
-            ++offset;
-        } // cycle trough samples
-        bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
+            for (uint32_t i = 0; i < len; i++) {
+                // should never be used. but hackers are paranoid by default.
+                // so we make shure NOTHING is above limit
+                float outL = std::min(std::max(over_buf[0][i], -*params[param_limit]), *params[param_limit]);
+                float outR = std::min(std::max(over_buf[1][i], -*params[param_limit]), *params[param_limit]);
+
+                // autolevel
+                outL /= *params[param_limit];
+                outR /= *params[param_limit];
+
+                // out level
+                outL *= *params[param_level_out];
+                outR *= *params[param_level_out];
+
+                // send to output
+                outs[0][offset] = outL;
+                outs[1][offset] = outR;
+
+                // next sample
+                ++offset;
+            }
+            meters.process(0, in_buf[0], len);
+            meters.process(1, in_buf[1], len);
+            meters.process(2, outs[0] + offset - len, len);
+            meters.process(3, outs[1] + offset - len, len);
+            meters.process(4, att);
+        } // cycle trough blocks
+        dry.crossfade(bypass, outs, orig_offset, numsamples - orig_offset);
     } // process (no bypass)
+    SET_IF_CONNECTED(latency)
     meters.fall(numsamples);
     if (params[param_asc_led] != NULL) *params[param_asc_led] = asc_led;
     return outputs_mask;
@@ -183,10 +189,12 @@ multibandlimiter_audio_module::multibandlimiter_audio_module()
     over                = 1;
     buffer_size         = 0;
     overall_buffer_size = 0;
+    buffer              = NULL;
     channels            = 2;
     asc_led             = 0.f;
     attack_old          = -1.f;
     oversampling_old    = -1.f;
+    latency             = 0;
     limit_old           = -1.f;
     asc_old             = true;
     _sanitize           = false;
@@ -208,6 +216,7 @@ void multibandlimiter_audio_module::activate()
     is_active = true;
     // set all filters and strips
     params_changed();
+    dry.reset();
     // activate all strips
     for (int j = 0; j < strips; j ++) {
         strip[j].activate();
@@ -295,6 +304,16 @@ void multibandlimiter_audio_module::params_changed()
 void multibandlimiter_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
+    // allocate for the highest oversampling factor, so that params_changed
+    // doesn't have to when it's switched
+    broadband.set_sample_rate(srate * max_over);
+    for (int j = 0; j < strips; j ++) {
+        strip[j].set_sample_rate(srate * max_over);
+        resampler[j][0].prepare(max_over);
+        resampler[j][1].prepare(max_over);
+    }
+    free(buffer);
+    buffer = (float*) calloc((int)(srate * (100.f / 1000.f) * channels * max_over) + channels, sizeof(float));
     set_srates();
     int meter[] = {param_meter_inL, param_meter_inR,  param_meter_outL, param_meter_outR, -param_att0, -param_att1, -param_att2, -param_att3};
     int clip[] = {param_clip_inL, param_clip_inR, param_clip_outL, param_clip_outR, -1, -1, -1, -1};
@@ -307,12 +326,14 @@ void multibandlimiter_audio_module::set_srates()
     crossover.set_sample_rate(srate);
     for (int j = 0; j < strips; j ++) {
         strip[j].set_sample_rate(srate * over);
-        resampler[j][0].set_params(srate, over, 2);
-        resampler[j][1].set_params(srate, over, 2);
+        resampler[j][0].set_params(std::min((int)over, max_over));
+        resampler[j][1].set_params(std::min((int)over, max_over));
     }
-    // rebuild buffer
+    latency = (int)(resampler[0][0].get_latency() + 0.5);
+    dry.set_latency(latency);
+    // rebuild buffer (allocated in set_sample_rate)
     overall_buffer_size = (int)(srate * (100.f / 1000.f) * channels * over) + channels; // buffer size max attack rate
-    buffer = (float*) calloc(overall_buffer_size, sizeof(float));
+    memset(buffer, 0, overall_buffer_size * sizeof(float));
     pos = 0;
 }
 
@@ -331,65 +352,56 @@ uint32_t multibandlimiter_audio_module::process(uint32_t offset, uint32_t numsam
     uint32_t orig_offset = offset;
     numsamples += offset;
     float batt = 0.f;
+    dry.process(ins, orig_offset, numsamples - orig_offset);
     if(bypassed) {
-        // everything bypassed
-        while(offset < numsamples) {
-            outs[0][offset] = ins[0][offset];
-            outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 0, 0, 1, 1, 1, 1};
-            meters.process(values);
-            ++offset;
-        }
+        // everything bypassed (but delayed like the processed signal)
+        memcpy(outs[0] + offset, dry.buffer[0], (numsamples - offset) * sizeof(float));
+        memcpy(outs[1] + offset, dry.buffer[1], (numsamples - offset) * sizeof(float));
+        float values[] = {0, 0, 0, 0, 1, 1, 1, 1};
+        meters.process(values);
         asc_led    = 0.f;
     } else {
         // process all strips
         asc_led     -= std::min(asc_led, numsamples);
+        float limit = *params[param_limit];
+        float level_in = *params[param_level_in];
+        float level_out = *params[param_level_out];
+        const float *xin[] = {in_buf[0], in_buf[1]};
+        float *xout[strips * 2];
+        for (int j = 0; j < strips * 2; j++)
+            xout[j] = band_buf[j];
         while(offset < numsamples) {
-            float inL  = 0.f; // input
-            float inR  = 0.f;
-            float outL = 0.f; // final output
-            float outR = 0.f;
-            float tmpL = 0.f; // used for temporary purposes
-            float tmpR = 0.f;
-            double overL[strips * 16];
-            double overR[strips * 16];
-            double resL[16];
-            double resR[16];
-            
-            bool asc_active = false;
-            
-            // cycle through samples
-            if(!_sanitize) {
-                inL = ins[0][offset];
-                inR = ins[1][offset];
-            }
+            // while the multiband buffer is being sanitized, the input is ignored;
+            // it's only a few milliseconds, so go sample by sample until it's done
+            uint32_t len = _sanitize ? 1 : std::min(numsamples - offset, (uint32_t)MAX_SAMPLE_RUN);
+            float *outsL = outs[0] + offset;
+            float *outsR = outs[1] + offset;
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
+            for (uint32_t i = 0; i < len; i++) {
+                in_buf[0][i] = _sanitize ? 0.f : ins[0][offset + i] * level_in;
+                in_buf[1][i] = _sanitize ? 0.f : ins[1][offset + i] * level_in;
+            }
+            // split the block into bands
+            crossover.process(xin, xout, len);
             
-            //if(!(cnt%50)) printf("i: %.5f\n", inL);
+            // strongest attenuation of each strip within the block, for the meters
+            float att[strips];
+            for (int i = 0; i < strips; i++)
+                att[i] = 1.f;
             
-            // process crossover
-            float xin[] = {inL, inR};
-            crossover.process(xin);
+            // upsample the bands
+            int over = resampler[0][0].get_factor();
+            for (int j = 0; j < strips * 2; j++)
+                resampler[j / 2][j & 1].upsample(band_buf[j], over_buf[j], len);
             
-            // cycle over strips
-            for (int i = 0; i < strips; i++) {
-                // upsample
-                double *samplesL = resampler[i][0].upsample((double)crossover.get_value(0, i));
-                double *samplesR = resampler[i][1].upsample((double)crossover.get_value(1, i));
-                // copy to cache
-                memcpy(&overL[i * 16], samplesL, sizeof(double) * over);
-                memcpy(&overR[i * 16], samplesR, sizeof(double) * over);
-                //if(!(cnt%200)) printf("u0: %.5f\n", overL[i*16]);
-            }
+            bool asc_active = false;
             
             // cycle over upsampled samples
-            for (int o = 0; o < over; o++) {
-                tmpL = 0.f;
-                tmpR = 0.f;
-                resL[o] = 0;
-                resR[o] = 0;
+            for (uint32_t o = 0; o < len * over; o++) {
+                float tmpL = 0.f; // used for temporary purposes
+                float tmpR = 0.f;
+                float resL = 0.f;
+                float resR = 0.f;
                 
                 // cycle over strips for multiband coefficient
                 
@@ -418,16 +430,16 @@ uint32_t multibandlimiter_audio_module::process(uint32_t offset, uint32_t numsam
                 //
                 // -------------------------------------------
                 
-                
                 for (int i = 0; i < strips; i++) {
                     // sum up for multiband coefficient
-                    int p = i * 16 + o;
-                    tmpL += ((fabs(overL[p]) > *params[param_limit]) ? *params[param_limit] * (fabs(overL[p]) / overL[p]) : overL[p]) * weight[i];
-                    tmpR += ((fabs(overR[p]) > *params[param_limit]) ? *params[param_limit] * (fabs(overR[p]) / overR[p]) : overR[p]) * weight[i];
+                    float sL = over_buf[i * 2][o];
+                    float sR = over_buf[i * 2 + 1][o];
+                    tmpL += ((fabs(sL) > limit) ? limit * (fabs(sL) / sL) : sL) * weight[i];
+                    tmpR += ((fabs(sR) > limit) ? limit * (fabs(sR) / sR) : sR) * weight[i];
                 }
                 
                 // write multiband coefficient to buffer
-                buffer[pos] = std::min(*params[param_limit] / std::max(fabs(tmpL), fabs(tmpR)), 1.0);
+                buffer[pos] = std::min(limit / std::max(fabs(tmpL), fabs(tmpR)), 1.0);
                 
                 // step forward in multiband buffer
                 pos = (pos + channels) % buffer_size;
@@ -435,18 +447,14 @@ uint32_t multibandlimiter_audio_module::process(uint32_t offset, uint32_t numsam
                 
                 // limit and add up strips
                 for (int i = 0; i < strips; i++) {
-                    int p = i * 16 + o;
-                    //if(!(cnt%200) and !o) printf("u1: %.5f\n", overL[p]);
                     // limit
-                    tmpL = (float)overL[p];
-                    tmpR = (float)overR[p];
-                    //if(!(cnt%200)) printf("1: %.5f\n", tmpL);
+                    tmpL = over_buf[i * 2][o];
+                    tmpR = over_buf[i * 2 + 1][o];
                     strip[i].process(tmpL, tmpR, buffer);
-                    //if(!(cnt%200)) printf("2: %.5f\n\n", tmpL);
                     if (solo[i] || no_solo) {
                         // add
-                        resL[o] += (double)tmpL;
-                        resR[o] += (double)tmpR;
+                        resL += tmpL;
+                        resR += tmpR;
                         // flash the asc led?
                         asc_active = asc_active || strip[i].get_asc();
                     }
@@ -454,101 +462,58 @@ uint32_t multibandlimiter_audio_module::process(uint32_t offset, uint32_t numsam
                 
                 // process broadband limiter
                 float fickdich[0];
-                tmpL = resL[o];
-                tmpR = resR[o];
-                broadband.process(tmpL, tmpR, fickdich);
-                resL[o] = (double)tmpL;
-                resR[o] = (double)tmpR;
+                broadband.process(resL, resR, fickdich);
+                res_buf[0][o] = resL;
+                res_buf[1][o] = resR;
                 asc_active = asc_active || broadband.get_asc();
+                
+                batt = broadband.get_attenuation();
+                for (int i = 0; i < strips; i++)
+                    att[i] = std::min(att[i], strip[i].get_attenuation() * batt);
             }
             
-            // downsampling
-            outL = (float)resampler[0][0].downsample(resL);
-            outR = (float)resampler[0][1].downsample(resR);
-            
-            //if(!(cnt%50)) printf("o: %.5f %.5f\n\n", outL, resL[0]);
-            
-            // should never be used. but hackers are paranoid by default.
-            // so we make shure NOTHING is above limit
-            outL = std::min(std::max(outL, -*params[param_limit]), *params[param_limit]);
-            outR = std::min(std::max(outR, -*params[param_limit]), *params[param_limit]);
+            // downsampling (the first strip's resamplers only do the upsampling otherwise)
+            resampler[0][0].downsample(res_buf[0], res_buf[0], len);
+            resampler[0][1].downsample(res_buf[1], res_buf[1], len);
             
             // light led
             if(asc_active)  {
                 asc_led = srate >> 3;
             }
             
-            // autolevel
-            outL /= *params[param_limit];
-            outR /= *params[param_limit];
-
-            // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
+            for (uint32_t n = 0; n < len; n++) {
+                // should never be used. but hackers are paranoid by default.
+                // so we make shure NOTHING is above limit
+                float outL = std::min(std::max(res_buf[0][n], -limit), limit);
+                float outR = std::min(std::max(res_buf[1][n], -limit), limit);
+                
+                // autolevel
+                outL /= limit;
+                outR /= limit;
 
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+                // out level
+                outL *= level_out;
+                outR *= level_out;
 
-            // next sample
-            ++offset;
-            
-            batt = broadband.get_attenuation();
-            
-            float values[] = {inL, inR, outL, outR,
-                bypassed ? (float)1.0 : (float)strip[0].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[1].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[2].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[3].get_attenuation() * batt};
-            meters.process(values);
-            
-            
-            
-            //for (int i = 0; i < strips; i++) {
-                //left  = crossover.get_value(0, i);
-                //right = crossover.get_value(1, i);
+                // send to output
+                outsL[n] = outL;
+                outsR[n] = outR;
                 
-                //// remember filtered values for limiting
-                //// (we need multiband_coeff before we can call the limiter bands)
-                //_tmpL[i] = left;
-                //_tmpR[i] = right;
-
-                //// sum up for multiband coefficient
-                //sum_left += ((fabs(left) > *params[param_limit]) ? *params[param_limit] * (fabs(left) / left) : left) * weight[i];
-                //sum_right += ((fabs(right) > *params[param_limit]) ? *params[param_limit] * (fabs(right) / right) : right) * weight[i];
-            //} // process single strip with filter
-
-            //// write multiband coefficient to buffer
-            //buffer[pos] = std::min(*params[param_limit] / std::max(fabs(sum_left), fabs(sum_right)), 1.0);
-
-            //for (int i = 0; i < strips; i++) {
-                //// process gain reduction
-                //strip[i].process(_tmpL[i], _tmpR[i], buffer);
-                //// sum up output of limiters
-                //if (solo[i] || no_solo) {
-                    //outL += _tmpL[i];
-                    //outR += _tmpR[i];
-                //}
-                //asc_active = asc_active || strip[i].get_asc();
-            //} // process single strip again for limiter
-            //float fickdich[0];
-            //broadband.process(outL, outR, fickdich);
-            //asc_active = asc_active || broadband.get_asc();
-            
-            //// should never be used. but hackers are paranoid by default.
-            //// so we make shure NOTHING is above limit
-            //outL = std::max(outL, -*params[param_limit]);
-            //outL = std::min(outL, *params[param_limit]);
-            //outR = std::max(outR, -*params[param_limit]);
-            //outR = std::min(outR, *params[param_limit]);
-            
-            //if(asc_active)  {
-                //asc_led = srate >> 3;
-            //}
-            cnt++;
-        } // cycle trough samples
-        bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
+                cnt++;
+            } // cycle trough samples
+            
+            // in/out meters see every sample, strip meters are updated once per block
+            meters.process(0, in_buf[0], len);
+            meters.process(1, in_buf[1], len);
+            meters.process(2, outsL, len);
+            meters.process(3, outsR, len);
+            for (int i = 0; i < strips; i++)
+                meters.process(4 + i, att[i]);
+            offset += len;
+        } // cycle trough blocks
+        dry.crossfade(bypass, outs, orig_offset, numsamples - orig_offset);
     } // process (no bypass)
+    SET_IF_CONNECTED(latency)
     if (params[param_asc_led] != NULL) *params[param_asc_led] = asc_led;
     meters.fall(numsamples);
     return outputs_mask;
@@ -574,10 +539,12 @@ sidechainlimiter_audio_module::sidechainlimiter_audio_module()
     over                = 1;
     buffer_size         = 0;
     overall_buffer_size = 0;
+    buffer              = NULL;
     channels            = 2;
     asc_led             = 0.f;
     attack_old          = -1.f;
     oversampling_old    = -1.f;
+    latency             = 0;
     limit_old           = -1.f;
     asc_old             = true;
     _sanitize           = false;
@@ -599,6 +566,7 @@ void sidechainlimiter_audio_module::activate()
     is_active = true;
     // set all filters and strips
     params_changed();
+    dry.reset();
     // activate all strips
     for (int j = 0; j < strips; j ++) {
         strip[j].activate();
@@ -689,6 +657,16 @@ void sidechainlimiter_audio_module::params_changed()
 void sidechainlimiter_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
+    // allocate for the highest oversampling factor, so that params_changed
+    // doesn't have to when it's switched
+    broadband.set_sample_rate(srate * max_over);
+    for (int j = 0; j < strips; j ++) {
+        strip[j].set_sample_rate(srate * max_over);
+        resampler[j][0].prepare(max_over);
+        resampler[j][1].prepare(max_over);
+    }
+    free(buffer);
+    buffer = (float*) calloc((int)(srate * (100.f / 1000.f) * channels * max_over) + channels, sizeof(float));
     set_srates();
     int meter[] = {param_meter_inL, param_meter_inR, param_meter_scL, param_meter_scR, param_meter_outL, param_meter_outR, -param_att0, -param_att1, -param_att2, -param_att3, -param_att_sc};
     int clip[] = {param_clip_inL, param_clip_inR, -1, -1, param_clip_outL, param_clip_outR, -1, -1, -1, -1, -1};
@@ -701,12 +679,14 @@ void sidechainlimiter_audio_module::set_srates()
     crossover.set_sample_rate(srate);
     for (int j = 0; j < strips; j ++) {
         strip[j].set_sample_rate(srate * over);
-        resampler[j][0].set_params(srate, over, 2);
-        resampler[j][1].set_params(srate, over, 2);
+        resampler[j][0].set_params(std::min((int)over, max_over));
+        resampler[j][1].set_params(std::min((int)over, max_over));
     }
-    // rebuild buffer
+    latency = (int)(resampler[0][0].get_latency() + 0.5);
+    dry.set_latency(latency);
+    // rebuild buffer (allocated in set_sample_rate)
     overall_buffer_size = (int)(srate * (100.f / 1000.f) * channels * over) + channels; // buffer size max attack rate
-    buffer = (float*) calloc(overall_buffer_size, sizeof(float));
+    memset(buffer, 0, overall_buffer_size * sizeof(float));
     pos = 0;
 }
 
@@ -725,90 +705,71 @@ uint32_t sidechainlimiter_audio_module::process(uint32_t offset, uint32_t numsam
     uint32_t orig_offset = offset;
     numsamples += offset;
     float batt = 0.f;
+    dry.process(ins, orig_offset, numsamples - orig_offset);
     if(bypassed) {
-        // everything bypassed
-        while(offset < numsamples) {
-            outs[0][offset] = ins[0][offset];
-            outs[1][offset] = ins[1][offset];
-            float values[] = {0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1};
-            meters.process(values);
-            ++offset;
-        }
+        // everything bypassed (but delayed like the processed signal)
+        memcpy(outs[0] + offset, dry.buffer[0], (numsamples - offset) * sizeof(float));
+        memcpy(outs[1] + offset, dry.buffer[1], (numsamples - offset) * sizeof(float));
+        float values[] = {0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1};
+        meters.process(values);
         asc_led    = 0.f;
     } else {
         // process all strips
         asc_led     -= std::min(asc_led, numsamples);
+        float limit = *params[param_limit];
+        float level_in = *params[param_level_in];
+        float level_sc = *params[param_level_sc];
+        float level_out = *params[param_level_out];
+        const float *xin[] = {in_buf[0], in_buf[1]};
+        float *xout[(strips - 1) * 2];
+        for (int j = 0; j < (strips - 1) * 2; j++)
+            xout[j] = band_buf[j];
         while(offset < numsamples) {
-            float inL  = 0.f; // input
-            float inR  = 0.f;
-            float scL  = 0.f;
-            float scR  = 0.f;
-            float outL = 0.f; // final output
-            float outR = 0.f;
-            float tmpL = 0.f; // used for temporary purposes
-            float tmpR = 0.f;
-            double overL[strips * 16];
-            double overR[strips * 16];
-            double resL[16];
-            double resR[16];
-            
-            bool asc_active = false;
-            
-            // cycle through samples
-            if(!_sanitize) {
-                inL = ins[0][offset];
-                inR = ins[1][offset];
-                scL = ins[2][offset];
-                scR = ins[3][offset];
+            // while the multiband buffer is being sanitized, the input is ignored;
+            // it's only a few milliseconds, so go sample by sample until it's done
+            uint32_t len = _sanitize ? 1 : std::min(numsamples - offset, (uint32_t)MAX_SAMPLE_RUN);
+            float *outsL = outs[0] + offset;
+            float *outsR = outs[1] + offset;
+            // in level; the last strip is fed by the sidechain input
+            for (uint32_t i = 0; i < len; i++) {
+                in_buf[0][i] = _sanitize ? 0.f : ins[0][offset + i] * level_in;
+                in_buf[1][i] = _sanitize ? 0.f : ins[1][offset + i] * level_in;
+                band_buf[(strips - 1) * 2][i] = _sanitize ? 0.f : ins[2][offset + i] * level_sc;
+                band_buf[(strips - 1) * 2 + 1][i] = _sanitize ? 0.f : ins[3][offset + i] * level_sc;
             }
+            // split the block into bands
+            crossover.process(xin, xout, len);
             
-            // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-            
-            scR *= *params[param_level_sc];
-            scL *= *params[param_level_sc];
+            // strongest attenuation of each strip within the block, for the meters
+            float att[strips];
+            for (int i = 0; i < strips; i++)
+                att[i] = 1.f;
             
-            //if(!(cnt%50)) printf("i: %.5f\n", inL);
+            // upsample the bands
+            int over = resampler[0][0].get_factor();
+            for (int j = 0; j < strips * 2; j++)
+                resampler[j / 2][j & 1].upsample(band_buf[j], over_buf[j], len);
             
-            // process crossover
-            float xin[] = {inL, inR};
-            crossover.process(xin);
-            
-            // cycle over strips
-            for (int i = 0; i < strips; i++) {
-                double *samplesR, *samplesL;
-                // upsample
-                if (i < strips - 1) {
-                    samplesL = resampler[i][0].upsample((double)crossover.get_value(0, i));
-                    samplesR = resampler[i][1].upsample((double)crossover.get_value(1, i));
-                } else {
-                    samplesL = resampler[i][0].upsample((double)scL);
-                    samplesR = resampler[i][1].upsample((double)scR);
-                }
-                // copy to cache
-                memcpy(&overL[i * 16], samplesL, sizeof(double) * over);
-                memcpy(&overR[i * 16], samplesR, sizeof(double) * over);
-                //if(!(cnt%200)) printf("u0: %.5f\n", overL[i*16]);
-            }
+            bool asc_active = false;
             
             // cycle over upsampled samples
-            for (int o = 0; o < over; o++) {
-                tmpL = 0.f;
-                tmpR = 0.f;
-                resL[o] = 0;
-                resR[o] = 0;
+            for (uint32_t o = 0; o < len * over; o++) {
+                float tmpL = 0.f; // used for temporary purposes
+                float tmpR = 0.f;
+                float resL = 0.f;
+                float resR = 0.f;
                 
                 // cycle over strips for multiband coefficient
                 for (int i = 0; i < strips; i++) {
                     // sum up for multiband coefficient
-                    int p = i * 16 + o;
-                    tmpL += ((fabs(overL[p]) > *params[param_limit]) ? *params[param_limit] * (fabs(overL[p]) / overL[p]) : overL[p]) * weight[i];
-                    tmpR += ((fabs(overR[p]) > *params[param_limit]) ? *params[param_limit] * (fabs(overR[p]) / overR[p]) : overR[p]) * weight[i];
+                    float sL = over_buf[i * 2][o];
+                    float sR = over_buf[i * 2 + 1][o];
+                    tmpL += ((fabs(sL) > limit) ? limit * (fabs(sL) / sL) : sL) * weight[i];
+                    tmpR += ((fabs(sR) > limit) ? limit * (fabs(sR) / sR) : sR) * weight[i];
                 }
                 
                 // write multiband coefficient to buffer
-                buffer[pos] = std::min(*params[param_limit] / std::max(fabs(tmpL), fabs(tmpR)), 1.0);
+                buffer[pos] = std::min(limit / std::max(fabs(tmpL), fabs(tmpR)), 1.0);
                 
                 // step forward in multiband buffer
                 pos = (pos + channels) % buffer_size;
@@ -816,18 +777,14 @@ uint32_t sidechainlimiter_audio_module::process(uint32_t offset, uint32_t numsam
                 
                 // limit and add up strips
                 for (int i = 0; i < strips; i++) {
-                    int p = i * 16 + o;
-                    //if(!(cnt%200) and !o) printf("u1: %.5f\n", overL[p]);
                     // limit
-                    tmpL = (float)overL[p];
-                    tmpR = (float)overR[p];
-                    //if(!(cnt%200)) printf("1: %.5f\n", tmpL);
+                    tmpL = over_buf[i * 2][o];
+                    tmpR = over_buf[i * 2 + 1][o];
                     strip[i].process(tmpL, tmpR, buffer);
-                    //if(!(cnt%200)) printf("2: %.5f\n\n", tmpL);
                     if (solo[i] || no_solo) {
                         // add
-                        resL[o] += (double)tmpL;
-                        resR[o] += (double)tmpR;
+                        resL += tmpL;
+                        resR += tmpR;
                         // flash the asc led?
                         asc_active = asc_active || strip[i].get_asc();
                     }
@@ -835,59 +792,60 @@ uint32_t sidechainlimiter_audio_module::process(uint32_t offset, uint32_t numsam
                 
                 // process broadband limiter
                 float fickdich[0];
-                tmpL = resL[o];
-                tmpR = resR[o];
-                broadband.process(tmpL, tmpR, fickdich);
-                resL[o] = (double)tmpL;
-                resR[o] = (double)tmpR;
+                broadband.process(resL, resR, fickdich);
+                res_buf[0][o] = resL;
+                res_buf[1][o] = resR;
                 asc_active = asc_active || broadband.get_asc();
+                
+                batt = broadband.get_attenuation();
+                for (int i = 0; i < strips; i++)
+                    att[i] = std::min(att[i], strip[i].get_attenuation() * batt);
             }
             
-            // downsampling
-            outL = (float)resampler[0][0].downsample(resL);
-            outR = (float)resampler[0][1].downsample(resR);
-            
-            //if(!(cnt%50)) printf("o: %.5f %.5f\n\n", outL, resL[0]);
-            
-            // should never be used. but hackers are paranoid by default.
-            // so we make shure NOTHING is above limit
-            outL = std::min(std::max(outL, -*params[param_limit]), *params[param_limit]);
-            outR = std::min(std::max(outR, -*params[param_limit]), *params[param_limit]);
+            // downsampling (the first strip's resamplers only do the upsampling otherwise)
+            resampler[0][0].downsample(res_buf[0], res_buf[0], len);
+            resampler[0][1].downsample(res_buf[1], res_buf[1], len);
             
             // light led
             if(asc_active)  {
                 asc_led = srate >> 3;
             }
             
-            // autolevel
-            outL /= *params[param_limit];
-            outR /= *params[param_limit];
-
-            // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
+            for (uint32_t n = 0; n < len; n++) {
+                // should never be used. but hackers are paranoid by default.
+                // so we make shure NOTHING is above limit
+                float outL = std::min(std::max(res_buf[0][n], -limit), limit);
+                float outR = std::min(std::max(res_buf[1][n], -limit), limit);
+                
+                // autolevel
+                outL /= limit;
+                outR /= limit;
 
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+                // out level
+                outL *= level_out;
+                outR *= level_out;
 
-            // next sample
-            ++offset;
-            
-            batt = broadband.get_attenuation();
-            
-            float values[] = {inL, inR, scL, scR, outL, outR,
-                bypassed ? (float)1.0 : (float)strip[0].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[1].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[2].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[3].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[4].get_attenuation() * batt};
-            meters.process(values);
-            
-            cnt++;
-        } // cycle trough samples
-        bypass.crossfade(ins, outs, 2, orig_offset, numsamples);
+                // send to output
+                outsL[n] = outL;
+                outsR[n] = outR;
+                
+                cnt++;
+            } // cycle trough samples
+            
+            // in/out meters see every sample, strip meters are updated once per block
+            meters.process(0, in_buf[0], len);
+            meters.process(1, in_buf[1], len);
+            meters.process(2, band_buf[(strips - 1) * 2], len);
+            meters.process(3, band_buf[(strips - 1) * 2 + 1], len);
+            meters.process(4, outsL, len);
+            meters.process(5, outsR, len);
+            for (int i = 0; i < strips; i++)
+                meters.process(6 + i, att[i]);
+            offset += len;
+        } // cycle trough blocks
+        dry.crossfade(bypass, outs, orig_offset, numsamples - orig_offset);
     } // process (no bypass)
+    SET_IF_CONNECTED(latency)
     if (params[param_asc_led] != NULL) *params[param_asc_led] = asc_led;
     meters.fall(numsamples);
     return outputs_mask;
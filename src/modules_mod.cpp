@@ -41,6 +41,11 @@ void flanger_audio_module::activate() {
     is_active = true;
 }
 
+int flanger_audio_module::get_tail_length() const
+{
+    return feedback_tail_length((*params[par_delay] + *params[par_depth]) * srate / 1000.0, *params[par_fb]);
+}
+
 void flanger_audio_module::set_sample_rate(uint32_t sr) {
     srate = sr;
     left.setup(sr);
@@ -123,6 +128,12 @@ phaser_audio_module::phaser_audio_module()
     is_active = false;
 }
 
+int phaser_audio_module::get_tail_length() const
+{
+    // group delay of the allpass stages, estimated at the lowest frequency they can be swept to
+    return feedback_tail_length(*params[par_stages] * srate / (M_PI * 20.0), *params[par_fb]);
+}
+
 void phaser_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
@@ -354,41 +365,63 @@ uint32_t rotary_speaker_audio_module::process(uint32_t offset, uint32_t nsamples
     float mix2 = *params[par_reflection];
     float mix3 = mix2 * mix2;
     double am_depth = *params[par_am_depth];
-    for (unsigned int i = 0; i < nsamples; i++) {
-        float in_l = ins[0][i + offset], in_r = ins[1][i + offset];
-        double in_mono = atan(0.5f * (in_l + in_r));
+    // rotor positions are calculated for a block of samples, the 8 taps needed by each sample are read at once
+    enum { BlockSize = 64 };
+    int xl[BlockSize], yl[BlockSize], xh[BlockSize], yh[BlockSize];
+    for (uint32_t block = 0; block < nsamples; block += BlockSize) {
+        uint32_t len = std::min(nsamples - block, (uint32_t)BlockSize);
+        for (unsigned int i = 0; i < len; i++) {
+            uint32_t pl = phase_l + i * dphase_l, ph = phase_h + i * dphase_h;
+            xl[i] = pseudo_sine_scl(pl), yl[i] = pseudo_sine_scl(pl + 0x40000000);
+            xh[i] = pseudo_sine_scl(ph), yh[i] = pseudo_sine_scl(ph + 0x40000000);
+        }
+        phase_l += len * dphase_l;
+        phase_h += len * dphase_h;
+        meter_l = xl[len - 1];
+        meter_h = xh[len - 1];
+        for (unsigned int i = 0; i < len; i++) {
+            float in_l = ins[0][block + i + offset], in_r = ins[1][block + i + offset];
+            double in_mono = atan(0.5f * (in_l + in_r));
         
-        int xl = pseudo_sine_scl(phase_l), yl = pseudo_sine_scl(phase_l + 0x40000000);
-        int xh = pseudo_sine_scl(phase_h), yh = pseudo_sine_scl(phase_h + 0x40000000);
-        // printf("%d %d %d\n", shift, pdelta, shift + pdelta + 20 * xl);
-        meter_l = xl;
-        meter_h = xh;
-        // float out_hi_l = in_mono - delay.get_interp_1616(shift + md * xh) + delay.get_interp_1616(shift + md * 65536 + pdelta - md * yh) - delay.get_interp_1616(shift + md * 65536 + pdelta + pdelta - md * xh);
-        // float out_hi_r = in_mono + delay.get_interp_1616(shift + md * 65536 - md * yh) - delay.get_interp_1616(shift + pdelta + md * xh) + delay.get_interp_1616(shift + pdelta + pdelta + md * yh);
-        float fm_hi_l = delay.get_interp_1616(shift + md * xh) - mix2 * delay.get_interp_1616(shift + md * 65536 + pdelta - md * yh) + mix3 * delay.get_interp_1616(shift + md * 65536 + pdelta + pdelta - md * xh);
-        float fm_hi_r = delay.get_interp_1616(shift + md * 65536 - md * yh) - mix2 * delay.get_interp_1616(shift + pdelta + md * xh) + mix3 * delay.get_interp_1616(shift + pdelta + pdelta + md * yh);
-        float out_hi_l = lerp(in_mono, (double)damper1l.process(fm_hi_l), lerp(0.5, xh * 1.0 / 65536.0, am_depth));
-        float out_hi_r = lerp(in_mono, (double)damper1r.process(fm_hi_r), lerp(0.5, yh * 1.0 / 65536.0, am_depth));
-
-        float out_lo_l = lerp(in_mono, (double)delay.get_interp_1616(shift + (md * xl >> 2)), lerp(0.5, yl * 1.0 / 65536.0, am_depth)); // + delay.get_interp_1616(shift + md * 65536 + pdelta - md * yl);
-        float out_lo_r = lerp(in_mono, (double)delay.get_interp_1616(shift + (md * yl >> 2)), lerp(0.5, xl * 1.0 / 65536.0, am_depth)); // + delay.get_interp_1616(shift + md * 65536 + pdelta - md * yl);
+            // printf("%d %d %d\n", shift, pdelta, shift + pdelta + 20 * xl[i]);
+            // float out_hi_l = in_mono - delay.get_interp_1616(shift + md * xh) + delay.get_interp_1616(shift + md * 65536 + pdelta - md * yh) - delay.get_interp_1616(shift + md * 65536 + pdelta + pdelta - md * xh);
+            // float out_hi_r = in_mono + delay.get_interp_1616(shift + md * 65536 - md * yh) - delay.get_interp_1616(shift + pdelta + md * xh) + delay.get_interp_1616(shift + pdelta + pdelta + md * yh);
+            // same as delay.get_interp_1616 on each of these
+            int taps[8] = {
+                shift + md * xh[i], shift + md * 65536 + pdelta - md * yh[i], shift + md * 65536 + pdelta + pdelta - md * xh[i],
+                shift + md * 65536 - md * yh[i], shift + pdelta + md * xh[i], shift + pdelta + pdelta + md * yh[i],
+                shift + (md * xl[i] >> 2), shift + (md * yl[i] >> 2)
+            };
+            int pos[8];
+            float frac[8], tap[8];
+            for (int t = 0; t < 8; t++) {
+                pos[t] = (delay.pos + 1024 - (int)((unsigned int)taps[t] >> 16)) & 1023;
+                frac[t] = (float)((taps[t] & 0xFFFF) * (1.0 / 65536.0));
+            }
+            dsp::gather_interp(&delay.data[0], 1023, pos, frac, tap, 8, false);
+            float fm_hi_l = tap[0] - mix2 * tap[1] + mix3 * tap[2];
+            float fm_hi_r = tap[3] - mix2 * tap[4] + mix3 * tap[5];
+            float out_hi_l = lerp(in_mono, (double)damper1l.process(fm_hi_l), lerp(0.5, xh[i] * 1.0 / 65536.0, am_depth));
+            float out_hi_r = lerp(in_mono, (double)damper1r.process(fm_hi_r), lerp(0.5, yh[i] * 1.0 / 65536.0, am_depth));
+
+            float out_lo_l = lerp(in_mono, (double)tap[6], lerp(0.5, yl[i] * 1.0 / 65536.0, am_depth)); // + delay.get_interp_1616(shift + md * 65536 + pdelta - md * yl);
+            float out_lo_r = lerp(in_mono, (double)tap[7], lerp(0.5, xl[i] * 1.0 / 65536.0, am_depth)); // + delay.get_interp_1616(shift + md * 65536 + pdelta - md * yl);
         
-        out_hi_l = crossover2l.process(out_hi_l); // sanitize(out_hi_l);
-        out_hi_r = crossover2r.process(out_hi_r); // sanitize(out_hi_r);
-        out_lo_l = crossover1l.process(out_lo_l); // sanitize(out_lo_l);
-        out_lo_r = crossover1r.process(out_lo_r); // sanitize(out_lo_r);
+            out_hi_l = crossover2l.process(out_hi_l); // sanitize(out_hi_l);
+            out_hi_r = crossover2r.process(out_hi_r); // sanitize(out_hi_r);
+            out_lo_l = crossover1l.process(out_lo_l); // sanitize(out_lo_l);
+            out_lo_r = crossover1r.process(out_lo_r); // sanitize(out_lo_r);
         
-        float out_l = out_hi_l + out_lo_l;
-        float out_r = out_hi_r + out_lo_r;
+            float out_l = out_hi_l + out_lo_l;
+            float out_r = out_hi_r + out_lo_r;
         
-        float mic_l = out_l + mix * (out_r - out_l);
-        float mic_r = out_r + mix * (out_l - out_r);
+            float mic_l = out_l + mix * (out_r - out_l);
+            float mic_r = out_r + mix * (out_l - out_r);
         
-        outs[0][i + offset] = mic_l;
-        outs[1][i + offset] = mic_r;
-        delay.put(in_mono);
-        phase_l += dphase_l;
-        phase_h += dphase_h;
+            outs[0][block + i + offset] = mic_l;
+            outs[1][block + i + offset] = mic_r;
+            delay.put(in_mono);
+        }
     }
     crossover1l.sanitize();
     crossover1r.sanitize();
@@ -439,6 +472,15 @@ void multichorus_audio_module::deactivate()
     is_active = false;
 }
 
+int multichorus_audio_module::get_tail_length() const
+{
+    // longest delay plus the ringing of the post filters (time to decay by 144 dB is about
+    // 16.6 time constants, the time constant of a resonant bandpass is Q / (pi * f))
+    float freq = std::max(20.f, std::min(*params[par_freq], *params[par_freq2]));
+    double ringing = 16.6 * *params[par_q] / (M_PI * freq);
+    return (int)((*params[par_delay] + *params[par_depth]) * srate / 1000.0 + ringing * srate) + 1;
+}
+
 void multichorus_audio_module::set_sample_rate(uint32_t sr) {
     srate = sr;
     last_r_phase = -1;
@@ -20,6 +20,10 @@
  */
 #include <calf/giface.h>
 #include <calf/modules_synths.h>
+#include <calf/wavecache.h>
+
+/// Increase when the generated waveforms change
+#define MONOSYNTH_TABLES_VERSION 1
 
 using namespace dsp;
 using namespace calf_plugins;
@@ -85,6 +89,22 @@ void monosynth_audio_module::precalculate_waves(progress_report_iface *reporter)
     static waveform_family<MONOSYNTH_WAVE_BITS> waves_data[wave_count];
     waves = waves_data;
     
+    static wavetable_cache cache("monosynth", WAVETABLE_CACHE_BUILD_ID, MONOSYNTH_TABLES_VERSION);
+    if (cache.load())
+    {
+        bool ok = true;
+        for (int i = 0; ok && i < wave_count; i++)
+            ok = cache.read(waves[i]);
+        if (ok)
+        {
+            if (reporter)
+                reporter->report_progress(100, "");
+            return;
+        }
+        for (int i = 0; i < wave_count; i++)
+            waves[i].release();
+    }
+    
     enum { S = 1 << MONOSYNTH_WAVE_BITS, HS = S / 2, QS = S / 4, QS3 = 3 * QS };
     float iQS = 1.0 / QS;
     
@@ -199,6 +219,13 @@ void monosynth_audio_module::precalculate_waves(progress_report_iface *reporter)
     }
     normalize_waveform(data, S);
     waves[wave_test8].make(bl, data);
+    
+    if (cache.create())
+    {
+        for (int i = 0; i < wave_count; i++)
+            cache.write(waves[i]);
+        cache.commit();
+    }
     if (reporter)
         reporter->report_progress(100, "");
     
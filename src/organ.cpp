@@ -22,8 +22,16 @@
 
 #include <calf/giface.h>
 #include <calf/organ.h>
+#include <calf/wavecache.h>
 #include <iostream>
 
+/// Increase when the generated waveforms change
+#define ORGAN_TABLES_VERSION 1
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 using namespace dsp;
 using namespace calf_plugins;
@@ -238,6 +246,38 @@ static void padsynth(bandlimiter<ORGAN_WAVE_BITS> blSrc, bandlimiter<ORGAN_BIG_W
     #endif
 }
 
+/// Try to get all the waveform families from the cache
+static bool load_cached_waves(wavetable_cache &cache, organ_voice_base::small_wave_family *waves, organ_voice_base::big_wave_family *big_waves)
+{
+    if (!cache.load())
+        return false;
+    bool ok = true;
+    for (int i = 0; ok && i < organ_voice_base::wave_count_small; i++)
+        ok = cache.read(waves[i]);
+    for (int i = 0; ok && i < organ_voice_base::wave_count_big; i++)
+        ok = cache.read(big_waves[i]);
+    if (!ok)
+    {
+        // stale or damaged file, it will be regenerated
+        for (int i = 0; i < organ_voice_base::wave_count_small; i++)
+            waves[i].release();
+        for (int i = 0; i < organ_voice_base::wave_count_big; i++)
+            big_waves[i].release();
+    }
+    return ok;
+}
+
+static void save_cached_waves(wavetable_cache &cache, organ_voice_base::small_wave_family *waves, organ_voice_base::big_wave_family *big_waves)
+{
+    if (!cache.create())
+        return;
+    for (int i = 0; i < organ_voice_base::wave_count_small; i++)
+        cache.write(waves[i]);
+    for (int i = 0; i < organ_voice_base::wave_count_big; i++)
+        cache.write(big_waves[i]);
+    cache.commit();
+}
+
 #define LARGE_WAVEFORM_PROGRESS() do { if (reporter) { progress += 100; reporter->report_progress(floor(progress / totalwaves), "Precalculating large waveforms"); } } while(0)
 
 void organ_voice_base::update_pitch()
@@ -257,6 +297,16 @@ void organ_voice_base::precalculate_waves(progress_report_iface *reporter)
         organ_voice_base::waves = &waves;
         organ_voice_base::big_waves = &big_waves;
         
+        // generating the big waves takes a few seconds, so the results are kept in a file
+        static wavetable_cache cache("organ", WAVETABLE_CACHE_BUILD_ID, ORGAN_TABLES_VERSION);
+        if (load_cached_waves(cache, waves, big_waves))
+        {
+            inited = true;
+            if (reporter)
+                reporter->report_progress(100, "");
+            return;
+        }
+        
         float progress = 0.0;
         int totalwaves = 1 + wave_count_big;
         if (reporter)
@@ -498,6 +548,7 @@ void organ_voice_base::precalculate_waves(progress_report_iface *reporter)
         padsynth(bl, blBig, big_waves[wave_choir3 - wave_count_small], 50, 10);
         LARGE_WAVEFORM_PROGRESS();
         
+        save_cached_waves(cache, waves, big_waves);
         inited = true;
     }
 }
@@ -695,6 +746,63 @@ void scanner_vibrato::process(organ_parameters *parameters, float (*data)[2], un
 }
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void organ_voice_bank::render()
+{
+    // padding lanes read the start of a silent wave and are never written anywhere
+    static const float silence[2] = { 0.f, 0.f };
+    for (int i = lanes; i & 3; i++)
+    {
+        phase[i] = dphase[i] = 0;
+        data[i] = silence;
+    }
+    for (int l = 0; l < lanes; l += 4)
+    {
+        // interleaved output of 4 lanes
+        float wv[BlockSize][4];
+#if defined(__SSE2__)
+        __m128i ph = _mm_loadu_si128((const __m128i *)(phase + l));
+        __m128i dph = _mm_loadu_si128((const __m128i *)(dphase + l));
+        const __m128i fmask = _mm_set1_epi32((1 << 20) - 1);
+        const __m128 fscale = _mm_set1_ps(1.f / (1 << 20));
+        const float *d0 = data[l], *d1 = data[l + 1], *d2 = data[l + 2], *d3 = data[l + 3];
+        for (int i = 0; i < BlockSize; i++)
+        {
+            // there is no gather in SSE, so the table lookups are done one lane at a time
+            uint32_t idx[4];
+            _mm_storeu_si128((__m128i *)idx, _mm_srli_epi32(ph, 20));
+            __m128 y0 = _mm_setr_ps(d0[idx[0]], d1[idx[1]], d2[idx[2]], d3[idx[3]]);
+            __m128 y1 = _mm_setr_ps(d0[idx[0] + 1], d1[idx[1] + 1], d2[idx[2] + 1], d3[idx[3] + 1]);
+            __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(ph, fmask)), fscale);
+            _mm_storeu_ps(wv[i], _mm_add_ps(y0, _mm_mul_ps(_mm_sub_ps(y1, y0), frac)));
+            ph = _mm_add_epi32(ph, dph);
+        }
+#else
+        for (int j = 0; j < 4; j++)
+        {
+            uint32_t ph = phase[l + j], dph = dphase[l + j];
+            const float *d = data[l + j];
+            for (int i = 0; i < BlockSize; i++, ph += dph)
+            {
+                uint32_t idx = ph >> 20;
+                wv[i][j] = d[idx] + (d[idx + 1] - d[idx]) * ((ph & ((1 << 20) - 1)) * (1.f / (1 << 20)));
+            }
+        }
+#endif
+        int count = std::min(4, lanes - l);
+        for (int j = 0; j < count; j++)
+        {
+            float (*dest)[2] = out[l + j];
+            float l_gain = ampl[l + j], r_gain = ampr[l + j];
+            for (int i = 0; i < BlockSize; i++)
+            {
+                dest[i][0] += wv[i][j] * l_gain;
+                dest[i][1] += wv[i][j] * r_gain;
+            }
+        }
+    }
+    lanes = 0;
+}
+
 void organ_voice::update_pitch()
 {
     organ_voice_base::update_pitch();
@@ -702,8 +810,17 @@ void organ_voice::update_pitch()
 }
 
 void organ_voice::render_block(int snapshot) {
+    organ_voice_bank bank;
+    if (prepare_block(bank))
+    {
+        bank.render();
+        finish_block();
+    }
+}
+
+bool organ_voice::prepare_block(organ_voice_bank &bank) {
     if (note == -1)
-        return;
+        return false;
 
     dsp::zero(&output_buffer[0][0], Channels * BlockSize);
     dsp::zero(&aux_buffers[1][0][0], 2 * Channels * BlockSize);
@@ -711,15 +828,13 @@ void organ_voice::render_block(int snapshot) {
     {
         if (use_percussion())
             render_percussion_to(output_buffer, BlockSize);
-        return;
+        return false;
     }
 
     inertia_pitchbend.set_inertia(parameters->pitch_bend);
     inertia_pitchbend.step();
     update_pitch();
-    dsp::fixed_point<int, 20> tphase, tdphase;
     unsigned int foldvalue = parameters->foldvalue * inertia_pitchbend.get_last();
-    int vibrato_mode = fastf2i_drm(parameters->lfo_mode);
     for (int h = 0; h < 9; h++)
     {
         float amp = parameters->drawbars[h];
@@ -764,21 +879,18 @@ void organ_voice::render_block(int snapshot) {
             data = (*waves)[waveid].get_level(rate);
             if (!data)
                 continue;
-            tphase.set((uint32_t)((phase * hm).get()) + parameters->phaseshift[h]);
-            tdphase.set((uint32_t)rate);
             float ampl = amp * 0.5f * (1 - parameters->pan[h]);
             float ampr = amp * 0.5f * (1 + parameters->pan[h]);
             float (*out)[Channels] = aux_buffers[dsp::fastf2i_drm(parameters->routing[h])];
-            
-            for (int i=0; i < (int)BlockSize; i++) {
-                float wv = wave(data, tphase);
-                out[i][0] += wv * ampl;
-                out[i][1] += wv * ampr;
-                tphase += tdphase;
-            }
+            // rendered later, together with the drawbars of other voices
+            bank.add((uint32_t)((phase * hm).get()) + parameters->phaseshift[h], rate, data, ampl, ampr, out);
         }
     }
-    
+    return true;
+}
+
+void organ_voice::finish_block() {
+    int vibrato_mode = fastf2i_drm(parameters->lfo_mode);
     bool is_quad = parameters->quad_env >= 0.5f;
     
     expression.set_inertia(parameters->cutoff);
@@ -1074,11 +1186,53 @@ void organ_audio_module::deactivate()
     
 }
 
+void drawbar_organ::render_voices(dsp::voice **first, dsp::voice **last, float (*output)[2], int nsamples, int partition)
+{
+    organ_voice_bank &bank = voice_bank[partition];
+    dsp::block_voice<organ_voice> **pending_voices = this->pending_voices[partition];
+    typedef block_voice<organ_voice> organ_block_voice;
+    enum { BlockSize = organ_block_voice::BlockSize };
+    for (int p = 0; p < nsamples; )
+    {
+        // all the voices that have used up their previous block render the
+        // next one now, so that their oscillators can be processed together
+        int pending = 0;
+        for (dsp::voice **i = first; i != last; i++)
+        {
+            organ_block_voice *v = static_cast<organ_block_voice *>(*i);
+            if (v->read_ptr == BlockSize)
+            {
+                if (v->prepare_block(bank))
+                    pending_voices[pending++] = v;
+                v->read_ptr = 0;
+            }
+        }
+        bank.render();
+        for (int j = 0; j < pending; j++)
+            pending_voices[j]->finish_block();
+        // mix until the end of the buffer or the first voice that runs out of data
+        int len = nsamples - p;
+        for (dsp::voice **i = first; i != last; i++)
+            len = std::min<int>(len, BlockSize - static_cast<organ_block_voice *>(*i)->read_ptr);
+        for (dsp::voice **i = first; i != last; i++)
+        {
+            organ_block_voice *v = static_cast<organ_block_voice *>(*i);
+            for (int k = 0; k < len; k++)
+            {
+                output[p + k][0] += v->output_buffer[v->read_ptr + k][0];
+                output[p + k][1] += v->output_buffer[v->read_ptr + k][1];
+            }
+            v->read_ptr += len;
+        }
+        p += len;
+    }
+}
+
 void drawbar_organ::render_separate(float *output[], int nsamples)
 {
     float buf[MAX_SAMPLE_RUN][2];
     dsp::zero(&buf[0][0], 2 * nsamples);
-    basic_synth::render_to(buf, nsamples);
+    render_to(buf, nsamples);
     if (dsp::fastf2i_drm(parameters->lfo_mode) == organ_voice_base::lfomode_global)
     {
         for (int i = 0; i < nsamples; i += 64)
@@ -0,0 +1,402 @@
+/* Calf DSP Library
+ * Block-based polyphase FIR oversampling
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#include <calf/oversampler.h>
+#include <calf/fft.h>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+using namespace dsp;
+using namespace std;
+
+/// Stopband attenuation of all the filters, in dB
+#define RESAMPLER_ATTENUATION 90.0
+/// Highest frequency that is passed unchanged, relative to the base sample rate
+#define RESAMPLER_PASSBAND 0.45
+/// Limit on the length of the polyphase components (2 * RESAMPLER_MAX_HALF + 1)
+#define RESAMPLER_MAX_HALF 31
+
+/// Modified Bessel function of the first kind, order 0 (for the Kaiser window)
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 100; k++)
+    {
+        double t = x / (2 * k);
+        term *= t * t;
+        sum += term;
+        if (term < sum * 1e-15)
+            break;
+    }
+    return sum;
+}
+
+/// Design a Kaiser-windowed sinc lowpass with the cutoff at the Nyquist
+/// frequency of the lower rate. Every factor-th tap from the center is zero.
+/// @param factor ratio of the stage
+/// @param ratio  lower sample rate of the stage relative to the base rate
+/// @param h      resulting kernel (odd length)
+/// @return index of the center tap
+static int design_lowpass(int factor, int ratio, vector<double> &h)
+{
+    // everything that would alias back into the passband needs to be rejected,
+    // the higher the stage's rate is, the wider the transition band can be
+    double width = 1.0 - 2 * RESAMPLER_PASSBAND / ratio;
+    double beta = 0.1102 * (RESAMPLER_ATTENUATION - 8.7);
+    int order = (int)ceil((RESAMPLER_ATTENUATION - 7.95) / (2.285 * 2 * M_PI * width / factor));
+    // put the center on a multiple of factor
+    int half = factor * min(RESAMPLER_MAX_HALF, (order + 2 * factor - 1) / (2 * factor));
+    h.resize(2 * half + 1);
+    double norm = 1.0 / bessel_i0(beta), sum = 0;
+    for (int i = -half; i <= half; i++)
+    {
+        double sinc;
+        if (!i)
+            sinc = 1;
+        else if (!(i % factor))
+            sinc = 0;
+        else
+            sinc = sin(M_PI * i / factor) / (M_PI * i / factor);
+        double x = (double)i / half;
+        h[i + half] = sinc * bessel_i0(beta * sqrt(max(0.0, 1 - x * x))) * norm;
+        sum += h[i + half];
+    }
+    for (size_t i = 0; i < h.size(); i++)
+        h[i] /= sum;
+    return half;
+}
+
+/// Convert a kernel into a minimum phase one with the same magnitude response
+/// (homomorphic method: fold the real cepstrum onto positive quefrencies)
+static void make_minimum_phase(vector<double> &h)
+{
+    typedef complex<double> cplx;
+    enum { ORDER = 12, SIZE = 1 << ORDER };
+    fft<double, ORDER> *transform = new fft<double, ORDER>;
+    vector<cplx> a(SIZE), b(SIZE);
+    for (size_t i = 0; i < h.size(); i++)
+        a[i] = h[i];
+    transform->calculate(&a[0], &b[0], false);
+    // the floor keeps the zeros of the stopband from producing infinities
+    for (int i = 0; i < SIZE; i++)
+        a[i] = log(max(abs(b[i]), 1e-9));
+    transform->calculate(&a[0], &b[0], true);
+    for (int i = 0; i < SIZE; i++)
+    {
+        if (!i || i == SIZE / 2)
+            a[i] = b[i].real();
+        else
+            a[i] = i < SIZE / 2 ? 2 * b[i].real() : 0;
+    }
+    transform->calculate(&a[0], &b[0], false);
+    for (int i = 0; i < SIZE; i++)
+        a[i] = exp(b[i]);
+    transform->calculate(&a[0], &b[0], true);
+    for (size_t i = 0; i < h.size(); i++)
+        h[i] = b[i].real();
+    delete transform;
+}
+
+const resampler_kernel *resampler_kernel::get(int factor, int ratio, bool minimum_phase)
+{
+    static resampler_kernel *volatile cache[oversampler::MAX_FACTOR + 1][oversampler::MAX_FACTOR + 1][2];
+    resampler_kernel *volatile &slot = cache[factor][ratio][minimum_phase ? 1 : 0];
+    if (slot)
+        return slot;
+
+    vector<double> h;
+    int center = design_lowpass(factor, ratio, h);
+    resampler_kernel *k = new resampler_kernel;
+    k->factor = factor;
+    k->taps = (((int)h.size() + factor - 1) / factor + 3) & ~3;
+    k->phases.resize(factor * k->taps);
+    k->delay_tap.resize(factor);
+    if (minimum_phase)
+    {
+        make_minimum_phase(h);
+        double sum = 0, moment = 0;
+        for (size_t i = 0; i < h.size(); i++)
+        {
+            sum += h[i];
+            moment += i * h[i];
+        }
+        k->delay = moment / sum;
+    }
+    else
+        k->delay = center;
+    for (int p = 0; p < factor; p++)
+    {
+        int nonzero = 0, last = -1;
+        for (int t = 0; t < k->taps; t++)
+        {
+            size_t i = p + t * factor;
+            double v = i < h.size() ? h[i] : 0;
+            k->phases[p * k->taps + t] = v;
+            if (v != 0)
+            {
+                nonzero++;
+                last = t;
+            }
+        }
+        k->delay_tap[p] = nonzero == 1 ? last : -1;
+    }
+    // another thread may have been designing the same kernel at the same time
+    if (!__sync_bool_compare_and_swap(&slot, (resampler_kernel *)NULL, k))
+        delete k;
+    return slot;
+}
+
+float dsp::dot_product(const float *a, const float *b, int len)
+{
+#if defined(__SSE__)
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    int i = 0;
+    // two accumulators, to hide some of the latency of the additions
+    for (; i + 8 <= len; i += 8)
+    {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    if (i < len)
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    float sums[4];
+    _mm_storeu_ps(sums, _mm_add_ps(s0, s1));
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#else
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < len; i += 4)
+    {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////
+
+void upsampler_stage::reserve(const resampler_kernel *k)
+{
+    hist.reserve(2 * k->taps);
+}
+
+void upsampler_stage::set_kernel(const resampler_kernel *k)
+{
+    kernel = k;
+    hist.resize(2 * k->taps);
+    reset();
+}
+
+void upsampler_stage::reset()
+{
+    std::fill(hist.begin(), hist.end(), 0.f);
+    pos = 0;
+}
+
+void upsampler_stage::process(const float *in, float *out, uint32_t len)
+{
+    int L = kernel->factor, K = kernel->taps;
+    const float *phases = &kernel->phases[0];
+    const int *delay_tap = &kernel->delay_tap[0];
+    float *h = &hist[0];
+    // the gain of L makes up for the energy of the zeros stuffed between the samples
+    float gain = L;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        pos = (pos ? pos : K) - 1;
+        h[pos] = h[pos + K] = in[i];
+        const float *window = h + pos;
+        for (int p = 0; p < L; p++)
+        {
+            const float *coeffs = phases + p * K;
+            int t = delay_tap[p];
+            *out++ = gain * (t >= 0 ? coeffs[t] * window[t] : dot_product(coeffs, window, K));
+        }
+    }
+}
+
+void downsampler_stage::reserve(const resampler_kernel *k)
+{
+    hist.reserve(2 * k->taps * k->factor);
+}
+
+void downsampler_stage::set_kernel(const resampler_kernel *k)
+{
+    kernel = k;
+    hist.resize(2 * k->taps * k->factor);
+    reset();
+}
+
+void downsampler_stage::reset()
+{
+    std::fill(hist.begin(), hist.end(), 0.f);
+    pos = 0;
+}
+
+void downsampler_stage::process(const float *in, float *out, uint32_t len)
+{
+    int L = kernel->factor, K = kernel->taps;
+    const float *phases = &kernel->phases[0];
+    const int *delay_tap = &kernel->delay_tap[0];
+    float *h = &hist[0];
+    // output n is the sum over p of component p applied to inputs L * n - p;
+    // component 0 gets its input at the start of each group of L inputs, the
+    // other ones got theirs from the previous group, so their windows are
+    // one position older
+    for (uint32_t i = 0; i < len; i++, in += L)
+    {
+        pos = (pos ? pos : K) - 1;
+        h[pos] = h[pos + K] = in[0];
+        float sum = 0.f;
+        for (int p = 0; p < L; p++)
+        {
+            const float *coeffs = phases + p * K;
+            const float *window = h + 2 * K * p + pos + (p ? 1 : 0);
+            int t = delay_tap[p];
+            sum += t >= 0 ? coeffs[t] * window[t] : dot_product(coeffs, window, K);
+        }
+        out[i] = sum;
+        for (int j = 1; j < L; j++)
+        {
+            float *hp = h + 2 * K * (L - j);
+            hp[pos] = hp[pos + K] = in[j];
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////
+
+oversampler::oversampler()
+{
+    factor = 1;
+    stages = 0;
+    minimum_phase = false;
+    latency = 0;
+}
+
+int oversampler::split_factor(int factor, int *stage_factor)
+{
+    int odd = factor;
+    while(!(odd & 1))
+        odd >>= 1;
+    int stages = 0;
+    // the odd part goes first, so that only one stage needs a long kernel
+    for (int ratio = 1; ratio < factor; ratio *= stage_factor[stages++])
+        stage_factor[stages] = (ratio == 1 && odd > 1) ? odd : 2;
+    return stages;
+}
+
+void oversampler::prepare(int max_factor, bool _minimum_phase)
+{
+    max_factor = std::max(1, std::min((int)MAX_FACTOR, max_factor));
+    for (int f = 2; f <= max_factor; f++)
+    {
+        int sf[MAX_STAGES];
+        int n = split_factor(f, sf);
+        for (int s = 0, ratio = 1; s < n; ratio *= sf[s++])
+        {
+            const resampler_kernel *k = resampler_kernel::get(sf[s], ratio, _minimum_phase);
+            up[s].reserve(k);
+            down[s].reserve(k);
+        }
+    }
+    for (int i = 0; i < 2; i++)
+        scratch[i].reserve(max_factor / 2 * MAX_BLOCK);
+}
+
+void oversampler::set_params(int _factor, bool _minimum_phase)
+{
+    _factor = std::max(1, std::min((int)MAX_FACTOR, _factor));
+    if (_factor == factor && _minimum_phase == minimum_phase)
+        return;
+    factor = _factor;
+    minimum_phase = _minimum_phase;
+    stages = split_factor(factor, stage_factor);
+    latency = 0;
+    for (int s = 0, ratio = 1; s < stages; s++)
+    {
+        const resampler_kernel *k = resampler_kernel::get(stage_factor[s], ratio, minimum_phase);
+        up[s].set_kernel(k);
+        down[s].set_kernel(k);
+        ratio *= stage_factor[s];
+        // delay of both directions, converted from the higher rate of the stage to the base rate
+        latency += 2 * k->delay / ratio;
+    }
+    for (int i = 0; i < 2; i++)
+        scratch[i].resize(stages > 1 ? factor / 2 * MAX_BLOCK : 0);
+}
+
+void oversampler::reset()
+{
+    for (int s = 0; s < stages; s++)
+    {
+        up[s].reset();
+        down[s].reset();
+    }
+}
+
+void oversampler::upsample(const float *in, float *out, uint32_t len)
+{
+    if (!stages)
+    {
+        memmove(out, in, len * sizeof(float));
+        return;
+    }
+    for (uint32_t offset = 0; offset < len; offset += MAX_BLOCK)
+    {
+        uint32_t count = std::min<uint32_t>(MAX_BLOCK, len - offset);
+        const float *src = in + offset;
+        for (int s = 0; s < stages; s++)
+        {
+            float *dst = s == stages - 1 ? out + offset * factor : &scratch[s & 1][0];
+            up[s].process(src, dst, count);
+            count *= stage_factor[s];
+            src = dst;
+        }
+    }
+}
+
+void oversampler::downsample(const float *in, float *out, uint32_t len)
+{
+    if (!stages)
+    {
+        memmove(out, in, len * sizeof(float));
+        return;
+    }
+    for (uint32_t offset = 0; offset < len; offset += MAX_BLOCK)
+    {
+        uint32_t count = std::min<uint32_t>(MAX_BLOCK, len - offset) * factor;
+        const float *src = in + offset * factor;
+        for (int s = stages - 1; s >= 0; s--)
+        {
+            count /= stage_factor[s];
+            float *dst = s ? &scratch[s & 1][0] : out + offset;
+            down[s].process(src, dst, count);
+            src = dst;
+        }
+    }
+}
@@ -54,7 +54,7 @@ const LV2_Descriptor *lv2_descriptor(uint32_t index)
 
 #endif
 
-#if USE_JACK
+#if USE_JACK || USE_SNDFILE
 
 extern "C" {
 
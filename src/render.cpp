@@ -0,0 +1,495 @@
+/* Calf DSP Library
+ * Offline renderer - streams audio files through a chain of Calf plugins.
+ * Copyright (C) 2007-2014 Krzysztof Foltman, Markus Schmidt and others.
+ * See AUTHORS file for a complete list.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#include <config.h>
+#include <calf/giface.h>
+#include <calf/preset.h>
+#include <calf/utils.h>
+#include <calf/workers.h>
+#include <getopt.h>
+#include <sndfile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+using namespace std;
+using namespace calf_utils;
+using namespace calf_plugins;
+
+extern "C" audio_module_iface *create_calf_plugin_by_name(const char *effect_name);
+
+/// A plugin instance in the offline chain. Owns the parameter values, which
+/// are only changed before rendering starts (by presets or session files).
+class render_plugin: public plugin_ctl_iface
+{
+public:
+    audio_module_iface *module;
+    const plugin_metadata_iface *metadata;
+    string name;
+    float **ins, **outs, **params;
+    int in_count, out_count;
+    vector<float> param_values;
+    /// Buffers for outputs that aren't passed to the next plugin (beyond the first two)
+    vector<float> extra_outs;
+    uint32_t block_size;
+
+    render_plugin(audio_module_iface *_module, const string &_name, uint32_t sample_rate)
+    : module(_module)
+    , name(_name)
+    , block_size(0)
+    {
+        module->get_port_arrays(ins, outs, params);
+        metadata = module->get_metadata_iface();
+        in_count = metadata->get_input_count();
+        out_count = metadata->get_output_count();
+        int param_count = metadata->get_param_count();
+        param_values.resize(param_count);
+        for (int i = 0; i < param_count; i++)
+            params[i] = &param_values[i];
+        clear_preset();
+        module->post_instantiate(sample_rate);
+    }
+    ~render_plugin()
+    {
+        delete module;
+    }
+    void init(uint32_t sample_rate, uint32_t _block_size)
+    {
+        block_size = _block_size;
+        extra_outs.resize(max(0, out_count - 2) * block_size);
+        module->set_sample_rate(sample_rate);
+        module->activate();
+        module->params_changed_if_needed(true);
+    }
+    /// Process one block from in (two channels) to out (two channels)
+    /// @param zeros  block_size zero samples, for sidechain inputs
+    void process(float *const *in, float *const *out, uint32_t frames, float *zeros)
+    {
+        for (int i = 0; i < in_count; i++)
+            ins[i] = i < 2 ? in[i] : zeros;
+        for (int i = 0; i < out_count; i++)
+            outs[i] = i < 2 ? out[i] : &extra_outs[(i - 2) * block_size];
+        module->params_changed_if_needed(false);
+        uint32_t mask = module->process_slice(0, frames);
+        for (int i = 0; i < min(out_count, 2); i++)
+        {
+            if (!(mask & (1 << i)))
+                dsp::zero(out[i], frames);
+        }
+        // mono plugins feed the same signal to both channels of the next one
+        if (out_count == 1)
+            memcpy(out[1], out[0], frames * sizeof(float));
+    }
+
+    virtual float get_param_value(int param_no) { return param_values[param_no]; }
+    virtual void set_param_value(int param_no, float value) { param_values[param_no] = value; }
+    virtual bool activate_preset(int bank, int program) { return false; }
+    virtual float get_level(unsigned int port) { return 0.f; }
+    virtual void execute(int cmd_no) { module->execute(cmd_no); }
+    virtual char *configure(const char *key, const char *value)
+    {
+        // automation (MIDI controller) assignments make no sense offline
+        uint32_t controller;
+        automation_range *ar = automation_range::new_from_configure(metadata, key, value, controller);
+        if (ar)
+        {
+            delete ar;
+            return NULL;
+        }
+        return module->configure(key, value);
+    }
+    virtual void send_configures(send_configure_iface *sci) { module->send_configures(sci); }
+    virtual int send_status_updates(send_updates_iface *sui, int last_serial) { return module->send_status_updates(sui, last_serial); }
+    virtual const plugin_metadata_iface *get_metadata_iface() const { return metadata; }
+    virtual const line_graph_iface *get_line_graph_iface() const { return module->get_line_graph_iface(); }
+    virtual const phase_graph_iface *get_phase_graph_iface() const { return module->get_phase_graph_iface(); }
+};
+
+/// Plugin type and state, as given on the command line or in a session file
+struct plugin_spec
+{
+    string type;
+    /// Named preset (command line only)
+    string preset_name;
+    /// Preset from a session file (NULL if none)
+    plugin_preset *preset;
+    /// Configure variables from a session file
+    vector<pair<string, string> > configure_vars;
+
+    plugin_spec() : preset(NULL) {}
+};
+
+static bool activate_named_preset(render_plugin *plugin, const string &preset, bool builtin)
+{
+    preset_vector &pvec = (builtin ? get_builtin_presets() : get_user_presets()).presets;
+    for (unsigned int i = 0; i < pvec.size(); i++) {
+        if (pvec[i].name == preset && pvec[i].plugin == plugin->metadata->get_id())
+        {
+            pvec[i].activate(plugin);
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Renders one file through a chain of plugins. The chain is processed as a
+/// pipeline: in every cycle, the file reader, each of the plugins and the file
+/// writer work on consecutive blocks, so they can run on different threads.
+/// Each stage writes into one of two sets of buffers (alternating between
+/// cycles) and reads what the previous stage has written in the previous cycle,
+/// so the stages don't need to wait for each other within a cycle.
+class chain_renderer: public task_graph_iface
+{
+    vector<render_plugin *> &plugins;
+    SNDFILE *in_file, *out_file;
+    int in_channels;
+    uint32_t block_size;
+    /// Number of stages producing audio (reader + plugins)
+    int stages;
+    /// Stage output buffers, [phase][stage][channel][block_size]
+    vector<float> buffers;
+    /// Number of frames in each stage's output buffer, [phase][stage]
+    vector<uint32_t> frames;
+    vector<float> zeros, read_buf, write_buf;
+    int phase;
+    sf_count_t to_read, to_produce, to_write;
+public:
+    bool failed;
+
+    chain_renderer(vector<render_plugin *> &_plugins, SNDFILE *_in_file, int _in_channels, SNDFILE *_out_file, uint32_t _block_size, sf_count_t in_frames, sf_count_t tail_frames)
+    : plugins(_plugins)
+    , in_file(_in_file)
+    , out_file(_out_file)
+    , in_channels(_in_channels)
+    , block_size(_block_size)
+    {
+        stages = plugins.size() + 1;
+        buffers.resize(2 * stages * 2 * block_size);
+        frames.resize(2 * stages);
+        zeros.resize(block_size);
+        read_buf.resize(block_size * in_channels);
+        write_buf.resize(block_size * 2);
+        phase = 0;
+        to_read = in_frames;
+        to_produce = to_write = in_frames + tail_frames;
+        failed = false;
+    }
+    float *buffer(int ph, int stage, int channel)
+    {
+        return &buffers[((ph * stages + stage) * 2 + channel) * block_size];
+    }
+    /// Run the pipeline until the whole file has been written
+    void run(worker_pool &pool)
+    {
+        task_graph graph(stages + 1);
+        graph.finalize();
+        while(to_write > 0 && !failed)
+        {
+            pool.run(&graph, this);
+            phase ^= 1;
+        }
+    }
+    virtual void run_task(int node, int worker)
+    {
+        if (!node)
+            read_block();
+        else if (node < stages)
+        {
+            uint32_t n = frames[(phase ^ 1) * stages + node - 1];
+            frames[phase * stages + node] = n;
+            if (!n)
+                return;
+            float *in[2] = { buffer(phase ^ 1, node - 1, 0), buffer(phase ^ 1, node - 1, 1) };
+            float *out[2] = { buffer(phase, node, 0), buffer(phase, node, 1) };
+            plugins[node - 1]->process(in, out, n, &zeros[0]);
+        }
+        else
+            write_block();
+    }
+    void read_block()
+    {
+        uint32_t n = (uint32_t)min<sf_count_t>(block_size, to_produce);
+        frames[phase * stages] = n;
+        if (!n)
+            return;
+        float *left = buffer(phase, 0, 0), *right = buffer(phase, 0, 1);
+        sf_count_t got = 0;
+        if (to_read > 0)
+        {
+            got = sf_readf_float(in_file, &read_buf[0], min<sf_count_t>(n, to_read));
+            // a truncated file is rendered as if it ended there
+            to_read = got > 0 ? to_read - got : 0;
+            got = max<sf_count_t>(got, 0);
+        }
+        for (sf_count_t i = 0; i < got; i++)
+        {
+            const float *src = &read_buf[i * in_channels];
+            left[i] = src[0];
+            right[i] = in_channels > 1 ? src[1] : src[0];
+        }
+        // after the end of input, render the tail (eg. of a reverb)
+        dsp::zero(left + got, n - got);
+        dsp::zero(right + got, n - got);
+        to_produce -= n;
+    }
+    void write_block()
+    {
+        uint32_t n = frames[(phase ^ 1) * stages + stages - 1];
+        if (!n)
+            return;
+        const float *left = buffer(phase ^ 1, stages - 1, 0), *right = buffer(phase ^ 1, stages - 1, 1);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            write_buf[2 * i] = left[i];
+            write_buf[2 * i + 1] = right[i];
+        }
+        if (sf_writef_float(out_file, &write_buf[0], n) != n)
+            failed = true;
+        to_write -= n;
+    }
+};
+
+static const char *short_options = "l:i:o:d:b:t:T:hv";
+
+static struct option long_options[] = {
+    {"help", 0, 0, 'h'},
+    {"version", 0, 0, 'v'},
+    {"load", 1, 0, 'l'},
+    {"input", 1, 0, 'i'},
+    {"output", 1, 0, 'o'},
+    {"output-dir", 1, 0, 'd'},
+    {"block", 1, 0, 'b'},
+    {"threads", 1, 0, 't'},
+    {"tail", 1, 0, 'T'},
+    {0,0,0,0},
+};
+
+static void print_help(char *argv[])
+{
+    printf("Offline renderer for Calf effects\n"
+        "Syntax: %s [--load <session>] --input <file> [--input <file> ...] [--output <file>|--output-dir <dir>]\n"
+        "       [--block <frames>] [--threads <count>] [--tail <seconds>] [--help] [--version] [pluginname[:<preset>] ...]\n"
+        "Plugins are connected in series, in the order given on the command line or in the session file.\n",
+        argv[0]);
+}
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 0.000001;
+}
+
+static bool render_file(const vector<plugin_spec> &specs, const string &input, const string &output, worker_pool &pool, uint32_t block_size, float tail)
+{
+    SF_INFO in_info;
+    memset(&in_info, 0, sizeof(in_info));
+    SNDFILE *in_file = sf_open(input.c_str(), SFM_READ, &in_info);
+    if (!in_file)
+    {
+        fprintf(stderr, "Cannot open %s: %s\n", input.c_str(), sf_strerror(NULL));
+        return false;
+    }
+    if (in_info.channels > 2)
+        fprintf(stderr, "Warning: %s has %d channels, only the first two are processed\n", input.c_str(), in_info.channels);
+
+    SF_INFO out_info = in_info;
+    out_info.channels = 2;
+    if (!sf_format_check(&out_info))
+        out_info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    SNDFILE *out_file = sf_open(output.c_str(), SFM_WRITE, &out_info);
+    if (!out_file)
+    {
+        fprintf(stderr, "Cannot create %s: %s\n", output.c_str(), sf_strerror(NULL));
+        sf_close(in_file);
+        return false;
+    }
+
+    // the sample rate may differ between files, so the chain is created for every file
+    vector<render_plugin *> plugins;
+    bool ok = true;
+    for (size_t i = 0; i < specs.size() && ok; i++)
+    {
+        const plugin_spec &spec = specs[i];
+        audio_module_iface *module = create_calf_plugin_by_name(spec.type.c_str());
+        if (!module)
+        {
+            fprintf(stderr, "Unknown plugin: %s\n", spec.type.c_str());
+            ok = false;
+            break;
+        }
+        render_plugin *plugin = new render_plugin(module, spec.type, in_info.samplerate);
+        plugins.push_back(plugin);
+        if (!plugin->in_count)
+        {
+            fprintf(stderr, "Plugin %s has no audio inputs\n", spec.type.c_str());
+            ok = false;
+        }
+        if (spec.preset)
+            spec.preset->activate(plugin);
+        for (size_t j = 0; j < spec.configure_vars.size(); j++)
+            plugin->configure(spec.configure_vars[j].first.c_str(), spec.configure_vars[j].second.c_str());
+        if (!spec.preset_name.empty() && !activate_named_preset(plugin, spec.preset_name, false) && !activate_named_preset(plugin, spec.preset_name, true))
+            fprintf(stderr, "Unknown preset: %s\n", spec.preset_name.c_str());
+        plugin->init(in_info.samplerate, block_size);
+    }
+
+    if (ok)
+    {
+        double start = get_time();
+        chain_renderer renderer(plugins, in_file, in_info.channels, out_file, block_size, in_info.frames, (sf_count_t)(tail * in_info.samplerate));
+        renderer.run(pool);
+        double elapsed = get_time() - start;
+        if (renderer.failed)
+        {
+            fprintf(stderr, "Error writing %s: %s\n", output.c_str(), sf_strerror(out_file));
+            ok = false;
+        }
+        else
+            printf("%s -> %s: %.1fx real time\n", input.c_str(), output.c_str(), (in_info.frames / (double)in_info.samplerate + tail) / max(elapsed, 0.000001));
+    }
+
+    for (size_t i = 0; i < plugins.size(); i++)
+    {
+        plugins[i]->module->deactivate();
+        delete plugins[i];
+    }
+    sf_close(in_file);
+    if (sf_close(out_file))
+        ok = false;
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    string load_name, output_name, output_dir;
+    vector<string> inputs;
+    uint32_t block_size = 4096;
+    int threads = 1;
+    float tail = 0;
+    while(1) {
+        int option_index;
+        int c = getopt_long(argc, argv, short_options, long_options, &option_index);
+        if (c == -1)
+            break;
+        switch(c) {
+            case 'h':
+            case '?':
+                print_help(argv);
+                return 0;
+            case 'v':
+                printf("%s\n", PACKAGE_STRING);
+                return 0;
+            case 'l':
+                load_name = optarg;
+                break;
+            case 'i':
+                inputs.push_back(optarg);
+                break;
+            case 'o':
+                output_name = optarg;
+                break;
+            case 'd':
+                output_dir = optarg;
+                break;
+            case 'b':
+                block_size = max(1, atoi(optarg));
+                break;
+            case 't':
+                threads = max(1, atoi(optarg));
+                break;
+            case 'T':
+                tail = max(0.f, (float)atof(optarg));
+                break;
+        }
+    }
+    if (inputs.empty() || (output_name.empty() == output_dir.empty()) || (!output_name.empty() && inputs.size() > 1))
+    {
+        fprintf(stderr, "Specify input file(s) and either an output file (for a single input) or an output directory\n");
+        print_help(argv);
+        return 1;
+    }
+
+    try {
+        get_builtin_presets().load_defaults(true);
+        get_user_presets().load_defaults(false);
+    }
+    catch(calf_plugins::preset_exception &e)
+    {
+        fprintf(stderr, "Error while loading presets: %s\n", e.what());
+        return 1;
+    }
+
+    vector<plugin_spec> specs;
+    preset_list session;
+    if (!load_name.empty())
+    {
+        try {
+            session.load(load_name.c_str(), true);
+        }
+        catch(calf_plugins::preset_exception &e)
+        {
+            fprintf(stderr, "Error while loading session %s: %s\n", load_name.c_str(), e.what());
+            return 1;
+        }
+        for (size_t i = 0; i < session.plugins.size(); i++)
+        {
+            preset_list::plugin_snapshot &ps = session.plugins[i];
+            plugin_spec spec;
+            spec.type = ps.type;
+            if (ps.preset_offset < (int)session.presets.size())
+                spec.preset = &session.presets[ps.preset_offset];
+            spec.configure_vars = ps.automation_entries;
+            specs.push_back(spec);
+        }
+    }
+    for (; optind < argc; optind++)
+    {
+        plugin_spec spec;
+        spec.type = argv[optind];
+        size_t pos = spec.type.find(":");
+        if (pos != string::npos) {
+            spec.preset_name = spec.type.substr(pos + 1);
+            spec.type = spec.type.substr(0, pos);
+        }
+        specs.push_back(spec);
+    }
+    if (specs.empty())
+    {
+        fprintf(stderr, "No plugins to render with\n");
+        return 1;
+    }
+
+    worker_pool pool(threads);
+    int failures = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        string output = output_name;
+        if (output.empty())
+        {
+            size_t slash = inputs[i].rfind('/');
+            output = output_dir + "/" + (slash == string::npos ? inputs[i] : inputs[i].substr(slash + 1));
+        }
+        if (!render_file(specs, inputs[i], output, pool, block_size, tail))
+            failures++;
+    }
+    return failures ? 1 : 0;
+}
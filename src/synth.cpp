@@ -18,11 +18,23 @@
  * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, 
  * Boston, MA  02110-1301  USA
  */
+#include <stdlib.h>
+#include <calf/primitives.h>
 #include <calf/synth.h>
 
 using namespace dsp;
 using namespace std;
 
+basic_synth::basic_synth()
+{
+    render_pool = NULL;
+    render_graph = NULL;
+    renderer.synth = this;
+    render_partitions = 1;
+    render_output = NULL;
+    render_nsamples = 0;
+}
+
 void basic_synth::init_voices(int count)
 {
     allocated_voices.init(count);
@@ -34,6 +46,28 @@ void basic_synth::init_voices(int count)
         allocated_voices.add(v);
         unused_voices.add(v);
     }
+    const char *threads = getenv("CALF_VOICE_THREADS");
+    if (threads && atoi(threads) > 1)
+    {
+        const char *priority = getenv("CALF_VOICE_THREADS_RTPRIO");
+        set_render_threads(atoi(threads), priority ? atoi(priority) : 0);
+    }
+}
+
+void basic_synth::set_render_threads(int threads, int rt_priority)
+{
+    delete render_pool;
+    delete render_graph;
+    render_pool = NULL;
+    render_graph = NULL;
+    render_partitions = std::max(1, std::min<int>(threads, MaxRenderPartitions));
+    render_buffers.resize(render_partitions * RenderBlock * 2);
+    if (render_partitions > 1)
+    {
+        render_pool = new calf_utils::worker_pool(render_partitions, rt_priority);
+        render_graph = new calf_utils::task_graph(render_partitions);
+        render_graph->finalize();
+    }
 }
 
 void basic_synth::kill_note(int note, int vel, bool just_one)
@@ -200,12 +234,53 @@ void basic_synth::control_change(int ctl, int val)
     }
 }
 
+void basic_synth::render_voices(dsp::voice **first, dsp::voice **last, float (*output)[2], int nsamples, int partition)
+{
+    for (dsp::voice **i = first; i != last; i++)
+        (*i)->render_to(output, nsamples);
+}
+
+void basic_synth::render_partition(int index)
+{
+    // contiguous ranges, so that a given set of voices is always split the same way
+    int count = active_voices.size();
+    dsp::voice **first = active_voices.begin() + count * index / render_partitions;
+    dsp::voice **last = active_voices.begin() + count * (index + 1) / render_partitions;
+    if (!index)
+    {
+        render_voices(first, last, render_output, render_nsamples, 0);
+        return;
+    }
+    float (*buf)[2] = (float (*)[2])&render_buffers[index * RenderBlock * 2];
+    dsp::zero(&buf[0][0], 2 * render_nsamples);
+    render_voices(first, last, buf, render_nsamples, index);
+}
+
 void basic_synth::render_to(float (*output)[2], int nsamples)
 {
-    // render voices, eliminate ones that aren't sounding anymore
+    // render voices
+    if (!render_pool || active_voices.size() < 2)
+        render_voices(active_voices.begin(), active_voices.end(), output, nsamples, 0);
+    else
+    {
+        for (int pos = 0; pos < nsamples; pos += RenderBlock)
+        {
+            render_output = output + pos;
+            render_nsamples = std::min<int>(RenderBlock, nsamples - pos);
+            render_pool->run(render_graph, &renderer);
+            // add the other partitions to the first one, always in the same order
+            for (int p = 1; p < render_partitions; p++)
+            {
+                const float *buf = &render_buffers[p * RenderBlock * 2];
+                float *out = &render_output[0][0];
+                for (int i = 0; i < 2 * render_nsamples; i++)
+                    out[i] += buf[i];
+            }
+        }
+    }
+    // eliminate ones that aren't sounding anymore
     for (dsp::voice **i = active_voices.begin(); i != active_voices.end(); ) {
         dsp::voice *v = *i;
-        v->render_to(output, nsamples);
         if (!v->get_active()) {
             i = active_voices.erase(i);
             unused_voices.add(v);
@@ -217,6 +292,8 @@ void basic_synth::render_to(float (*output)[2], int nsamples)
 
 basic_synth::~basic_synth()
 {
+    delete render_pool;
+    delete render_graph;
     for (voice_array::iterator i = allocated_voices.begin(); i != allocated_voices.end(); i++)
         delete *i;
 }
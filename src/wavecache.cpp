@@ -0,0 +1,223 @@
+/* Calf DSP Library
+ * On-disk cache of precalculated waveform families
+ *
+ * Copyright (C) 2001-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#include <calf/wavecache.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace dsp;
+using namespace std;
+
+/// Increase when the file layout changes
+#define WAVETABLE_CACHE_FORMAT 1
+
+struct cache_header
+{
+    char magic[8];
+    uint32_t format;
+    uint32_t hash;
+    /// Size of the whole file, for detecting truncated files
+    uint64_t size;
+};
+
+static uint32_t fnv_hash(uint32_t hash, const char *str)
+{
+    // include the terminating zero, so that the boundaries between strings matter
+    do {
+        hash ^= (uint8_t)*str;
+        hash *= 16777619;
+    } while(*str++);
+    return hash;
+}
+
+static bool make_dir(const string &path)
+{
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+wavetable_cache::wavetable_cache(const char *name, const char *key, int version, const char *content)
+{
+    data = NULL;
+    size = 0;
+    pos = 0;
+    out = NULL;
+    out_ok = false;
+
+    // the data is stored in the native format, so a file from a machine with
+    // different float size or endianness must not be used
+    char layout[64];
+    uint32_t endian = 0x01020304;
+    sprintf(layout, "float%d endian%02x version%d format%d", (int)sizeof(float), *(uint8_t *)&endian, version, WAVETABLE_CACHE_FORMAT);
+    uint32_t key_hash = fnv_hash(fnv_hash(2166136261U, name), key);
+    uint32_t name_hash = fnv_hash(key_hash, layout);
+    hash = content ? fnv_hash(name_hash, content) : name_hash;
+
+    char buf[64];
+    sprintf(buf, "-%08x-", key_hash);
+    prefix = name + string(buf);
+    sprintf(buf, "v%d.%d-", version, WAVETABLE_CACHE_FORMAT);
+    version_tag = buf;
+
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    string dir;
+    if (xdg && *xdg)
+        dir = xdg;
+    else if (home && *home)
+        dir = string(home) + "/.cache";
+    else
+        return;
+    char filename[32];
+    sprintf(filename, "%08x.cache", name_hash);
+    path = dir + "/calf/" + prefix + version_tag + filename;
+}
+
+wavetable_cache::~wavetable_cache()
+{
+    if (out)
+    {
+        fclose(out);
+        unlink(temp_path.c_str());
+    }
+    if (data)
+        munmap((void *)data, size);
+}
+
+bool wavetable_cache::load()
+{
+    if (path.empty() || getenv("CALF_NO_WAVETABLE_CACHE"))
+        return false;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(cache_header))
+    {
+        close(fd);
+        return false;
+    }
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+    const cache_header *hdr = (const cache_header *)ptr;
+    if (memcmp(hdr->magic, "CALFWAVE", 8) || hdr->format != WAVETABLE_CACHE_FORMAT || hdr->hash != hash || hdr->size != (uint64_t)st.st_size)
+    {
+        munmap(ptr, st.st_size);
+        return false;
+    }
+    if (data)
+        munmap((void *)data, size);
+    data = (const char *)ptr;
+    size = st.st_size;
+    pos = sizeof(cache_header);
+    return true;
+}
+
+const char *wavetable_cache::read_bytes(size_t bytes)
+{
+    if (!data || bytes > size - pos)
+        return NULL;
+    const char *ptr = data + pos;
+    pos += bytes;
+    return ptr;
+}
+
+bool wavetable_cache::create()
+{
+    if (path.empty() || getenv("CALF_NO_WAVETABLE_CACHE"))
+        return false;
+    string dir = path.substr(0, path.rfind('/'));
+    if (!make_dir(dir.substr(0, dir.rfind('/'))) || !make_dir(dir))
+        return false;
+    // several processes may be generating the same file at once, so each one
+    // writes its own temporary file and then renames it, which is atomic
+    char suffix[32];
+    sprintf(suffix, ".%d.tmp", (int)getpid());
+    temp_path = path + suffix;
+    out = fopen(temp_path.c_str(), "wb");
+    if (!out)
+        return false;
+    out_ok = true;
+    cache_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    write_bytes(&hdr, sizeof(hdr));
+    return out_ok;
+}
+
+void wavetable_cache::write_bytes(const void *src, size_t bytes)
+{
+    if (out && out_ok && fwrite(src, 1, bytes, out) != bytes)
+        out_ok = false;
+}
+
+bool wavetable_cache::commit()
+{
+    if (!out)
+        return false;
+    // fill in the header now that the size is known
+    cache_header hdr;
+    memcpy(hdr.magic, "CALFWAVE", 8);
+    hdr.format = WAVETABLE_CACHE_FORMAT;
+    hdr.hash = hash;
+    long file_size = ftell(out);
+    hdr.size = file_size;
+    if (file_size < 0 || fseek(out, 0, SEEK_SET) != 0)
+        out_ok = false;
+    write_bytes(&hdr, sizeof(hdr));
+    if (fclose(out) != 0)
+        out_ok = false;
+    out = NULL;
+    if (!out_ok || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    remove_stale_files();
+    return true;
+}
+
+void wavetable_cache::remove_stale_files()
+{
+    // older versions of the tables would otherwise accumulate forever; processes
+    // that have them mapped can still use them after they're deleted
+    string dir = path.substr(0, path.rfind('/'));
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while(struct dirent *de = readdir(d))
+    {
+        string fn = de->d_name;
+        // the same build and parameters, but a different table or file format version
+        if (fn.length() > prefix.length() + 6 && fn.compare(0, prefix.length(), prefix) == 0 &&
+            fn.compare(prefix.length(), 1, "v") == 0 &&
+            fn.compare(prefix.length(), version_tag.length(), version_tag) != 0 &&
+            fn.compare(fn.length() - 6, 6, ".cache") == 0)
+            unlink((dir + "/" + fn).c_str());
+    }
+    closedir(d);
+}
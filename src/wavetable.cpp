@@ -89,11 +89,17 @@ void wavetable_voice::steal()
 }
 
 void wavetable_voice::render_block(int current_snapshot)
+{
+    float modsrc[wavetable_metadata::modsrc_count];
+    calc_modsrc(modsrc, 1);
+    parent->calculate_modmatrix(moddest, wavetable_metadata::moddest_count, modsrc);
+    render_block_from_moddest(current_snapshot);
+}
+
+void wavetable_voice::calc_modsrc(float *modsrc, int stride)
 {
     typedef wavetable_metadata md;
     
-    const float step = 1.f / BlockSize;
-
     float s = 0.001;
     float scl[EnvCount];
     int espc = md::par_eg2attack - md::par_eg1attack;
@@ -112,9 +118,18 @@ void wavetable_voice::render_block(int current_snapshot)
     lfo1.last = lfo1.get();
     lfo2.last = lfo2.get();
 
-    float modsrc[wavetable_metadata::modsrc_count] = { 1.f, velocity, parent->inertia_pressure.get_last(), parent->modwheel_value, (float)envs[0].value * scl[0], (float)envs[1].value * scl[1], (float)envs[2].value * scl[2], 0.5f+0.5f*lfo1.last, 0.5f+0.5f*lfo2.last, dsp::clip<float>(note / 120.0, 0.f, 1.f)};
-    parent->calculate_modmatrix(moddest, md::moddest_count, modsrc);
-    calc_derived_dests(envs[0].value * scl[0] * scl[0]);
+    float values[wavetable_metadata::modsrc_count] = { 1.f, velocity, parent->inertia_pressure.get_last(), parent->modwheel_value, (float)envs[0].value * scl[0], (float)envs[1].value * scl[1], (float)envs[2].value * scl[2], 0.5f+0.5f*lfo1.last, 0.5f+0.5f*lfo2.last, dsp::clip<float>(note / 120.0, 0.f, 1.f)};
+    for (int i = 0; i < md::modsrc_count; i++)
+        modsrc[i * stride] = values[i];
+}
+
+void wavetable_voice::render_block_from_moddest(int current_snapshot)
+{
+    typedef wavetable_metadata md;
+    
+    const float step = 1.f / BlockSize;
+    float scl0 = dsp::lerp(1.f, velocity, *params[md::par_eg1velscl]);
+    calc_derived_dests(envs[0].value * scl0 * scl0);
 
     int ospc = md::par_o2level - md::par_o1level;
     float pb = moddest[md::moddest_pitch] + parent->control_snapshots[current_snapshot].pitchbend;
@@ -149,6 +164,61 @@ void wavetable_voice::render_block(int current_snapshot)
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void wavetable_audio_module::render_voices(dsp::voice **first, dsp::voice **last, float (*output)[2], int nsamples, int partition)
+{
+    typedef dsp::block_voice<wavetable_voice> wt_block_voice;
+    typedef wavetable_metadata md;
+    enum { BlockSize = wavetable_voice::BlockSize };
+    float *voice_modsrc = this->voice_modsrc[partition], *voice_moddest = this->voice_moddest[partition];
+    int *pending_index = this->pending_index[partition];
+    // number of blocks rendered by each of the voices in the range within this call (index of the control snapshot to use)
+    int blocks[MaxVoices];
+    for (int i = 0; i < MaxVoices; i++)
+        blocks[i] = 0;
+    for (int p = 0; p < nsamples; )
+    {
+        // all the voices that have used up their previous block start the
+        // next one now, so that the mod matrix can be evaluated for all of them at once
+        int pending = 0;
+        for (dsp::voice **i = first; i != last; i++)
+        {
+            wt_block_voice *v = static_cast<wt_block_voice *>(*i);
+            if (v->read_ptr == BlockSize)
+            {
+                pending_index[pending] = i - first;
+                v->calc_modsrc(voice_modsrc + pending, MaxVoices);
+                pending++;
+            }
+        }
+        if (pending)
+            calculate_modmatrix_voices(voice_moddest, md::moddest_count, voice_modsrc, pending, MaxVoices, render_program);
+        for (int j = 0; j < pending; j++)
+        {
+            int index = pending_index[j];
+            wt_block_voice *v = static_cast<wt_block_voice *>(first[index]);
+            for (int k = 0; k < md::moddest_count; k++)
+                v->moddest[k] = voice_moddest[k * MaxVoices + j];
+            v->render_block_from_moddest(blocks[index]++);
+            v->read_ptr = 0;
+        }
+        // mix until the end of the buffer or the first voice that runs out of data
+        int len = nsamples - p;
+        for (dsp::voice **i = first; i != last; i++)
+            len = std::min<int>(len, BlockSize - static_cast<wt_block_voice *>(*i)->read_ptr);
+        for (dsp::voice **i = first; i != last; i++)
+        {
+            wt_block_voice *v = static_cast<wt_block_voice *>(*i);
+            for (int k = 0; k < len; k++)
+            {
+                output[p + k][0] += v->output_buffer[v->read_ptr + k][0];
+                output[p + k][1] += v->output_buffer[v->read_ptr + k][1];
+            }
+            v->read_ptr += len;
+        }
+        p += len;
+    }
+}
+
 const int16_t *wavetable_voice::get_last_table(int osc) const
 {
     float os = dsp::clip<double>(last_oscshift[osc] * 1.27, 0, 127);
@@ -214,10 +284,11 @@ wavetable_audio_module::wavetable_audio_module()
 , inertia_pitchbend(64)
 , inertia_pressure(64)
 {
-    init_voices(36);
+    init_voices(MaxVoices);
     last_voice = (wavetable_voice *)allocated_voices.items[0];
 
     panic_flag = false;
+    render_program = 0;
     modwheel_value = 0.;
     for (int i = 0; i < 129; i += 8)
     {
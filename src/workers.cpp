@@ -0,0 +1,212 @@
+/* Calf DSP Library
+ * Real-time worker threads and dependency graph scheduling.
+ *
+ * Copyright (C) 2007-2014 Krzysztof Foltman, Markus Schmidt and others
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+#include <calf/workers.h>
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace calf_utils;
+
+task_graph::task_graph(int _count)
+: count(_count)
+, dep_count(_count, 0)
+, succ_start(_count + 1, 0)
+, pending(_count, 0)
+, ready(_count, -1)
+{
+    ready_tail = ready_head = 0;
+    remaining = 0;
+}
+
+void task_graph::add_edge(int before, int after)
+{
+    assert(before >= 0 && before < count);
+    assert(after >= 0 && after < count);
+    assert(before != after);
+    edges.push_back(std::make_pair(before, after));
+}
+
+void task_graph::finalize()
+{
+    std::fill(dep_count.begin(), dep_count.end(), 0);
+    std::fill(succ_start.begin(), succ_start.end(), 0);
+    for (unsigned int i = 0; i < edges.size(); i++)
+    {
+        succ_start[edges[i].first + 1]++;
+        dep_count[edges[i].second]++;
+    }
+    for (int i = 0; i < count; i++)
+        succ_start[i + 1] += succ_start[i];
+    successors.resize(edges.size());
+    std::vector<int> fill_pos(succ_start.begin(), succ_start.end() - 1);
+    for (unsigned int i = 0; i < edges.size(); i++)
+        successors[fill_pos[edges[i].first]++] = edges[i].second;
+    edges.clear();
+}
+
+void task_graph::start()
+{
+    for (int i = 0; i < count; i++)
+    {
+        pending[i] = dep_count[i];
+        ready[i] = -1;
+    }
+    ready_head = ready_tail = 0;
+    remaining = count;
+    for (int i = 0; i < count; i++)
+    {
+        if (!dep_count[i])
+            push(i);
+    }
+    __sync_synchronize();
+}
+
+void task_graph::work(task_graph_iface *exec, int worker)
+{
+    int spins = 0;
+    while(remaining > 0)
+    {
+        int node = pop();
+        if (node == -1)
+        {
+            spin_wait(spins);
+            continue;
+        }
+        spins = 0;
+        exec->run_task(node, worker);
+        for (int i = succ_start[node]; i < succ_start[node + 1]; i++)
+        {
+            int succ = successors[i];
+            if (!__sync_sub_and_fetch(&pending[succ], 1))
+                push(succ);
+        }
+        __sync_sub_and_fetch(&remaining, 1);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+worker_pool::worker_pool(int threads, int rt_priority)
+{
+    graph = NULL;
+    exec = NULL;
+    busy = 0;
+    quit = false;
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0 && threads > cpus)
+        threads = cpus;
+    for (int i = 1; i < threads; i++)
+    {
+        worker *w = new worker;
+        w->pool = this;
+        w->index = i;
+        sem_init(&w->wakeup, 0, 0);
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (rt_priority > 0)
+        {
+            struct sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = rt_priority;
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+            pthread_attr_setschedparam(&attr, &param);
+        }
+        int err = pthread_create(&w->thread, &attr, thread_func, w);
+        if (err && rt_priority > 0)
+        {
+            fprintf(stderr, "Warning: could not create a real-time worker thread, using normal priority\n");
+            pthread_attr_destroy(&attr);
+            pthread_attr_init(&attr);
+            err = pthread_create(&w->thread, &attr, thread_func, w);
+        }
+        pthread_attr_destroy(&attr);
+        if (err)
+        {
+            fprintf(stderr, "Warning: could not create a worker thread\n");
+            sem_destroy(&w->wakeup);
+            delete w;
+            break;
+        }
+        workers.push_back(w);
+    }
+}
+
+worker_pool::~worker_pool()
+{
+    quit = true;
+    __sync_synchronize();
+    for (unsigned int i = 0; i < workers.size(); i++)
+        sem_post(&workers[i]->wakeup);
+    for (unsigned int i = 0; i < workers.size(); i++)
+    {
+        pthread_join(workers[i]->thread, NULL);
+        sem_destroy(&workers[i]->wakeup);
+        delete workers[i];
+    }
+    workers.clear();
+}
+
+void *worker_pool::thread_func(void *arg)
+{
+    worker *w = (worker *)arg;
+    w->pool->worker_loop(w);
+    return NULL;
+}
+
+void worker_pool::worker_loop(worker *w)
+{
+    for(;;)
+    {
+        while(sem_wait(&w->wakeup) != 0)
+            ;
+        if (quit)
+            break;
+        graph->work(exec, w->index);
+        __sync_sub_and_fetch(&busy, 1);
+    }
+}
+
+void worker_pool::run(task_graph *_graph, task_graph_iface *_exec)
+{
+    // waking up more threads than there are nodes to run in parallel is a waste
+    int helpers = std::min<int>(workers.size(), _graph->count - 1);
+    _graph->start();
+    if (helpers <= 0)
+    {
+        _graph->work(_exec, 0);
+        return;
+    }
+    graph = _graph;
+    exec = _exec;
+    busy = helpers;
+    __sync_synchronize();
+    for (int i = 0; i < helpers; i++)
+        sem_post(&workers[i]->wakeup);
+    _graph->work(_exec, 0);
+    // the graph's state may only be reset after all the helpers are done with it
+    int spins = 0;
+    while(busy > 0)
+        spin_wait(spins);
+}